@@ -42,11 +42,19 @@ public:
    * The filter exhibits hysteresis if the thresholds are appropriately specified.
    */
   State update(uint32_t dataValue) {
+    return update(dataValue, timebase_.read_us());
+  }
+
+  /**
+   * Updates the filter with the latest value sampled at nowUs, returning the current state.
+   * Use this when updating many filters per loop, so the timebase is only read once.
+   */
+  State update(uint32_t dataValue, uint32_t nowUs) {
     if ((dataValue >= risingThreshold_ && filteredValue_ == false)
         || (dataValue <= fallingThreshold_ && filteredValue_ == true)) {
       bool digitalValue = dataValue >= risingThreshold_;
       if (digitalValue == lastValue_) {
-        if (LongTimer::timePast(timebase_.read_us(), filterUpdateTime_)) {  // past filter time
+        if (LongTimer::timePast(nowUs, filterUpdateTime_)) {  // past filter time
           filteredValue_ = digitalValue;
           if (digitalValue == true) {
             return State::kRising;
@@ -59,9 +67,9 @@ public:
       } else {  // first detection of changed data, set filter deadline
         lastValue_ = digitalValue;
         if (digitalValue == true) {  // rising edge
-          filterUpdateTime_ = timebase_.read_us() + filterRiseUs_;
+          filterUpdateTime_ = nowUs + filterRiseUs_;
         } else {
-          filterUpdateTime_ = timebase_.read_us() + filterFallUs_;
+          filterUpdateTime_ = nowUs + filterFallUs_;
         }
       }
     } else {
@@ -0,0 +1,87 @@
+#ifndef _ANALOG_THRESHOLD_FILTER_BANK_H_
+#define _ANALOG_THRESHOLD_FILTER_BANK_H_
+
+#include "mbed.h"
+#include "LongTimer.h"
+#include "AnalogThresholdFilter.h"
+
+/**
+ * A bank of NumChannels AnalogThresholdFilters with compile-time thresholds and filter delays,
+ * updated together from one timestamp per loop. Per-channel state is stored as parallel arrays,
+ * so a full update is a tight loop with no timebase reads.
+ */
+template <size_t NumChannels, uint32_t RisingThreshold, uint32_t FallingThreshold,
+    uint32_t FilterRiseUs, uint32_t FilterFallUs = FilterRiseUs>
+class AnalogThresholdFilterBank {
+public:
+  typedef AnalogThresholdFilter::State State;
+
+  AnalogThresholdFilterBank(bool initialValue) {
+    for (size_t i=0; i<NumChannels; i++) {
+      filterUpdateTime_[i] = 0;
+      lastValue_[i] = initialValue;
+      filteredValue_[i] = initialValue;
+    }
+  }
+
+  /**
+   * Read the filtered value of a channel without updating internal state.
+   */
+  bool read(size_t channel) const {
+    return filteredValue_[channel];
+  }
+
+  /**
+   * Updates a single channel with its latest value sampled at nowUs, returning the current state.
+   */
+  State update(size_t channel, uint32_t dataValue, uint32_t nowUs) {
+    if ((dataValue >= RisingThreshold && filteredValue_[channel] == false)
+        || (dataValue <= FallingThreshold && filteredValue_[channel] == true)) {
+      bool digitalValue = dataValue >= RisingThreshold;
+      if (digitalValue == lastValue_[channel]) {
+        if (LongTimer::timePast(nowUs, filterUpdateTime_[channel])) {  // past filter time
+          filteredValue_[channel] = digitalValue;
+          if (digitalValue == true) {
+            return State::kRising;
+          } else {
+            return State::kFalling;
+          }
+        } else {
+          // no update needed
+        }
+      } else {  // first detection of changed data, set filter deadline
+        lastValue_[channel] = digitalValue;
+        if (digitalValue == true) {  // rising edge
+          filterUpdateTime_[channel] = nowUs + FilterRiseUs;
+        } else {
+          filterUpdateTime_[channel] = nowUs + FilterFallUs;
+        }
+      }
+    } else {
+      // do nothing, current value will not trigger a rising or falling edge
+      lastValue_[channel] = filteredValue_[channel];  // reset any filtered-out data glitching
+    }
+    if (filteredValue_[channel]) {
+      return State::kHigh;
+    } else {
+      return State::kLow;
+    }
+  }
+
+  /**
+   * Updates all channels with their latest values, all sampled at nowUs.
+   * The state (including detected edges) of each channel is written to statesOut.
+   */
+  void update(const uint32_t (&dataValues)[NumChannels], uint32_t nowUs, State (&statesOut)[NumChannels]) {
+    for (size_t i=0; i<NumChannels; i++) {
+      statesOut[i] = update(i, dataValues[i], nowUs);
+    }
+  }
+
+protected:
+  uint32_t filterUpdateTime_[NumChannels];  // time at which filteredValue becomes lastValue (if different)
+  bool lastValue_[NumChannels];  // last observed value
+  bool filteredValue_[NumChannels];  // current filter output
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "AsyncEInkRefresh.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+const uint8_t AsyncEInkRefresh::kFont[][AsyncEInkRefresh::kFontWidth] = {
+  {0x00, 0x00, 0x00, 0x00, 0x00},  // ' '
+  {0x00, 0x00, 0x5f, 0x00, 0x00},  // '!'
+  {0x00, 0x07, 0x00, 0x07, 0x00},  // '"'
+  {0x14, 0x7f, 0x14, 0x7f, 0x14},  // '#'
+  {0x24, 0x2a, 0x7f, 0x2a, 0x12},  // '$'
+  {0x23, 0x13, 0x08, 0x64, 0x62},  // '%'
+  {0x36, 0x49, 0x56, 0x20, 0x50},  // '&'
+  {0x00, 0x05, 0x03, 0x00, 0x00},  // '\''
+  {0x00, 0x1c, 0x22, 0x41, 0x00},  // '('
+  {0x00, 0x41, 0x22, 0x1c, 0x00},  // ')'
+  {0x14, 0x08, 0x3e, 0x08, 0x14},  // '*'
+  {0x08, 0x08, 0x3e, 0x08, 0x08},  // '+'
+  {0x00, 0x50, 0x30, 0x00, 0x00},  // ','
+  {0x08, 0x08, 0x08, 0x08, 0x08},  // '-'
+  {0x00, 0x60, 0x60, 0x00, 0x00},  // '.'
+  {0x20, 0x10, 0x08, 0x04, 0x02},  // '/'
+  {0x3e, 0x51, 0x49, 0x45, 0x3e},  // '0'
+  {0x00, 0x42, 0x7f, 0x40, 0x00},  // '1'
+  {0x42, 0x61, 0x51, 0x49, 0x46},  // '2'
+  {0x21, 0x41, 0x45, 0x4b, 0x31},  // '3'
+  {0x18, 0x14, 0x12, 0x7f, 0x10},  // '4'
+  {0x27, 0x45, 0x45, 0x45, 0x39},  // '5'
+  {0x3c, 0x4a, 0x49, 0x49, 0x30},  // '6'
+  {0x01, 0x71, 0x09, 0x05, 0x03},  // '7'
+  {0x36, 0x49, 0x49, 0x49, 0x36},  // '8'
+  {0x06, 0x49, 0x49, 0x29, 0x1e},  // '9'
+  {0x00, 0x36, 0x36, 0x00, 0x00},  // ':'
+  {0x00, 0x56, 0x36, 0x00, 0x00},  // ';'
+  {0x08, 0x14, 0x22, 0x41, 0x00},  // '<'
+  {0x14, 0x14, 0x14, 0x14, 0x14},  // '='
+  {0x00, 0x41, 0x22, 0x14, 0x08},  // '>'
+  {0x02, 0x01, 0x51, 0x09, 0x06},  // '?'
+  {0x32, 0x49, 0x79, 0x41, 0x3e},  // '@'
+  {0x7e, 0x11, 0x11, 0x11, 0x7e},  // 'A'
+  {0x7f, 0x49, 0x49, 0x49, 0x36},  // 'B'
+  {0x3e, 0x41, 0x41, 0x41, 0x22},  // 'C'
+  {0x7f, 0x41, 0x41, 0x22, 0x1c},  // 'D'
+  {0x7f, 0x49, 0x49, 0x49, 0x41},  // 'E'
+  {0x7f, 0x09, 0x09, 0x09, 0x01},  // 'F'
+  {0x3e, 0x41, 0x49, 0x49, 0x7a},  // 'G'
+  {0x7f, 0x08, 0x08, 0x08, 0x7f},  // 'H'
+  {0x00, 0x41, 0x7f, 0x41, 0x00},  // 'I'
+  {0x20, 0x40, 0x41, 0x3f, 0x01},  // 'J'
+  {0x7f, 0x08, 0x14, 0x22, 0x41},  // 'K'
+  {0x7f, 0x40, 0x40, 0x40, 0x40},  // 'L'
+  {0x7f, 0x02, 0x0c, 0x02, 0x7f},  // 'M'
+  {0x7f, 0x04, 0x08, 0x10, 0x7f},  // 'N'
+  {0x3e, 0x41, 0x41, 0x41, 0x3e},  // 'O'
+  {0x7f, 0x09, 0x09, 0x09, 0x06},  // 'P'
+  {0x3e, 0x41, 0x51, 0x21, 0x5e},  // 'Q'
+  {0x7f, 0x09, 0x19, 0x29, 0x46},  // 'R'
+  {0x46, 0x49, 0x49, 0x49, 0x31},  // 'S'
+  {0x01, 0x01, 0x7f, 0x01, 0x01},  // 'T'
+  {0x3f, 0x40, 0x40, 0x40, 0x3f},  // 'U'
+  {0x1f, 0x20, 0x40, 0x20, 0x1f},  // 'V'
+  {0x3f, 0x40, 0x38, 0x40, 0x3f},  // 'W'
+  {0x63, 0x14, 0x08, 0x14, 0x63},  // 'X'
+  {0x07, 0x08, 0x70, 0x08, 0x07},  // 'Y'
+  {0x61, 0x51, 0x49, 0x45, 0x43},  // 'Z'
+  {0x00, 0x7f, 0x41, 0x41, 0x00},  // '['
+  {0x02, 0x04, 0x08, 0x10, 0x20},  // '\\'
+  {0x00, 0x41, 0x41, 0x7f, 0x00},  // ']'
+  {0x04, 0x02, 0x01, 0x02, 0x04},  // '^'
+  {0x40, 0x40, 0x40, 0x40, 0x40},  // '_'
+};
+
+void AsyncEInkRefresh::clear(uint16_t startRow, uint16_t numRows) {
+  uint16_t endRow = std::min((uint16_t)(startRow + numRows), height_);
+  if (endRow > startRow) {
+    memset(framebuffer_ + startRow * rowBytes_, background_, (endRow - startRow) * rowBytes_);
+  }
+}
+
+void AsyncEInkRefresh::text(uint16_t x, uint16_t y, const char* str) {
+  for (; *str != '\0' && x < width_; str++, x += kFontAdvance) {
+    char c = toupper(*str);
+    if (c < kFontFirst || c > kFontLast) {
+      continue;
+    }
+    const uint8_t* glyph = kFont[c - kFontFirst];
+    for (uint8_t col = 0; col < kFontWidth; col++) {
+      for (uint8_t row = 0; row < kFontHeight; row++) {
+        if (glyph[col] & (1 << row)) {
+          setPixel(x + col, y + row);
+        }
+      }
+    }
+  }
+}
+
+void AsyncEInkRefresh::setPixel(uint16_t x, uint16_t y) {
+  if (x >= width_ || y >= height_) {
+    return;
+  }
+  uint8_t* byte = framebuffer_ + y * rowBytes_ + x / 8;
+  uint8_t mask = 0x80 >> (x % 8);
+  if (background_) {
+    *byte &= ~mask;
+  } else {
+    *byte |= mask;
+  }
+}
+
+void AsyncEInkRefresh::requestRefresh(uint16_t startRow, uint16_t numRows) {
+  uint16_t endRow = std::min((uint16_t)(startRow + numRows), height_);
+  if (endRow <= startRow) {
+    return;
+  }
+  if (pendingEndRow_ <= pendingStartRow_) {  // nothing pending
+    pendingStartRow_ = startRow;
+    pendingEndRow_ = endRow;
+  } else {  // merge into the pending window
+    pendingStartRow_ = std::min(pendingStartRow_, startRow);
+    pendingEndRow_ = std::max(pendingEndRow_, endRow);
+  }
+}
+
+void AsyncEInkRefresh::poll() {
+  switch (state_) {
+    case kIdle:
+      if (pendingEndRow_ > pendingStartRow_ && !busy()) {
+        startWindow();
+      }
+      break;
+    case kStreaming:
+      if (windowData_.done()) {
+        writeCommand(kCmdDisplayRefresh);
+        state_ = kRefreshing;
+      }
+      break;
+    case kRefreshing:
+      if (!busy()) {
+        writeCommand(kCmdPartialOut);
+        state_ = kIdle;
+      }
+      break;
+  }
+}
+
+void AsyncEInkRefresh::startWindow() {
+  windowStartRow_ = pendingStartRow_;
+  windowEndRow_ = pendingEndRow_;
+  pendingStartRow_ = 0;
+  pendingEndRow_ = 0;
+
+  uint16_t lastRow = windowEndRow_ - 1;
+  uint8_t window[] = {
+    0x00,  // horizontal start, byte-aligned
+    (uint8_t)((width_ - 1) | 0x07),  // horizontal end, byte-aligned
+    (uint8_t)(windowStartRow_ >> 8), (uint8_t)windowStartRow_,
+    (uint8_t)(lastRow >> 8), (uint8_t)lastRow,
+    0x01  // gates scan both inside and outside of the window
+  };
+  writeCommand(kCmdPartialIn);
+  writeCommand(kCmdPartialWindow);
+  writeData(window, sizeof(window));
+  writeCommand(kCmdDataTransmission2);
+
+  windowData_.set(spiSettings_, cs_, framebuffer_ + windowStartRow_ * rowBytes_, NULL,
+      (windowEndRow_ - windowStartRow_) * rowBytes_, SpiTransaction::kBulk, bytesPerSlice_, &dc_, true);
+  spi_.submit(windowData_);
+  state_ = kStreaming;
+}
+
+void AsyncEInkRefresh::writeCommand(uint8_t command) {
+  spi_.configure(spiSettings_);
+  dc_ = 0;
+  cs_ = 0;
+  spi_.spi().write(command);
+  cs_ = 1;
+}
+
+void AsyncEInkRefresh::writeData(const uint8_t* data, size_t len) {
+  spi_.configure(spiSettings_);
+  dc_ = 1;
+  cs_ = 0;
+  spi_.spi().write((const char*)data, len, NULL, 0);
+  cs_ = 1;
+}
@@ -0,0 +1,142 @@
+#ifndef _ASYNC_EINK_REFRESH_H_
+#define _ASYNC_EINK_REFRESH_H_
+
+#include "mbed.h"
+#include "SpiBus.h"
+
+/**
+ * Non-blocking partial refresh for a UC8151 / IL0373 E-Ink panel, with its own framebuffer.
+ *
+ * Text is drawn into a 1bpp, row-major framebuffer in the controller's data layout (MSB is the
+ * leftmost pixel of each byte). Windows of rows are streamed to the panel controller as a sliced
+ * bulk transaction on the shared SPI bus, so other devices on the bus can run between slices, then
+ * a partial refresh is triggered and the busy pin is polled instead of waited on. Requested rows
+ * that arrive while a refresh is in progress are merged and sent once the panel is idle.
+ *
+ * The panel must already be initialized (eg, by the graphics library init()). Use
+ * AsyncEInkRefreshBuffer for the framebuffer storage.
+ */
+class AsyncEInkRefresh {
+public:
+  /**
+   * framebuffer holds (width + 7) / 8 * height bytes. With inkBit 1, set bits are drawn pixels and
+   * the background is 0, and the other way around with inkBit 0, as the panel's data polarity is set.
+   */
+  AsyncEInkRefresh(SpiBus& spi, DigitalOut& cs, DigitalOut& dc, DigitalIn& busy,
+      uint8_t* framebuffer, uint16_t width, uint16_t height, uint8_t inkBit = 1,
+      uint32_t frequencyHz = 4000000, size_t bytesPerSlice = 64) :
+      spi_(spi), cs_(cs), dc_(dc), busy_(busy),
+      framebuffer_(framebuffer), width_(width), height_(height), rowBytes_((width + 7) / 8),
+      background_(inkBit ? 0x00 : 0xff),
+      spiSettings_({frequencyHz, 8, 0}), bytesPerSlice_(bytesPerSlice),
+      state_(kIdle), pendingStartRow_(0), pendingEndRow_(0),
+      windowStartRow_(0), windowEndRow_(0) {
+    clear(0, height_);
+  }
+
+  uint16_t width() const {
+    return width_;
+  }
+
+  uint16_t height() const {
+    return height_;
+  }
+
+  /**
+   * Clears rows [startRow, startRow + numRows) of the framebuffer to the background.
+   */
+  void clear(uint16_t startRow, uint16_t numRows);
+
+  /**
+   * Draws text into the framebuffer in a 5x7 font with a 6 pixel advance, top left at (x, y),
+   * clipped to the framebuffer. Lowercase is drawn as uppercase, other characters without a glyph
+   * as blanks. Nothing is sent to the panel until requestRefresh.
+   */
+  void text(uint16_t x, uint16_t y, const char* str);
+
+  static const uint8_t kFontWidth = 5;
+  static const uint8_t kFontHeight = 7;
+  static const uint8_t kFontAdvance = 6;
+
+  /**
+   * Requests that rows [startRow, startRow + numRows) be sent to the panel and refreshed.
+   * Returns immediately; the transfer happens over subsequent poll() calls.
+   */
+  void requestRefresh(uint16_t startRow, uint16_t numRows);
+
+  /**
+   * Advances the refresh state machine, without waiting on the panel.
+   * Call once per main loop iteration, alongside the bus poll() which streams the window data.
+   */
+  void poll();
+
+  /**
+   * Returns true if no refresh is in progress or pending.
+   */
+  bool idle() const {
+    return state_ == kIdle && pendingEndRow_ <= pendingStartRow_;
+  }
+
+protected:
+  enum State {
+    kIdle,
+    kStreaming,  // window data transaction queued on the bus
+    kRefreshing,  // refresh triggered, waiting for the busy pin to release
+  };
+
+  // Controller (UC8151 / IL0373) commands
+  static const uint8_t kCmdDisplayRefresh = 0x12;
+  static const uint8_t kCmdDataTransmission2 = 0x13;
+  static const uint8_t kCmdPartialWindow = 0x90;
+  static const uint8_t kCmdPartialIn = 0x91;
+  static const uint8_t kCmdPartialOut = 0x92;
+
+  bool busy() {
+    return busy_ == 0;  // BUSY_N, active low
+  }
+
+  void startWindow();
+  void setPixel(uint16_t x, uint16_t y);
+
+  void writeCommand(uint8_t command);
+  void writeData(const uint8_t* data, size_t len);
+
+  SpiBus& spi_;
+  DigitalOut& cs_;
+  DigitalOut& dc_;
+  DigitalIn& busy_;
+
+  uint8_t* const framebuffer_;
+  const uint16_t width_;
+  const uint16_t height_;
+  const size_t rowBytes_;
+  const uint8_t background_;
+  const SpiSettings spiSettings_;
+  const size_t bytesPerSlice_;
+
+  State state_;
+  uint16_t pendingStartRow_, pendingEndRow_;  // rows requested but not yet started, empty if end <= start
+  uint16_t windowStartRow_, windowEndRow_;  // rows of the window being streamed
+  SpiTransaction windowData_;
+
+  static const char kFontFirst = ' ';
+  static const char kFontLast = '_';
+  static const uint8_t kFont[][kFontWidth];  // columns of each glyph, LSB on top
+};
+
+/**
+ * AsyncEInkRefresh with its framebuffer, sized for a width x height panel.
+ */
+template <uint16_t kWidth, uint16_t kHeight>
+class AsyncEInkRefreshBuffer : public AsyncEInkRefresh {
+public:
+  AsyncEInkRefreshBuffer(SpiBus& spi, DigitalOut& cs, DigitalOut& dc, DigitalIn& busy,
+      uint8_t inkBit = 1, uint32_t frequencyHz = 4000000, size_t bytesPerSlice = 64) :
+      AsyncEInkRefresh(spi, cs, dc, busy, buffer_, kWidth, kHeight, inkBit, frequencyHz, bytesPerSlice) {
+  }
+
+protected:
+  uint8_t buffer_[(kWidth + 7) / 8 * kHeight];
+};
+
+#endif
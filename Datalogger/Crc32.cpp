@@ -0,0 +1,149 @@
+#include "Crc32.h"
+
+#if defined(TARGET_LPC15XX)
+#include "mbed.h"
+#endif
+
+namespace {
+
+const uint32_t kPolynomialReflected = 0xEDB88320;
+
+struct Crc32Tables {
+  uint32_t table[4][256];  // table[k][b] is the CRC of byte b followed by k zero bytes
+};
+
+constexpr Crc32Tables generateTables() {
+  Crc32Tables tables = {};
+  for (uint32_t i=0; i<256; i++) {
+    uint32_t crc = i;
+    for (uint8_t bit=0; bit<8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? kPolynomialReflected : 0);
+    }
+    tables.table[0][i] = crc;
+  }
+  for (uint32_t i=0; i<256; i++) {
+    for (uint8_t k=1; k<4; k++) {
+      uint32_t prev = tables.table[k - 1][i];
+      tables.table[k][i] = (prev >> 8) ^ tables.table[0][prev & 0xff];
+    }
+  }
+  return tables;
+}
+
+constexpr Crc32Tables kTables = generateTables();
+
+#if defined(TARGET_LPC15XX)
+// CRC engine registers, see UM10736 chapter 20
+struct CrcEngineRegisters {
+  volatile uint32_t MODE;
+  volatile uint32_t SEED;
+  volatile uint32_t SUM_WR_DATA;  // reads return the checksum, writes add data
+};
+CrcEngineRegisters* const kCrcEngine = (CrcEngineRegisters*)0x1C010000;
+
+const uint32_t kCrcModePoly32 = 0x2 << 0;
+const uint32_t kCrcModeBitReverseWrite = 1 << 2;
+const uint32_t kCrcModeBitReverseSum = 1 << 4;
+const uint32_t kCrcModeComplementSum = 1 << 5;
+const uint32_t kSysAhbClkCtrl0Crc = 1 << 20;
+
+bool crcEngineInitialized = false;
+bool crcEngineOk = false;
+
+// Adds data to the CRC engine, which must be set up for CRC-32
+void crcEngineWrite(const uint8_t* data, size_t len) {
+  volatile uint8_t* writeByte = (volatile uint8_t*)&kCrcEngine->SUM_WR_DATA;
+  while (len > 0 && ((uintptr_t)data & 0x03) != 0) {
+    *writeByte = *data;
+    data++;
+    len--;
+  }
+  while (len >= 4) {
+    // bits are reversed within each byte, but words are shifted in from bit 31, so swap the
+    // little-endian bytes to keep them in order (as the SD card driver's CRC16 does)
+    kCrcEngine->SUM_WR_DATA = __REV(*(const uint32_t*)data);
+    data += 4;
+    len -= 4;
+  }
+  while (len > 0) {
+    *writeByte = *data;
+    data++;
+    len--;
+  }
+}
+
+uint32_t crcEngineCompute(uint32_t crc, const uint8_t* data, size_t len) {
+  // the SD card driver also uses the engine (CRC16 of data blocks), so set the mode every time
+  kCrcEngine->MODE = kCrcModePoly32 | kCrcModeBitReverseWrite | kCrcModeBitReverseSum | kCrcModeComplementSum;
+  // the engine holds the un-reflected, un-complemented state, so undo the output transforms to resume
+  kCrcEngine->SEED = __RBIT(~crc);
+  crcEngineWrite(data, len);
+  return kCrcEngine->SUM_WR_DATA;
+}
+
+// Enables the engine, and checks it against the software CRC once, over unaligned bytes, words
+// and a resumed CRC, so a mismatch falls back to software instead of writing bad checksum frames
+void crcEngineInit() {
+  LPC_SYSCON->SYSAHBCLKCTRL0 |= kSysAhbClkCtrl0Crc;
+  alignas(4) static const uint8_t kTestData[16] = "123456789abcdef";
+  const uint8_t* data = kTestData + 1;
+  uint32_t crc = crcEngineCompute(0, data, 7);
+  crc = crcEngineCompute(crc, data + 7, 7);
+  crcEngineOk = crc == Crc32::computeSoftware(0, data, 14);
+  crcEngineInitialized = true;
+}
+#endif
+
+}
+
+uint32_t Crc32::computeSoftware(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  while (len > 0 && ((uintptr_t)data & 0x03) != 0) {
+    crc = (crc >> 8) ^ kTables.table[0][(crc ^ *data) & 0xff];
+    data++;
+    len--;
+  }
+  while (len >= 4) {  // slice-by-4, byte order independent of host endianness
+    crc ^= (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    crc = kTables.table[3][crc & 0xff] ^ kTables.table[2][(crc >> 8) & 0xff]
+        ^ kTables.table[1][(crc >> 16) & 0xff] ^ kTables.table[0][crc >> 24];
+    data += 4;
+    len -= 4;
+  }
+  while (len > 0) {
+    crc = (crc >> 8) ^ kTables.table[0][(crc ^ *data) & 0xff];
+    data++;
+    len--;
+  }
+  return ~crc;
+}
+
+#if defined(TARGET_LPC15XX)
+uint32_t Crc32::compute(uint32_t crc, const uint8_t* data, size_t len) {
+  if (len == 0) {
+    return crc;
+  }
+  if (!crcEngineInitialized) {
+    crcEngineInit();
+  }
+  if (!crcEngineOk) {
+    return computeSoftware(crc, data, len);
+  }
+  return crcEngineCompute(crc, data, len);
+}
+
+bool Crc32::usesHardware() {
+  if (!crcEngineInitialized) {
+    crcEngineInit();
+  }
+  return crcEngineOk;
+}
+#else
+uint32_t Crc32::compute(uint32_t crc, const uint8_t* data, size_t len) {
+  return computeSoftware(crc, data, len);
+}
+
+bool Crc32::usesHardware() {
+  return false;
+}
+#endif
@@ -0,0 +1,58 @@
+#ifndef _CRC32_H_
+#define _CRC32_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Running CRC-32 (IEEE 802.3 / zlib polynomial, reflected, ~0 seed and final XOR), so values match
+ * zlib crc32() and the host tools.
+ *
+ * On the LPC15xx this uses the hardware CRC engine, which is fast enough to leave on for every
+ * logged byte, once it has checked it against the software CRC. Elsewhere (including host builds of
+ * the validator), or if that check fails, it falls back to slice-by-4 tables.
+ */
+class Crc32 {
+public:
+  Crc32() : crc_(0) {
+  }
+
+  void reset() {
+    crc_ = 0;
+  }
+
+  /**
+   * Adds data to the running CRC.
+   */
+  void update(const uint8_t* data, size_t len) {
+    crc_ = compute(crc_, data, len);
+  }
+
+  /**
+   * Returns the CRC of all data since the last reset.
+   */
+  uint32_t read() const {
+    return crc_;
+  }
+
+  /**
+   * Continues a CRC from a previous result (0 to start), like zlib crc32().
+   */
+  static uint32_t compute(uint32_t crc, const uint8_t* data, size_t len);
+
+  /**
+   * Software-only version of compute(), for targets without the hardware engine and for testing it.
+   */
+  static uint32_t computeSoftware(uint32_t crc, const uint8_t* data, size_t len);
+
+  /**
+   * Returns whether compute() uses the hardware engine, which it does only if the engine gave the
+   * same CRC as computeSoftware() on its first use.
+   */
+  static bool usesHardware();
+
+protected:
+  uint32_t crc_;
+};
+
+#endif
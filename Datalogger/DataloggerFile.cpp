@@ -1,5 +1,6 @@
 #include "DataloggerFile.h"
 
+#include <algorithm>
 #include <limits>
 #include <utility>
 
@@ -71,9 +72,15 @@ static size_t itoaLimited(char* dst, uint32_t val, size_t len) {
 }
 
 bool DataloggerFile::newFile(const char* dirname, const char* basename) {
-  if (file_ != NULL) {
+  if (streams_[0].file != NULL) {
     debugWarn("File not null\r\n");
-    file_ = NULL;
+    for (size_t i=0; i<kMaxStreams; i++) {
+      if (streams_[i].file == &streams_[i].fatFile) {
+        flushBatch(i);
+        streams_[i].fatFile.close();
+      }
+      streams_[i].file = NULL;
+    }
   }
 
   char filename[8 + 1 + 8+1+3 + 1];  // 8/8.3 format, disallow LFN (Long Filename)
@@ -88,24 +95,36 @@ bool DataloggerFile::newFile(const char* dirname, const char* basename) {
   strcpy(filename + dirnameLen + 1, basename);
   size_t basenameEnd = dirnameLen + 1 + basenameLen;
 
-  DirHandle* dir;
-  if (!filesystem_.open(&dir, dirname)) {
+  if (log_ != NULL) {
+    // streams in the log don't collide, the extractor numbers files with the same name
+    int retVal = log_->open(filename);
+    if (retVal) {
+      debugWarn("Log stream open failed: %i", retVal);
+      return false;
+    }
+    debugInfo("Opened log stream %lu '%s'", log_->get_stream(), filename);
+    streams_[0].file = log_;  // the log has one stream at a time, the other streams go to stream 0
+    return true;
+  }
+
+  Dir dir;
+  if (!dir.open(&filesystem_, dirname)) {
     debugInfo("Opened dir '%s'", dirname);
     struct dirent dirp;
     uint16_t nextFilenameSeq = 0;
-    while (dir->read(&dirp) > 0) {
+    while (dir.read(&dirp) > 0) {
       const char* dirFilename = dirp.d_name;
       debugInfo("Found file '%s'", dirFilename);
 
       if (strPrefixMatch(basename, dirFilename, basenameLen)) {
-        if (dirFilename[basenameLen] == '\0') {
+        if (dirFilename[basenameLen] == '\0' || dirFilename[basenameLen] == '.') {  // any stream's file
           if (nextFilenameSeq == 0) {
             nextFilenameSeq = 1;
           }
         } else if (dirFilename[basenameLen] == '_') {
           // Determine length of postfix (sequence), between underscore and dot (or end-of-string)
           uint32_t seqLen = 0;
-          while (dirFilename[basenameLen + 1 + seqLen] != '\0') {
+          while (dirFilename[basenameLen + 1 + seqLen] != '\0' && dirFilename[basenameLen + 1 + seqLen] != '.') {
             seqLen++;
           }
           uint32_t thisNameSeq;
@@ -117,7 +136,7 @@ bool DataloggerFile::newFile(const char* dirname, const char* basename) {
         }
       }
     }
-    dir->close();
+    dir.close();
 
     if (nextFilenameSeq > 0) {
       if (basenameLen > 6) {
@@ -144,41 +163,157 @@ bool DataloggerFile::newFile(const char* dirname, const char* basename) {
     // Empty directory, don't need to mangle filename
   }
 
-  debugInfo("Opening file '%s'", filename);
-  if (!filesystem_.open(&file_, filename, O_WRONLY | O_CREAT | O_TRUNC)) {
-    debugInfo("File open OK");
-  } else {
-    debugWarn("File open failed");
+  if (!openStream(0, filename)) {
+    return false;
+  }
+  for (size_t i=1; i<kMaxStreams; i++) {
+    if (streams_[i].extension != NULL) {
+      openStream(i, filename);  // if it fails, its records go to stream 0
+    }
   }
+  return true;
+}
 
-  return file_ != NULL;
+bool DataloggerFile::openStream(size_t stream, const char* filename) {
+  Stream& s = streams_[stream];
+  char streamFilename[8 + 1 + 8+1+3 + 1];
+  strcpy(streamFilename, filename);
+  if (s.extension != NULL) {
+    if (strlen(s.extension) > 3) {
+      debugWarn("extension '%s' too long", s.extension);
+      return false;
+    }
+    strcat(streamFilename, ".");
+    strcat(streamFilename, s.extension);
+  }
+
+  debugInfo("Opening file '%s'", streamFilename);
+  if (s.fatFile.open(&filesystem_, streamFilename, O_WRONLY | O_CREAT | O_TRUNC)) {
+    debugWarn("File open failed");
+    return false;
+  }
+  debugInfo("File open OK");
+  s.file = &s.fatFile;
+  s.batchBytes = 0;
+  s.batchStart = 0;
+  if (s.extentBytes != 0) {
+    int result = s.fatFile.set_extent_size(s.extentBytes);
+    if (result) {  // still usable, just allocated like any other file
+      debugWarn("File extent size failed: %i", result);
+    }
+  }
+  return true;
 }
 
 bool DataloggerFile::syncFile() {
-  if (file_ == NULL) {
+  if (streams_[0].file == NULL) {
     return false;  // TODO: perhaps assert out?
   }
-  int result = file_->sync();
-  if (!result) {
-    debugInfo("File sync");
-  } else {
-    debugWarn("File sync failed: %i", result);
+  bool ok = true;
+  for (size_t i=0; i<kMaxStreams; i++) {
+    if (streams_[i].file == NULL) {
+      continue;
+    }
+    bool batchOk = flushBatch(i);
+    int result = streams_[i].file->sync();
+    if (!result) {
+      debugInfo("File %u sync", i);
+    } else {
+      debugWarn("File %u sync failed: %i", i, result);
+    }
+    ok = ok && result == 0 && batchOk;
+  }
+  return ok;
+}
+
+bool DataloggerFile::checkpointFile() {
+  if (streams_[0].file == NULL) {
+    return false;
+  }
+  bool ok = true;
+  for (size_t i=0; i<kMaxStreams; i++) {
+    if (streams_[i].file == NULL) {
+      continue;
+    }
+    bool batchOk = flushBatch(i);
+    int result;
+    if (streams_[i].file == &streams_[i].fatFile) {
+      result = streams_[i].fatFile.checkpoint();
+    } else {  // a SegmentLog sync only programs the last block anyways
+      result = streams_[i].file->sync();
+    }
+    if (result) {
+      debugWarn("File %u checkpoint failed: %i", i, result);
+    }
+    ok = ok && result == 0 && batchOk;
   }
-  return result == 0;
+  return ok;
 }
 
 bool DataloggerFile::closeFile() {
-  if (file_ == NULL) {
+  if (streams_[0].file == NULL) {
     return false;  // TODO: perhaps assert out?
   }
-  int result = file_->close();
-  if (!result) {
-    debugInfo("File close");
+  bool ok = true;
+  for (size_t i=0; i<kMaxStreams; i++) {
+    if (streams_[i].file == NULL) {
+      continue;
+    }
+    bool batchOk = flushBatch(i);
+    int result = streams_[i].file->close();
+    if (!result) {
+      debugInfo("File %u close", i);
+    } else {
+      debugWarn("File %u close failed: %i", i, result);
+    }
+    streams_[i].file = NULL;
+    ok = ok && result == 0 && batchOk;
+  }
+  return ok;
+}
+
+ssize_t DataloggerFile::writeBytes(size_t stream, const uint8_t* data, size_t len) {
+  Stream& s = streams_[stream];
+  if (s.file != &s.fatFile) {
+    return s.file->write(data, len);
+  }
+  size_t done = 0;
+  while (done < len) {
+    // batches end on a sector boundary, so the one after a partial flush (sync) realigns
+    size_t batchEnd = kBatchBytes - s.batchStart % kSectorBytes;
+    size_t copyBytes = std::min(len - done, batchEnd - s.batchBytes);
+    memcpy(s.batch + s.batchBytes, data + done, copyBytes);
+    s.batchBytes += copyBytes;
+    done += copyBytes;
+    if (s.batchBytes == batchEnd && !flushBatch(stream)) {
+      return -EIO;
+    }
+  }
+  return len;
+}
+
+bool DataloggerFile::flushBatch(size_t stream) {
+  Stream& s = streams_[stream];
+  if (s.file != &s.fatFile || s.batchBytes == 0) {
+    return true;
+  }
+  ssize_t written = -EINVAL;
+  if (s.batchStart % kSectorBytes == 0 && s.batchBytes % kSectorBytes == 0) {
+    written = s.fatFile.write_direct(s.batch, s.batchBytes);
+  }
+  if (written == -EINVAL) {  // not whole sectors, or sectors aren't kSectorBytes: through the sector buffer
+    written = s.fatFile.write(s.batch, s.batchBytes);
+  }
+  bool ok = written >= 0 && (size_t)written == s.batchBytes;
+  if (ok) {
+    s.batchStart += s.batchBytes;
   } else {
-    debugWarn("File close failed: %i", result);
+    debugWarn("File %u write failed: %i", stream, (int)written);
+    off_t pos = s.fatFile.tell();
+    s.batchStart = pos >= 0 ? pos : 0;
   }
-  file_ = NULL;
-  return result == 0;
+  s.batchBytes = 0;
+  return ok;
 }
 
 struct pb_ostream_cobs_state {
@@ -228,16 +363,108 @@ static pb_ostream_t pb_ostream_cobs_from_buffer(uint8_t* buffer, size_t bufsize,
   return {&pb_ostream_cobs_callback, state, bufsize, 0};
 }
 
-bool DataloggerProtoFile::write(const DataloggerRecord record) {
+const uint8_t DataloggerProtoFile::kChecksumMagic[4] = {0x07, 'C', 'R', 'C'};
+
+bool DataloggerProtoFile::newFile(const char* dirname, const char* basename) {
+  for (size_t i=0; i<kMaxStreams; i++) {
+    blockCrc_[i].reset();
+    blockBytes_[i] = 0;
+    blockRecords_[i] = 0;
+  }
+  return DataloggerFile::newFile(dirname, basename);
+}
+
+bool DataloggerProtoFile::syncFile() {
+  bool checksumOk = true;
+  for (size_t i=0; i<kMaxStreams; i++) {
+    if (isStreamOpen(i)) {
+      checksumOk = writeChecksum(i) && checksumOk;  // so everything on the card is covered by a checksum
+    }
+  }
+  return DataloggerFile::syncFile() && checksumOk;
+}
+
+bool DataloggerProtoFile::checkpointFile() {
+  bool checksumOk = true;
+  for (size_t i=0; i<kMaxStreams; i++) {
+    if (isStreamOpen(i)) {
+      checksumOk = writeChecksum(i) && checksumOk;  // otherwise what survives would be unverified
+    }
+  }
+  return DataloggerFile::checkpointFile() && checksumOk;
+}
+
+bool DataloggerProtoFile::closeFile() {
+  bool checksumOk = true;
+  for (size_t i=0; i<kMaxStreams; i++) {
+    if (isStreamOpen(i)) {
+      checksumOk = writeChecksum(i) && checksumOk;
+    }
+  }
+  return DataloggerFile::closeFile() && checksumOk;
+}
+
+bool DataloggerProtoFile::write(const DataloggerRecord record, size_t stream) {
+  if (!isStreamOpen(stream)) {
+    stream = 0;
+  }
+  pb_ostream_cobs_state state;
+  pb_ostream_t ostream = pb_ostream_cobs_from_buffer(encodingBuffer_ + 1, sizeof(encodingBuffer_) - 1, &state);
+
+  if (streams_[stream].file != NULL
+      && pb_encode(&ostream, DataloggerRecord_fields, &record)
+      && pb_ostream_cobs_finish(&state)) {
+    encodingBuffer_[0] = 0;  // state of frame delimiter
+    size_t bufferSize = state.bufPos - encodingBuffer_;
+    ssize_t bytesWritten = writeBytes(stream, encodingBuffer_, bufferSize);
+    if (bytesWritten > 0) {
+      blockCrc_[stream].update(encodingBuffer_, bytesWritten);
+      blockBytes_[stream] += bytesWritten;
+    }
+    bool recordOk = bytesWritten >= 0 && (size_t)bytesWritten == bufferSize;
+
+    blockRecords_[stream]++;
+    if (blockRecords_[stream] >= kChecksumIntervalRecords) {
+      recordOk = writeChecksum(stream) && recordOk;
+    }
+    return recordOk;
+  } else {
+    return false;
+  }
+}
+
+bool DataloggerProtoFile::writeChecksum(size_t stream) {
+  if (!isStreamOpen(stream)) {
+    return false;
+  }
+  if (blockBytes_[stream] == 0) {
+    return true;
+  }
+
+  uint32_t crc = blockCrc_[stream].read();
+  uint32_t blockBytes = blockBytes_[stream];
+  uint8_t payload[12] = {
+    kChecksumMagic[0], kChecksumMagic[1], kChecksumMagic[2], kChecksumMagic[3],
+    (uint8_t)blockBytes, (uint8_t)(blockBytes >> 8), (uint8_t)(blockBytes >> 16), (uint8_t)(blockBytes >> 24),
+    (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24),
+  };
+  // the next block starts after this frame, even if writing it failed
+  blockCrc_[stream].reset();
+  blockBytes_[stream] = 0;
+  blockRecords_[stream] = 0;
+
+  return writeFrame(stream, payload, sizeof(payload));
+}
+
+bool DataloggerProtoFile::writeFrame(size_t stream, const uint8_t* payload, size_t len) {
   pb_ostream_cobs_state state;
-  pb_ostream_t stream = pb_ostream_cobs_from_buffer(encodingBuffer_ + 1, sizeof(encodingBuffer_) - 1, &state);
+  pb_ostream_t ostream = pb_ostream_cobs_from_buffer(encodingBuffer_ + 1, sizeof(encodingBuffer_) - 1, &state);
 
-  if (file_ != NULL
-      && pb_encode(&stream, DataloggerRecord_fields, &record)
+  if (pb_write(&ostream, payload, len)
       && pb_ostream_cobs_finish(&state)) {
     encodingBuffer_[0] = 0;  // state of frame delimiter
     size_t bufferSize = state.bufPos - encodingBuffer_;
-    ssize_t bytesWritten = file_->write(encodingBuffer_, bufferSize);
+    ssize_t bytesWritten = writeBytes(stream, encodingBuffer_, bufferSize);
     return bytesWritten >= 0 && (size_t)bytesWritten == bufferSize;
   } else {
     return false;
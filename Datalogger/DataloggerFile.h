@@ -2,43 +2,147 @@
 #define _DATALOGGER_FILE_H
 
 #include "mbed.h"
-#include "FileSystemLike.h"
+#include "Dir.h"
+#include "File.h"
+#include "FileSystem.h"
+#include "SegmentLog.h"
 
 #include "datalogger/datalogger.pb.h"
 
+#include "Crc32.h"
+
 class DataloggerFile {
 public:
-  DataloggerFile(FileSystemLike& filesystem) :
-      filesystem_(filesystem), file_(NULL) {
+  static const size_t kMaxStreams = 2;
+
+  DataloggerFile(FileSystem& filesystem) :
+      filesystem_(filesystem), log_(NULL) {
+    for (size_t i=0; i<kMaxStreams; i++) {
+      streams_[i].extension = NULL;
+      streams_[i].extentBytes = 0;
+      streams_[i].file = NULL;
+      streams_[i].batchBytes = 0;
+      streams_[i].batchStart = 0;
+    }
+  }
+
+  /**
+   * Writes new files as streams in a mounted SegmentLog (eg, on a raw partition) instead of to the
+   * filesystem, or to the filesystem again if NULL. Takes effect at the next newFile.
+   */
+  void setSegmentLog(SegmentLog* log) {
+    log_ = log;
   }
 
-  bool newFile(const char* dirname, const char* basename);
-  bool syncFile();
-  bool closeFile();
+  /**
+   * Configures a stream, a file opened by newFile alongside the others, with the same name and the
+   * given extension (eg "CAN"). Stream 0 is always opened, without an extension if NULL, other
+   * streams only with one. On the filesystem, each file claims extentBytes at a time as it grows
+   * (0 for the filesystem default), so files growing side by side each stay contiguous.
+   * In a SegmentLog, all streams go to stream 0. Takes effect at the next newFile.
+   */
+  void setStream(size_t stream, const char* extension, uint32_t extentBytes) {
+    streams_[stream].extension = extension;
+    streams_[stream].extentBytes = extentBytes;
+  }
+
+  /**
+   * Returns whether a stream has its own file open. Records for streams that don't go to stream 0.
+   */
+  bool isStreamOpen(size_t stream) const {
+    return stream < kMaxStreams && streams_[stream].file != NULL;
+  }
+
+  virtual bool newFile(const char* dirname, const char* basename);
+  virtual bool syncFile();
+  virtual bool closeFile();
+
+  /**
+   * Makes everything written so far survive a power loss, at a couple of sector writes per stream
+   * (File::checkpoint) instead of a full sync, so it can run every few seconds between syncs.
+   */
+  virtual bool checkpointFile();
 
 protected:
-  FileSystemLike& filesystem_;
-  FileHandle* file_;  // currently open file, or NULL if none open
+  /**
+   * Appends to a stream's file. Files on the filesystem are batched into whole sectors, which go
+   * straight to the card with File::write_direct instead of through the FAT sector buffer, and
+   * are written out by syncFile and closeFile. Returns len on success, or a negative error code.
+   */
+  ssize_t writeBytes(size_t stream, const uint8_t* data, size_t len);
+  bool flushBatch(size_t stream);
+  bool openStream(size_t stream, const char* filename);
+
+  static const size_t kSectorBytes = 512;
+  static const size_t kBatchBytes = 2 * kSectorBytes;
+
+  struct Stream {
+    const char* extension;  // appended to the file name, or NULL
+    uint32_t extentBytes;  // claimed at a time as the file grows, 0 for the filesystem default
+    File fatFile;  // file on the filesystem, file points here while it's open
+    FileHandle* file;  // currently open file, or NULL if none open
+
+    uint8_t batch[kBatchBytes];
+    size_t batchBytes;  // bytes in batch not written to fatFile yet
+    uint32_t batchStart;  // file offset of batch[0]
+  };
+
+  FileSystem& filesystem_;
+  SegmentLog* log_;  // if not NULL, new files are streams in this log
+  Stream streams_[kMaxStreams];
 };
 
 /**
  * Variant of DataloggerFile with COBS protobuf recording utilities.
+ *
+ * Blocks of records are followed by a checksum frame, written every kChecksumIntervalRecords records
+ * and on each sync and close, so damage (eg, from an unsafe eject) can be told apart from bad
+ * encoding and skipped. A checksum frame is a COBS frame like a record, but its 12-byte payload is
+ *   kChecksumMagic (4 bytes), block length in bytes (uint32 LE), CRC-32 of the block (uint32 LE)
+ * where the block is every file byte since the end of the previous checksum frame (or the start of
+ * the file) up to the start of this frame. The magic starts with a field 0 / wire type 7 tag,
+ * which is never valid protobuf, so record decoders reject it.
  */
 class DataloggerProtoFile : public DataloggerFile {
 public:
-  DataloggerProtoFile(FileSystemLike& filesystem) :
+  DataloggerProtoFile(FileSystem& filesystem) :
       DataloggerFile(filesystem) {
+    for (size_t i=0; i<kMaxStreams; i++) {
+      blockBytes_[i] = 0;
+      blockRecords_[i] = 0;
+    }
   }
 
+  static const uint8_t kChecksumMagic[4];
+  static const uint16_t kChecksumIntervalRecords = 64;
+
+  virtual bool newFile(const char* dirname, const char* basename);
+  virtual bool syncFile();
+  virtual bool closeFile();
+  virtual bool checkpointFile();
+
   /**
    * Encodes a DataloggerRecord to wire format, COBS it, and writes it to the
-   * open file. Returns true on success.
+   * stream's file, or stream 0's if the stream has no file open. Returns true on success.
    *
    * Does nothing if no file is open.
    */
-  bool write(const DataloggerRecord record);
+  bool write(const DataloggerRecord record, size_t stream = 0);
+
+  /**
+   * Writes a checksum frame to a stream covering all bytes since the previous one, if any.
+   * Returns true on success, or if there was nothing to cover.
+   */
+  bool writeChecksum(size_t stream);
 
 protected:
+  bool writeFrame(size_t stream, const uint8_t* payload, size_t len);
+
+  // per stream, checksum blocks are within each file
+  Crc32 blockCrc_[kMaxStreams];  // CRC of the bytes written since the last checksum frame
+  uint32_t blockBytes_[kMaxStreams];
+  uint16_t blockRecords_[kMaxStreams];
+
   uint8_t encodingBuffer_[DataloggerRecord_size + (DataloggerRecord_size + 253) / 254 + 2];  // staticly allocate the buffer
 };
 
@@ -35,9 +35,17 @@ public:
    * Updates the filter with the latest value, returning any detected edges.
    */
   State update(bool dataValue) {
+    return update(dataValue, timebase_.read_us());
+  }
+
+  /**
+   * Updates the filter with the latest value sampled at nowUs, returning any detected edges.
+   * Use this when updating many filters per loop, so the timebase is only read once.
+   */
+  State update(bool dataValue, uint32_t nowUs) {
     if (dataValue != filteredValue_) {
       if (dataValue == lastValue_) {
-        if (LongTimer::timePast(timebase_.read_us(), filterUpdateTime_)) {  // past filter time
+        if (LongTimer::timePast(nowUs, filterUpdateTime_)) {  // past filter time
           filteredValue_ = dataValue;
           if (dataValue == true) {
             return State::kRising;
@@ -50,9 +58,9 @@ public:
       } else {  // first detection of changed data, set filter deadline
         lastValue_ = dataValue;
         if (dataValue == true) {  // rising edge
-          filterUpdateTime_ = timebase_.read_us() + filterRiseUs_;
+          filterUpdateTime_ = nowUs + filterRiseUs_;
         } else {
-          filterUpdateTime_ = timebase_.read_us() + filterFallUs_;
+          filterUpdateTime_ = nowUs + filterFallUs_;
         }
       }
     } else {
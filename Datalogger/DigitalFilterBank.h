@@ -0,0 +1,90 @@
+#ifndef _DIGITAL_FILTER_BANK_H_
+#define _DIGITAL_FILTER_BANK_H_
+
+#include "mbed.h"
+#include "LongTimer.h"
+#include "DigitalFilter.h"
+
+/**
+ * A bank of NumChannels DigitalFilters updated together from one timestamp per loop.
+ * Per-channel state is stored as parallel arrays, so a full update is a tight loop with no
+ * timebase reads. Filter delays are per channel, since inputs debounce differently.
+ */
+template <size_t NumChannels>
+class DigitalFilterBank {
+public:
+  typedef DigitalFilter::State State;
+
+  DigitalFilterBank(const bool (&initialValues)[NumChannels],
+      const uint32_t (&filterRiseUs)[NumChannels], const uint32_t (&filterFallUs)[NumChannels]) {
+    for (size_t i=0; i<NumChannels; i++) {
+      filterRiseUs_[i] = filterRiseUs[i];
+      filterFallUs_[i] = filterFallUs[i];
+      filterUpdateTime_[i] = 0;
+      lastValue_[i] = initialValues[i];
+      filteredValue_[i] = initialValues[i];
+    }
+  }
+
+  /**
+   * Read the filtered value of a channel without updating internal state
+   */
+  bool read(size_t channel) const {
+    return filteredValue_[channel];
+  }
+
+  /**
+   * Updates a single channel with its latest value sampled at nowUs, returning any detected edges.
+   */
+  State update(size_t channel, bool dataValue, uint32_t nowUs) {
+    if (dataValue != filteredValue_[channel]) {
+      if (dataValue == lastValue_[channel]) {
+        if (LongTimer::timePast(nowUs, filterUpdateTime_[channel])) {  // past filter time
+          filteredValue_[channel] = dataValue;
+          if (dataValue == true) {
+            return State::kRising;
+          } else {
+            return State::kFalling;
+          }
+        } else {
+          // no update needed
+        }
+      } else {  // first detection of changed data, set filter deadline
+        lastValue_[channel] = dataValue;
+        if (dataValue == true) {  // rising edge
+          filterUpdateTime_[channel] = nowUs + filterRiseUs_[channel];
+        } else {
+          filterUpdateTime_[channel] = nowUs + filterFallUs_[channel];
+        }
+      }
+    } else {
+      // do nothing, current data equivalent to the last filtered value
+      lastValue_[channel] = dataValue;  // reset any filtered-out data glitching
+    }
+    if (filteredValue_[channel]) {
+      return State::kHigh;
+    } else {
+      return State::kLow;
+    }
+  }
+
+  /**
+   * Updates all channels with their latest values, all sampled at nowUs.
+   * The state (including detected edges) of each channel is written to statesOut.
+   */
+  void update(const bool (&dataValues)[NumChannels], uint32_t nowUs, State (&statesOut)[NumChannels]) {
+    for (size_t i=0; i<NumChannels; i++) {
+      statesOut[i] = update(i, dataValues[i], nowUs);
+    }
+  }
+
+protected:
+  uint32_t filterRiseUs_[NumChannels];
+  uint32_t filterFallUs_[NumChannels];
+
+  uint32_t filterUpdateTime_[NumChannels];  // time at which filteredValue becomes lastValue (if different)
+  bool lastValue_[NumChannels];  // last observed value
+  bool filteredValue_[NumChannels];  // current filter output
+};
+
+#endif
@@ -84,3 +84,65 @@ DataloggerRecord generateInfoRecord(const char* info, uint8_t sourceId, uint32_t
 
   return rec;
 }
+
+DataloggerRecord generateSourceDefRecord(uint8_t sourceId, SourceDef_SourceType type, const char* name) {
+  DataloggerRecord rec = {
+    0,
+    0,
+    sourceId,
+    DataloggerRecord_sourceDef_tag, {}
+  };
+  rec.payload.sourceDef = SourceDef {
+    type,
+    ""
+  };
+  strncpy(rec.payload.sourceDef.name, name, sizeof(rec.payload.sourceDef.name) - 1);
+
+  return rec;
+}
+
+DataloggerRecord generateLatencyStatsRecord(const timing_bd_op_stats_t& stats,
+    uint8_t sourceId, uint32_t timestampMs, uint32_t periodMs) {
+  DataloggerRecord rec = {
+    timestampMs,
+    periodMs,
+    sourceId,
+    DataloggerRecord_sensorReading_tag, {}
+  };
+  rec.payload.sensorReading = StatisticalAggregate {
+    stats.count,
+    (int32_t)stats.min_latency_us,
+    (int32_t)stats.max_latency_us,
+    stats.count > 0 ? (int32_t)(stats.total_latency_us / stats.count) : 0,
+    0
+  };
+
+  return rec;
+}
+
+DataloggerRecord generateLatencyHistogramRecord(const timing_bd_op_stats_t& stats,
+    uint8_t sourceId, uint32_t timestampMs, uint32_t periodMs) {
+  DataloggerRecord rec = {
+    timestampMs,
+    periodMs,
+    sourceId,
+    DataloggerRecord_sensorDistribution_tag, {}
+  };
+
+  IntHistogram& histogramRec = rec.payload.sensorDistribution;
+  static_assert(TIMING_BD_LATENCY_BUCKETS - 1 <= sizeof(histogramRec.buckets) / sizeof(histogramRec.buckets[0]),
+      "Insufficient buckets in proto message");
+
+  const uint32_t* limits = TimingBlockDevice::get_latency_bucket_limits();
+  histogramRec = IntHistogram {
+    (pb_size_t)(TIMING_BD_LATENCY_BUCKETS - 1), {},  // buckets
+    (pb_size_t)(TIMING_BD_LATENCY_BUCKETS), {}  // counts
+  };
+  for (uint8_t i=0; i<TIMING_BD_LATENCY_BUCKETS-1; i++) {
+    histogramRec.buckets[i] = limits[i];
+    histogramRec.counts[i] = stats.latency_counts[i];
+  }
+  histogramRec.counts[TIMING_BD_LATENCY_BUCKETS - 1] = stats.latency_counts[TIMING_BD_LATENCY_BUCKETS - 1];
+
+  return rec;
+}
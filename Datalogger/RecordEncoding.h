@@ -8,12 +8,21 @@
 #include "Histogram.h"
 #include "MovingAverage.h"
 #include "can_buffer_timestamp.h"
+#include "TimingBlockDevice.h"
 
 #include "datalogger/datalogger.pb.h"
 
 DataloggerRecord timeToRecord(tm time, uint8_t sourceId, uint32_t timestampMs);
 DataloggerRecord canMessageToRecord(Timestamped_CANMessage msg, uint8_t sourceId);
 DataloggerRecord generateInfoRecord(const char* info, uint8_t sourceId, uint32_t timestampMs);
+DataloggerRecord generateSourceDefRecord(uint8_t sourceId, SourceDef_SourceType type, const char* name);
+
+// Block device operation latency (in us) as a stats record. Standard deviation is not tracked and is zero.
+DataloggerRecord generateLatencyStatsRecord(const timing_bd_op_stats_t& stats,
+    uint8_t sourceId, uint32_t timestampMs, uint32_t periodMs);
+// Block device operation latency (in us) as a histogram record.
+DataloggerRecord generateLatencyHistogramRecord(const timing_bd_op_stats_t& stats,
+    uint8_t sourceId, uint32_t timestampMs, uint32_t periodMs);
 
 template<typename T, typename V>
 DataloggerRecord generateStatsRecord(
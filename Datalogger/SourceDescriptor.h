@@ -0,0 +1,81 @@
+#ifndef _SOURCE_DESCRIPTOR_H_
+#define _SOURCE_DESCRIPTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "datalogger/datalogger.pb.h"
+
+/**
+ * Returns numerator / denominator as a Q32 fixed-point factor, rounded to nearest.
+ * The magnitude of the ratio must be below 0.5 to fit.
+ */
+constexpr int32_t fixedRatioQ32(int64_t numerator, int64_t denominator) {
+  return (int32_t)((numerator * ((int64_t)1 << 32) + (numerator >= 0 ? denominator : -denominator) / 2)
+      / denominator);
+}
+
+/**
+ * Returns numerator / denominator, rounded to nearest, for use as a compile-time offset.
+ */
+constexpr int32_t roundedRatio(int64_t numerator, int64_t denominator) {
+  return (int32_t)((numerator + (numerator >= 0 ? denominator : -denominator) / 2) / denominator);
+}
+
+/**
+ * Describes one datalogger source: its header definition and, for analog channels,
+ * how to sample and convert it.
+ *
+ * Analog channels are ratiometric to Vref+, and are converted to output units as
+ *   offset + raw counts * Vref+ (mV) * scale
+ * where scale is in Q32 fixed point, so conversion is a single multiply and shift.
+ * Non-analog sources leave sample as NULL.
+ */
+struct SourceDescriptor {
+  uint8_t sourceId;
+  SourceDef_SourceType type;
+  const char* name;
+
+  uint16_t (*sample)();  // returns 12-bit ADC counts, or NULL if not an analog channel
+  int32_t offset;  // output value at zero counts
+  int32_t scaleQ32;  // output units per (count * mV of Vref+), in Q32 fixed point
+
+  int32_t convert(uint16_t raw, uint16_t vrefpMv) const {
+    int64_t scaled = (int64_t)((uint32_t)raw * vrefpMv) * scaleQ32;
+    return offset + (int32_t)((scaled + ((int64_t)1 << 31)) >> 32);
+  }
+};
+
+/**
+ * Returns the number of analog channels (sources with a sample function) in a table.
+ */
+template <size_t NumSources>
+constexpr size_t countAnalogSources(const SourceDescriptor (&sources)[NumSources]) {
+  size_t count = 0;
+  for (size_t i=0; i<NumSources; i++) {
+    if (sources[i].sample != NULL) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * Returns the index of a source among the analog channels of a table,
+ * or the number of analog channels if not found.
+ */
+template <size_t NumSources>
+constexpr size_t analogSourceIndex(const SourceDescriptor (&sources)[NumSources], uint8_t sourceId) {
+  size_t index = 0;
+  for (size_t i=0; i<NumSources; i++) {
+    if (sources[i].sample != NULL) {
+      if (sources[i].sourceId == sourceId) {
+        return index;
+      }
+      index++;
+    }
+  }
+  return index;
+}
+
+#endif
@@ -0,0 +1,200 @@
+// Filter update cost on the host, see ../README.md.
+//
+// Each result is one line of JSON on stdout, with the host time per channel update. The
+// shared-timestamp filters and the banks see the same inputs and timestamps, so they must
+// detect the same edges; the benchmark exits non-zero if they don't.
+
+#include "mbed.h"
+#include "DigitalFilter.h"
+#include "DigitalFilterBank.h"
+#include "AnalogThresholdFilter.h"
+#include "AnalogThresholdFilterBank.h"
+
+#include <vector>
+
+static const size_t kLoops = 200000;
+static const size_t kPatterns = 64;  // input patterns, cycled through
+static const uint32_t kLoopUs = 1000;  // simulated time per loop
+static const uint32_t kFilterUs = 5000;
+
+static Timer BenchTimer;
+static bool Failed = false;
+
+static uint32_t nextRandom(uint32_t &seed) {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static void report(const char *bench, const char *variant, size_t channels, uint64_t us, uint32_t edges) {
+  printf("{\"bench\": \"%s\", \"variant\": \"%s\", \"channels\": %u, \"updates\": %u, "
+      "\"ns_per_update\": %.2f, \"edges\": %u}\n",
+      bench, variant, (unsigned)channels, (unsigned)(kLoops * channels),
+      us * 1000.0 / (kLoops * channels), edges);
+}
+
+static uint32_t countEdge(int state) {
+  return state == DigitalFilter::kRising || state == DigitalFilter::kFalling;
+}
+
+template <size_t N>
+static void benchDigital() {
+  // inputs that mostly hold, with occasional changes and glitches, so the filters see edges
+  static bool inputs[kPatterns][N];
+  uint32_t seed = N;
+  bool held[N] = {};
+  for (size_t p = 0; p < kPatterns; p++) {
+    for (size_t i = 0; i < N; i++) {
+      uint32_t r = nextRandom(seed) % 16;
+      if (r == 0) {
+        held[i] = !held[i];
+      }
+      inputs[p][i] = r == 1 ? !held[i] : held[i];
+    }
+  }
+
+  // each filter reading the timer itself, as DigitalFilter::update(bool) does
+  {
+    std::vector<DigitalFilter *> filters;
+    for (size_t i = 0; i < N; i++) {
+      filters.push_back(new DigitalFilter(BenchTimer, false, kFilterUs));
+    }
+    uint32_t edges = 0;
+    uint64_t startUs = BenchTimer.read_high_resolution_us();
+    for (size_t loop = 0; loop < kLoops; loop++) {
+      for (size_t i = 0; i < N; i++) {
+        edges += countEdge(filters[i]->update(inputs[loop % kPatterns][i]));
+      }
+    }
+    report("digital", "timer_per_filter", N, BenchTimer.read_high_resolution_us() - startUs, edges);
+    for (DigitalFilter *filter : filters) {
+      delete filter;
+    }
+  }
+
+  // one timestamp per loop, shared by separate filters
+  uint32_t sharedEdges = 0;
+  {
+    std::vector<DigitalFilter *> filters;
+    for (size_t i = 0; i < N; i++) {
+      filters.push_back(new DigitalFilter(BenchTimer, false, kFilterUs));
+    }
+    uint64_t startUs = BenchTimer.read_high_resolution_us();
+    for (size_t loop = 0; loop < kLoops; loop++) {
+      uint32_t nowUs = loop * kLoopUs;
+      for (size_t i = 0; i < N; i++) {
+        sharedEdges += countEdge(filters[i]->update(inputs[loop % kPatterns][i], nowUs));
+      }
+    }
+    report("digital", "shared_timestamp", N, BenchTimer.read_high_resolution_us() - startUs, sharedEdges);
+    for (DigitalFilter *filter : filters) {
+      delete filter;
+    }
+  }
+
+  // one timestamp per loop, and a bank
+  {
+    bool initialValues[N] = {};
+    uint32_t delays[N];
+    for (size_t i = 0; i < N; i++) {
+      delays[i] = kFilterUs;
+    }
+    DigitalFilterBank<N> bank(initialValues, delays, delays);
+    DigitalFilter::State states[N];
+    uint32_t edges = 0;
+    uint64_t startUs = BenchTimer.read_high_resolution_us();
+    for (size_t loop = 0; loop < kLoops; loop++) {
+      bank.update(inputs[loop % kPatterns], loop * kLoopUs, states);
+      for (size_t i = 0; i < N; i++) {
+        edges += countEdge(states[i]);
+      }
+    }
+    report("digital", "bank", N, BenchTimer.read_high_resolution_us() - startUs, edges);
+    if (edges != sharedEdges) {
+      fprintf(stderr, "digital bank of %u: %u edges, separate filters %u\n", (unsigned)N, edges, sharedEdges);
+      Failed = true;
+    }
+  }
+}
+
+template <size_t N>
+static void benchAnalog() {
+  static const uint32_t kRising = 3750, kFalling = 3500;  // mV, as the supercap filter
+  static uint32_t inputs[kPatterns][N];
+  uint32_t seed = N + 1;
+  bool held[N] = {};
+  for (size_t p = 0; p < kPatterns; p++) {
+    for (size_t i = 0; i < N; i++) {
+      if (nextRandom(seed) % 16 == 0) {
+        held[i] = !held[i];
+      }
+      inputs[p][i] = (held[i] ? 3900 : 3350) + nextRandom(seed) % 100;  // with noise, inside the hysteresis
+    }
+  }
+
+  {
+    std::vector<AnalogThresholdFilter *> filters;
+    for (size_t i = 0; i < N; i++) {
+      filters.push_back(new AnalogThresholdFilter(BenchTimer, false, kRising, kFalling, kFilterUs));
+    }
+    uint32_t edges = 0;
+    uint64_t startUs = BenchTimer.read_high_resolution_us();
+    for (size_t loop = 0; loop < kLoops; loop++) {
+      for (size_t i = 0; i < N; i++) {
+        edges += countEdge(filters[i]->update(inputs[loop % kPatterns][i]));
+      }
+    }
+    report("analog", "timer_per_filter", N, BenchTimer.read_high_resolution_us() - startUs, edges);
+    for (AnalogThresholdFilter *filter : filters) {
+      delete filter;
+    }
+  }
+
+  uint32_t sharedEdges = 0;
+  {
+    std::vector<AnalogThresholdFilter *> filters;
+    for (size_t i = 0; i < N; i++) {
+      filters.push_back(new AnalogThresholdFilter(BenchTimer, false, kRising, kFalling, kFilterUs));
+    }
+    uint64_t startUs = BenchTimer.read_high_resolution_us();
+    for (size_t loop = 0; loop < kLoops; loop++) {
+      uint32_t nowUs = loop * kLoopUs;
+      for (size_t i = 0; i < N; i++) {
+        sharedEdges += countEdge(filters[i]->update(inputs[loop % kPatterns][i], nowUs));
+      }
+    }
+    report("analog", "shared_timestamp", N, BenchTimer.read_high_resolution_us() - startUs, sharedEdges);
+    for (AnalogThresholdFilter *filter : filters) {
+      delete filter;
+    }
+  }
+
+  {
+    AnalogThresholdFilterBank<N, kRising, kFalling, kFilterUs> bank(false);
+    AnalogThresholdFilter::State states[N];
+    uint32_t edges = 0;
+    uint64_t startUs = BenchTimer.read_high_resolution_us();
+    for (size_t loop = 0; loop < kLoops; loop++) {
+      bank.update(inputs[loop % kPatterns], loop * kLoopUs, states);
+      for (size_t i = 0; i < N; i++) {
+        edges += countEdge(states[i]);
+      }
+    }
+    report("analog", "bank", N, BenchTimer.read_high_resolution_us() - startUs, edges);
+    if (edges != sharedEdges) {
+      fprintf(stderr, "analog bank of %u: %u edges, separate filters %u\n", (unsigned)N, edges, sharedEdges);
+      Failed = true;
+    }
+  }
+}
+
+int main() {
+  BenchTimer.start();
+  benchDigital<4>();
+  benchDigital<16>();
+  benchDigital<64>();
+  benchAnalog<1>();
+  benchAnalog<4>();
+  benchAnalog<16>();
+  benchAnalog<64>();
+  return Failed ? 1 : 0;
+}
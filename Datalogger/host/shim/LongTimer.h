@@ -0,0 +1,20 @@
+// Host stand-in for LongTimer.h from calsol-fw-libs, see ../README.md
+//
+// Only the wrapping time comparison the filters use.
+
+#ifndef _LONG_TIMER_H_
+#define _LONG_TIMER_H_
+
+#include <stdint.h>
+
+class LongTimer {
+public:
+  /**
+   * Returns whether the 32-bit microsecond time nowUs is at or past deadlineUs, across wraparound
+   */
+  static bool timePast(uint32_t nowUs, uint32_t deadlineUs) {
+    return (int32_t)(nowUs - deadlineUs) >= 0;
+  }
+};
+
+#endif
@@ -2,6 +2,10 @@
 
 #include <SDBlockDevice.h>
 #include <FATFileSystem.h>
+#include <TimingBlockDevice.h>
+#include <BufferedBlockDevice.h>
+#include <MBRBlockDevice.h>
+#include <SegmentLog.h>
 
 #define DEBUG_ENABLED
 #include "debug.h"
@@ -19,13 +23,15 @@
 #include "Histogram.h"
 #include "MovingAverage.h"
 #include "DmaSerial.h"
-#include "DigitalFilter.h"
-#include "AnalogThresholdFilter.h"
+#include "DigitalFilterBank.h"
+#include "AnalogThresholdFilterBank.h"
 #include "EInk.h"
-#include "DefaultFonts.h"
+#include "AsyncEInkRefresh.h"
+#include "SpiBus.h"
 
 #include "datalogger/datalogger.pb.h"
 #include "RecordEncoding.h"
+#include "SourceDescriptor.h"
 
 #include <locale>
 
@@ -53,10 +59,21 @@ LongTimer Timestamp(UsTimer);
 CAN Can(P1_8, P1_7, CAN_FREQUENCY);
 CANTimestampedRxBuffer<128> CanBuffer(Can, Timestamp);
 
-DigitalIn SdCd(P0_9);
-DigitalFilter SdCdFilter(UsTimer, true, 250 * 1000, 25 * 1000);
-SDBlockDevice Sd(P1_1, P0_10, P0_18, P0_7, 15000000);
+DigitalIn SdCd(P0_9);  // debounced in InputFilters
+SDBlockDevice Sd(P1_1, P0_10, P0_18, P0_7, 50000000, true);  // clock is an upper limit, CRC16 runs on the CRC engine
+TimingBlockDevice SdTiming(&Sd);  // below the cache, so latency records see the coalesced programs
+BufferedBlockDevice SdCache(&SdTiming, 8, 4);  // absorbs FAT / directory rewrites, coalesces data sectors, reads ahead
+const uint32_t kSdStallReportUs = 100 * 1000;  // program latency above this is also logged as an info record
+const uint32_t kSdFreeMapSectorsPerLoop = 4;  // FAT sectors scanned into the free cluster map per main loop
+const uint32_t kSdTrimAheadBytes = 64 * 1024;  // largest piece trimmed ahead of the log per main loop
+const uint32_t kSdLowSpaceMb = 256;  // free space below this is logged as an info record after mount
 FATFileSystem Fat("fs");
+// Cards partitioned with a small FAT partition 1 (for configuration) and a raw partition 2 of
+// kSdLogPartitionType log to a SegmentLog on partition 2 instead, without the FAT bookkeeping.
+// The log programs whole blocks sequentially, so it bypasses the cache.
+MBRBlockDevice SdLogPartition(&SdTiming, 2);
+SegmentLog SdLog;
+const uint8_t kSdLogPartitionType = 0xDA;  // non-FS data
 DataloggerProtoFile Datalogger(Fat);
 
 
@@ -64,6 +81,7 @@ DataloggerProtoFile Datalogger(Fat);
 // Sensors
 //
 SPI SpiAux(P0_2, P0_3, P0_1);
+SpiBus SpiAuxBus(SpiAux);  // shared by the RTC and E-Ink display
 DigitalOut RtcCs(P0_29);
 PCF2129 Rtc(SpiAux, RtcCs);
 
@@ -73,7 +91,8 @@ AnalogIn AdcSupercap(P0_4);
 TempSensor AdcTempSensor;
 BandgapReference AdcBandgap;
 
-AnalogThresholdFilter MountDismountFilter(UsTimer, false, 3750, 3500, 25 * 1000, 250 * 1000);  // mV thresholds
+// supercap voltage as channel 0, mV thresholds
+AnalogThresholdFilterBank<1, 3750, 3500, 25 * 1000, 250 * 1000> MountDismountFilter(false);
 
 
 //
@@ -85,6 +104,7 @@ TimerTicker VoltageSaveTicker(kVoltageWritePeriod_us, UsTimer);
 TimerTicker heartbeatTicker(1 * 1000 * 1000, UsTimer);
 TimerTicker CanCheckTicker(1 * 1000 * 1000, UsTimer);
 TimerTicker FileSyncTicker(5 * 60 * 1000 * 1000, UsTimer);
+TimerTicker FileCheckpointTicker(5 * 1000 * 1000, UsTimer);  // bounds data lost on power loss, between syncs
 TimerTicker RemountTicker(250 * 1000, UsTimer);
 TimerTicker UndismountTicker(10 * 1000 * 1000, UsTimer);
 
@@ -98,13 +118,24 @@ DigitalOut EInkReset(P0_0, 0);
 DigitalOut EInkDc(P0_31, 1);
 DigitalOut EInkCs(P1_0, 1);
 
-//EInk152Graphics EInk(SpiAux, EInkCs, EInkDc, EInkReset, EInkBusy);
+const uint16_t kEInkWidth = 152, kEInkHeight = 152;  // the EInk152Graphics panel
+EInk152Graphics EInk(SpiAux, EInkCs, EInkDc, EInkReset, EInkBusy);  // only brings up the panel
+AsyncEInkRefreshBuffer<kEInkWidth, kEInkHeight> EInkRefresh(SpiAuxBus, EInkCs, EInkDc, EInkBusy);
 
 DigitalIn SdSwitch(P0_11, PullUp);
-DigitalFilter Sw1Filter(UsTimer, true, 250*1000);
-
 DigitalIn CanSwitch(P1_4, PullUp);
-DigitalFilter SwResetFilter(UsTimer, true, 1000*1000);
+
+// Debounced digital inputs, all updated from one timestamp per loop
+enum DebouncedInput {
+  kInputSdCd = 0,
+  kInputSw1,
+  kInputSwReset,
+  kNumDebouncedInputs
+};
+DigitalFilterBank<kNumDebouncedInputs> InputFilters(
+    {true, true, true},
+    {250 * 1000, 250 * 1000, 1000 * 1000},  // rise delays
+    {25 * 1000, 250 * 1000, 1000 * 1000});  // fall delays
 
 DigitalOut SystemLedR(P1_6), SystemLedG(P0_17), SystemLedB(P1_11);
 RgbActivityDigitalOut MainStatusLed(UsTimer, SystemLedR, SystemLedG, SystemLedB, false);
@@ -132,11 +163,72 @@ enum SourceId {
   kVoltage5v,
   kVoltageSupercap,
 
-  kTemperatureChip = 40
+  kTemperatureChip = 40,
+
+  kSdRead = 50,
+  kSdProgram,
+};
+
+static uint16_t sample12v() {
+  return Adc12V.read_u16() >> 4;
+}
+
+static uint16_t sample5v() {
+  return Adc5v.read_u16() >> 4;
+}
+
+static uint16_t sampleSupercap() {
+  return AdcSupercap.read_u16() >> 4;
+}
+
+static uint16_t sampleTemperature() {
+  return AdcTempSensor.read_u16() >> 4;
+}
+
+// All datalogger sources, in header order. Analog channels are sampled and converted in table order.
+// The precision 3v reference is more accurate than the internal bandgap, so analog channels are
+// converted relative to that.
+constexpr SourceDescriptor kSources[] = {
+  {kSystem, SourceDef_SourceType_UNKNOWN, "System"},
+  {kMainLoop, SourceDef_SourceType_UNKNOWN, "Main loop, ms"},
+  {kCan, SourceDef_SourceType_CAN, "CAN"},
+  {kRtc, SourceDef_SourceType_TIME, "PCF2129 RTC"},
+  {kVoltageBandgap, SourceDef_SourceType_VOLTAGE, "Vref+, bandgap, mV"},
+  {kVoltage12v, SourceDef_SourceType_VOLTAGE, "12v, Vref+, mV",
+      &sample12v, 0, fixedRatioQ32(47+15, 15 * 4095)},
+  {kVoltage5v, SourceDef_SourceType_VOLTAGE, "5v, Vref+, mV",
+      &sample5v, 0, fixedRatioQ32(10+15, 15 * 4095)},
+  {kVoltageSupercap, SourceDef_SourceType_VOLTAGE, "Supercap, Vref+, mV",
+      &sampleSupercap, 0, fixedRatioQ32(10+15, 15 * 4095)},
+  {kTemperatureChip, SourceDef_SourceType_TEMPERATURE, "LPC1549 temperature, milliC",
+      &sampleTemperature, roundedRatio(577 * 1000 * 100, 229), fixedRatioQ32(-1000 * 100, 229 * 4095)},  // -2.29mV/C, 577.3mV @ 0C
+  {kSdRead, SourceDef_SourceType_UNKNOWN, "SD read latency, us"},
+  {kSdProgram, SourceDef_SourceType_UNKNOWN, "SD program latency, us"},
 };
+constexpr size_t kNumAnalogSources = countAnalogSources(kSources);
+constexpr size_t kAnalog12vIndex = analogSourceIndex(kSources, kVoltage12v);
+constexpr size_t kAnalog5vIndex = analogSourceIndex(kSources, kVoltage5v);
+constexpr size_t kAnalogSupercapIndex = analogSourceIndex(kSources, kVoltageSupercap);
+constexpr size_t kAnalogTemperatureIndex = analogSourceIndex(kSources, kTemperatureChip);
+
+// Log files, as DataloggerFile streams. CAN traffic goes to its own file, so that the main file with
+// the system and sensor records stays small and the tools can read it without going through the CAN
+// traffic. Each file claims its own extents as it grows, so the two don't interleave on the card.
+// Closing a file gives back the rest of its extent, but a power loss before that leaves up to an
+// extent (4.25 MiB for both) allocated past the file ends, until the card is checked on a computer.
+enum DataloggerStream {
+  kMainStream = 0,
+  kCanStream,
+};
+const uint32_t kMainStreamExtentBytes = 256 * 1024;
+const uint32_t kCanStreamExtentBytes = 4 * 1024 * 1024;
+
+static size_t sourceStream(uint8_t sourceId) {
+  return sourceId == kCan ? kCanStream : kMainStream;
+}
 
 
-void writeHeader(DataloggerProtoFile& datalogger) {
+void writeHeader(DataloggerProtoFile& datalogger, size_t stream) {
   DataloggerRecord rec = {
     0,
     0,
@@ -146,72 +238,11 @@ void writeHeader(DataloggerProtoFile& datalogger) {
   rec.payload.info = InfoString {
     "Datalogger Rv B, " __DATE__ " " __TIME__ " " COMPILERNAME
     };
-  datalogger.write(rec);
-
-  rec.which_payload = DataloggerRecord_sourceDef_tag;
-
-  rec.sourceId = kSystem;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_UNKNOWN,
-    "System"
-  };
-  datalogger.write(rec);
-
-  rec.sourceId = kMainLoop;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_UNKNOWN,
-    "Main loop, ms"
-  };
-  datalogger.write(rec);
+  datalogger.write(rec, stream);
 
-  rec.sourceId = kCan;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_CAN,
-    "CAN"
-  };
-  datalogger.write(rec);
-
-  rec.sourceId = kRtc;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_TIME,
-    "PCF2129 RTC"
-  };
-  datalogger.write(rec);
-
-  rec.sourceId = kVoltageBandgap;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_VOLTAGE,
-    "Vref+, bandgap, mV"
-  };
-  datalogger.write(rec);
-
-  rec.sourceId = kVoltage12v;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_VOLTAGE,
-    "12v, Vref+, mV"
-  };
-  datalogger.write(rec);
-
-  rec.sourceId = kVoltage5v;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_VOLTAGE,
-    "5v, Vref+, mV"
-  };
-  datalogger.write(rec);
-
-  rec.sourceId = kVoltageSupercap;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_VOLTAGE,
-    "Supercap, Vref+, mV"
-  };
-  datalogger.write(rec);
-
-  rec.sourceId = kTemperatureChip;
-  rec.payload.sourceDef = SourceDef {
-    SourceDef_SourceType_TEMPERATURE,
-    "LPC1549 temperature, milliC"
-  };
-  datalogger.write(rec);
+  for (const SourceDescriptor& source : kSources) {
+    datalogger.write(generateSourceDefRecord(source.sourceId, source.type, source.name), stream);
+  }
 }
 
 enum DataloggerState {
@@ -242,6 +273,16 @@ static bool itoaFixed(char* dst, uint32_t val, size_t len) {
   return true;
 }
 
+// Updates the status LEDs and streams the display refresh, from the main loop and while the SD card is busy.
+// Must not touch the SD card, since the busy wait holds its SPI bus.
+static void pollIndicators() {
+  MainStatusLed.update();
+  CanStatusLed.update();
+  SdStatusLed.update();
+  EInkRefresh.poll();
+  SpiAuxBus.poll();
+}
+
 static void tmDateToStr(char* dst, const tm time) {
   itoaFixed(dst, time.tm_year + 1900, 4);
   itoaFixed(dst + 4, time.tm_mon + 1, 2);
@@ -255,11 +296,40 @@ static void tmMinToStr(char* dst, const tm time) {
   dst[4] = '\0';
 }
 
-bool mountSd(bool wasWdtReset, uint32_t sdInsertedTimestamp,
-    SDBlockDevice& sd, FATFileSystem &fat, DataloggerProtoFile& datalogger) {
+// Mounts the raw log partition if the card has one, formatting it on first use.
+// Returns false if records should go to the FAT volume instead.
+static bool mountSdLog(MBRBlockDevice& partition, SegmentLog& log) {
+  if (partition.init()) {
+    return false;  // no partition table, or no partition 2
+  }
+  if (partition.get_partition_type() != kSdLogPartitionType) {
+    partition.deinit();
+    return false;
+  }
+  int result = log.mount(&partition);
+  if (result == -EINVAL) {
+    debugInfo("Formatting raw log partition");
+    result = SegmentLog::format(&partition);
+    if (!result) {
+      result = log.mount(&partition);
+    }
+  }
+  if (result) {
+    debugWarn("Raw log mount failed: %i", result);
+    partition.deinit();
+    return false;
+  }
+  return true;
+}
+
+// Mounts the card through sd, the stack above card, logging to the raw log partition if it has one.
+bool mountSd(bool wasWdtReset, uint32_t sdInsertedTimestamp, SDBlockDevice& card, BlockDevice& sd,
+    FATFileSystem &fat, MBRBlockDevice& logPartition, SegmentLog& log, DataloggerProtoFile& datalogger) {
   tm time;
   uint32_t rtcTimestamp = Timestamp.read_ms();
+  SpiAuxBus.flush();  // finish any in-progress display slice before the RTC driver takes the bus
   bool timeGood = Rtc.gettime(&time);
+  SpiAuxBus.invalidate();  // RTC driver sets its own SPI frequency
 
   debugInfo("RTC %s %04d-%02d-%02d %02d:%02d:%02d", timeGood ? "OK" : "Stopped",
       time.tm_year + 1900, time.tm_mon + 1, time.tm_mday,
@@ -270,14 +340,20 @@ bool mountSd(bool wasWdtReset, uint32_t sdInsertedTimestamp,
   tmMinToStr(filename, time);
 
   bool openSuccess = true;
+  uint32_t sdInitStartUs = Timestamp.read_short_us();
   int sdInitResult = sd.init();
+  uint32_t sdInitUs = Timestamp.read_short_us() - sdInitStartUs;
+  bool sdWarm = card.card_unchanged();  // same card as the last init, so the FAT volume is likely where it was
   if (sdInitResult) {
     debugInfo("SD init failed: %i", sdInitResult);
     sd.deinit();
     openSuccess = false;
   }
+  uint32_t fatMountUs = 0;
   if (openSuccess) {
-    int fatMountResult = fat.mount(&sd);
+    uint32_t fatMountStartUs = Timestamp.read_short_us();
+    int fatMountResult = sdWarm ? fat.warm_mount(&sd) : fat.mount(&sd);
+    fatMountUs = Timestamp.read_short_us() - fatMountStartUs;
     if (fatMountResult) {
       debugInfo("FAT mount failed: %i", fatMountResult);
       fat.unmount();
@@ -285,11 +361,17 @@ bool mountSd(bool wasWdtReset, uint32_t sdInsertedTimestamp,
       openSuccess = false;
     }
   }
+  bool rawLog = false;
   if (openSuccess) {
+    rawLog = mountSdLog(logPartition, log);
+    datalogger.setSegmentLog(rawLog ? &log : NULL);
+
     bool newfileResult = datalogger.newFile(dirname, filename);
     if (!newfileResult) {
       debugInfo("New file failed: %i", newfileResult);
       openSuccess = false;
+      log.unmount();
+      logPartition.deinit();
       fat.unmount();
       sd.deinit();
     }
@@ -298,7 +380,13 @@ bool mountSd(bool wasWdtReset, uint32_t sdInsertedTimestamp,
   uint32_t initTimestamp = Timestamp.read_ms();
 
   if (openSuccess) {
-    writeHeader(datalogger);
+    // each file can be decoded on its own, and its timestamps placed in time
+    for (size_t stream=0; stream<DataloggerProtoFile::kMaxStreams; stream++) {
+      if (stream == kMainStream || datalogger.isStreamOpen(stream)) {
+        writeHeader(datalogger, stream);
+        datalogger.write(timeToRecord(time, kRtc, rtcTimestamp), stream);
+      }
+    }
 
     if (wasWdtReset) {
       datalogger.write(generateInfoRecord("WDT Reset", kSystem, 0));
@@ -306,13 +394,27 @@ bool mountSd(bool wasWdtReset, uint32_t sdInsertedTimestamp,
 
     datalogger.write(generateInfoRecord("SD inserted", kSystem, sdInsertedTimestamp));
 
-    datalogger.write(timeToRecord(time, kRtc, rtcTimestamp));
     if (!timeGood) {
       datalogger.write(generateInfoRecord("RTC stopped", kRtc, rtcTimestamp));
     }
 
     datalogger.write(generateInfoRecord("FS mounted", kSystem, initTimestamp));
 
+    // records are lost from insertion (after the card detect debounce) until here, including failed attempts
+    char mountInfoBuffer[128];
+    sprintf(mountInfoBuffer, "Insert to first record %lu ms, %s card init %lu us, mount %lu us, SD clock %lu kHz",
+        initTimestamp - sdInsertedTimestamp, sdWarm ? "known" : "new", sdInitUs, fatMountUs,
+        card.get_transfer_frequency() / 1000);
+    datalogger.write(generateInfoRecord(mountInfoBuffer, kSystem, initTimestamp));
+    debugInfo("%s", mountInfoBuffer);
+
+    if (rawLog) {
+      sprintf(mountInfoBuffer, "Raw log stream %lu, segment sequence %lu, %lu segments",
+          log.get_stream(), log.get_sequence(), log.get_segment_count());
+      datalogger.write(generateInfoRecord(mountInfoBuffer, kSystem, initTimestamp));
+      debugInfo("%s", mountInfoBuffer);
+    }
+
     datalogger.syncFile();
 
     return true;
@@ -321,6 +423,15 @@ bool mountSd(bool wasWdtReset, uint32_t sdInsertedTimestamp,
   }
 }
 
+// Closes the log file and releases the card, dropping cached sectors so they can't be written to the next card
+static void dismountSd() {
+  Datalogger.closeFile();
+  SdLog.unmount();
+  SdLogPartition.deinit();
+  Fat.unmount();
+  SdCache.deinit();
+}
+
 int main() {
   // disable the reset pin, to avoid accidental resets from EMI
   uint32_t* PINENABLE = (uint32_t*)0x400381C4;
@@ -333,6 +444,7 @@ int main() {
   debugInfo("\r\n\r\n\r\n");
   debugInfo("Datalogger 2");
   debugInfo("Built " __DATE__ " " __TIME__ " " COMPILERNAME);
+  debugInfo("CRC-32 %s", Crc32::usesHardware() ? "hardware" : "software (CRC engine self-test failed)");
   if (wasWdtReset) {
     debugWarn("WDT Reset");
   }
@@ -351,12 +463,11 @@ int main() {
 
   uint16_t numMountAttempts = 0;
   uint32_t sdInsertedTimestamp;
+  bool sdFreeSpaceChecked = false;
+  bool sdTrimAhead = true;
 
   StatisticalCounter<uint16_t, uint64_t> vrefpStats;
-  StatisticalCounter<uint16_t, uint64_t> rail12vStats;
-  StatisticalCounter<uint16_t, uint64_t> rail5vStats;
-  StatisticalCounter<uint16_t, uint64_t> railSupercapStats;
-  StatisticalCounter<int32_t, int64_t> tempStats;
+  StatisticalCounter<int32_t, int64_t> analogStats[kNumAnalogSources];  // in kSources analog channel order
   StatisticalCounter<uint32_t, uint64_t> loopStats;
 
   // Histogram buckets in us
@@ -366,24 +477,29 @@ int main() {
 
   UsTimer.start();
   Wdt.enable();
-//  EInk.init();
+  EInk.init();
+  SpiAuxBus.invalidate();  // graphics library configures the SPI itself
 
-//  EInk.text(0, 0, "DATALOGGER", Font5x7, 255);
+  EInkRefresh.text(0, 0, "DATALOGGER");
 
   char strBuf[128] = __DATE__ " " __TIME__;
   for (char* buildStrPtr = strBuf; *buildStrPtr != '\0'; buildStrPtr++) {
     *buildStrPtr = std::toupper(*buildStrPtr);
   }
-//  EInk.text(0, 8, strBuf, Font3x5, 255);
+  EInkRefresh.text(0, 8, strBuf);
 
   sprintf(strBuf, "ON %02d %02d %02d %02d:%02d:%02d  %s",
       (time.tm_year + 1900) % 100, time.tm_mon + 1, time.tm_mday,
       time.tm_hour, time.tm_min, time.tm_sec,
       timeGood ? "OK" : "STP");
-//  EInk.text(0, 16, strBuf, Font5x7, 255);
+  EInkRefresh.text(0, 16, strBuf);
 
-//  EInk.update();
+  EInkRefresh.requestRefresh(0, EInkRefresh.height());  // the whole panel, over what init() left on it
 
+  Sd.attach_busy_wait(pollIndicators);  // keep the LEDs and display going through card programming stalls
+
+  Datalogger.setStream(kMainStream, NULL, kMainStreamExtentBytes);
+  Datalogger.setStream(kCanStream, "CAN", kCanStreamExtentBytes);
 
   while (true) {
     uint32_t loopStartTime = Timestamp.read_short_us();
@@ -391,23 +507,32 @@ int main() {
     /** Feed the watchdog timer so the board doesn't reset */
     Wdt.feed();
     Timestamp.update();
+    uint32_t filterTimeUs = UsTimer.read_us();  // shared timestamp for all filter updates this loop
+    bool inputValues[kNumDebouncedInputs];
+    inputValues[kInputSdCd] = SdCd;
+    inputValues[kInputSw1] = SdSwitch;
+    inputValues[kInputSwReset] = CanSwitch;
+    DigitalFilter::State inputStates[kNumDebouncedInputs];
+    InputFilters.update(inputValues, filterTimeUs, inputStates);
 
     // Control reset switch in software to allow aggressive filtering
-    if (SwResetFilter.update(CanSwitch) == DigitalFilter::kFalling) {
+    if (inputStates[kInputSwReset] == DigitalFilter::kFalling) {
       // enable the reset pin to allow holding the system in reset
       *PINENABLE = *PINENABLE & ~(1 << 21);
       NVIC_SystemReset();
     }
-    bool sdSwitchPressed = Sw1Filter.update(SdSwitch) == DigitalFilter::kFalling;
-    SdCdFilter.update(SdCd);
+    bool sdSwitchPressed = inputStates[kInputSw1] == DigitalFilter::kFalling;
 
     if (state == kInactive || state == kUnsafeEject) {
-      if (!SdCdFilter.read()
-          && MountDismountFilter.read()) {  // card inserted
+      if (!InputFilters.read(kInputSdCd)
+          && MountDismountFilter.read(0)) {  // card inserted
         sdInsertedTimestamp = Timestamp.read_ms();
 
-        if (mountSd(wasWdtReset, sdInsertedTimestamp, Sd, Fat, Datalogger)) {
+        if (mountSd(wasWdtReset, sdInsertedTimestamp, Sd, SdCache, Fat, SdLogPartition, SdLog, Datalogger)) {
           FileSyncTicker.reset();
+          FileCheckpointTicker.reset();
+          sdFreeSpaceChecked = false;
+          sdTrimAhead = true;
 
           state = kActive;
           debugInfo("FSM -> kActive: successful mount");
@@ -422,13 +547,13 @@ int main() {
           MainStatusLed.setIdle(RgbActivity::kOff);
           SdStatusLed.setIdle(RgbActivity::kRed);
         }
-      } else if (!MountDismountFilter.read()) {  // voltage bad
+      } else if (!MountDismountFilter.read(0)) {  // voltage bad
         MainStatusLed.setIdle(RgbActivity::kPurple);
-      } else if (MountDismountFilter.read()) {  // voltage good, no SD card
+      } else if (MountDismountFilter.read(0)) {  // voltage good, no SD card
         MainStatusLed.setIdle(RgbActivity::kOff);
       }
     } else if (state == kBadCard) {
-      if (SdCdFilter.read() || !MountDismountFilter.read()) {  // disk ejected
+      if (InputFilters.read(kInputSdCd) || !MountDismountFilter.read(0)) {  // disk ejected
         state = kInactive;
         debugInfo("FSM -> kInactive: ejected / undervoltage");
         MainStatusLed.setIdle(RgbActivity::kOff);
@@ -436,8 +561,11 @@ int main() {
       } else if (RemountTicker.checkExpired()) {
         numMountAttempts++;
 
-        if (mountSd(wasWdtReset, sdInsertedTimestamp, Sd, Fat, Datalogger)) {
+        if (mountSd(wasWdtReset, sdInsertedTimestamp, Sd, SdCache, Fat, SdLogPartition, SdLog, Datalogger)) {
           FileSyncTicker.reset();
+          FileCheckpointTicker.reset();
+          sdFreeSpaceChecked = false;
+          sdTrimAhead = true;
 
           char remountInfoBuffer[128];
           sprintf(remountInfoBuffer, "%u unsuccessful mount attempts", numMountAttempts);
@@ -450,8 +578,8 @@ int main() {
         }
       }
     } else if (state == kActive) {
-      if (SdCdFilter.read()) {  // unsafe dismount
-        Datalogger.closeFile();
+      if (InputFilters.read(kInputSdCd)) {  // unsafe dismount
+        dismountSd();
 
         state = kUnsafeEject;
         debugInfo("FSM -> kUnsafeEject: unsafe dismount");
@@ -459,9 +587,7 @@ int main() {
         SdStatusLed.setIdle(RgbActivity::kRed);
       } else if (sdSwitchPressed) {  // user-requested dismount
         Datalogger.write(generateInfoRecord("User dismount", kSystem, Timestamp.read_ms()));
-        Datalogger.closeFile();
-        Fat.unmount();
-        Sd.deinit();
+        dismountSd();
 
         UndismountTicker.reset();
 
@@ -469,11 +595,9 @@ int main() {
         debugInfo("FSM -> kUserDismount: switch pressed");
         MainStatusLed.setIdle(RgbActivity::kBlue);
         SdStatusLed.setIdle(RgbActivity::kBlue);
-      } else if (!MountDismountFilter.read()) {  // undervoltage dismount
+      } else if (!MountDismountFilter.read(0)) {  // undervoltage dismount
         Datalogger.write(generateInfoRecord("Undervoltage dismount", kSystem, Timestamp.read_ms()));
-        Datalogger.closeFile();
-        Fat.unmount();
-        Sd.deinit();
+        dismountSd();
 
         state = kInactive;
         debugInfo("FSM -> kInactive: undervoltage");
@@ -481,7 +605,7 @@ int main() {
         SdStatusLed.setIdle(RgbActivity::kBlue);
       }
     } else if (state == kUserDismount) {
-      if (SdCdFilter.read()) {  // disk ejected
+      if (InputFilters.read(kInputSdCd)) {  // disk ejected
         state = kInactive;
         debugInfo("FSM -> kInactive: ejected");
         MainStatusLed.setIdle(RgbActivity::kOff);
@@ -504,51 +628,78 @@ int main() {
     if (state == kActive && FileSyncTicker.checkExpired()) {
       Datalogger.syncFile();
       SdStatusLed.pulse(RgbActivity::kWhite);
+      FileCheckpointTicker.reset();
+    } else if (state == kActive && FileCheckpointTicker.checkExpired()) {
+      Datalogger.checkpointFile();
+    }
+
+    if (state == kActive && !sdFreeSpaceChecked) {
+      // build the free cluster map a bit each loop, after which free space doesn't need a full FAT scan
+      int freeMapLeft = Fat.build_free_map(kSdFreeMapSectorsPerLoop);
+      struct statvfs sdStat;
+      if (freeMapLeft < 0) {
+        debugWarn("SD free map failed: %i", freeMapLeft);
+        sdFreeSpaceChecked = true;
+      } else if (freeMapLeft == 0 && Fat.statvfs("", &sdStat) == 0) {
+        uint32_t freeMb = (uint64_t)sdStat.f_bfree * sdStat.f_frsize / 1024 / 1024;
+        uint32_t totalMb = (uint64_t)sdStat.f_blocks * sdStat.f_frsize / 1024 / 1024;
+        char freeInfoBuffer[64];
+        sprintf(freeInfoBuffer, "SD free %lu / %lu MB", freeMb, totalMb);
+        Datalogger.write(generateInfoRecord(freeInfoBuffer, kSystem, Timestamp.read_ms()));
+        debugInfo("%s", freeInfoBuffer);
+        if (freeMb < kSdLowSpaceMb) {
+          Datalogger.write(generateInfoRecord("SD low space", kSystem, Timestamp.read_ms()));
+          debugWarn("SD low space");
+        }
+        sdFreeSpaceChecked = true;
+      }
     }
 
     if (VoltageSenseTicker.checkExpired()) {
       // Sample everything close together since the bandgap is used as a reference
+      uint32_t sampleTimeUs = UsTimer.read_us();  // the loop's filter timestamp is stale after the CAN and SD work
       uint16_t bandgapSample = AdcBandgap.read_u16() >> 4;
-      uint16_t rail12vSample = Adc12V.read_u16() >> 4;
-      uint16_t rail5vSample = Adc5v.read_u16() >> 4;
-      uint16_t railSupercapSample = AdcSupercap.read_u16() >> 4;
-      uint16_t tempVoltageSample = AdcTempSensor.read_u16() >> 4;
+      uint16_t analogSamples[kNumAnalogSources];
+      size_t analogIndex = 0;
+      for (const SourceDescriptor& source : kSources) {
+        if (source.sample != NULL) {
+          analogSamples[analogIndex++] = source.sample();
+        }
+      }
 
-      // Convert everything to mV
+      // Convert everything to mV (or the source's units)
       uint16_t vrefpSample = 905 * 4095 / bandgapSample;
-
-      // The precision 3v reference is more accurate than the internal bandgap,
-      // so log measurements according to that.
-      rail12vSample = (uint32_t)rail12vSample * vrefpSample * (47+15) / 15 / 4095;
-      rail5vSample = (uint32_t)rail5vSample * vrefpSample * (10+15) / 15 / 4095;
-      railSupercapSample = (uint32_t)railSupercapSample * vrefpSample * (10+15) / 15 / 4095;
-      tempVoltageSample = (uint32_t)tempVoltageSample * vrefpSample / 4095;  // convert to mV
-      int32_t tempSample = (577 - tempVoltageSample) * 1000 * 100 / 229;  // -2.29mV/C, 577.3mV @ 0C
-
       vrefpStats.addSample(vrefpSample);
-      rail12vStats.addSample(rail12vSample);
-      rail5vStats.addSample(rail5vSample);
-      railSupercapStats.addSample(railSupercapSample);
-      tempStats.addSample(tempSample);
 
-      MountDismountFilter.update(railSupercapSample);
+      int32_t analogValues[kNumAnalogSources];
+      analogIndex = 0;
+      for (const SourceDescriptor& source : kSources) {
+        if (source.sample != NULL) {
+          analogValues[analogIndex] = source.convert(analogSamples[analogIndex], vrefpSample);
+          analogStats[analogIndex].addSample(analogValues[analogIndex]);
+          analogIndex++;
+        }
+      }
+
+      MountDismountFilter.update(0, analogValues[kAnalogSupercapIndex], sampleTimeUs);
     }
 
-//    if (EInkTicker.checkExpired()) {
-//      EInk.rectFilled(0, 32, 152, 32, 0);
-//
-//      uint32_t timestampMs = Timestamp.read_ms();
-//      sprintf(strBuf, "UP %02dH  %02dM  %02dS",
-//          timestampMs / 1000 / 60 / 60, timestampMs / 1000 / 60 % 60, timestampMs / 1000 % 60);
-//      EInk.text(0, 32, strBuf, Font5x7, 255);
-//
-//      sprintf(strBuf, "+V:  %d %03d    5V:  %d %03d",
-//          vrefpStats.read().avg / 1000, vrefpStats.read().avg % 1000,
-//          rail5vStats.read().avg / 1000, rail5vStats.read().avg % 1000);
-//      EInk.text(0, 40, strBuf, Font5x7, 255);
-//
-//      EInk.update();
-//    }
+    if (EInkTicker.checkExpired()) {
+      EInkRefresh.clear(32, 16);
+
+      uint32_t timestampMs = Timestamp.read_ms();
+      sprintf(strBuf, "UP %02luH  %02luM  %02luS",
+          timestampMs / 1000 / 60 / 60, timestampMs / 1000 / 60 % 60, timestampMs / 1000 % 60);
+      EInkRefresh.text(0, 32, strBuf);
+
+      sprintf(strBuf, "+V:  %d %03d    5V:  %ld %03ld",
+          vrefpStats.read().avg / 1000, vrefpStats.read().avg % 1000,
+          analogStats[kAnalog5vIndex].read().avg / 1000, analogStats[kAnalog5vIndex].read().avg % 1000);
+      EInkRefresh.text(0, 40, strBuf);
+
+      // only the status lines changed, stream and refresh just those in the background
+      EInkRefresh.requestRefresh(32, 16);
+    }
 
     if (VoltageSaveTicker.checkExpired()) {
       uint32_t thisTimestamp = Timestamp.read_ms();
@@ -557,15 +708,14 @@ int main() {
         Datalogger.write(generateStatsRecord<uint16_t, uint64_t>(
             vrefpStats, kVoltageBandgap, thisTimestamp, kVoltageWritePeriod_us / 1000));
 
-        Datalogger.write(generateStatsRecord<uint16_t, uint64_t>(
-            rail12vStats, kVoltage12v, thisTimestamp, kVoltageWritePeriod_us / 1000));
-        Datalogger.write(generateStatsRecord<uint16_t, uint64_t>(
-            rail5vStats, kVoltage5v, thisTimestamp, kVoltageWritePeriod_us / 1000));
-        Datalogger.write(generateStatsRecord<uint16_t, uint64_t>(
-            railSupercapStats, kVoltageSupercap, thisTimestamp, kVoltageWritePeriod_us / 1000));
-
-        Datalogger.write(generateStatsRecord<int32_t, int64_t>(
-            tempStats, kTemperatureChip, thisTimestamp, kVoltageWritePeriod_us / 1000));
+        size_t analogIndex = 0;
+        for (const SourceDescriptor& source : kSources) {
+          if (source.sample != NULL) {
+            Datalogger.write(generateStatsRecord<int32_t, int64_t>(
+                analogStats[analogIndex], source.sourceId, thisTimestamp, kVoltageWritePeriod_us / 1000));
+            analogIndex++;
+          }
+        }
 
         Datalogger.write(generateStatsRecord<uint32_t, uint64_t>(
             loopStats, kMainLoop, thisTimestamp, kVoltageWritePeriod_us / 1000));
@@ -573,18 +723,56 @@ int main() {
         Datalogger.write(generateHistogramRecord<8>(
             loopDistribution, kMainLoop, thisTimestamp, kVoltageWritePeriod_us / 1000));
 
+        timing_bd_snapshot_t sdTiming;
+        SdTiming.get_snapshot(&sdTiming);
+        SdTiming.reset();
+        Datalogger.write(generateLatencyStatsRecord(
+            sdTiming.read, kSdRead, thisTimestamp, kVoltageWritePeriod_us / 1000));
+        Datalogger.write(generateLatencyStatsRecord(
+            sdTiming.program, kSdProgram, thisTimestamp, kVoltageWritePeriod_us / 1000));
+        Datalogger.write(generateLatencyHistogramRecord(
+            sdTiming.program, kSdProgram, thisTimestamp, kVoltageWritePeriod_us / 1000));
+        // programs return before the card is done (multiple blocks, and sd.DEFER_PROGRAM_BUSY), so the
+        // program latency misses most of a stall, which the card times against the program instead
+        bd_addr_t stallAddr = sdTiming.program.max_latency_addr;
+        bd_size_t stallSize = sdTiming.program.max_latency_size;
+        uint32_t stallUs = sdTiming.program.max_latency_us;
+        bd_addr_t busyAddr;
+        bd_size_t busySize;
+        uint32_t busyUs = Sd.take_max_program_busy(&busyAddr, &busySize);
+        if (busyUs > stallUs) {
+          stallAddr = busyAddr;
+          stallSize = busySize;
+          stallUs = busyUs;
+        }
+        if (stallUs >= kSdStallReportUs) {
+          char stallInfoBuffer[64];
+          sprintf(stallInfoBuffer, "Program stall %lu ms @ %08lx, %lu B, %lu B/s",
+              stallUs / 1000, (uint32_t)stallAddr, (uint32_t)stallSize, sdTiming.program_bytes_per_s);
+          Datalogger.write(generateInfoRecord(stallInfoBuffer, kSdProgram, thisTimestamp));
+        }
+
         SdStatusLed.pulse(RgbActivity::kYellow);
       }
 
-      debugInfo("ADCs: Vrp=%5dmv,  12v=%5dmv,  Sv=%5dmv,  Vsc=%5dmv, T=%2ldmc",
-          vrefpStats.read().avg, rail12vStats.read().avg, rail5vStats.read().avg, railSupercapStats.read().avg,
-          tempStats.read().avg);
+      debugInfo("ADCs: Vrp=%5dmv,  12v=%5ldmv,  Sv=%5ldmv,  Vsc=%5ldmv, T=%2ldmc",
+          vrefpStats.read().avg, analogStats[kAnalog12vIndex].read().avg, analogStats[kAnalog5vIndex].read().avg,
+          analogStats[kAnalogSupercapIndex].read().avg, analogStats[kAnalogTemperatureIndex].read().avg);
+
+      buffered_bd_stats_t sdCacheStats;
+      SdCache.get_stats(&sdCacheStats);
+      debugInfo("SD cache: wr %lu hit / %lu miss, %lu units in %lu programs, %lu evictions, %lu bypassed",
+          sdCacheStats.program_hits, sdCacheStats.program_misses,
+          sdCacheStats.programmed_units, sdCacheStats.programs, sdCacheStats.evictions, sdCacheStats.bypass_units);
+      debugInfo("SD cache: rd %lu hit / %lu miss, %lu read ahead, %lu used",
+          sdCacheStats.read_hits, sdCacheStats.read_misses,
+          sdCacheStats.read_ahead_units, sdCacheStats.read_ahead_hits);
+      SdCache.reset_stats();
 
-      rail12vStats.reset();
-      rail5vStats.reset();
-      railSupercapStats.reset();
       vrefpStats.reset();
-      tempStats.reset();
+      for (size_t i=0; i<kNumAnalogSources; i++) {
+        analogStats[i].reset();
+      }
 
       loopStats.reset();
       loopDistribution.reset();
@@ -613,7 +801,7 @@ int main() {
         CanStatusLed.pulse(RgbActivity::kRed);
 
         if (state == kActive) {
-          Datalogger.write(generateInfoRecord("CAN Reset", kCan, Timestamp.read_ms()));
+          Datalogger.write(generateInfoRecord("CAN Reset", kCan, Timestamp.read_ms()), sourceStream(kCan));
           SdStatusLed.pulse(RgbActivity::kCyan);
         }
       }
@@ -627,14 +815,29 @@ int main() {
         CanStatusLed.pulse(RgbActivity::kGreen);
       }
       if (state == kActive) {
-        Datalogger.write(canMessageToRecord(msg, kCan));
+        Datalogger.write(canMessageToRecord(msg, kCan), sourceStream(kCan));
         SdStatusLed.pulse(RgbActivity::kYellow);
       }
     }
 
-    MainStatusLed.update();
-    CanStatusLed.update();
-    SdStatusLed.update();
+    bool sdBusy = Sd.busy();  // also sees the end of the card's busy after a program, timing it to a loop
+    if (state == kActive && sdTrimAhead && !sdBusy) {
+      // the CAN buffer is drained, so spend the idle time letting the card erase the clusters the log
+      // file has claimed ahead of its write pointer, one small piece within an allocation unit per loop,
+      // but not while the card is still programming or erasing, since the trim would wait that out;
+      // the card erases in the background and busy() holds off the next piece until it is done
+      uint32_t trimPiece = Sd.get_allocation_unit_size();
+      if (trimPiece > kSdTrimAheadBytes) {
+        trimPiece = kSdTrimAheadBytes;
+      }
+      int trimLeft = Fat.trim_ahead(trimPiece);
+      if (trimLeft < 0) {
+        debugWarn("SD trim ahead failed: %i", trimLeft);
+        sdTrimAhead = false;  // until the next mount, the card may not support erase
+      }
+    }
+
+    pollIndicators();
 
     uint32_t loopTime = Timestamp.read_short_us() - loopStartTime;
     loopDistribution.addSample(loopTime);
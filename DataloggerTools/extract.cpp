@@ -0,0 +1,206 @@
+// Extracts the log files from a raw log partition written by the Datalogger.
+// See SegmentLog in lib/MbedSdFat/storage/segmentlog for the format.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "Crc32.h"
+
+static const size_t kBlockSize = 512;
+static const size_t kBlockPayload = kBlockSize - 12;
+static const uint8_t kSuperblockMagic[8] = {'S', 'E', 'G', 'L', 'O', 'G', 'S', 'B'};
+static const uint8_t kHeaderMagic[8] = {'S', 'E', 'G', 'L', 'O', 'G', 'H', 'D'};
+static const uint8_t kLogPartitionType = 0xDA;
+
+struct Segment {
+  uint32_t slot;
+  uint32_t sequence, stream, part;
+  std::string name;
+};
+
+static uint32_t readU32(const uint8_t* data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint16_t readU16(const uint8_t* data) {
+  return (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+}
+
+static bool readAt(FILE* in, uint64_t offset, uint8_t* buf, size_t len) {
+  return fseeko(in, offset, SEEK_SET) == 0 && fread(buf, 1, len, in) == len;
+}
+
+// Creates each directory along path, like mkdir -p of its dirname
+static void makeParentDirs(const std::string& path) {
+  for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+    mkdir(path.substr(0, pos).c_str(), 0777);
+  }
+}
+
+static bool fileExists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+int main(int argc, char** argv) {
+  const char* inFilename = NULL;
+  std::string outDir = ".";
+  bool listOnly = false;
+  for (int i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outDir = argv[++i];
+    } else if (strcmp(argv[i], "--list") == 0) {
+      listOnly = true;
+    } else if (inFilename == NULL) {
+      inFilename = argv[i];
+    } else {
+      inFilename = NULL;
+      break;
+    }
+  }
+  if (inFilename == NULL) {
+    fprintf(stderr, "usage: %s CARD.IMG [-o OUTDIR] [--list]\n", argv[0]);
+    return 2;
+  }
+
+  FILE* in = fopen(inFilename, "rb");
+  if (in == NULL) {
+    fprintf(stderr, "can't open %s\n", inFilename);
+    return 2;
+  }
+
+  // either an image of the log partition, or of the whole card, with the log partition in its MBR
+  uint8_t block[kBlockSize];
+  uint64_t base = 0;
+  if (!readAt(in, 0, block, sizeof(block))) {
+    fprintf(stderr, "can't read %s\n", inFilename);
+    return 2;
+  }
+  if (memcmp(block, kSuperblockMagic, sizeof(kSuperblockMagic)) != 0) {
+    bool found = false;
+    if (block[510] == 0x55 && block[511] == 0xaa) {
+      for (int i=0; i<4 && !found; i++) {
+        const uint8_t* entry = block + 446 + 16 * i;
+        if (entry[4] == kLogPartitionType) {
+          base = (uint64_t)readU32(entry + 8) * kBlockSize;
+          found = true;
+        }
+      }
+    }
+    if (!found || !readAt(in, base, block, sizeof(block))) {
+      fprintf(stderr, "no log partition (type 0x%02x) in %s\n", kLogPartitionType, inFilename);
+      return 2;
+    }
+  }
+
+  if (memcmp(block, kSuperblockMagic, sizeof(kSuperblockMagic)) != 0 || readU32(block + 8) != 1
+      || readU32(block + 12) != kBlockSize || readU32(block + 28) != Crc32::computeSoftware(0, block, 28)) {
+    fprintf(stderr, "no valid superblock at 0x%llx\n", (unsigned long long)base);
+    return 2;
+  }
+  uint32_t segmentSize = readU32(block + 16);
+  uint32_t segmentCount = readU32(block + 20);
+  uint8_t formatId[4];
+  memcpy(formatId, block + 24, sizeof(formatId));
+  uint32_t idCrc = Crc32::computeSoftware(0, formatId, sizeof(formatId));
+  printf("%u segments of %u bytes, format %u\n", segmentCount, segmentSize, readU32(formatId));
+
+  std::vector<Segment> segments;
+  for (uint32_t slot=1; slot<segmentCount; slot++) {
+    if (!readAt(in, base + (uint64_t)slot * segmentSize, block, sizeof(block))) {
+      break;  // image truncated
+    }
+    if (memcmp(block, kHeaderMagic, sizeof(kHeaderMagic)) == 0 && memcmp(block + 8, formatId, 4) == 0
+        && readU32(block + 56) == Crc32::computeSoftware(0, block, 56)) {
+      Segment segment;
+      segment.slot = slot;
+      segment.sequence = readU32(block + 12);
+      segment.stream = readU32(block + 16);
+      segment.part = readU32(block + 20);
+      block[55] = '\0';
+      segment.name = (const char*)block + 24;
+      segments.push_back(segment);
+    }
+  }
+  // oldest first, so each stream's segments are together and in order
+  std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) {
+    return a.sequence < b.sequence;
+  });
+
+  std::vector<uint8_t> data(segmentSize);
+  size_t numStreams = 0, numDamaged = 0;
+  size_t i = 0;
+  while (i < segments.size()) {
+    size_t end = i;
+    while (end < segments.size() && segments[end].stream == segments[i].stream) {
+      end++;
+    }
+    const Segment& first = segments[i];
+    numStreams++;
+
+    // files with the same name get a sequence suffix, like the Datalogger does on FAT
+    std::string path = outDir + "/" + first.name;
+    for (uint32_t seq = 1; !listOnly && fileExists(path); seq++) {
+      path = outDir + "/" + first.name + "_" + std::to_string(seq);
+    }
+    FILE* out = NULL;
+    if (!listOnly) {
+      makeParentDirs(path);
+      out = fopen(path.c_str(), "wb");
+      if (out == NULL) {
+        fprintf(stderr, "can't open %s: %s\n", path.c_str(), strerror(errno));
+        return 2;
+      }
+    }
+
+    uint64_t bytes = 0;
+    uint32_t expectedPart = first.part;
+    const char* damage = "";
+    for (size_t s=i; s<end; s++) {
+      if (segments[s].part != expectedPart) {
+        damage = ", segment missing";
+      }
+      expectedPart = segments[s].part + 1;
+      if (!readAt(in, base + (uint64_t)segments[s].slot * segmentSize, data.data(), segmentSize)) {
+        damage = ", image truncated";
+        break;
+      }
+      // data blocks up to the first one not written for this segment
+      for (size_t b=1; b<segmentSize / kBlockSize; b++) {
+        const uint8_t* blk = data.data() + b * kBlockSize;
+        const uint8_t* trailer = blk + kBlockPayload;
+        uint16_t used = readU16(trailer + 4);
+        if (readU32(trailer) != segments[s].sequence || readU16(trailer + 6) != b || used > kBlockPayload
+            || readU32(trailer + 8) != Crc32::computeSoftware(idCrc, blk, kBlockSize - 4)) {
+          break;
+        }
+        if (out != NULL) {
+          fwrite(blk, 1, used, out);
+        }
+        bytes += used;
+      }
+    }
+    if (*damage) {
+      numDamaged++;
+    }
+    // the oldest stream loses its start once the log wraps around, which is expected
+    printf("stream %u '%s' -> %s: %zu segments, %llu bytes%s%s\n", first.stream, first.name.c_str(),
+        listOnly ? "-" : path.c_str(), end - i, (unsigned long long)bytes,
+        first.part != 0 ? ", start overwritten" : "", damage);
+
+    if (out != NULL) {
+      fclose(out);
+    }
+    i = end;
+  }
+  fclose(in);
+  printf("%zu streams, %zu damaged\n", numStreams, numDamaged);
+  return numDamaged > 0 ? 1 : 0;
+}
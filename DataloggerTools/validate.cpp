@@ -0,0 +1,168 @@
+// Checks the checksum frames in a Datalogger log file and reports corrupt ranges.
+// See DataloggerProtoFile in Datalogger/DataloggerFile.h for the frame format.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Crc32.h"
+
+static const uint8_t kChecksumMagic[4] = {0x07, 'C', 'R', 'C'};
+static const size_t kChecksumPayloadLen = 12;
+
+// A COBS frame, from its leading zero delimiter up to the next delimiter (or end of file)
+struct Frame {
+  size_t start, end;
+  bool decodeOk;
+  std::vector<uint8_t> payload;
+};
+
+static bool cobsDecode(const uint8_t* data, size_t len, std::vector<uint8_t>& out) {
+  out.clear();
+  size_t pos = 0;
+  while (pos < len) {
+    uint8_t code = data[pos];
+    if (code == 0 || pos + code > len) {
+      return false;
+    }
+    out.insert(out.end(), data + pos + 1, data + pos + code);
+    pos += code;
+    if (code != 255 && pos < len) {
+      out.push_back(0);
+    }
+  }
+  return true;
+}
+
+static uint32_t readU32(const uint8_t* data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static bool isChecksumFrame(const Frame& frame) {
+  return frame.decodeOk && frame.payload.size() == kChecksumPayloadLen
+      && memcmp(frame.payload.data(), kChecksumMagic, sizeof(kChecksumMagic)) == 0;
+}
+
+static void copyFrames(FILE* out, const std::vector<uint8_t>& data, const std::vector<Frame>& frames,
+    size_t firstFrame, size_t endFrame) {
+  for (size_t i=firstFrame; i<endFrame; i++) {
+    if (out != NULL && !isChecksumFrame(frames[i])) {
+      fwrite(data.data() + frames[i].start, 1, frames[i].end - frames[i].start, out);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* inFilename = NULL;
+  const char* outFilename = NULL;
+  bool keepUnverified = false;
+  for (int i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outFilename = argv[++i];
+    } else if (strcmp(argv[i], "--keep-unverified") == 0) {
+      keepUnverified = true;
+    } else if (inFilename == NULL) {
+      inFilename = argv[i];
+    } else {
+      inFilename = NULL;
+      break;
+    }
+  }
+  if (inFilename == NULL) {
+    fprintf(stderr, "usage: %s LOG.BIN [-o CLEAN.BIN] [--keep-unverified]\n", argv[0]);
+    return 2;
+  }
+
+  FILE* in = fopen(inFilename, "rb");
+  if (in == NULL) {
+    fprintf(stderr, "can't open %s\n", inFilename);
+    return 2;
+  }
+  std::vector<uint8_t> data;
+  uint8_t readBuf[4096];
+  size_t readLen;
+  while ((readLen = fread(readBuf, 1, sizeof(readBuf), in)) > 0) {
+    data.insert(data.end(), readBuf, readBuf + readLen);
+  }
+  fclose(in);
+
+  FILE* out = NULL;
+  if (outFilename != NULL) {
+    out = fopen(outFilename, "wb");
+    if (out == NULL) {
+      fprintf(stderr, "can't open %s\n", outFilename);
+      return 2;
+    }
+  }
+
+  // split into frames at the zero delimiters
+  std::vector<Frame> frames;
+  size_t pos = 0;
+  if (!data.empty() && data[0] != 0) {
+    printf("corrupt 0x%08zx-", pos);
+    while (pos < data.size() && data[pos] != 0) {
+      pos++;
+    }
+    printf("0x%08zx: data before first frame delimiter\n", pos);
+  }
+  while (pos < data.size()) {
+    Frame frame;
+    frame.start = pos;
+    pos++;
+    while (pos < data.size() && data[pos] != 0) {
+      pos++;
+    }
+    frame.end = pos;
+    frame.decodeOk = cobsDecode(data.data() + frame.start + 1, frame.end - frame.start - 1, frame.payload);
+    frames.push_back(frame);
+  }
+
+  size_t numBlocks = 0, numCorruptBlocks = 0;
+  size_t blockStart = frames.empty() ? 0 : frames[0].start;
+  size_t blockFirstFrame = 0;
+  for (size_t i=0; i<frames.size(); i++) {
+    if (!isChecksumFrame(frames[i])) {
+      continue;
+    }
+    const Frame& checksumFrame = frames[i];
+    uint32_t blockLen = readU32(checksumFrame.payload.data() + 4);
+    uint32_t blockCrc = readU32(checksumFrame.payload.data() + 8);
+    numBlocks++;
+
+    const char* error = NULL;
+    if (checksumFrame.start - blockStart != blockLen) {
+      error = "block length mismatch";
+    } else if (Crc32::computeSoftware(0, data.data() + blockStart, blockLen) != blockCrc) {
+      error = "CRC mismatch";
+    }
+    if (error == NULL) {
+      copyFrames(out, data, frames, blockFirstFrame, i);
+    } else {
+      size_t badFrames = 0;
+      for (size_t j=blockFirstFrame; j<i; j++) {
+        if (!frames[j].decodeOk) {
+          badFrames++;
+        }
+      }
+      printf("corrupt 0x%08zx-0x%08zx: %s, %zu frames (%zu bad COBS)\n",
+          blockStart, checksumFrame.start, error, i - blockFirstFrame, badFrames);
+      numCorruptBlocks++;
+    }
+    blockStart = checksumFrame.end;
+    blockFirstFrame = i + 1;
+  }
+
+  if (blockFirstFrame < frames.size()) {
+    printf("unverified 0x%08zx-0x%08zx: %zu frames after the last checksum\n",
+        blockStart, data.size(), frames.size() - blockFirstFrame);
+    if (keepUnverified) {
+      copyFrames(out, data, frames, blockFirstFrame, frames.size());
+    }
+  }
+  printf("%zu blocks, %zu corrupt\n", numBlocks, numCorruptBlocks);
+
+  if (out != NULL) {
+    fclose(out);
+  }
+  return numCorruptBlocks > 0 ? 1 : 0;
+}
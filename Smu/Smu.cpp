@@ -15,6 +15,7 @@
 
 #include "ButtonGesture.h"
 
+#include "SpiBus.h"
 #include "Mcp3201.h"
 #include "Mcp4921.h"
 #include "SmuAnalogStage.h"
@@ -98,6 +99,7 @@ protected:
 // System
 //
 SPI SharedSpi(P0_3, P0_5, P0_6);  // mosi, miso, sclk
+SpiBus SharedSpiBus(SharedSpi);  // tracks per-device settings across the DACs, ADCs and LCD
 
 DigitalOut DacLdac(P0_0, 1);
 DigitalOut DacCurrNegCs(P0_1, 1);
@@ -114,7 +116,7 @@ Mcp4921 DacVolt(SharedSpi, DacVoltCs);
 DigitalOut EnableHigh(P0_15);  // Current source transistor enable
 DigitalOut EnableLow(P0_14);  // Current sink transistor enable
 
-SmuAnalogStage Smu(SharedSpi, DacVolt, DacCurrNeg, DacCurrPos, DacLdac, AdcVolt, AdcCurr, EnableHigh, EnableLow);
+SmuAnalogStage Smu(SharedSpiBus, DacVolt, DacCurrNeg, DacCurrPos, DacLdac, AdcVolt, AdcCurr, EnableHigh, EnableLow);
 
 
 InterruptIn PdInt(P0_17, PinMode::PullUp);
@@ -149,6 +151,7 @@ EepromProto<SmuConfig, SmuConfig_size + 1> NvConfig(SmuConfig_msg);
 // LCD and widgets
 //
 St7735sGraphics<160, 80, 1, 26> Lcd(SharedSpi, LcdCs, LcdRs, LcdReset);
+const SpiSettings kLcdSpiSettings = {10000000, 8, 0};
 TimerTicker MeasureTicker(50 * 1000, UsTimer);
 TimerTicker LcdUpdateTicker(100 * 1000, UsTimer);
 
@@ -287,6 +290,7 @@ int main() {
   UsTimer.start();
 
   Lcd.init();
+  SharedSpiBus.invalidate();  // graphics library configures the SPI itself
 
   SharedI2c.frequency(400000);
 
@@ -302,8 +306,6 @@ int main() {
   
   while (1) {
     if (MeasureTicker.checkExpired()) {  // limit the ADC read frequency to avoid impedance issues
-      SharedSpi.frequency(100000);
-    
       measMv = Smu.readVoltageMv(&measVoltAdc);
       widMeasV.setValue(measMv);
 
@@ -335,8 +337,8 @@ int main() {
       Lcd.clear();
       widMain.layout();
       widMain.draw(Lcd, 0, 0);
-      SharedSpi.frequency(10000000);
-      Lcd.update();
+      SharedSpiBus.configure(kLcdSpiSettings);
+      Lcd.update();  // the graphics library writes the whole frame synchronously, nothing is queued on the bus
     }
 
     bool voltageChanged = false;
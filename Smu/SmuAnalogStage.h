@@ -1,12 +1,13 @@
 #include "Mcp3201.h"
 #include "Mcp4921.h"
+#include "SpiBus.h"
 
 #ifndef __SMU_ANALOG_STAGE_H__
 #define __SMU_ANALOG_STAGE_H__
 
 class SmuAnalogStage {
 public:
-  SmuAnalogStage(SPI& sharedSpi,
+  SmuAnalogStage(SpiBus& sharedSpi,
       Mcp4921& dacVolt, Mcp4921& dacCurrNeg, Mcp4921& dacCurrPos, DigitalOut& dacLdac,
       Mcp3201& adcVolt, Mcp3201& adcCurr, DigitalOut& enableSource, DigitalOut& enableSink):
       sharedSpi_(sharedSpi),
@@ -20,7 +21,7 @@ public:
 
   // Reads the voltage ADC, returning millivolts (and optionally also the raw ADC counts)
   int32_t readVoltageMv(uint16_t* rawAdcOut = NULL) {
-    sharedSpi_.frequency(100000);  // TODO refactor into Mcp* classes
+    sharedSpi_.configure(adcSpiSettings_);
     uint16_t adcValue = adcVolt_.read_raw_u12();
     if (rawAdcOut != NULL) {
       *rawAdcOut = adcValue;
@@ -30,7 +31,7 @@ public:
 
   // Reads the current ADC, returning millivolts (and optionally also the raw ADC counts)
   int32_t readCurrentMa(uint16_t* rawAdcOut = NULL) {
-    sharedSpi_.frequency(100000);
+    sharedSpi_.configure(adcSpiSettings_);
     uint16_t adcValue = adcCurr_.read_raw_u12();
     if (rawAdcOut != NULL) {
       *rawAdcOut = adcValue;
@@ -78,9 +79,11 @@ public:
     enableSource_ = 0;
     enableSink_ = 0;
     if (dacToVoltage(targetVoltageDac_) >= readVoltageMv()) {  // likely will be sourcing current
+      sharedSpi_.configure(dacSpiSettings_);
       dacVolt_.write_u16(65535);  // command lowest voltage
       startSourceDriver_ = true;
     } else {  // likely will be sinking current
+      sharedSpi_.configure(dacSpiSettings_);
       dacVolt_.write_u16(0);  // command highest voltage
       startSourceDriver_ = false;
     }
@@ -179,7 +182,7 @@ public:
 
 protected:
   void writeVoltage(uint16_t dacValue) {
-    sharedSpi_.frequency(1000000);
+    sharedSpi_.configure(dacSpiSettings_);
     dacVolt_.write_raw_u12(dacValue);
     dacLdac_ = 1;
     wait_us(1);
@@ -187,7 +190,7 @@ protected:
   }
 
   void writeCurrentSource(uint16_t dacValue) {
-    sharedSpi_.frequency(1000000);
+    sharedSpi_.configure(dacSpiSettings_);
     dacCurrPos_.write_raw_u12(dacValue);
     dacLdac_ = 1;
     wait_us(1);
@@ -195,13 +198,18 @@ protected:
   }
 
   void writeCurrentSink(uint16_t dacValue) {
-    sharedSpi_.frequency(1000000);
+    sharedSpi_.configure(dacSpiSettings_);
     dacCurrNeg_.write_raw_u12(dacValue);
     dacLdac_ = 1;
     wait_us(1);
     dacLdac_ = 0;
   }
 
+  // SPI settings per device type, only applied when switching between devices on the shared bus.
+  // The ADC and DAC transfers are short and run synchronously, so they are not queued on the bus.
+  const SpiSettings adcSpiSettings_ = {100000, 8, 0};
+  const SpiSettings dacSpiSettings_ = {1000000, 8, 0};
+
   static const uint16_t kAdcCounts = 4095;
   static const uint16_t kDacCounts = 4095;
 
@@ -229,7 +237,7 @@ protected:
   uint16_t targetVoltageDac_ = voltageToDac(0);
   uint16_t targetCurrentSourceDac_ = currentToDac(100), targetCurrentSinkDac_ = currentToDac(-100);
 
-  SPI &sharedSpi_;
+  SpiBus &sharedSpi_;
 
   Mcp4921 &dacVolt_, &dacCurrNeg_, &dacCurrPos_;
   DigitalOut &dacLdac_;
@@ -139,6 +139,8 @@
 #if DEVICE_SPI
 
 #include "SDBlockDevice.h"
+#include "SDCardUtils.h"
+#include "cmsis.h"
 #include "rtos/ThisThread.h"
 #include "platform/mbed_debug.h"
 #ifndef __STDC_FORMAT_MACROS
@@ -146,6 +148,7 @@
 #endif
 #include <inttypes.h>
 #include <errno.h>
+#include <string.h>
 
 using namespace mbed;
 
@@ -161,12 +164,27 @@ using namespace mbed;
 #define MBED_CONF_SD_INIT_FREQUENCY              100000 /*!< Initialization frequency Range (100KHz-400KHz) */
 #endif
 
+#ifndef MBED_CONF_SD_WARM_INIT
+#define MBED_CONF_SD_WARM_INIT                   0      /*!< Skip identification of a card still initialized from the last init */
+#endif
+
+#ifndef MBED_CONF_SD_AUTO_FREQUENCY
+#define MBED_CONF_SD_AUTO_FREQUENCY              0      /*!< Select the highest transfer clock which passes CRC-checked reads */
+#endif
+
+#ifndef MBED_CONF_SD_DEFER_PROGRAM_BUSY
+#define MBED_CONF_SD_DEFER_PROGRAM_BUSY          0      /*!< Return from program before the card finishes programming */
+#endif
+
 
 #define SD_COMMAND_TIMEOUT                       MBED_CONF_SD_CMD_TIMEOUT
 #define SD_CMD0_GO_IDLE_STATE_RETRIES            MBED_CONF_SD_CMD0_IDLE_STATE_RETRIES
 #define SD_DBG                                   0      /*!< 1 - Enable debugging */
 #define SD_CMD_TRACE                             0      /*!< 1 - Enable SD command tracing */
 
+#define SD_AUTO_FREQUENCY_VERIFY_BLOCKS          8        /*!< Blocks read to verify a transfer clock */
+#define SD_AUTO_FREQUENCY_READ_RETRIES           2        /*!< Failed reads retried at a lower clock */
+
 #define SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK        -5001  /*!< operation would block */
 #define SD_BLOCK_DEVICE_ERROR_UNSUPPORTED        -5002  /*!< unsupported operation */
 #define SD_BLOCK_DEVICE_ERROR_PARAMETER          -5003  /*!< invalid parameter */
@@ -221,6 +239,7 @@ using namespace mbed;
 #define R2_OUT_OF_RANGE         (1 << 7)
 
 /* R3 Response : OCR Register */
+#define OCR_POWER_UP_STATUS     (0x1UL << 31)
 #define OCR_HCS_CCS             (0x1 << 30)
 #define OCR_LOW_VOLTAGE         (0x01 << 24)
 #define OCR_3_3V                (0x1 << 20)
@@ -252,11 +271,11 @@ const uint32_t SDBlockDevice::_block_size = BLOCK_SIZE_HC;
 #if MBED_CONF_SD_CRC_ENABLED
 SDBlockDevice::SDBlockDevice(PinName mosi, PinName miso, PinName sclk, PinName cs, uint64_t hz, bool crc_on)
     : _sectors(0), _spi(mosi, miso, sclk), _cs(cs), _is_initialized(0),
-      _init_ref_count(0), _crc_on(crc_on), _crc16(0, 0, false, false)
+      _init_ref_count(0), _cid_valid(false), _card_unchanged(false), _program_busy(false), _crc_on(crc_on)
 #else
 SDBlockDevice::SDBlockDevice(PinName mosi, PinName miso, PinName sclk, PinName cs, uint64_t hz, bool crc_on)
     : _sectors(0), _spi(mosi, miso, sclk), _cs(cs), _is_initialized(0),
-      _init_ref_count(0)
+      _init_ref_count(0), _cid_valid(false), _card_unchanged(false), _program_busy(false)
 #endif
 {
     _cs = 1;
@@ -267,18 +286,24 @@ SDBlockDevice::SDBlockDevice(PinName mosi, PinName miso, PinName sclk, PinName c
                        "Initialization frequency should be between 100KHz to 400KHz");
     _init_sck = MBED_CONF_SD_INIT_FREQUENCY;
     _transfer_sck = hz;
+    _max_transfer_sck = hz;
+    _high_speed = false;
 
     _erase_size = BLOCK_SIZE_HC;
+    _au_size = BLOCK_SIZE_HC;
+
+    _busy_size = 0;
+    _max_busy_us = 0;
 }
 
 #if MBED_CONF_SD_CRC_ENABLED
 SDBlockDevice::SDBlockDevice(const spi_pinmap_t &spi_pinmap, PinName cs, uint64_t hz, bool crc_on)
     : _sectors(0), _spi(spi_pinmap), _cs(cs), _is_initialized(0),
-      _init_ref_count(0), _crc_on(crc_on)
+      _init_ref_count(0), _cid_valid(false), _card_unchanged(false), _program_busy(false), _crc_on(crc_on)
 #else
 SDBlockDevice::SDBlockDevice(const spi_pinmap_t &spi_pinmap, PinName cs, uint64_t hz, bool crc_on)
     : _sectors(0), _spi(spi_pinmap), _cs(cs), _is_initialized(0),
-      _init_ref_count(0)
+      _init_ref_count(0), _cid_valid(false), _card_unchanged(false), _program_busy(false)
 #endif
 {
     _cs = 1;
@@ -289,8 +314,14 @@ SDBlockDevice::SDBlockDevice(const spi_pinmap_t &spi_pinmap, PinName cs, uint64_
                        "Initialization frequency should be between 100KHz to 400KHz");
     _init_sck = MBED_CONF_SD_INIT_FREQUENCY;
     _transfer_sck = hz;
+    _max_transfer_sck = hz;
+    _high_speed = false;
 
     _erase_size = BLOCK_SIZE_HC;
+    _au_size = BLOCK_SIZE_HC;
+
+    _busy_size = 0;
+    _max_busy_us = 0;
 }
 
 SDBlockDevice::~SDBlockDevice()
@@ -309,6 +340,7 @@ int SDBlockDevice::_initialise_card()
 
     // Initialize the SPI interface: Card by default is in SD mode
     _spi_init();
+    _high_speed = false;                        // CMD0 returns the card to default speed
 
     // The card is transitioned from SDCard mode to SPI mode by sending the CMD0 + CS Asserted("0")
     if (_go_idle_state() != R1_IDLE_STATE) {
@@ -366,6 +398,14 @@ int SDBlockDevice::_initialise_card()
         return status;
     }
 
+    // The identification clock limit no longer applies, so the remaining setup runs at the transfer clock,
+    // or at the lowest clock the automatic selection may pick, since the bus is not verified yet
+#if MBED_CONF_SD_AUTO_FREQUENCY
+    _spi.frequency(SD_AUTO_FREQUENCY_MIN);
+#else
+    _freq();
+#endif
+
     if (SDCARD_V2 == _card_type) {
         // Get the card capacity CCS: CMD58
         if (BD_ERROR_OK == (status = _cmd(CMD58_READ_OCR, 0x0, 0x0, &response))) {
@@ -411,6 +451,19 @@ int SDBlockDevice::init()
         goto end;
     }
 
+    _card_unchanged = false;
+    _busy_timer.start();
+    if (MBED_CONF_SD_WARM_INIT && _cid_valid && (BD_ERROR_OK == _warm_init_card())) {
+        debug_if(SD_DBG, "Warm init: card still initialized\n");
+        _card_type = _cid_card_type;
+        _sectors = _cid_sectors;
+        _erase_size = _cid_erase_size;
+        _au_size = _cid_au_size;
+        _card_unchanged = true;
+        _is_initialized = true;
+        goto end;
+    }
+
     err = _initialise_card();
     _is_initialized = (err == BD_ERROR_OK);
     if (!_is_initialized) {
@@ -419,7 +472,7 @@ int SDBlockDevice::init()
         return err;
     }
     debug_if(SD_DBG, "init card = %d\n", _is_initialized);
-    _sectors = _sd_sectors();
+    _sectors = _identify_card();
     // CMD9 failed
     if (0 == _sectors) {
         unlock();
@@ -433,8 +486,19 @@ int SDBlockDevice::init()
         return BD_ERROR_DEVICE_ERROR;
     }
 
+    // Bus speeds above the default speed mode need the card switched to high speed
+    if (_max_transfer_sck > SD_DEFAULT_SPEED_MAX_FREQUENCY) {
+        _high_speed = (BD_ERROR_OK == _switch_high_speed());
+        debug_if(SD_DBG, "High speed mode: %d\n", _high_speed);
+    }
+
     // Set SCK for data transfer
+#if MBED_CONF_SD_AUTO_FREQUENCY
+    err = _select_frequency();
+#else
+    _transfer_sck = _max_transfer_sck;
     err = _freq();
+#endif
     if (err) {
         unlock();
         return err;
@@ -460,6 +524,13 @@ int SDBlockDevice::deinit()
         goto end;
     }
 
+    // let a deferred program finish before the card may lose power
+    if (_program_busy) {
+        _select();
+        _wait_ready(SD_COMMAND_TIMEOUT);
+        _deselect();
+    }
+
     _is_initialized = false;
     _sectors = 0;
 
@@ -469,6 +540,70 @@ end:
 }
 
 
+int SDBlockDevice::sync()
+{
+    lock();
+    int status = BD_ERROR_OK;
+    if (_is_initialized && _program_busy) {
+        _select();
+        if (false == _wait_ready(SD_COMMAND_TIMEOUT)) {
+            debug_if(SD_DBG, "Card still programming\n");
+            status = SD_BLOCK_DEVICE_ERROR_WRITE;
+        }
+        _deselect();
+    }
+    unlock();
+    return status;
+}
+
+bool SDBlockDevice::busy()
+{
+    lock();
+    if (_is_initialized && _program_busy) {
+        _select();
+        _program_busy = (_spi.write(SPI_FILL_CHAR) != 0xFF);
+        _deselect();
+        if (!_program_busy) {
+            _program_done();
+        }
+    }
+    bool busy = _program_busy;
+    unlock();
+    return busy;
+}
+
+uint32_t SDBlockDevice::take_max_program_busy(bd_addr_t *addr, bd_size_t *size)
+{
+    lock();
+    uint32_t busy_us = _max_busy_us;
+    *addr = _max_busy_addr;
+    *size = _max_busy_size;
+    _max_busy_us = 0;
+    unlock();
+    return busy_us;
+}
+
+// Charges the time the card stayed busy to the program which returned before it was done
+void SDBlockDevice::_program_done()
+{
+    if (_busy_size) {
+        uint32_t busy_us = _busy_timer.read_us() - _busy_start_us;
+        if (busy_us >= _max_busy_us) {
+            _max_busy_us = busy_us;
+            _max_busy_addr = _busy_addr;
+            _max_busy_size = _busy_size;
+        }
+        _busy_size = 0;
+    }
+}
+
+void SDBlockDevice::attach_busy_wait(mbed::Callback<void()> func)
+{
+    lock();
+    _busy_wait = func;
+    unlock();
+}
+
 int SDBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
 {
     if (!is_valid_program(addr, size)) {
@@ -484,6 +619,7 @@ int SDBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
     const uint8_t *buffer = static_cast<const uint8_t *>(b);
     int status = BD_ERROR_OK;
     uint8_t response;
+    bd_addr_t program_addr = addr;
 
     // Get block count
     size_t blockCnt = size / _block_size;
@@ -502,8 +638,8 @@ int SDBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
             return status;
         }
 
-        // Write data
-        response = _write(buffer, SPI_START_BLOCK, _block_size);
+        // Write data, with sd.DEFER_PROGRAM_BUSY the next command waits for the card to finish programming
+        response = _write(buffer, SPI_START_BLOCK, _block_size, !MBED_CONF_SD_DEFER_PROGRAM_BUSY);
 
         // Only CRC and general write error are communicated via response token
         if (response != SPI_DATA_ACCEPTED) {
@@ -535,6 +671,14 @@ int SDBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
          * of the next block
          */
         _spi.write(SPI_STOP_TRAN);
+        _program_busy = true;
+    }
+
+    if (_program_busy) {
+        // the card is still programming, time it until it is seen ready, see take_max_program_busy
+        _busy_start_us = _busy_timer.read_us();
+        _busy_addr = program_addr;
+        _busy_size = size;
     }
 
     _deselect();
@@ -555,7 +699,6 @@ int SDBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
     }
 
     uint8_t *buffer = static_cast<uint8_t *>(b);
-    int status = BD_ERROR_OK;
     size_t blockCnt =  size / _block_size;
 
     // SDSC Card (CCS=0) uses byte unit address
@@ -564,21 +707,37 @@ int SDBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
         addr = addr / _block_size;
     }
 
+    int status = _read_blocks(buffer, addr, blockCnt, MBED_CONF_SD_AUTO_FREQUENCY);
+#if MBED_CONF_SD_AUTO_FREQUENCY
+    // The clock passed CRC-checked reads at init, so a failing read is most likely a marginal
+    // bus (eg, temperature drift): continue at the next lower clock
+    for (int retry = 0; (SD_BLOCK_DEVICE_ERROR_CRC == status || SD_BLOCK_DEVICE_ERROR_NO_RESPONSE == status) &&
+            (retry < SD_AUTO_FREQUENCY_READ_RETRIES) && _lower_frequency(); retry++) {
+        status = _read_blocks(buffer, addr, blockCnt, true);
+    }
+#endif
+    unlock();
+    return status;
+}
+
+int SDBlockDevice::_read_blocks(uint8_t *buffer, bd_addr_t addr, size_t blockCnt, bool check_crc)
+{
+    int status;
+    bool multiple = (blockCnt > 1);
+
     // Write command ro receive data
-    if (blockCnt > 1) {
+    if (multiple) {
         status = _cmd(CMD18_READ_MULTIPLE_BLOCK, addr);
     } else {
         status = _cmd(CMD17_READ_SINGLE_BLOCK, addr);
     }
     if (BD_ERROR_OK != status) {
-        unlock();
         return status;
     }
 
     // receive the data : one block at a time
     while (blockCnt) {
-        if (0 != _read(buffer, _block_size)) {
-            status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        if (0 != (status = _read(buffer, _block_size, check_crc))) {
             break;
         }
         buffer += _block_size;
@@ -587,10 +746,12 @@ int SDBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
     _deselect();
 
     // Send CMD12(0x00000000) to stop the transmission for multi-block transfer
-    if (size > _block_size) {
-        status = _cmd(CMD12_STOP_TRANSMISSION, 0x0);
+    if (multiple) {
+        int stop_status = _cmd(CMD12_STOP_TRANSMISSION, 0x0);
+        if (BD_ERROR_OK == status) {
+            status = stop_status;
+        }
     }
-    unlock();
     return status;
 }
 
@@ -659,6 +820,16 @@ const char *SDBlockDevice::get_type() const
     return "SD";
 }
 
+bool SDBlockDevice::card_unchanged() const
+{
+    return _card_unchanged;
+}
+
+bd_size_t SDBlockDevice::get_allocation_unit_size() const
+{
+    return _au_size;
+}
+
 void SDBlockDevice::debug(bool dbg)
 {
     _dbg = dbg;
@@ -667,26 +838,96 @@ void SDBlockDevice::debug(bool dbg)
 int SDBlockDevice::frequency(uint64_t freq)
 {
     lock();
+    _max_transfer_sck = freq;
     _transfer_sck = freq;
     int err = _freq();
     unlock();
     return err;
 }
 
+uint32_t SDBlockDevice::get_transfer_frequency() const
+{
+    return _transfer_sck;
+}
+
 // PRIVATE FUNCTIONS
 int SDBlockDevice::_freq(void)
 {
-    // Max frequency supported is 25MHZ
-    if (_transfer_sck <= 25000000) {
+    // Max frequency supported is 25MHZ, or 50MHz once the card is in high speed mode
+    uint32_t max_sck = _high_speed ? SD_HIGH_SPEED_MAX_FREQUENCY : SD_DEFAULT_SPEED_MAX_FREQUENCY;
+    if (_transfer_sck <= max_sck) {
         _spi.frequency(_transfer_sck);
         return 0;
-    } else {  // TODO: Switch function to be implemented for higher frequency
-        _transfer_sck = 25000000;
+    } else {
+        _transfer_sck = max_sck;
         _spi.frequency(_transfer_sck);
         return -EINVAL;
     }
 }
 
+int SDBlockDevice::_switch_high_speed()
+{
+    uint8_t switch_status[64];
+
+    // CMD6 in switch mode: function group 1 (access mode) to high speed, keep the other groups
+    int status = _cmd(CMD6_SWITCH_FUNC, 0x80FFFFF1);
+    if (BD_ERROR_OK != status) {
+        return status;                          // Version 1.0 cards don't support CMD6
+    }
+    if (BD_ERROR_OK != (status = _read_bytes(switch_status, sizeof(switch_status)))) {
+        return status;
+    }
+
+    if (!sd_high_speed_selected(switch_status)) {
+        return SD_BLOCK_DEVICE_ERROR_UNSUPPORTED;
+    }
+    return BD_ERROR_OK;
+}
+
+int SDBlockDevice::_verify_frequency()
+{
+    uint8_t block[BLOCK_SIZE_HC];
+
+    // A multiple block read streams data back to back, the worst case for the bus
+    int status = _cmd(CMD18_READ_MULTIPLE_BLOCK, 0x0);
+    if (BD_ERROR_OK != status) {
+        return status;
+    }
+    for (int i = 0; (BD_ERROR_OK == status) && (i < SD_AUTO_FREQUENCY_VERIFY_BLOCKS); i++) {
+        status = _read(block, _block_size, true);
+    }
+    _deselect();
+    int stop_status = _cmd(CMD12_STOP_TRANSMISSION, 0x0);
+    return (BD_ERROR_OK != status) ? status : stop_status;
+}
+
+int SDBlockDevice::_select_frequency()
+{
+    _transfer_sck = sd_divided_frequency(SystemCoreClock, sd_max_frequency(_high_speed, _max_transfer_sck));
+    _spi.frequency(_transfer_sck);
+    int status;
+    while (BD_ERROR_OK != (status = _verify_frequency())) {
+        debug_if(SD_DBG, "Reads failed at %" PRIu32 " Hz: %d\n", _transfer_sck, status);
+        if (!_lower_frequency()) {
+            return status;
+        }
+    }
+    debug_if(SD_DBG, "Transfer clock %" PRIu32 " Hz\n", _transfer_sck);
+    return BD_ERROR_OK;
+}
+
+bool SDBlockDevice::_lower_frequency()
+{
+    uint32_t sck = sd_lower_frequency(SystemCoreClock, _transfer_sck);
+    if (0 == sck) {
+        return false;
+    }
+    debug_if(SD_DBG, "Lowering transfer clock to %" PRIu32 " Hz\n", sck);
+    _transfer_sck = sck;
+    _spi.frequency(_transfer_sck);
+    return true;
+}
+
 uint8_t SDBlockDevice::_cmd_spi(SDBlockDevice::cmdSupported cmd, uint32_t arg)
 {
     uint8_t response;
@@ -829,10 +1070,17 @@ int SDBlockDevice::_cmd(SDBlockDevice::cmdSupported cmd, uint32_t arg, bool isAc
             break;
 
         case CMD12_STOP_TRANSMISSION:       // Response R1b
-        case CMD38_ERASE:
             _wait_ready(SD_COMMAND_TIMEOUT);
             break;
 
+        case CMD38_ERASE:                   // Response R1b, with sd.DEFER_PROGRAM_BUSY the next command waits
+            if (MBED_CONF_SD_DEFER_PROGRAM_BUSY) {
+                _program_busy = true;
+            } else {
+                _wait_ready(SD_COMMAND_TIMEOUT);
+            }
+            break;
+
         case ACMD13_SD_STATUS:             // Response R2
             response = _spi.write(SPI_FILL_CHAR);
             debug_if(_dbg, "R2: 0x%" PRIx32 "\n", response);
@@ -848,7 +1096,8 @@ int SDBlockDevice::_cmd(SDBlockDevice::cmdSupported cmd, uint32_t arg, bool isAc
     }
 
     // Do not deselect card if read is in progress.
-    if (((CMD9_SEND_CSD == cmd) || (ACMD22_SEND_NUM_WR_BLOCKS == cmd) ||
+    if (((CMD9_SEND_CSD == cmd) || (!isAcmd && (CMD6_SWITCH_FUNC == cmd)) || (CMD10_SEND_CID == cmd) || (ACMD22_SEND_NUM_WR_BLOCKS == cmd) ||
+            (isAcmd && (ACMD13_SD_STATUS == cmd)) ||
             (CMD24_WRITE_BLOCK == cmd) || (CMD25_WRITE_MULTIPLE_BLOCK == cmd) ||
             (CMD17_READ_SINGLE_BLOCK == cmd) || (CMD18_READ_MULTIPLE_BLOCK == cmd))
             && (BD_ERROR_OK == status)) {
@@ -880,6 +1129,47 @@ int SDBlockDevice::_cmd8()
     return status;
 }
 
+int SDBlockDevice::_warm_init_card()
+{
+    uint32_t ocr;
+    uint8_t cid[16];
+
+    /* A card which kept power since the last init is still in SPI mode with ACMD41 complete,
+     * so it answers CMD58 at the transfer clock with the power up status bit set. A newly
+     * inserted card is in SD mode and doesn't answer, and a card left in the idle state
+     * reports the bit clear. Either takes the full init.
+     */
+    _spi_init();
+    _freq();
+    int status = _cmd(CMD58_READ_OCR, 0x0, 0x0, &ocr);
+    if (BD_ERROR_OK != status) {
+        return status;
+    }
+    bool high_capacity = (ocr & OCR_HCS_CCS) != 0;
+    if (!(ocr & OCR_POWER_UP_STATUS) || (high_capacity != (SDCARD_V2HC == _cid_card_type))) {
+        return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+    }
+
+    // Guard against a swap which didn't interrupt power, eg a card socket on a separate supply
+    if (BD_ERROR_OK != (status = _read_cid(cid))) {
+        return status;
+    }
+    if (memcmp(cid, _cid, sizeof(cid)) != 0) {
+        return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+    }
+    return BD_ERROR_OK;
+}
+
+int SDBlockDevice::_read_cid(uint8_t *cid)
+{
+    // CMD10, Response R2 (R1 byte + 16-byte block read)
+    int status = _cmd(CMD10_SEND_CID, 0x0);
+    if (BD_ERROR_OK != status) {
+        return status;
+    }
+    return _read_bytes(cid, 16);
+}
+
 uint32_t SDBlockDevice::_go_idle_state()
 {
     uint32_t response;
@@ -899,6 +1189,50 @@ uint32_t SDBlockDevice::_go_idle_state()
     return response;
 }
 
+#if defined(TARGET_LPC15XX)
+// CRC engine registers, see UM10736 chapter 20
+struct sd_crc_engine_t {
+    volatile uint32_t MODE;
+    volatile uint32_t SEED;
+    volatile uint32_t SUM_WR_DATA;              // reads return the checksum, writes add data
+};
+#define SD_CRC_ENGINE            ((sd_crc_engine_t *)0x1C010000)
+#define SD_CRC_MODE_CCITT        (0x0 << 0)     /*!< CRC-CCITT polynomial, no bit reversal or complement */
+#define SD_SYSAHBCLKCTRL0_CRC    (1 << 20)
+
+// Data writes to the CRC engine, for sd_crc16_ccitt_feed
+struct sd_crc_engine_writer {
+    void write_byte(uint8_t byte)
+    {
+        *(volatile uint8_t *)&SD_CRC_ENGINE->SUM_WR_DATA = byte;
+    }
+
+    void write_word(uint32_t word)
+    {
+        // Word writes are shifted in from bit 31, so swap the little-endian bytes to keep them in order
+        SD_CRC_ENGINE->SUM_WR_DATA = __REV(word);
+    }
+};
+
+// CRC16-CCITT (XModem) of a data block on the CRC engine, a word per write
+static uint16_t crc16_ccitt(const uint8_t *data, uint32_t length)
+{
+    // The engine is shared with other CRC users, so set it up for every block
+    LPC_SYSCON->SYSAHBCLKCTRL0 |= SD_SYSAHBCLKCTRL0_CRC;
+    SD_CRC_ENGINE->MODE = SD_CRC_MODE_CCITT;
+    SD_CRC_ENGINE->SEED = 0;
+
+    sd_crc_engine_writer engine;
+    sd_crc16_ccitt_feed(engine, data, length);
+    return SD_CRC_ENGINE->SUM_WR_DATA;
+}
+#else
+static uint16_t crc16_ccitt(const uint8_t *data, uint32_t length)
+{
+    return sd_crc16_ccitt(data, length);
+}
+#endif
+
 int SDBlockDevice::_read_bytes(uint8_t *buffer, uint32_t length)
 {
     uint16_t crc;
@@ -921,12 +1255,11 @@ int SDBlockDevice::_read_bytes(uint8_t *buffer, uint32_t length)
 
 #if MBED_CONF_SD_CRC_ENABLED
     if (_crc_on) {
-        uint32_t crc_result;
         // Compute and verify checksum
-        _crc16.compute((void *)buffer, length, &crc_result);
-        if ((uint16_t)crc_result != crc) {
+        uint16_t crc_result = crc16_ccitt(buffer, length);
+        if (crc_result != crc) {
             debug_if(SD_DBG, "_read_bytes: Invalid CRC received 0x%" PRIx16 " result of computation 0x%" PRIx16 "\n",
-                     crc, (uint16_t)crc_result);
+                     crc, crc_result);
             _deselect();
             return SD_BLOCK_DEVICE_ERROR_CRC;
         }
@@ -937,7 +1270,7 @@ int SDBlockDevice::_read_bytes(uint8_t *buffer, uint32_t length)
     return 0;
 }
 
-int SDBlockDevice::_read(uint8_t *buffer, uint32_t length)
+int SDBlockDevice::_read(uint8_t *buffer, uint32_t length, bool check_crc)
 {
     uint16_t crc;
 
@@ -955,22 +1288,24 @@ int SDBlockDevice::_read(uint8_t *buffer, uint32_t length)
     crc |= _spi.write(SPI_FILL_CHAR);
 
 #if MBED_CONF_SD_CRC_ENABLED
-    if (_crc_on) {
-        uint32_t crc_result;
+    check_crc = check_crc || _crc_on;
+#endif
+
+    // The card sends the CRC even with CRC checking off, so the host can check it regardless
+    if (check_crc) {
         // Compute and verify checksum
-        _crc16.compute((void *)buffer, length, &crc_result);
-        if ((uint16_t)crc_result != crc) {
-            debug_if(SD_DBG, "_read_bytes: Invalid CRC received 0x%" PRIx16 " result of computation 0x%" PRIx16 "\n",
-                     crc, (uint16_t)crc_result);
+        uint16_t crc_result = crc16_ccitt(buffer, length);
+        if (crc_result != crc) {
+            debug_if(SD_DBG, "_read: Invalid CRC received 0x%" PRIx16 " result of computation 0x%" PRIx16 "\n",
+                     crc, crc_result);
             return SD_BLOCK_DEVICE_ERROR_CRC;
         }
     }
-#endif
 
     return 0;
 }
 
-uint8_t SDBlockDevice::_write(const uint8_t *buffer, uint8_t token, uint32_t length)
+uint8_t SDBlockDevice::_write(const uint8_t *buffer, uint8_t token, uint32_t length, bool wait_ready)
 {
 
     uint32_t crc = (~0);
@@ -985,7 +1320,7 @@ uint8_t SDBlockDevice::_write(const uint8_t *buffer, uint8_t token, uint32_t len
 #if MBED_CONF_SD_CRC_ENABLED
     if (_crc_on) {
         // Compute CRC
-        _crc16.compute((void *)buffer, length, &crc);
+        crc = crc16_ccitt(buffer, length);
     }
 #endif
 
@@ -998,7 +1333,8 @@ uint8_t SDBlockDevice::_write(const uint8_t *buffer, uint8_t token, uint32_t len
     response = _spi.write(SPI_FILL_CHAR);
 
     // Wait for last block to be written
-    if (false == _wait_ready(SD_COMMAND_TIMEOUT)) {
+    _program_busy = true;
+    if (wait_ready && (false == _wait_ready(SD_COMMAND_TIMEOUT))) {
         debug_if(SD_DBG, "Card not ready yet \n");
     }
 
@@ -1079,6 +1415,52 @@ bd_size_t SDBlockDevice::_sd_sectors()
     return blocks;
 }
 
+uint32_t SDBlockDevice::_sd_au_size()
+{
+    uint8_t sd_status[64];
+
+    // ACMD13, Response R2 (R1 byte + status byte, then a 64-byte block read)
+    if ((BD_ERROR_OK != _cmd(ACMD13_SD_STATUS, 0x0, 0x1)) || (0 != _read_bytes(sd_status, sizeof(sd_status)))) {
+        debug_if(SD_DBG, "Couldn't read SD status, using the erase size as AU\n");
+        return _erase_size;
+    }
+
+    uint32_t au_size = sd_au_size(sd_status);
+    if (0 == au_size) {
+        return _erase_size;                     // Not defined by the card
+    }
+    debug_if(SD_DBG, "Allocation unit: %" PRIu32 " KB\n", au_size / 1024U);
+    return (au_size > _erase_size) ? au_size : _erase_size;
+}
+
+bd_size_t SDBlockDevice::_identify_card()
+{
+    uint8_t cid[16];
+    bool cid_read = (BD_ERROR_OK == _read_cid(cid));
+
+    // The CSD of a card doesn't change, so the same card as the last init needs no CMD9
+    if (cid_read && _cid_valid && (_card_type == _cid_card_type) && (memcmp(cid, _cid, sizeof(cid)) == 0)) {
+        debug_if(SD_DBG, "Same card as the last init, using its CSD\n");
+        _erase_size = _cid_erase_size;
+        _au_size = _cid_au_size;
+        _card_unchanged = true;
+        return _cid_sectors;
+    }
+
+    _cid_valid = false;
+    bd_size_t sectors = _sd_sectors();
+    _au_size = _sd_au_size();
+    if (cid_read && sectors) {
+        memcpy(_cid, cid, sizeof(_cid));
+        _cid_sectors = sectors;
+        _cid_erase_size = _erase_size;
+        _cid_au_size = _au_size;
+        _cid_card_type = _card_type;
+        _cid_valid = true;
+    }
+    return sectors;
+}
+
 // SPI function to wait till chip is ready and sends start token
 bool SDBlockDevice::_wait_token(uint8_t token)
 {
@@ -1098,6 +1480,7 @@ bool SDBlockDevice::_wait_token(uint8_t token)
 
 // SPI function to wait till chip is ready
 // The host controller should wait for end of the process until DO goes high (a 0xFF is received).
+// The busy wait callback runs between polls, with the card selected.
 bool SDBlockDevice::_wait_ready(uint16_t ms)
 {
     uint8_t response;
@@ -1107,8 +1490,15 @@ bool SDBlockDevice::_wait_ready(uint16_t ms)
         response = _spi.write(SPI_FILL_CHAR);
         if (response == 0xFF) {
             _spi_timer.stop();
+            if (_program_busy) {
+                _program_done();
+            }
+            _program_busy = false;
             return true;
         }
+        if (_busy_wait) {
+            _busy_wait();
+        }
     } while (_spi_timer.read_ms() < ms);
     _spi_timer.stop();
     return false;
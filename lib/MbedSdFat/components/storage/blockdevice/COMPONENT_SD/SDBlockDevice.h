@@ -27,6 +27,7 @@
 #include "drivers/DigitalOut.h"
 #include "platform/platform.h"
 #include "platform/PlatformMutex.h"
+#include "platform/Callback.h"
 #include "hal/static_pinmap.h"
 
 /** SDBlockDevice class
@@ -72,6 +73,16 @@ public:
      */
     virtual int deinit();
 
+    /** Ensure data on storage is in sync with the driver
+     *
+     *  With the sd.DEFER_PROGRAM_BUSY option, this waits for the card to finish programming the
+     *  last write.
+     *
+     *  @return         BD_ERROR_OK(0) - success
+     *                  SD_BLOCK_DEVICE_ERROR_WRITE - card still busy after the command timeout
+     */
+    virtual int sync();
+
     /** Read blocks from a block device
      *
      *  @param buffer   Buffer to write blocks to
@@ -93,6 +104,8 @@ public:
      *  @param buffer   Buffer of data to write to blocks
      *  @param addr     Address of block to begin writing to
      *  @param size     Size to write in bytes. Must be a multiple of program block size
+     *  @note With the sd.DEFER_PROGRAM_BUSY option, this returns once the card accepted the data,
+     *        and the next command (or sync) waits for the card to finish programming it
      *  @return         BD_ERROR_OK(0) - success
      *                  SD_BLOCK_DEVICE_ERROR_NO_DEVICE - device (SD card) is missing or not connected
      *                  SD_BLOCK_DEVICE_ERROR_CRC - crc error
@@ -113,6 +126,8 @@ public:
      *
      *  @param addr     Address of block to mark as unused
      *  @param size     Size to mark as unused in bytes, must be a multiple of erase block size
+     *  @note With the sd.DEFER_PROGRAM_BUSY option, this returns once the card accepted the erase
+     *        command, and busy() reports the card busy until it is done
      *  @return         BD_ERROR_OK(0) - success
      *                  SD_BLOCK_DEVICE_ERROR_NO_DEVICE - device (SD card) is missing or not connected
      *                  SD_BLOCK_DEVICE_ERROR_CRC - crc error
@@ -149,18 +164,80 @@ public:
     virtual void debug(bool dbg);
 
     /** Set the transfer frequency
+     *
+     *  With the sd.AUTO_FREQUENCY option, this is the upper limit for the clock selected at the next init.
      *
      *  @param freq     Transfer frequency
-     *  @note Max frequency supported is 25MHZ
+     *  @note Max frequency supported is 25MHZ, or 50MHz if the card switched to high speed mode at init
      */
     virtual int frequency(uint64_t freq);
 
+    /** Get the transfer frequency in use
+     *
+     *  With the sd.AUTO_FREQUENCY option, init selects the highest clock up to the requested one
+     *  where CRC-checked reads pass, and reads which fail later lower it.
+     *
+     *  @return         SPI clock for data transfer in Hz
+     */
+    uint32_t get_transfer_frequency() const;
+
     /** Get the BlockDevice class type.
      *
      *  @return         A string representation of the BlockDevice class type.
      */
     virtual const char *get_type() const;
 
+    /** Check whether the last init found the same card as the init before it
+     *
+     *  The card is identified by its CID register. With the sd.WARM_INIT option, a card which
+     *  kept power since the last init (eg, after a deinit for a failed mount) also skips the
+     *  identification sequence.
+     *
+     *  @return         true if the card is unchanged, false if it is new or init failed
+     */
+    bool card_unchanged() const;
+
+    /** Get the allocation unit (AU) size of the card
+     *
+     *  The AU is the unit the card erases and manages internally, from the AU_SIZE field of the
+     *  SD status. Writes and trims aligned to it avoid read-modify-write inside the card.
+     *
+     *  @return         Size of an allocation unit in bytes, the erase size if the card doesn't report it
+     */
+    mbed::bd_size_t get_allocation_unit_size() const;
+
+    /** Check whether the card is still programming the last write or erasing the last trim
+     *
+     *  With the sd.DEFER_PROGRAM_BUSY option, program and trim return before the card is done, so the
+     *  caller can do other work instead of starting a command which would wait for it.
+     *
+     *  @return         true if the card is busy, false if it is ready
+     */
+    bool busy();
+
+    /** Get the longest time the card stayed busy after a program returned, and reset it
+     *
+     *  Multiple block writes, and with the sd.DEFER_PROGRAM_BUSY option all writes, return before
+     *  the card is done programming, so the wait shows up in whichever operation comes next. This
+     *  charges it to the program instead, timed from its return until the card is seen ready, by
+     *  busy() or by the wait before the next command.
+     *
+     *  @param addr     Destination for the address of that program
+     *  @param size     Destination for the size of that program
+     *  @return         Busy time in microseconds, 0 if no program finished since the last call
+     */
+    uint32_t take_max_program_busy(mbed::bd_addr_t *addr, mbed::bd_size_t *size);
+
+    /** Attach a function to call while waiting for the card to be ready
+     *
+     *  Programming, erasing and some commands can keep the card busy for hundreds of milliseconds.
+     *  The function is called repeatedly during the wait, with the card selected and the SPI bus
+     *  locked, so it must not access this block device or anything else on its SPI bus.
+     *
+     *  @param func     Function to call, or NULL to remove it
+     */
+    void attach_busy_wait(mbed::Callback<void()> func);
+
 private:
     /* Commands : Listed below are commands supported
      * in SPI mode for SD card : Only Mandatory ones
@@ -219,8 +296,24 @@ private:
     uint32_t _go_idle_state();
     int _initialise_card();
 
+    /*  Resume a card which is still initialized from the last init
+     *
+     *  @return         BD_ERROR_OK(0) if the card is in the transfer state and its CID matches
+     *                  the last init, else an error and the card needs the full init
+     */
+    int _warm_init_card();
+    int _read_cid(uint8_t *cid);
+
+    /*  Switch the card to high speed mode (CMD6), which allows clocks up to 50MHz
+     *
+     *  @return         BD_ERROR_OK(0) if the card switched, else an error and it stays in default speed
+     */
+    int _switch_high_speed();
+
     mbed::bd_size_t _sectors;
     mbed::bd_size_t _sd_sectors();
+    uint32_t _sd_au_size();                 /**< Read the AU size from the SD status */
+    mbed::bd_size_t _identify_card();       /**< Read the CID, and the CSD and SD status if the card is new */
 
     bool _is_valid_trim(mbed::bd_addr_t addr, mbed::bd_size_t size);
 
@@ -228,6 +321,8 @@ private:
     mbed::Timer _spi_timer;               /**< Timer Class object used for busy wait */
     uint32_t _init_sck;             /**< Initial SPI frequency */
     uint32_t _transfer_sck;         /**< SPI frequency during data transfer/after initialization */
+    uint32_t _max_transfer_sck;     /**< Requested SPI frequency for data transfer */
+    bool _high_speed;               /**< Card switched to high speed mode */
     mbed::SPI _spi;                       /**< SPI Class object */
 
     /* SPI initialization function */
@@ -237,10 +332,14 @@ private:
 
     bool _wait_token(uint8_t token);        /**< Wait for token */
     bool _wait_ready(uint16_t ms = 300);    /**< 300ms default wait for card to be ready */
-    int _read(uint8_t *buffer, uint32_t length);
+    int _read(uint8_t *buffer, uint32_t length, bool check_crc = false);
+    int _read_blocks(uint8_t *buffer, mbed::bd_addr_t addr, size_t blockCnt, bool check_crc);
     int _read_bytes(uint8_t *buffer, uint32_t length);
-    uint8_t _write(const uint8_t *buffer, uint8_t token, uint32_t length);
+    uint8_t _write(const uint8_t *buffer, uint8_t token, uint32_t length, bool wait_ready = true);
     int _freq(void);
+    int _verify_frequency();                /**< Read blocks at the current clock, checking their CRC */
+    int _select_frequency();                /**< Select the highest clock which passes _verify_frequency */
+    bool _lower_frequency();                /**< Step down to the next clock divider, false at the lowest */
 
     /* Chip Select and SPI mode select */
     mbed::DigitalOut _cs;
@@ -260,14 +359,35 @@ private:
     PlatformMutex _mutex;
     static const uint32_t _block_size;
     uint32_t _erase_size;
+    uint32_t _au_size;
     bool _is_initialized;
     bool _dbg;
     uint32_t _init_ref_count;
 
+    /* Last initialized card, so the same card can skip reading its CSD */
+    uint8_t _cid[16];
+    bool _cid_valid;
+    mbed::bd_size_t _cid_sectors;
+    uint32_t _cid_erase_size;
+    uint32_t _cid_au_size;
+    uint8_t _cid_card_type;
+    bool _card_unchanged;
+
+    bool _program_busy;                     /**< Card may still be programming the last write */
+    void _program_done();
+
+    mbed::Timer _busy_timer;                /**< Times the card busy after a program returns */
+    uint32_t _busy_start_us;                /**< When the last program returned */
+    mbed::bd_addr_t _busy_addr;             /**< Address of the last program */
+    mbed::bd_size_t _busy_size;             /**< Size of the last program, 0 once its busy is timed */
+    uint32_t _max_busy_us;                  /**< Longest busy since take_max_program_busy */
+    mbed::bd_addr_t _max_busy_addr;
+    mbed::bd_size_t _max_busy_size;
+    mbed::Callback<void()> _busy_wait;      /**< Called while waiting for the card to be ready */
+
 #if MBED_CONF_SD_CRC_ENABLED
     bool _crc_on;
     mbed::MbedCRC<POLY_7BIT_SD, 7> _crc7;
-    mbed::MbedCRC<POLY_16BIT_CCITT, 16> _crc16;
 #endif
 };
 
@@ -0,0 +1,71 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2013 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDCardUtils.h"
+
+uint32_t sd_max_frequency(bool high_speed, uint32_t max_transfer_sck)
+{
+    uint32_t max_sck = high_speed ? SD_HIGH_SPEED_MAX_FREQUENCY : SD_DEFAULT_SPEED_MAX_FREQUENCY;
+    return (max_transfer_sck < max_sck) ? max_transfer_sck : max_sck;
+}
+
+uint32_t sd_divided_frequency(uint32_t core_clock, uint32_t max_sck)
+{
+    uint32_t div = (core_clock + max_sck - 1) / max_sck;
+    return core_clock / div;
+}
+
+uint32_t sd_lower_frequency(uint32_t core_clock, uint32_t sck)
+{
+    // sck is core_clock / div rounded down, so dividing back rounds down to div again, where rounding
+    // up would skip a divider whenever div doesn't divide the core clock
+    uint32_t div = core_clock / sck;
+    uint32_t lower = core_clock / (div + 1);
+    return (lower < SD_AUTO_FREQUENCY_MIN) ? 0 : lower;
+}
+
+bool sd_high_speed_selected(const uint8_t *switch_status)
+{
+    // Function selected in group 1 : switch_status[379:376], 0xF if the switch failed
+    return (switch_status[16] & 0x0F) == 0x1;
+}
+
+uint32_t sd_au_size(const uint8_t *sd_status)
+{
+    // AU_SIZE codes 0xB to 0xF are not powers of two
+    static const uint8_t large_au_mib[] = {12, 16, 24, 32, 64};
+
+    uint32_t au_code = sd_status[10] >> 4;      // AU_SIZE : sd_status[431:428]
+    if (0 == au_code) {
+        return 0;                               // Not defined by the card
+    }
+    return (au_code <= 0xA) ? (16U * 1024U) << (au_code - 1) : large_au_mib[au_code - 0xB] * 1024U * 1024U;
+}
+
+uint16_t sd_crc16_ccitt(const uint8_t *data, uint32_t length)
+{
+    // A nibble at a time to keep the table small
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+    uint16_t crc = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
@@ -0,0 +1,102 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2013 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MBED_SD_CARD_UTILS_H
+#define MBED_SD_CARD_UTILS_H
+
+#include <stdint.h>
+
+/* SD card logic that doesn't touch the SPI bus, used by SDBlockDevice and tested on the host */
+
+#define SD_DEFAULT_SPEED_MAX_FREQUENCY           25000000 /*!< Max clock in default speed mode */
+#define SD_HIGH_SPEED_MAX_FREQUENCY              50000000 /*!< Max clock once CMD6 switched the card to high speed */
+#define SD_AUTO_FREQUENCY_MIN                    1000000  /*!< Lowest transfer clock the automatic selection falls back to */
+
+/** Highest transfer clock the card allows
+ *
+ *  @param high_speed        Whether CMD6 switched the card to high speed
+ *  @param max_transfer_sck  Limit on the clock from the application
+ *  @return                  Clock in Hz
+ */
+uint32_t sd_max_frequency(bool high_speed, uint32_t max_transfer_sck);
+
+/** Highest clock at or below max_sck from an integer divider of the core clock,
+ *  which most SPI peripherals divide
+ *
+ *  @param core_clock  Clock the SPI peripheral divides, in Hz
+ *  @param max_sck     Upper limit on the clock, in Hz
+ *  @return            Clock in Hz
+ */
+uint32_t sd_divided_frequency(uint32_t core_clock, uint32_t max_sck);
+
+/** Clock from the next divider down, to fall back to when reads fail at sck
+ *
+ *  @param core_clock  Clock the SPI peripheral divides, in Hz
+ *  @param sck         Current clock, from sd_divided_frequency or sd_lower_frequency
+ *  @return            Clock in Hz, 0 if it would be below SD_AUTO_FREQUENCY_MIN
+ */
+uint32_t sd_lower_frequency(uint32_t core_clock, uint32_t sck);
+
+/** Whether a CMD6 switch to high speed took effect
+ *
+ *  @param switch_status  The 64 byte switch function status returned by CMD6
+ *  @return               true if function group 1 selected high speed
+ */
+bool sd_high_speed_selected(const uint8_t *switch_status);
+
+/** Allocation unit size of the card
+ *
+ *  @param sd_status  The 64 byte SD status returned by ACMD13
+ *  @return           Size in bytes, 0 if the card doesn't define it
+ */
+uint32_t sd_au_size(const uint8_t *sd_status);
+
+/** CRC16-CCITT (XModem) of a data block, as SD cards check it on each data block
+ *
+ *  @param data    Data block
+ *  @param length  Size of the data block in bytes
+ *  @return        CRC of the data block
+ */
+uint16_t sd_crc16_ccitt(const uint8_t *data, uint32_t length);
+
+/** Feeds a data block to a CRC engine, a word per write where the data is word aligned
+ *
+ *  The engine has write_byte(uint8_t) and write_word(uint32_t), which is passed the next 4 bytes
+ *  as loaded from memory, little-endian.
+ *
+ *  @param engine  CRC engine
+ *  @param data    Data block
+ *  @param length  Size of the data block in bytes
+ */
+template <typename Engine>
+void sd_crc16_ccitt_feed(Engine &engine, const uint8_t *data, uint32_t length)
+{
+    while (length > 0 && ((uintptr_t)data & 0x03) != 0) {
+        engine.write_byte(*data++);
+        length--;
+    }
+    while (length >= 4) {
+        engine.write_word(*(const uint32_t *)data);
+        data += 4;
+        length -= 4;
+    }
+    while (length > 0) {
+        engine.write_byte(*data++);
+        length--;
+    }
+}
+
+#endif  /* MBED_SD_CARD_UTILS_H */
@@ -0,0 +1,937 @@
+// Storage stack benchmarks on the host, see README.md.
+//
+// Each result is one line of JSON on stdout. Alongside host wall-clock times, which vary from
+// machine to machine, each result has the block device traffic (operation counts and bytes),
+// which is deterministic and is what to compare between commits.
+
+#include "mbed.h"
+#include "BufferedBlockDevice.h"
+#include "FATFileSystem.h"
+#include "FlashSimBlockDevice.h"
+#include "HeapBlockDevice.h"
+#include "LatencySimBlockDevice.h"
+#include "SegmentLog.h"
+#include "StripingBlockDevice.h"
+#include "TimingBlockDevice.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static const bd_size_t device_size = 64 * 1024 * 1024;
+
+// Block device stack under test, with a TimingBlockDevice on top to count traffic
+struct BenchDevice {
+    BenchDevice()
+    {
+        clock.start();
+    }
+    virtual ~BenchDevice() {}
+    virtual const char *name() = 0;
+    virtual BlockDevice *device() = 0;
+    // Counts the traffic, the top of the stack unless a cache sits above it
+    virtual TimingBlockDevice *timing()
+    {
+        return static_cast<TimingBlockDevice *>(device());
+    }
+    // Cache between the file system and the traffic counts, if any
+    virtual BufferedBlockDevice *cache()
+    {
+        return NULL;
+    }
+    // What a power loss leaves, below any cache
+    virtual BlockDevice *card()
+    {
+        return device();
+    }
+    // Microseconds for the "us" results, host time unless the device models its own
+    virtual uint64_t now_us()
+    {
+        return clock.read_high_resolution_us();
+    }
+    // The simulated card, if the device models one
+    virtual LatencySimBlockDevice *card_sim()
+    {
+        return NULL;
+    }
+
+    Timer clock;
+};
+
+// SD-card-like, 512 byte sectors
+struct HeapDevice : BenchDevice {
+    HeapDevice() : heap(device_size, 512), timing(&heap) {}
+    const char *name()
+    {
+        return "heap";
+    }
+    BlockDevice *device()
+    {
+        return &timing;
+    }
+
+    HeapBlockDevice heap;
+    TimingBlockDevice timing;
+};
+
+// NOR-flash-like, 4 KiB erase sectors with byte programming through a BufferedBlockDevice
+struct FlashDevice : BenchDevice {
+    FlashDevice() : heap(device_size, 1, 1, 4096), flash(&heap), buffered(&flash), timing(&buffered) {}
+    const char *name()
+    {
+        return "flash";
+    }
+    BlockDevice *device()
+    {
+        return &timing;
+    }
+
+    HeapBlockDevice heap;
+    FlashSimBlockDevice flash;
+    BufferedBlockDevice buffered;
+    TimingBlockDevice timing;
+};
+
+// SD card latencies on the virtual clock of a LatencySimBlockDevice, so times are repeatable
+struct SdDevice : BenchDevice {
+    SdDevice() : heap(device_size, 512), sim(&heap), timing(&sim) {}
+    const char *name()
+    {
+        return "sd";
+    }
+    BlockDevice *device()
+    {
+        return &timing;
+    }
+    uint64_t now_us()
+    {
+        return sim.get_time_us();
+    }
+    LatencySimBlockDevice *card_sim()
+    {
+        return &sim;
+    }
+
+    HeapBlockDevice heap;
+    LatencySimBlockDevice sim;
+    TimingBlockDevice timing;
+};
+
+// The simulated SD card behind the datalogger's cache: 8 sectors with 4 sectors of read-ahead, with
+// the traffic counted below the cache, so the results show what reaches the card
+struct SdCacheDevice : BenchDevice {
+    SdCacheDevice() : heap(device_size, 512), sim(&heap), sd_timing(&sim), buffered(&sd_timing, 8, 4) {}
+    const char *name()
+    {
+        return "sd_cache";
+    }
+    BlockDevice *device()
+    {
+        return &buffered;
+    }
+    TimingBlockDevice *timing()
+    {
+        return &sd_timing;
+    }
+    BufferedBlockDevice *cache()
+    {
+        return &buffered;
+    }
+    BlockDevice *card()
+    {
+        return &sd_timing;
+    }
+    uint64_t now_us()
+    {
+        return sim.get_time_us();
+    }
+    LatencySimBlockDevice *card_sim()
+    {
+        return &sim;
+    }
+
+    HeapBlockDevice heap;
+    LatencySimBlockDevice sim;
+    TimingBlockDevice sd_timing;
+    BufferedBlockDevice buffered;
+};
+
+// Two simulated SD cards behind a StripingBlockDevice with 4 KiB stripes, each sent a stripe at a
+// time, or with a 64 KiB bounce buffer gathering a request's stripes for each card (gather).
+// Requests to the cards are issued one after another, so the time is the sum of their clocks.
+struct StripeDevice : BenchDevice {
+    static const bd_size_t stripe_size = 4096;
+
+    StripeDevice(bool gather)
+        : heap0(device_size / 2, 512), heap1(device_size / 2, 512), sim0(&heap0), sim1(&heap1)
+        , card0(&sim0), card1(&sim1), striping(cards, stripe_size, gather ? bounce : NULL, sizeof(bounce))
+        , timing(&striping), gather(gather)
+    {
+    }
+    const char *name()
+    {
+        return gather ? "stripe_gather" : "stripe";
+    }
+    BlockDevice *device()
+    {
+        return &timing;
+    }
+    uint64_t now_us()
+    {
+        return sim0.get_time_us() + sim1.get_time_us();
+    }
+    // Requests reaching the cards
+    uint64_t card_requests()
+    {
+        timing_bd_snapshot_t snapshot0, snapshot1;
+        card0.get_snapshot(&snapshot0);
+        card1.get_snapshot(&snapshot1);
+        return snapshot0.read.count + snapshot0.program.count + snapshot1.read.count + snapshot1.program.count;
+    }
+
+    HeapBlockDevice heap0, heap1;
+    LatencySimBlockDevice sim0, sim1;
+    TimingBlockDevice card0, card1;
+    BlockDevice *cards[2] = {&card0, &card1};
+    uint8_t bounce[64 * 1024];
+    StripingBlockDevice striping;
+    TimingBlockDevice timing;
+    bool gather;
+};
+
+// One benchmark result, printed as a JSON object
+class Result {
+public:
+    Result(const char *bench, BenchDevice &dev) : _dev(dev), _failed(false), _stopped(false), _us(0)
+    {
+        add("bench", bench);
+        add("bd", dev.name());
+        _dev.timing()->reset();
+        if (_dev.cache()) {
+            _dev.cache()->reset_stats();
+        }
+        _start_us = dev.now_us();
+    }
+
+    void add(const char *key, const char *value)
+    {
+        _json += std::string(_json.empty() ? "{" : ", ") + "\"" + key + "\": \"" + value + "\"";
+    }
+
+    void add(const char *key, uint64_t value)
+    {
+        _json += std::string(_json.empty() ? "{" : ", ") + "\"" + key + "\": " + std::to_string(value);
+    }
+
+    /** Checks the return code of a file system call, failing the result on errors */
+    int check(int res)
+    {
+        if (res < 0 && !_failed) {
+            _failed = true;
+            add("error", (uint64_t) - res);
+        }
+        return res;
+    }
+
+    /** Stops the clock, for setup or checking done after the measured part */
+    void stop()
+    {
+        _stopped = true;
+        _us = _dev.now_us() - _start_us;
+        _dev.timing()->get_snapshot(&_traffic);
+        if (_dev.cache()) {
+            _dev.cache()->get_stats(&_cache_stats);
+        }
+    }
+
+    void print(uint64_t bytes = 0)
+    {
+        if (!_stopped) {
+            stop();
+        }
+        add("us", _us);
+        if (bytes) {
+            add("bytes", bytes);
+            add("bytes_per_s", _us ? bytes * 1000000 / _us : 0);
+        }
+        add("reads", _traffic.read.count);
+        add("read_bytes", _traffic.read.bytes);
+        add("programs", _traffic.program.count);
+        add("program_bytes", _traffic.program.bytes);
+        add("erases", _traffic.erase.count);
+        add("erase_bytes", _traffic.erase.bytes);
+        add("syncs", _traffic.sync.count);
+        if (_dev.cache()) {
+            add("cache_read_hits", _cache_stats.read_hits);
+            add("cache_program_hits", _cache_stats.program_hits);
+            add("cache_evictions", _cache_stats.evictions);
+            add("cache_bypass_units", _cache_stats.bypass_units);
+            add("read_ahead_units", _cache_stats.read_ahead_units);
+            add("read_ahead_hits", _cache_stats.read_ahead_hits);
+        }
+        add("ok", _failed ? 0 : 1);
+        printf("%s}\n", _json.c_str());
+        fflush(stdout);
+    }
+
+    bool failed()
+    {
+        return _failed;
+    }
+
+private:
+    BenchDevice &_dev;
+    bool _failed;
+    bool _stopped;
+    uint64_t _start_us;
+    uint64_t _us;
+    timing_bd_snapshot_t _traffic;
+    buffered_bd_stats_t _cache_stats;
+    std::string _json;
+};
+
+static bool any_failed = false;
+
+static void finish(Result &result, uint64_t bytes = 0)
+{
+    result.print(bytes);
+    any_failed |= result.failed();
+}
+
+static void fill(uint8_t *buffer, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 16;
+    }
+}
+
+static int format_and_mount(BenchDevice &dev, FATFileSystem &fs)
+{
+    int err = FATFileSystem::format(dev.device());
+    if (err) {
+        return err;
+    }
+    return fs.mount(dev.device());
+}
+
+// Sequential append throughput, for each write size, like the datalogger's log file,
+// through File::write or, for whole sectors, File::write_direct
+static void bench_append(BenchDevice &dev, bd_size_t total, bool direct)
+{
+    static const size_t write_sizes[] = {32, 512, 1024, 4096, 32768};
+    std::vector<uint8_t> buffer(32768);
+    fill(buffer.data(), buffer.size(), 1);
+
+    for (size_t write_size : write_sizes) {
+        FATFileSystem fs("bench");
+        struct statvfs st;
+        if (format_and_mount(dev, fs) || fs.statvfs("", &st)) {
+            fprintf(stderr, "append: format failed\n");
+            any_failed = true;
+            return;
+        }
+        if (direct && write_size % st.f_bsize) {
+            fs.unmount();
+            continue;
+        }
+        Result result(direct ? "append_direct" : "append", dev);
+        result.add("write_size", write_size);
+        File file;
+        result.check(file.open(&fs, "append.bin", O_WRONLY | O_CREAT | O_APPEND));
+        for (bd_size_t written = 0; written < total && !result.failed(); written += write_size) {
+            ssize_t res = direct ? file.write_direct(buffer.data(), write_size) : file.write(buffer.data(), write_size);
+            if (result.check(res) != (ssize_t)write_size) {
+                result.check(-EIO);
+            }
+        }
+        result.check(file.close());
+        result.stop();
+        finish(result, total);
+        fs.unmount();
+    }
+}
+
+// Sequential append with a sync every 256 KiB, on a volume formatted with the default layout and
+// aligned to the simulated card's allocation units (FATFileSystem::format's align), counting the
+// programs that move to another allocation unit
+static void bench_append_aligned(BenchDevice &dev, bd_size_t total)
+{
+    static const size_t write_sizes[] = {4096, 16384, 32768};
+    static const bd_size_t sync_interval = 256 * 1024;
+    if (!dev.card_sim()) {
+        return;
+    }
+    const bd_size_t aligns[] = {0, LatencySimBlockDevice::get_sd_card_config().au_size};
+    std::vector<uint8_t> buffer(32768);
+    fill(buffer.data(), buffer.size(), 7);
+
+    for (bd_size_t align : aligns) {
+        for (size_t write_size : write_sizes) {
+            FATFileSystem fs("bench");
+            if (FATFileSystem::format(dev.device(), 0, align) || fs.mount(dev.device())) {
+                fprintf(stderr, "append_aligned: format failed\n");
+                any_failed = true;
+                return;
+            }
+            Result result("append_aligned", dev);
+            result.add("align", align);
+            result.add("write_size", write_size);
+            uint32_t au_penalties = dev.card_sim()->get_au_penalties();
+            File file;
+            result.check(file.open(&fs, "append.bin", O_WRONLY | O_CREAT | O_APPEND));
+            for (bd_size_t written = 0; written < total && !result.failed();) {
+                if (result.check(file.write(buffer.data(), write_size)) != (ssize_t)write_size) {
+                    result.check(-EIO);
+                }
+                written += write_size;
+                if (written % sync_interval == 0) {
+                    result.check(file.sync());
+                }
+            }
+            result.check(file.close());
+            result.stop();
+            result.add("au_penalties", dev.card_sim()->get_au_penalties() - au_penalties);
+            finish(result, total);
+            fs.unmount();
+        }
+    }
+}
+
+// A high-rate and a low-rate log growing side by side, like the datalogger's CAN and sensor
+// streams: interleaved in one file, as two files, and as two files each claiming its own extents.
+// Then reading back the low-rate records alone, and the high-rate file, after a remount.
+static void bench_streams(BenchDevice &dev, bd_size_t total)
+{
+    static const char *layouts[] = {"interleaved", "files", "files_extent"};
+    static const size_t ratio = 64;  // high-rate batches per low-rate batch
+    static const bd_size_t sync_interval = 64 * 1024;  // high-rate bytes between syncs
+    // files are read in one call, so each contiguous fragment is one device read
+    std::vector<uint8_t> buffer(total + total / ratio);
+    fill(buffer.data(), buffer.size(), 6);
+
+    for (const char *layout : layouts) {
+        bool one_file = strcmp(layout, "interleaved") == 0;
+        FATFileSystem fs("bench");
+        struct statvfs st;
+        if (format_and_mount(dev, fs) || fs.statvfs("", &st)) {
+            fprintf(stderr, "streams: format failed\n");
+            any_failed = true;
+            return;
+        }
+        size_t batch = std::max<size_t>(1024, st.f_bsize);  // the datalogger's write_direct batch
+
+        Result result("streams_write", dev);
+        result.add("layout", layout);
+        File high, low;
+        result.check(high.open(&fs, "high.bin", O_WRONLY | O_CREAT));
+        File &low_file = one_file ? high : low;
+        if (!one_file) {
+            result.check(low.open(&fs, "low.bin", O_WRONLY | O_CREAT));
+        }
+        if (strcmp(layout, "files_extent") == 0) {
+            result.check(high.set_extent_size(1024 * 1024));
+            result.check(low.set_extent_size(64 * 1024));
+        }
+        bd_size_t low_total = 0;
+        for (bd_size_t written = 0; written < total && !result.failed(); written += batch) {
+            if (result.check(high.write_direct(buffer.data(), batch)) != (ssize_t)batch) {
+                result.check(-EIO);
+            }
+            if ((written / batch) % ratio == ratio - 1) {
+                if (result.check(low_file.write_direct(buffer.data(), batch)) != (ssize_t)batch) {
+                    result.check(-EIO);
+                }
+                low_total += batch;
+            }
+            if ((written + batch) % sync_interval == 0) {
+                result.check(high.sync());
+                if (!one_file) {
+                    result.check(low.sync());
+                }
+            }
+        }
+        result.check(high.close());
+        if (!one_file) {
+            result.check(low.close());
+        }
+        result.stop();
+        finish(result, total + low_total);
+        fs.unmount();
+
+        // without the separate file, the low-rate records are only found by reading everything
+        struct {
+            const char *bench;
+            const char *path;
+            bd_size_t size;
+        } reads[] = {
+            {"streams_read_low", one_file ? "high.bin" : "low.bin", one_file ? total + low_total : low_total},
+            {"streams_read_high", "high.bin", one_file ? total + low_total : total},
+        };
+        std::vector<uint8_t> readback(buffer.size());
+        for (auto &read : reads) {
+            Result read_result(read.bench, dev);
+            read_result.add("layout", layout);
+            read_result.check(fs.mount(dev.device()));
+            File file;
+            read_result.check(file.open(&fs, read.path, O_RDONLY));
+            bd_size_t read_total = 0;
+            ssize_t res;
+            while (!read_result.failed() && (res = read_result.check(file.read(readback.data() + read_total, readback.size() - read_total))) > 0) {
+                read_total += res;
+            }
+            read_result.check(file.close());
+            read_result.stop();
+
+            // every batch of either stream is the start of the buffer
+            if (read_total != read.size) {
+                read_result.check(-EIO);
+            }
+            for (bd_size_t offset = 0; offset + batch <= read_total && !read_result.failed(); offset += batch) {
+                if (memcmp(readback.data() + offset, buffer.data(), batch) != 0) {
+                    read_result.check(-EILSEQ);
+                }
+            }
+            finish(read_result, read_total);
+            fs.unmount();
+        }
+    }
+}
+
+// Latency of small records each followed by a sync (or a checkpoint), the worst case for a crash-safe log
+static void bench_small_write(BenchDevice &dev, size_t records, size_t record_size, bool checkpoint)
+{
+    FATFileSystem fs("bench");
+    if (format_and_mount(dev, fs)) {
+        fprintf(stderr, "small_write: format failed\n");
+        any_failed = true;
+        return;
+    }
+    std::vector<uint8_t> record(record_size);
+    fill(record.data(), record.size(), 2);
+    std::vector<uint32_t> latencies;
+    latencies.reserve(records);
+
+    Result result("small_write", dev);
+    result.add("flush", checkpoint ? "checkpoint" : "sync");
+    result.add("record_size", record_size);
+    result.add("records", records);
+    File file;
+    result.check(file.open(&fs, "small.bin", O_WRONLY | O_CREAT | O_APPEND));
+    for (size_t i = 0; i < records && !result.failed(); i++) {
+        uint64_t start_us = dev.now_us();
+        result.check(file.write(record.data(), record.size()));
+        result.check(checkpoint ? file.checkpoint() : file.sync());
+        latencies.push_back(dev.now_us() - start_us);
+    }
+    result.stop();
+
+    // what a power loss before the close leaves: another mount only sees what's on the card
+    FATFileSystem probe("probe");
+    struct stat st;
+    if (result.check(probe.mount(dev.card())) == 0) {
+        if (result.check(probe.stat("small.bin", &st)) == 0 && (size_t)st.st_size != records * record_size) {
+            result.check(-EIO);
+        }
+        probe.unmount();
+    }
+    result.check(file.close());
+
+    std::sort(latencies.begin(), latencies.end());
+    if (!latencies.empty()) {
+        uint64_t sum = 0;
+        for (uint32_t latency : latencies) {
+            sum += latency;
+        }
+        result.add("mean_us", sum / latencies.size());
+        result.add("p99_us", latencies[latencies.size() * 99 / 100]);
+        result.add("max_us", latencies.back());
+    }
+    finish(result, records * record_size);
+    fs.unmount();
+}
+
+// Creating files in one directory, then listing and looking up each of them
+static void bench_dir(BenchDevice &dev, size_t files)
+{
+    FATFileSystem fs("bench");
+    if (format_and_mount(dev, fs)) {
+        fprintf(stderr, "dir: format failed\n");
+        any_failed = true;
+        return;
+    }
+    char path[32];
+    {
+        Result result("dir_create", dev);
+        result.add("files", files);
+        result.check(fs.mkdir("dir", 0777));
+        for (size_t i = 0; i < files && !result.failed(); i++) {
+            snprintf(path, sizeof(path), "dir/log%05u.bin", (unsigned)i);
+            File file;
+            result.check(file.open(&fs, path, O_WRONLY | O_CREAT));
+            result.check(file.close());
+        }
+        finish(result);
+    }
+    {
+        Result result("dir_scan", dev);
+        result.add("files", files);
+        Dir dir;
+        struct dirent ent;
+        size_t found = 0;
+        result.check(dir.open(&fs, "dir"));
+        while (result.check(dir.read(&ent)) > 0) {
+            found++;
+        }
+        result.check(dir.close());
+        result.stop();
+        result.add("entries", found);
+        finish(result);
+    }
+    {
+        Result result("dir_stat", dev);
+        result.add("files", files);
+        for (size_t i = 0; i < files && !result.failed(); i++) {
+            snprintf(path, sizeof(path), "dir/log%05u.bin", (unsigned)((i * 7919) % files));
+            struct stat st;
+            result.check(fs.stat(path, &st));
+        }
+        finish(result);
+    }
+    {
+        // the datalogger reopening the newest few files of its directory, at its end
+        Result result("dir_open", dev);
+        result.add("files", files);
+        for (size_t i = 0; i < files && !result.failed(); i++) {
+            snprintf(path, sizeof(path), "dir/log%05u.bin", (unsigned)(files - 1 - i % 4));
+            File file;
+            result.check(file.open(&fs, path, O_WRONLY | O_APPEND));
+            result.check(file.close());
+        }
+        finish(result);
+    }
+    fs.unmount();
+}
+
+// Sequential reads of a file in small pieces, and listing a directory, after a remount: the reads
+// a cache with read-ahead (sd_cache) turns into fewer, longer reads of the card.
+// The data read and the names listed are checked against what was written.
+static void bench_read_ahead(BenchDevice &dev, bd_size_t file_size, size_t files)
+{
+    static const size_t read_sizes[] = {32, 512, 4096};
+    std::vector<uint8_t> expected(file_size);
+    fill(expected.data(), expected.size(), 7);
+    char path[32];
+    {
+        FATFileSystem fs("bench");
+        File file;
+        if (format_and_mount(dev, fs) || file.open(&fs, "seq.bin", O_WRONLY | O_CREAT)
+                || file.write(expected.data(), expected.size()) != (ssize_t)expected.size() || file.close()
+                || fs.mkdir("dir", 0777)) {
+            fprintf(stderr, "read_ahead: setup failed\n");
+            any_failed = true;
+            return;
+        }
+        for (size_t i = 0; i < files; i++) {
+            snprintf(path, sizeof(path), "dir/log%05u.bin", (unsigned)i);
+            if (file.open(&fs, path, O_WRONLY | O_CREAT) || file.close()) {
+                fprintf(stderr, "read_ahead: setup failed\n");
+                any_failed = true;
+                return;
+            }
+        }
+        fs.unmount();
+    }
+
+    std::vector<uint8_t> data(file_size);
+    for (size_t read_size : read_sizes) {
+        FATFileSystem fs("bench");
+        Result result("read_seq", dev);
+        result.add("read_size", read_size);
+        result.check(fs.mount(dev.device()));
+        File file;
+        result.check(file.open(&fs, "seq.bin", O_RDONLY));
+        bd_size_t read_total = 0;
+        ssize_t res;
+        while (!result.failed() && read_total < data.size()
+                && (res = result.check(file.read(data.data() + read_total, std::min<bd_size_t>(read_size, data.size() - read_total)))) > 0) {
+            read_total += res;
+        }
+        result.check(file.close());
+        result.stop();
+        if (read_total != expected.size() || memcmp(data.data(), expected.data(), expected.size()) != 0) {
+            result.check(-EILSEQ);
+        }
+        finish(result, read_total);
+        fs.unmount();
+    }
+    {
+        FATFileSystem fs("bench");
+        Result result("read_dir", dev);
+        result.add("files", files);
+        result.check(fs.mount(dev.device()));
+        Dir dir;
+        struct dirent ent;
+        size_t found = 0;
+        result.check(dir.open(&fs, "dir"));
+        while (!result.failed() && result.check(dir.read(&ent)) > 0) {
+            // entries are listed in the order they were created
+            snprintf(path, sizeof(path), "log%05u.bin", (unsigned)found);
+            if (strcasecmp(ent.d_name, path) != 0) {
+                result.check(-EILSEQ);
+            }
+            found++;
+        }
+        result.check(dir.close());
+        result.stop();
+        if (found != files) {
+            result.check(-ENOENT);
+        }
+        result.add("entries", found);
+        finish(result);
+        fs.unmount();
+    }
+}
+
+// Random seeks with a short read at each, within one large file
+static void bench_seek(BenchDevice &dev, bd_size_t file_size, size_t seeks)
+{
+    FATFileSystem fs("bench");
+    if (format_and_mount(dev, fs)) {
+        fprintf(stderr, "seek: format failed\n");
+        any_failed = true;
+        return;
+    }
+    std::vector<uint8_t> buffer(32768);
+    fill(buffer.data(), buffer.size(), 3);
+    File file;
+    if (file.open(&fs, "seek.bin", O_RDWR | O_CREAT)) {
+        fprintf(stderr, "seek: open failed\n");
+        any_failed = true;
+        return;
+    }
+    for (bd_size_t written = 0; written < file_size; written += buffer.size()) {
+        file.write(buffer.data(), buffer.size());
+    }
+    file.sync();
+
+    Result result("seek", dev);
+    result.add("file_size", file_size);
+    result.add("seeks", seeks);
+    uint32_t seed = 4;
+    uint8_t data[16];
+    for (size_t i = 0; i < seeks && !result.failed(); i++) {
+        seed = seed * 1103515245 + 12345;
+        off_t offset = ((uint64_t)seed * (file_size - sizeof(data))) >> 32;
+        result.check(file.seek(offset, SEEK_SET));
+        result.check(file.read(data, sizeof(data)));
+    }
+    finish(result);
+    file.close();
+    fs.unmount();
+}
+
+// Mounting a volume with some content, the startup cost
+static void bench_mount(BenchDevice &dev, size_t mounts)
+{
+    {
+        FATFileSystem fs("bench");
+        if (format_and_mount(dev, fs)) {
+            fprintf(stderr, "mount: format failed\n");
+            any_failed = true;
+            return;
+        }
+        std::vector<uint8_t> buffer(4096);
+        fill(buffer.data(), buffer.size(), 5);
+        File file;
+        file.open(&fs, "data.bin", O_WRONLY | O_CREAT);
+        for (int i = 0; i < 1024; i++) {
+            file.write(buffer.data(), buffer.size());
+        }
+        file.close();
+        fs.unmount();
+    }
+
+    FATFileSystem fs("bench");
+    Result result("mount", dev);
+    result.add("mounts", mounts);
+    for (size_t i = 0; i < mounts && !result.failed(); i++) {
+        result.check(fs.mount(dev.device()));
+        // the free cluster count is computed lazily, statvfs forces it like an application would
+        struct statvfs st;
+        result.check(fs.statvfs("/", &st));
+        result.check(fs.unmount());
+    }
+    finish(result);
+}
+
+// The append benchmark through a SegmentLog on the raw device, to compare with FAT's
+static void bench_log_append(BenchDevice &dev, bd_size_t total)
+{
+    static const size_t write_sizes[] = {32, 512, 4096, 32768};
+    std::vector<uint8_t> buffer(32768);
+    fill(buffer.data(), buffer.size(), 1);
+
+    for (size_t write_size : write_sizes) {
+        SegmentLog log;
+        if (SegmentLog::format(dev.device()) || log.mount(dev.device())) {
+            fprintf(stderr, "log_append: format failed\n");
+            any_failed = true;
+            return;
+        }
+        Result result("log_append", dev);
+        result.add("write_size", write_size);
+        result.check(log.open("append"));
+        for (bd_size_t written = 0; written < total && !result.failed(); written += write_size) {
+            if (result.check(log.write(buffer.data(), write_size)) != (ssize_t)write_size) {
+                result.check(-EIO);
+            }
+        }
+        result.check(log.close());
+        result.stop();
+        finish(result, total);
+        log.unmount();
+    }
+}
+
+// The small write benchmark through a SegmentLog, where each sync programs one block
+static void bench_log_small_write(BenchDevice &dev, size_t records, size_t record_size)
+{
+    SegmentLog log;
+    if (SegmentLog::format(dev.device()) || log.mount(dev.device())) {
+        fprintf(stderr, "log_small_write: format failed\n");
+        any_failed = true;
+        return;
+    }
+    std::vector<uint8_t> record(record_size);
+    fill(record.data(), record.size(), 2);
+    std::vector<uint32_t> latencies;
+    latencies.reserve(records);
+
+    Result result("log_small_write", dev);
+    result.add("record_size", record_size);
+    result.add("records", records);
+    result.check(log.open("small"));
+    for (size_t i = 0; i < records && !result.failed(); i++) {
+        uint64_t start_us = dev.now_us();
+        result.check(log.write(record.data(), record.size()));
+        result.check(log.sync());
+        latencies.push_back(dev.now_us() - start_us);
+    }
+    result.check(log.close());
+    result.stop();
+
+    std::sort(latencies.begin(), latencies.end());
+    if (!latencies.empty()) {
+        uint64_t sum = 0;
+        for (uint32_t latency : latencies) {
+            sum += latency;
+        }
+        result.add("mean_us", sum / latencies.size());
+        result.add("p99_us", latencies[latencies.size() * 99 / 100]);
+        result.add("max_us", latencies.back());
+    }
+    finish(result, records * record_size);
+    log.unmount();
+}
+
+// Mounting a SegmentLog after a few streams, the recovery cost after a power loss
+static void bench_log_mount(BenchDevice &dev, size_t mounts)
+{
+    {
+        SegmentLog log;
+        if (SegmentLog::format(dev.device()) || log.mount(dev.device())) {
+            fprintf(stderr, "log_mount: format failed\n");
+            any_failed = true;
+            return;
+        }
+        std::vector<uint8_t> buffer(4096);
+        fill(buffer.data(), buffer.size(), 5);
+        for (int stream = 0; stream < 5; stream++) {
+            log.open("data");
+            for (int i = 0; i < 1024; i++) {
+                log.write(buffer.data(), buffer.size());
+            }
+        }
+        log.unmount();
+    }
+
+    Result result("log_mount", dev);
+    result.add("mounts", mounts);
+    for (size_t i = 0; i < mounts && !result.failed(); i++) {
+        SegmentLog log;
+        result.check(log.mount(dev.device()));
+        result.check(log.unmount());
+    }
+    finish(result);
+}
+
+// Sequential programs and then reads of the raw striped device, for each request size, starting
+// half way into a stripe so that requests start and end with part of one; fails unless the reads
+// match the programs
+static void bench_stripe(StripeDevice &dev, bd_size_t total)
+{
+    static const size_t request_sizes[] = {4096, 16384, 65536, 262144};
+    static const bd_addr_t start = StripeDevice::stripe_size / 2;
+    std::vector<uint8_t> buffer(262144), check(262144);
+
+    for (size_t request_size : request_sizes) {
+        for (int pass = 0; pass < 2; pass++) {
+            bool write = pass == 0;
+            Result result(write ? "stripe_write" : "stripe_read", dev);
+            result.add("request_size", request_size);
+            uint64_t card_requests = dev.card_requests();
+            for (bd_size_t done = 0; done < total && !result.failed(); done += request_size) {
+                fill(buffer.data(), request_size, done + request_size);
+                if (write) {
+                    result.check(dev.device()->program(buffer.data(), start + done, request_size));
+                } else {
+                    result.check(dev.device()->read(check.data(), start + done, request_size));
+                    if (memcmp(check.data(), buffer.data(), request_size)) {
+                        result.check(-EIO);
+                    }
+                }
+            }
+            result.stop();
+            result.add("card_requests", dev.card_requests() - card_requests);
+            finish(result, total);
+        }
+    }
+}
+
+int main()
+{
+    HeapDevice heap;
+    FlashDevice flash;
+    SdDevice sd;
+    SdCacheDevice sd_cache;
+    BenchDevice *devices[] = {&heap, &flash, &sd, &sd_cache};
+
+    for (BenchDevice *dev : devices) {
+        dev->device()->init();
+        bench_append(*dev, 4 * 1024 * 1024, false);
+        bench_append(*dev, 4 * 1024 * 1024, true);
+        bench_append_aligned(*dev, 16 * 1024 * 1024);
+        bench_streams(*dev, 4 * 1024 * 1024);
+        bench_small_write(*dev, 2000, 32, false);
+        bench_small_write(*dev, 2000, 32, true);
+        bench_dir(*dev, 256);
+        bench_read_ahead(*dev, 1024 * 1024, 256);
+        bench_seek(*dev, 4 * 1024 * 1024, 2000);
+        bench_mount(*dev, 20);
+        bench_log_append(*dev, 4 * 1024 * 1024);
+        bench_log_small_write(*dev, 2000, 32);
+        bench_log_mount(*dev, 20);
+        dev->device()->deinit();
+    }
+
+    StripeDevice stripe(false);
+    StripeDevice stripe_gather(true);
+    StripeDevice *stripe_devices[] = {&stripe, &stripe_gather};
+    for (StripeDevice *dev : stripe_devices) {
+        dev->device()->init();
+        bench_stripe(*dev, 4 * 1024 * 1024);
+        dev->device()->deinit();
+    }
+    return any_failed ? 1 : 0;
+}
@@ -0,0 +1,367 @@
+// BufferedBlockDevice cache tests on the host, see README.md.
+//
+// The programs and reads reaching the device below the cache are recorded, so the tests check
+// when and how the cache writes back, not only that the data survives.
+
+#include "mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity.h"
+#include "utest.h"
+
+#include "BufferedBlockDevice.h"
+#include "HeapBlockDevice.h"
+#include "TimingBlockDevice.h"
+
+#include <utility>
+#include <vector>
+
+using namespace utest::v1;
+
+static const bd_size_t device_size = 1024 * 1024;
+static const bd_size_t unit = 512;
+
+// Block device that records the address and size of each program and read
+class RecordingBlockDevice : public TimingBlockDevice {
+public:
+    RecordingBlockDevice(BlockDevice *bd) : TimingBlockDevice(bd) {}
+
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        reads.push_back(std::make_pair(addr, size));
+        return TimingBlockDevice::read(buffer, addr, size);
+    }
+
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        programs.push_back(std::make_pair(addr, size));
+        return TimingBlockDevice::program(buffer, addr, size);
+    }
+
+    void clear()
+    {
+        reads.clear();
+        programs.clear();
+    }
+
+    std::vector<std::pair<bd_addr_t, bd_size_t> > reads;
+    std::vector<std::pair<bd_addr_t, bd_size_t> > programs;
+};
+
+HeapBlockDevice heap(device_size, unit);
+RecordingBlockDevice bd(&heap);
+
+static void fill(uint8_t *buffer, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 16;
+    }
+}
+
+static void assert_program(size_t i, bd_addr_t addr, bd_size_t size)
+{
+    TEST_ASSERT_TRUE(i < bd.programs.size());
+    TEST_ASSERT_EQUAL(addr, bd.programs[i].first);
+    TEST_ASSERT_EQUAL(size, bd.programs[i].second);
+}
+
+static void test_write_back()
+{
+    BufferedBlockDevice cache(&bd, 4);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    bd.clear();
+
+    // partial writes to three units: each unit is read once, and nothing is programmed yet
+    uint8_t data[100], check[100];
+    const bd_addr_t units[] = {20, 0, 10};
+    for (bd_addr_t u : units) {
+        fill(data, sizeof(data), u);
+        TEST_ASSERT_EQUAL(0, cache.program(data, u * unit + 10, sizeof(data)));
+    }
+    TEST_ASSERT_EQUAL(3, bd.reads.size());
+    TEST_ASSERT_EQUAL(0, bd.programs.size());
+
+    // served from the cache, while the device still has the old data
+    uint8_t block[unit];
+    for (bd_addr_t u : units) {
+        fill(data, sizeof(data), u);
+        TEST_ASSERT_EQUAL(0, cache.read(check, u * unit + 10, sizeof(check)));
+        TEST_ASSERT_EQUAL_MEMORY(data, check, sizeof(data));
+        TEST_ASSERT_EQUAL(0, heap.read(block, u * unit, sizeof(block)));
+        TEST_ASSERT_TRUE(memcmp(data, block + 10, sizeof(data)) != 0);
+    }
+    TEST_ASSERT_EQUAL(3, bd.reads.size());
+
+    // the sync writes each unit back whole, in address order
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(3, bd.programs.size());
+    assert_program(0, 0 * unit, unit);
+    assert_program(1, 10 * unit, unit);
+    assert_program(2, 20 * unit, unit);
+    for (bd_addr_t u : units) {
+        fill(data, sizeof(data), u);
+        TEST_ASSERT_EQUAL(0, heap.read(block, u * unit, sizeof(block)));
+        TEST_ASSERT_EQUAL_MEMORY(data, block + 10, sizeof(data));
+    }
+
+    buffered_bd_stats_t stats;
+    cache.get_stats(&stats);
+    TEST_ASSERT_EQUAL(3, stats.program_misses);
+    TEST_ASSERT_EQUAL(0, stats.program_hits);
+    TEST_ASSERT_EQUAL(3, stats.read_hits);
+    TEST_ASSERT_EQUAL(0, stats.evictions);
+    TEST_ASSERT_EQUAL(3, stats.programs);
+    TEST_ASSERT_EQUAL(3, stats.programmed_units);
+
+    // a second sync has nothing to write
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(3, bd.programs.size());
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+static void test_coalescing()
+{
+    BufferedBlockDevice cache(&bd, 4);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    bd.clear();
+
+    // whole units, out of order and rewritten: no reads, and one program for the run
+    uint8_t data[unit];
+    const bd_addr_t units[] = {5, 3, 6, 4, 5};
+    for (bd_addr_t u : units) {
+        fill(data, sizeof(data), u);
+        TEST_ASSERT_EQUAL(0, cache.program(data, u * unit, sizeof(data)));
+    }
+    TEST_ASSERT_EQUAL(0, bd.reads.size());
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(1, bd.programs.size());
+    assert_program(0, 3 * unit, 4 * unit);
+
+    uint8_t check[unit];
+    for (bd_addr_t u = 3; u <= 6; u++) {
+        fill(data, sizeof(data), u);
+        TEST_ASSERT_EQUAL(0, heap.read(check, u * unit, sizeof(check)));
+        TEST_ASSERT_EQUAL_MEMORY(data, check, sizeof(data));
+    }
+
+    buffered_bd_stats_t stats;
+    cache.get_stats(&stats);
+    TEST_ASSERT_EQUAL(4, stats.program_misses);
+    TEST_ASSERT_EQUAL(1, stats.program_hits);
+    TEST_ASSERT_EQUAL(1, stats.programs);
+    TEST_ASSERT_EQUAL(4, stats.programmed_units);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+static void test_eviction_order()
+{
+    BufferedBlockDevice cache(&bd, 4);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    bd.clear();
+
+    uint8_t data[unit];
+    fill(data, sizeof(data), 1);
+    const bd_addr_t units[] = {0, 10, 20, 30};
+    for (bd_addr_t u : units) {
+        TEST_ASSERT_EQUAL(0, cache.program(data, u * unit, sizeof(data)));
+    }
+    // using unit 0 again makes unit 10 the least recently used
+    uint8_t check[16];
+    TEST_ASSERT_EQUAL(0, cache.read(check, 0, sizeof(check)));
+    TEST_ASSERT_EQUAL(0, bd.programs.size());
+
+    TEST_ASSERT_EQUAL(0, cache.program(data, 40 * unit, sizeof(data)));
+    TEST_ASSERT_EQUAL(1, bd.programs.size());
+    assert_program(0, 10 * unit, unit);
+    TEST_ASSERT_EQUAL(0, cache.program(data, 50 * unit, sizeof(data)));
+    TEST_ASSERT_EQUAL(2, bd.programs.size());
+    assert_program(1, 20 * unit, unit);
+
+    // evicting a unit writes back the whole run of dirty units it is in
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    bd.clear();
+    const bd_addr_t run[] = {100, 101, 102, 200};
+    for (bd_addr_t u : run) {
+        TEST_ASSERT_EQUAL(0, cache.program(data, u * unit, sizeof(data)));
+    }
+    TEST_ASSERT_EQUAL(0, bd.programs.size());
+    TEST_ASSERT_EQUAL(0, cache.program(data, 300 * unit, sizeof(data)));
+    TEST_ASSERT_EQUAL(1, bd.programs.size());
+    assert_program(0, 100 * unit, 3 * unit);
+
+    buffered_bd_stats_t stats;
+    cache.get_stats(&stats);
+    TEST_ASSERT_EQUAL(3, stats.evictions);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+    TEST_ASSERT_EQUAL(3, bd.programs.size());  // the deinit wrote back units 200 and 300
+    assert_program(1, 200 * unit, unit);
+    assert_program(2, 300 * unit, unit);
+}
+
+static void test_bypass_and_counts()
+{
+    BufferedBlockDevice cache(&bd, 4);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    bd.clear();
+
+    // a write of at least as many whole units as the cache holds goes straight to the device
+    std::vector<uint8_t> data(5 * unit), check(5 * unit);
+    fill(data.data(), data.size(), 2);
+    TEST_ASSERT_EQUAL(0, cache.program(data.data(), 64 * unit, data.size()));
+    TEST_ASSERT_EQUAL(1, bd.programs.size());
+    assert_program(0, 64 * unit, 5 * unit);
+
+    // and isn't cached: reading it back reads the device, in one read
+    TEST_ASSERT_EQUAL(0, cache.read(check.data(), 64 * unit, check.size()));
+    TEST_ASSERT_EQUAL_MEMORY(data.data(), check.data(), data.size());
+    TEST_ASSERT_EQUAL(1, bd.reads.size());
+
+    // a cached unit splits a read of the device around it
+    TEST_ASSERT_EQUAL(0, cache.program(data.data(), 66 * unit + 1, 1));
+    bd.clear();
+    TEST_ASSERT_EQUAL(0, cache.read(check.data(), 64 * unit, check.size()));
+    TEST_ASSERT_EQUAL_MEMORY(data.data(), check.data(), 2 * unit + 1);
+    TEST_ASSERT_EQUAL(data[0], check[2 * unit + 1]);
+    TEST_ASSERT_EQUAL(2, bd.reads.size());
+
+    buffered_bd_stats_t stats;
+    cache.get_stats(&stats);
+    TEST_ASSERT_EQUAL(5, stats.bypass_units);
+    TEST_ASSERT_EQUAL(5 + 4, stats.read_misses);
+    TEST_ASSERT_EQUAL(1, stats.read_hits);
+    TEST_ASSERT_EQUAL(0, stats.programs);
+
+    cache.reset_stats();
+    cache.get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.bypass_units + stats.read_misses + stats.read_hits + stats.program_misses);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+static void test_read_ahead()
+{
+    BufferedBlockDevice cache(&bd, 8, 4);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    bd.clear();
+
+    // small sequential reads: the first one reads its unit, and from the second one on, each miss
+    // reads 4 units in one go
+    std::vector<uint8_t> expected(16 * unit), check(32);
+    TEST_ASSERT_EQUAL(0, heap.read(expected.data(), 0, expected.size()));
+    for (bd_addr_t addr = 0; addr < expected.size(); addr += check.size()) {
+        TEST_ASSERT_EQUAL(0, cache.read(check.data(), addr, check.size()));
+        TEST_ASSERT_EQUAL_MEMORY(&expected[addr], check.data(), check.size());
+    }
+    TEST_ASSERT_EQUAL(1 + 4, bd.reads.size());
+    for (size_t i = 1; i < bd.reads.size(); i++) {
+        TEST_ASSERT_EQUAL(4 * unit, bd.reads[i].second);
+    }
+
+    buffered_bd_stats_t stats;
+    cache.get_stats(&stats);
+    TEST_ASSERT_EQUAL(4 * 3, stats.read_ahead_units);
+    TEST_ASSERT_EQUAL(4 * 3, stats.read_ahead_hits);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+// Random reads, writes and syncs against a reference copy, with several cache sizes
+static void test_random()
+{
+    const uint32_t configs[][2] = {{1, 0}, {3, 0}, {8, 0}, {8, 4}};
+    std::vector<uint8_t> reference(64 * unit), buffer(8 * unit);
+    for (auto &config : configs) {
+        TEST_ASSERT_EQUAL(0, heap.program(reference.data(), 0, reference.size()));
+        BufferedBlockDevice cache(&bd, config[0], config[1]);
+        TEST_ASSERT_EQUAL(0, cache.init());
+        uint32_t seed = config[0] * 10 + config[1];
+        for (int i = 0; i < 5000; i++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t op = (seed >> 16) % 16;
+            seed = seed * 1103515245 + 12345;
+            bd_size_t size = 1 + (seed >> 16) % buffer.size();
+            seed = seed * 1103515245 + 12345;
+            bd_addr_t addr = (seed >> 8) % (reference.size() - size);
+            if (op < 7) {
+                fill(buffer.data(), size, seed);
+                TEST_ASSERT_EQUAL(0, cache.program(buffer.data(), addr, size));
+                memcpy(&reference[addr], buffer.data(), size);
+            } else if (op < 15) {
+                TEST_ASSERT_EQUAL(0, cache.read(buffer.data(), addr, size));
+                TEST_ASSERT_EQUAL_MEMORY(&reference[addr], buffer.data(), size);
+            } else {
+                TEST_ASSERT_EQUAL(0, cache.sync());
+            }
+        }
+        TEST_ASSERT_EQUAL(0, cache.deinit());
+        std::vector<uint8_t> check(reference.size());
+        TEST_ASSERT_EQUAL(0, heap.read(check.data(), 0, check.size()));
+        TEST_ASSERT_EQUAL_MEMORY(reference.data(), check.data(), reference.size());
+    }
+}
+
+// Addresses past 4 GiB, on a sparse device as large as an 8 GB card
+static void test_large_addresses()
+{
+    static const bd_addr_t base = 5ULL * 1024 * 1024 * 1024;
+    HeapBlockDevice large_heap(8ULL * 1024 * 1024 * 1024, unit, unit, 64 * 1024);
+    RecordingBlockDevice large(&large_heap);
+    BufferedBlockDevice cache(&large, 8, 4);
+    TEST_ASSERT_EQUAL(0, cache.init());
+
+    // a partial write is cached at its own address, and written back there
+    uint8_t data[16], check[16];
+    fill(data, sizeof(data), 5);
+    TEST_ASSERT_EQUAL(0, cache.program(data, base + 1024, sizeof(data)));
+    TEST_ASSERT_EQUAL(0, cache.read(check, base + 1024, sizeof(check)));
+    TEST_ASSERT_EQUAL_MEMORY(data, check, sizeof(data));
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(1, large.programs.size());
+    TEST_ASSERT_EQUAL(base + 1024, large.programs[0].first);
+    uint8_t written[unit];
+    TEST_ASSERT_EQUAL(0, large_heap.read(written, base + 1024, sizeof(written)));
+    TEST_ASSERT_EQUAL_MEMORY(data, written, sizeof(data));
+
+    // a write bypassing the cache, read back in small sequential reads through read-ahead
+    std::vector<uint8_t> block(16 * unit), small(32);
+    fill(block.data(), block.size(), 6);
+    TEST_ASSERT_EQUAL(0, cache.program(block.data(), base + 64 * unit, block.size()));
+    large.clear();
+    for (bd_addr_t offset = 0; offset < block.size(); offset += small.size()) {
+        TEST_ASSERT_EQUAL(0, cache.read(small.data(), base + 64 * unit + offset, small.size()));
+        TEST_ASSERT_EQUAL_MEMORY(&block[offset], small.data(), small.size());
+    }
+    for (auto &read : large.reads) {
+        TEST_ASSERT_TRUE(read.first >= base + 64 * unit && read.first < base + 80 * unit);
+    }
+
+    buffered_bd_stats_t stats;
+    cache.get_stats(&stats);
+    TEST_ASSERT_EQUAL(16, stats.bypass_units);
+    TEST_ASSERT_TRUE(stats.read_ahead_hits > 0);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+
+// test setup
+utest::v1::status_t test_setup(const size_t number_of_cases)
+{
+    GREENTEA_SETUP(120, "default_auto");
+    return verbose_test_setup_handler(number_of_cases);
+}
+
+Case cases[] = {
+    Case("Write-back on sync", test_write_back),
+    Case("Coalescing adjacent units", test_coalescing),
+    Case("Eviction order", test_eviction_order),
+    Case("Bypass and counts", test_bypass_and_counts),
+    Case("Sequential read-ahead", test_read_ahead),
+    Case("Random against a reference", test_random),
+    Case("Addresses past 4 GiB", test_large_addresses),
+};
+
+Specification specification(test_setup, cases);
+
+int main()
+{
+    heap.init();  // keeps the data while each case inits and deinits its cache over it
+    return !Harness::run(specification);
+}
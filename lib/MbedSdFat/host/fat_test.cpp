@@ -0,0 +1,375 @@
+// FatFs allocation tests on the host, see README.md.
+//
+// Cluster chains are checked by walking the FAT on the device, so they show what a computer (or
+// a power loss) would find on the card, not what FatFs holds in RAM.
+
+#include "mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity.h"
+#include "utest.h"
+
+#include "FATFileSystem.h"
+#include "HeapBlockDevice.h"
+#include "MBRBlockDevice.h"
+#include "TimingBlockDevice.h"
+
+#include <vector>
+
+using namespace utest::v1;
+
+static const bd_size_t cluster_size = 4096;
+
+// Block device that counts the reads of the device and the programs into a watched range
+class CountingBlockDevice : public TimingBlockDevice {
+public:
+    CountingBlockDevice(BlockDevice *bd) : TimingBlockDevice(bd), reads(0), programs(0), watch_start(0), watch_end(0) {}
+
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        reads++;
+        return TimingBlockDevice::read(buffer, addr, size);
+    }
+
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        if (addr < watch_end && addr + size > watch_start) {
+            programs++;
+        }
+        return TimingBlockDevice::program(buffer, addr, size);
+    }
+
+    void clear()
+    {
+        reads = 0;
+        programs = 0;
+    }
+
+    uint32_t reads;
+    uint32_t programs;
+    bd_addr_t watch_start;
+    bd_addr_t watch_end;
+};
+
+HeapBlockDevice heap(16 * 1024 * 1024, 512);
+CountingBlockDevice bd(&heap);
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// Returns the number of clusters in the chain of a file in the root directory of the FAT12/16
+// volume formatted at the start of dev, given its 8.3 name (eg "EXTENT  BIN"), or -1 if not found
+static int chain_length(BlockDevice &dev, const char *name83)
+{
+    uint8_t boot[512];
+    dev.read(boot, 0, sizeof(boot));
+    uint32_t sector = get_le16(boot + 11);
+    uint32_t fat_start = get_le16(boot + 14);
+    uint32_t fat_size = get_le16(boot + 22);
+    uint32_t root_start = fat_start + boot[16] * fat_size;
+    uint32_t root_sectors = (get_le16(boot + 17) * 32 + sector - 1) / sector;
+    std::vector<uint8_t> fat(fat_size * sector);
+    dev.read(fat.data(), fat_start * sector, fat.size());
+    std::vector<uint8_t> root(root_sectors * sector);
+    dev.read(root.data(), root_start * sector, root.size());
+
+    for (size_t i = 0; i < root.size() && root[i] != 0; i += 32) {
+        if (memcmp(&root[i], name83, 11) != 0) {
+            continue;
+        }
+        int n = 0;
+        for (uint32_t clst = get_le16(&root[i] + 26); clst >= 2 && clst < 0xFFF8; clst = get_le16(&fat[clst * 2])) {
+            n++;
+        }
+        return n;
+    }
+    return -1;
+}
+
+// Watches the FATs of the FAT12/16 volume formatted at the start of dev
+static void watch_fats(CountingBlockDevice &dev)
+{
+    uint8_t boot[512];
+    dev.read(boot, 0, sizeof(boot));
+    uint32_t sector = get_le16(boot + 11);
+    dev.watch_start = get_le16(boot + 14) * sector;
+    dev.watch_end = dev.watch_start + boot[16] * get_le16(boot + 22) * sector;
+}
+
+static int clusters(size_t bytes)
+{
+    return (bytes + cluster_size - 1) / cluster_size;
+}
+
+static void test_extent_release()
+{
+    static const size_t extent = 64 * 1024;
+    uint8_t buffer[1000];
+    memset(buffer, 0x5a, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL(0, FATFileSystem::format(&bd, cluster_size));
+    FATFileSystem fs("fat");
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    struct statvfs before;
+    TEST_ASSERT_EQUAL(0, fs.statvfs("", &before));
+
+    // a short file with an extent: the sync keeps the extent, the close gives the rest back
+    File file;
+    TEST_ASSERT_EQUAL(0, file.open(&fs, "extent.bin", O_WRONLY | O_CREAT));
+    TEST_ASSERT_EQUAL(0, file.set_extent_size(extent));
+    TEST_ASSERT_EQUAL(100, file.write(buffer, 100));
+    TEST_ASSERT_EQUAL(0, file.sync());
+    TEST_ASSERT_EQUAL(clusters(extent), chain_length(bd, "EXTENT  BIN"));
+    TEST_ASSERT_EQUAL(0, file.close());
+    TEST_ASSERT_EQUAL(1, chain_length(bd, "EXTENT  BIN"));
+
+    // a file over a few extents, ending part way into the last one
+    size_t size = 0;
+    TEST_ASSERT_EQUAL(0, file.open(&fs, "long.bin", O_WRONLY | O_CREAT));
+    TEST_ASSERT_EQUAL(0, file.set_extent_size(extent));
+    while (size < 2 * extent + 5000) {
+        TEST_ASSERT_EQUAL((ssize_t)sizeof(buffer), file.write(buffer, sizeof(buffer)));
+        size += sizeof(buffer);
+        if (size % 16000 == 0) {
+            TEST_ASSERT_EQUAL(0, file.checkpoint());
+        }
+    }
+    TEST_ASSERT_EQUAL(0, file.close());
+    TEST_ASSERT_EQUAL(clusters(size), chain_length(bd, "LONG    BIN"));
+
+    struct statvfs after;
+    TEST_ASSERT_EQUAL(0, fs.statvfs("", &after));
+    TEST_ASSERT_EQUAL(before.f_bfree * before.f_frsize - (1 + clusters(size)) * cluster_size,
+                      after.f_bfree * after.f_frsize);
+
+    // and the free space counted again from the FAT agrees
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    TEST_ASSERT_EQUAL(0, fs.statvfs("", &after));
+    TEST_ASSERT_EQUAL(before.f_bfree * before.f_frsize - (1 + clusters(size)) * cluster_size,
+                      after.f_bfree * after.f_frsize);
+    TEST_ASSERT_EQUAL(1, chain_length(bd, "EXTENT  BIN"));
+    TEST_ASSERT_EQUAL(clusters(size), chain_length(bd, "LONG    BIN"));
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+}
+
+static void test_checkpoint_power_loss()
+{
+    static const size_t extent = 32 * 1024;
+    uint8_t buffer[700];
+    memset(buffer, 0xa5, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL(0, FATFileSystem::format(&bd, cluster_size));
+    FATFileSystem fs("fat");
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    File file;
+    TEST_ASSERT_EQUAL(0, file.open(&fs, "ckpt.bin", O_WRONLY | O_CREAT));
+    TEST_ASSERT_EQUAL(0, file.set_extent_size(extent));
+    size_t size = 0;
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL((ssize_t)sizeof(buffer), file.write(buffer, sizeof(buffer)));
+        size += sizeof(buffer);
+        TEST_ASSERT_EQUAL(0, file.checkpoint());
+
+        // what a power loss now leaves: all of the data, and at most an extent of lost clusters
+        FATFileSystem probe("probe");
+        TEST_ASSERT_EQUAL(0, probe.mount(&bd));
+        struct stat st;
+        TEST_ASSERT_EQUAL(0, probe.stat("ckpt.bin", &st));
+        TEST_ASSERT_EQUAL(size, st.st_size);
+        TEST_ASSERT_EQUAL(0, probe.unmount());
+        int n = chain_length(bd, "CKPT    BIN");
+        TEST_ASSERT_TRUE(n >= clusters(size) && n <= clusters(size) + clusters(extent));
+    }
+    TEST_ASSERT_EQUAL(0, file.close());
+    TEST_ASSERT_EQUAL(clusters(size), chain_length(bd, "CKPT    BIN"));
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+}
+
+static void test_append_run()
+{
+    static const size_t size = 4 * 1024 * 1024;
+    static const size_t sync_interval = 1024 * 1024;
+    uint8_t buffer[4096];
+    memset(buffer, 0x3c, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL(0, FATFileSystem::format(&bd, cluster_size));
+    watch_fats(bd);
+    FATFileSystem fs("fat");
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    File file;
+    TEST_ASSERT_EQUAL(0, file.open(&fs, "append.bin", O_WRONLY | O_CREAT));
+    bd.clear();
+    for (size_t written = 0; written < size;) {
+        TEST_ASSERT_EQUAL((ssize_t)sizeof(buffer), file.write(buffer, sizeof(buffer)));
+        written += sizeof(buffer);
+        if (written % sync_interval == 0) {
+            TEST_ASSERT_EQUAL(0, file.sync());
+        }
+    }
+    TEST_ASSERT_EQUAL(0, file.close());
+
+    // with fat_chan.ff_append_run, each FAT is written once per run and once per sync, rather
+    // than for each cluster
+    uint32_t updates = clusters(size) / FF_APPEND_RUN + size / sync_interval + 1;
+    TEST_ASSERT_TRUE(bd.programs <= 2 * updates);
+    TEST_ASSERT_EQUAL(clusters(size), chain_length(bd, "APPEND  BIN"));
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+}
+
+static void test_free_map()
+{
+    uint8_t buffer[1000];
+    memset(buffer, 0x96, sizeof(buffer));
+
+    // fragment the free space with files of different sizes, removing every other one
+    TEST_ASSERT_EQUAL(0, FATFileSystem::format(&bd, cluster_size));
+    FATFileSystem fs("fat");
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    char name[16];
+    for (int i = 0; i < 40; i++) {
+        File file;
+        sprintf(name, "frag%02d.bin", i);
+        TEST_ASSERT_EQUAL(0, file.open(&fs, name, O_WRONLY | O_CREAT));
+        for (int j = 0; j < (i % 7 + 1) * 9; j++) {
+            TEST_ASSERT_EQUAL((ssize_t)sizeof(buffer), file.write(buffer, sizeof(buffer)));
+        }
+        TEST_ASSERT_EQUAL(0, file.close());
+    }
+    for (int i = 0; i < 40; i += 2) {
+        sprintf(name, "frag%02d.bin", i);
+        TEST_ASSERT_EQUAL(0, fs.remove(name));
+    }
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+
+    // FAT16 has no FSInfo, so without the map statvfs counts the free clusters in the FAT
+    struct statvfs scanned;
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    bd.clear();
+    TEST_ASSERT_EQUAL(0, fs.statvfs("", &scanned));
+    uint32_t scan_reads = bd.reads;
+    watch_fats(bd);
+    TEST_ASSERT_TRUE(scan_reads >= (bd.watch_end - bd.watch_start) / 2 / 512);
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+
+    // once the map is built a few FAT sectors at a time, it answers without reading the FAT
+    struct statvfs mapped;
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    int left;
+    do {
+        left = fs.build_free_map(4);
+    } while (left > 0);
+    TEST_ASSERT_EQUAL(0, left);
+    bd.clear();
+    TEST_ASSERT_EQUAL(0, fs.statvfs("", &mapped));
+    TEST_ASSERT_EQUAL(0, bd.reads);
+    TEST_ASSERT_EQUAL(scanned.f_bfree, mapped.f_bfree);
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+}
+
+// Partitions dev with a FAT volume starting at start
+static void format_partition(BlockDevice &dev, bd_addr_t start)
+{
+    TEST_ASSERT_EQUAL(0, MBRBlockDevice::partition(&dev, 1, 0x06, start));
+    MBRBlockDevice part(&dev, 1);
+    TEST_ASSERT_EQUAL(0, part.init());
+    TEST_ASSERT_EQUAL(0, FATFileSystem::format(&part, cluster_size));
+    TEST_ASSERT_EQUAL(0, part.deinit());
+}
+
+static void test_warm_mount()
+{
+    format_partition(bd, 1024 * 1024);
+    FATFileSystem fs("fat");
+    bd.clear();
+    TEST_ASSERT_EQUAL(0, fs.mount(&bd));
+    uint32_t cold_reads = bd.reads;
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+
+    bd.clear();
+    TEST_ASSERT_EQUAL(0, fs.warm_mount(&bd));
+    uint32_t warm_reads = bd.reads;
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+
+    // a card partitioned differently since, with no volume left at the hint: it costs a read
+    // and still mounts
+    uint8_t zeros[512] = {};
+    TEST_ASSERT_EQUAL(0, heap.program(zeros, 1024 * 1024, sizeof(zeros)));
+    format_partition(bd, 2 * 1024 * 1024);
+    bd.clear();
+    TEST_ASSERT_EQUAL(0, fs.warm_mount(&bd));
+    uint32_t stale_reads = bd.reads;
+    struct statvfs st;
+    TEST_ASSERT_EQUAL(0, fs.statvfs("", &st));
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+    TEST_ASSERT_EQUAL(cold_reads - 1, warm_reads);
+    TEST_ASSERT_EQUAL(cold_reads, stale_reads - 1);
+}
+
+// Checks that the FAT and data area of the FAT12/16 volume formatted at the start of dev are on
+// boundaries of align bytes of the device under it, which starts offset bytes before dev
+static void check_aligned(BlockDevice &dev, bd_addr_t offset, bd_size_t align)
+{
+    uint8_t boot[512];
+    TEST_ASSERT_EQUAL(0, dev.read(boot, 0, sizeof(boot)));
+    uint32_t sector = get_le16(boot + 11);
+    uint32_t fat_start = get_le16(boot + 14);
+    uint32_t root_start = fat_start + boot[16] * get_le16(boot + 22);
+    uint32_t data_start = root_start + (get_le16(boot + 17) * 32 + sector - 1) / sector;
+    TEST_ASSERT_EQUAL(0, (offset + fat_start * sector) % align);
+    TEST_ASSERT_EQUAL(0, (offset + data_start * sector) % align);
+    TEST_ASSERT_TRUE(boot[13] * sector <= align);
+}
+
+static void test_aligned_format()
+{
+    static const bd_size_t align = 1024 * 1024;
+
+    TEST_ASSERT_EQUAL(0, FATFileSystem::format(&bd, 0, align));
+    check_aligned(bd, 0, align);
+
+    // a partition keeps the alignment relative to the device
+    TEST_ASSERT_EQUAL(0, MBRBlockDevice::partition_aligned(&bd, 1, 0x06, align));
+    MBRBlockDevice part(&bd, 1);
+    TEST_ASSERT_EQUAL(0, part.init());
+    TEST_ASSERT_EQUAL(0, part.get_partition_start() % align);
+    TEST_ASSERT_EQUAL(0, FATFileSystem::format(&part, 0, align));
+    check_aligned(part, part.get_partition_start(), align);
+
+    // and the volume works
+    FATFileSystem fs("fat");
+    TEST_ASSERT_EQUAL(0, fs.mount(&part));
+    File file;
+    uint8_t buffer[1000];
+    memset(buffer, 0x69, sizeof(buffer));
+    TEST_ASSERT_EQUAL(0, file.open(&fs, "aligned.bin", O_WRONLY | O_CREAT));
+    TEST_ASSERT_EQUAL((ssize_t)sizeof(buffer), file.write(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(0, file.close());
+    TEST_ASSERT_EQUAL(0, fs.unmount());
+    TEST_ASSERT_EQUAL(0, part.deinit());
+}
+
+
+// test setup
+utest::v1::status_t test_setup(const size_t number_of_cases)
+{
+    GREENTEA_SETUP(120, "default_auto");
+    return verbose_test_setup_handler(number_of_cases);
+}
+
+Case cases[] = {
+    Case("Extent released on close", test_extent_release),
+    Case("Checkpoint and power loss", test_checkpoint_power_loss),
+    Case("Append run FAT writes", test_append_run),
+    Case("Free map statvfs", test_free_map),
+    Case("Warm mount", test_warm_mount),
+    Case("Aligned format", test_aligned_format),
+};
+
+Specification specification(test_setup, cases);
+
+int main()
+{
+    return !Harness::run(specification);
+}
@@ -0,0 +1,202 @@
+// SD card logic from SDCardUtils on the host, see README.md.
+//
+// The SD card driver needs SPI hardware, so only the logic it doesn't need the bus for is tested:
+// the transfer clocks it tries, the registers it decodes, and the data block CRC.
+
+#include "mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity.h"
+#include "utest.h"
+
+#include "components/storage/blockdevice/COMPONENT_SD/SDCardUtils.h"
+
+#include <string.h>
+
+using namespace utest::v1;
+
+static const uint32_t core_clock = 72000000;
+
+void test_max_frequency()
+{
+    TEST_ASSERT_EQUAL(25000000, sd_max_frequency(false, 0xFFFFFFFF));
+    TEST_ASSERT_EQUAL(50000000, sd_max_frequency(true, 0xFFFFFFFF));
+    TEST_ASSERT_EQUAL(20000000, sd_max_frequency(true, 20000000));
+    TEST_ASSERT_EQUAL(20000000, sd_max_frequency(false, 20000000));
+}
+
+void test_divided_frequency()
+{
+    TEST_ASSERT_EQUAL(36000000, sd_divided_frequency(core_clock, 50000000));
+    TEST_ASSERT_EQUAL(24000000, sd_divided_frequency(core_clock, 25000000));
+    TEST_ASSERT_EQUAL(24000000, sd_divided_frequency(core_clock, 24000000));
+    TEST_ASSERT_EQUAL(18000000, sd_divided_frequency(core_clock, 23999999));
+    TEST_ASSERT_EQUAL(72000000, sd_divided_frequency(core_clock, 100000000));
+    TEST_ASSERT_EQUAL(1000000, sd_divided_frequency(core_clock, 1000000));
+}
+
+// Falling back from the high speed clock tries every divider in turn, down to the lowest clock
+void test_fallback_order()
+{
+    uint32_t sck = sd_divided_frequency(core_clock, sd_max_frequency(true, 0xFFFFFFFF));
+    uint32_t div = 2;
+    TEST_ASSERT_EQUAL(core_clock / div, sck);
+    while (0 != (sck = sd_lower_frequency(core_clock, sck))) {
+        div++;
+        TEST_ASSERT_EQUAL(core_clock / div, sck);
+    }
+    TEST_ASSERT_EQUAL(core_clock / SD_AUTO_FREQUENCY_MIN, div);
+
+    // 72 MHz / 7 is not a whole number of Hz, and needs 72 MHz / 8 next
+    TEST_ASSERT_EQUAL(9000000, sd_lower_frequency(core_clock, core_clock / 7));
+    TEST_ASSERT_EQUAL(0, sd_lower_frequency(core_clock, SD_AUTO_FREQUENCY_MIN));
+
+    // A core clock with few whole dividers, from a limit between them
+    sck = sd_divided_frequency(48000000, 20000000);
+    TEST_ASSERT_EQUAL(16000000, sck);
+    TEST_ASSERT_EQUAL(12000000, sck = sd_lower_frequency(48000000, sck));
+    TEST_ASSERT_EQUAL(9600000, sck = sd_lower_frequency(48000000, sck));
+    TEST_ASSERT_EQUAL(8000000, sd_lower_frequency(48000000, sck));
+}
+
+void test_high_speed_status()
+{
+    uint8_t status[64];
+    memset(status, 0, sizeof(status));
+
+    status[16] = 0x01;                          // group 1 switched to function 1, high speed
+    TEST_ASSERT_TRUE(sd_high_speed_selected(status));
+    status[16] = 0x81;                          // group 2 is in the high nibble
+    TEST_ASSERT_TRUE(sd_high_speed_selected(status));
+    status[16] = 0x0F;                          // the switch failed
+    TEST_ASSERT_FALSE(sd_high_speed_selected(status));
+    status[16] = 0x00;                          // still default speed
+    TEST_ASSERT_FALSE(sd_high_speed_selected(status));
+    status[16] = 0x10;
+    TEST_ASSERT_FALSE(sd_high_speed_selected(status));
+}
+
+void test_au_size()
+{
+    static const uint32_t expected[16] = {
+        0, 16 * 1024, 32 * 1024, 64 * 1024, 128 * 1024, 256 * 1024, 512 * 1024, 1024 * 1024,
+        2 * 1024 * 1024, 4 * 1024 * 1024, 8 * 1024 * 1024, 12 * 1024 * 1024, 16 * 1024 * 1024,
+        24 * 1024 * 1024, 32 * 1024 * 1024, 64 * 1024 * 1024
+    };
+    uint8_t status[64];
+    memset(status, 0xFF, sizeof(status));
+    for (uint32_t code = 0; code < 16; code++) {
+        status[10] = (code << 4) | 0x0F;        // the low nibble is reserved
+        TEST_ASSERT_EQUAL(expected[code], sd_au_size(status));
+    }
+}
+
+// Bit at a time reference CRC16-CCITT (XModem): polynomial 0x1021, zero seed, no reflection
+static uint16_t reference_crc16(uint16_t crc, uint8_t byte)
+{
+    crc ^= byte << 8;
+    for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t reference_crc16(const uint8_t *data, uint32_t length)
+{
+    uint16_t crc = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        crc = reference_crc16(crc, data[i]);
+    }
+    return crc;
+}
+
+static void fill(uint8_t *buffer, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 16;
+    }
+}
+
+void test_crc16()
+{
+    TEST_ASSERT_EQUAL(0x31C3, sd_crc16_ccitt((const uint8_t *)"123456789", 9));
+    TEST_ASSERT_EQUAL(0x0000, sd_crc16_ccitt(NULL, 0));
+
+    // A block of ones, the example in the SD physical layer specification
+    uint8_t block[512 + 4];
+    memset(block, 0xFF, 512);
+    TEST_ASSERT_EQUAL(0x7FA1, sd_crc16_ccitt(block, 512));
+
+    for (uint32_t length = 0; length <= sizeof(block); length++) {
+        fill(block, sizeof(block), length);
+        TEST_ASSERT_EQUAL(reference_crc16(block, length), sd_crc16_ccitt(block, length));
+    }
+}
+
+// CRC engine taking bytes and words like the LPC15xx one, with the target's byte swap of each word
+class ModelCrcEngine {
+public:
+    ModelCrcEngine() : crc(0), bytes(0), words(0) {}
+
+    void write_byte(uint8_t byte)
+    {
+        crc = reference_crc16(crc, byte);
+        bytes++;
+    }
+
+    void write_word(uint32_t word)
+    {
+        // The target swaps the little-endian word, then the engine shifts it in from bit 31
+        uint32_t swapped = __builtin_bswap32(word);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            crc = reference_crc16(crc, swapped >> shift);
+        }
+        words++;
+    }
+
+    uint16_t crc;
+    uint32_t bytes;
+    uint32_t words;
+};
+
+void test_crc16_engine_feed()
+{
+    uint32_t buffer[(512 + 8) / 4];
+    uint8_t *base = (uint8_t *)buffer;
+    fill(base, sizeof(buffer), 1);
+
+    for (uint32_t offset = 0; offset < 4; offset++) {
+        for (uint32_t length = 0; length <= 512; length++) {
+            ModelCrcEngine engine;
+            sd_crc16_ccitt_feed(engine, base + offset, length);
+            TEST_ASSERT_EQUAL(sd_crc16_ccitt(base + offset, length), engine.crc);
+            TEST_ASSERT_EQUAL(length, engine.bytes + 4 * engine.words);
+            TEST_ASSERT_TRUE(engine.bytes < 7);
+        }
+    }
+}
+
+
+// test setup
+utest::v1::status_t test_setup(const size_t number_of_cases)
+{
+    GREENTEA_SETUP(120, "default_auto");
+    return verbose_test_setup_handler(number_of_cases);
+}
+
+Case cases[] = {
+    Case("Max frequency", test_max_frequency),
+    Case("Divided frequency", test_divided_frequency),
+    Case("Fallback order", test_fallback_order),
+    Case("High speed switch status", test_high_speed_status),
+    Case("Allocation unit size", test_au_size),
+    Case("Data block CRC", test_crc16),
+    Case("CRC engine feed", test_crc16_engine_feed),
+};
+
+Specification specification(test_setup, cases);
+
+int main()
+{
+    return !Harness::run(specification);
+}
@@ -0,0 +1,334 @@
+// SegmentLog tests on the host, see README.md.
+//
+// Streams are read back by parsing the device, with the layout documented in SegmentLog.cpp,
+// the same way DataloggerTools/extract does from a card image.
+
+#include "mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity.h"
+#include "utest.h"
+
+#include "HeapBlockDevice.h"
+#include "SegmentLog.h"
+#include "TimingBlockDevice.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace utest::v1;
+
+static const bd_size_t device_size = 256 * 1024;
+static const bd_size_t segment_size = 16 * 1024;    // 16 segments, each with 31 data blocks
+
+HeapBlockDevice heap(device_size, 512);
+TimingBlockDevice bd(&heap);
+
+// Block device that stops programming at a "power loss", dropping programs after it. Unlike
+// HeapBlockDevice, an erase clears the data, as on a card, and the power loss can be set to
+// happen right after the erase at lose_after_erase.
+class PowerLossBlockDevice : public TimingBlockDevice {
+public:
+    PowerLossBlockDevice(BlockDevice *bd) : TimingBlockDevice(bd), lost(false), lose_after_erase(-1), _bd(bd) {}
+
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        return lost ? BD_ERROR_DEVICE_ERROR : TimingBlockDevice::program(buffer, addr, size);
+    }
+
+    virtual int erase(bd_addr_t addr, bd_size_t size)
+    {
+        if (lost) {
+            return BD_ERROR_DEVICE_ERROR;
+        }
+        int err = TimingBlockDevice::erase(addr, size);
+        if (!err) {
+            std::vector<uint8_t> erased(size, 0xff);
+            err = _bd->program(erased.data(), addr, size);
+        }
+        if (addr == lose_after_erase) {
+            lost = true;
+        }
+        return err;
+    }
+
+    bool lost;
+    bd_addr_t lose_after_erase;
+
+private:
+    BlockDevice *_bd;
+};
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+        }
+    }
+    return ~crc;
+}
+
+// Reads a stream back from the device, returning its name in name if found
+static std::vector<uint8_t> read_stream(BlockDevice &dev, uint32_t stream, char *name = NULL)
+{
+    uint8_t block[SEGMENT_LOG_BLOCK_SIZE];
+    dev.read(block, 0, sizeof(block));
+    bd_size_t seg_size = get_le32(block + 16);
+    uint32_t seg_count = get_le32(block + 20);
+    uint8_t id[4];
+    memcpy(id, block + 24, sizeof(id));
+
+    // segments of the stream, by part
+    std::vector<std::pair<uint32_t, uint32_t> > segments;
+    for (uint32_t i = 1; i < seg_count; i++) {
+        dev.read(block, i * seg_size, sizeof(block));
+        if (memcmp(block, "SEGLOGHD", 8) == 0 && memcmp(block + 8, id, 4) == 0
+                && get_le32(block + 56) == crc32(0, block, 56) && get_le32(block + 16) == stream) {
+            segments.push_back(std::make_pair(get_le32(block + 20), i));
+            if (name) {
+                strcpy(name, (const char *)block + 24);
+            }
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    std::vector<uint8_t> data;
+    for (size_t s = 0; s < segments.size(); s++) {
+        bd_addr_t start = segments[s].second * seg_size;
+        dev.read(block, start, sizeof(block));
+        uint32_t sequence = get_le32(block + 12);
+        for (uint32_t b = 1; b < seg_size / SEGMENT_LOG_BLOCK_SIZE; b++) {
+            dev.read(block, start + b * SEGMENT_LOG_BLOCK_SIZE, sizeof(block));
+            const uint8_t *trailer = block + SEGMENT_LOG_BLOCK_PAYLOAD;
+            uint16_t used = trailer[4] | (trailer[5] << 8);
+            uint16_t index = trailer[6] | (trailer[7] << 8);
+            if (get_le32(trailer) != sequence || index != b || used > SEGMENT_LOG_BLOCK_PAYLOAD
+                    || get_le32(trailer + 8) != crc32(crc32(0, id, 4), block, SEGMENT_LOG_BLOCK_SIZE - 4)) {
+                break;
+            }
+            data.insert(data.end(), block, block + used);
+        }
+    }
+    return data;
+}
+
+static std::vector<uint8_t> pattern(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+    return data;
+}
+
+// Writes data in chunks of varying sizes, with a sync every sync_every chunks if not 0
+static void write_chunks(SegmentLog &log, const std::vector<uint8_t> &data, int sync_every)
+{
+    static const size_t sizes[] = {1, 17, 500, 31, 1024, 499, 3000, 64};
+    size_t pos = 0;
+    for (int i = 0; pos < data.size(); i++) {
+        size_t size = std::min(sizes[i % 8], data.size() - pos);
+        TEST_ASSERT_EQUAL((ssize_t)size, log.write(&data[pos], size));
+        pos += size;
+        if (sync_every && i % sync_every == sync_every - 1) {
+            TEST_ASSERT_EQUAL(0, log.sync());
+        }
+    }
+}
+
+void test_format_mount()
+{
+    TEST_ASSERT_EQUAL(0, bd.init());
+    SegmentLog log;
+    TEST_ASSERT_EQUAL(-EINVAL, log.mount(&bd));
+    TEST_ASSERT_EQUAL(-EINVAL, SegmentLog::format(&bd, 1000));
+    TEST_ASSERT_EQUAL(0, SegmentLog::format(&bd, segment_size));
+    TEST_ASSERT_EQUAL(0, log.mount(&bd));
+    TEST_ASSERT_EQUAL(16, log.get_segment_count());
+    TEST_ASSERT_EQUAL(0, log.get_sequence());
+    TEST_ASSERT_EQUAL(0, log.get_stream());
+    TEST_ASSERT_EQUAL(-EBADF, log.write("x", 1));
+    TEST_ASSERT_EQUAL(0, log.unmount());
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+}
+
+void test_streams()
+{
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(0, SegmentLog::format(&bd, segment_size));
+    std::vector<uint8_t> first = pattern(40000, 1);     // 3 segments
+    std::vector<uint8_t> second = pattern(1000, 2);
+    {
+        SegmentLog log(3);
+        TEST_ASSERT_EQUAL(0, log.mount(&bd));
+        TEST_ASSERT_EQUAL(0, log.open("20240501/1200"));
+        write_chunks(log, first, 5);
+        TEST_ASSERT_EQUAL((off_t)first.size(), log.size());
+        TEST_ASSERT_EQUAL(0, log.open("20240501/1300"));
+        write_chunks(log, second, 0);
+        TEST_ASSERT_EQUAL(0, log.close());
+        TEST_ASSERT_EQUAL(0, log.open("empty"));
+        TEST_ASSERT_EQUAL(0, log.unmount());
+    }
+
+    char name[SEGMENT_LOG_NAME_SIZE];
+    TEST_ASSERT_TRUE(read_stream(bd, 1, name) == first);
+    TEST_ASSERT_EQUAL_STRING("20240501/1200", name);
+    TEST_ASSERT_TRUE(read_stream(bd, 2, name) == second);
+    TEST_ASSERT_EQUAL_STRING("20240501/1300", name);
+    TEST_ASSERT_TRUE(read_stream(bd, 3, name).empty());
+    TEST_ASSERT_EQUAL_STRING("empty", name);
+
+    SegmentLog log;
+    TEST_ASSERT_EQUAL(0, log.mount(&bd));
+    TEST_ASSERT_EQUAL(5, log.get_sequence());
+    TEST_ASSERT_EQUAL(3, log.get_stream());
+    TEST_ASSERT_EQUAL(0, log.unmount());
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+}
+
+void test_power_loss()
+{
+    PowerLossBlockDevice dev(&heap);
+    TEST_ASSERT_EQUAL(0, dev.init());
+    TEST_ASSERT_EQUAL(0, SegmentLog::format(&dev, segment_size));
+    std::vector<uint8_t> synced = pattern(20000, 3);
+    std::vector<uint8_t> lost = pattern(5000, 4);
+    {
+        SegmentLog log;
+        TEST_ASSERT_EQUAL(0, log.mount(&dev));
+        TEST_ASSERT_EQUAL(0, log.open("a"));
+        write_chunks(log, synced, 0);
+        TEST_ASSERT_EQUAL(0, log.sync());
+        dev.lost = true;
+        log.write(lost.data(), lost.size());
+        TEST_ASSERT_NOT_EQUAL(0, log.unmount());
+    }
+    dev.lost = false;
+    TEST_ASSERT_TRUE(read_stream(dev, 1) == synced);
+
+    // the next stream starts after the newest segment, and reads only a few headers to find it
+    SegmentLog log;
+    dev.reset();
+    TEST_ASSERT_EQUAL(0, log.mount(&dev));
+    timing_bd_snapshot_t snapshot;
+    dev.get_snapshot(&snapshot);
+    TEST_ASSERT_TRUE(snapshot.read.count <= 6);
+    TEST_ASSERT_EQUAL(2, log.get_sequence());
+    TEST_ASSERT_EQUAL(0, log.open("b"));
+    TEST_ASSERT_EQUAL(100, log.write(lost.data(), 100));
+    TEST_ASSERT_EQUAL(0, log.unmount());
+    TEST_ASSERT_TRUE(read_stream(dev, 1) == synced);
+    TEST_ASSERT_TRUE(read_stream(dev, 2) == std::vector<uint8_t>(lost.begin(), lost.begin() + 100));
+    TEST_ASSERT_EQUAL(0, dev.deinit());
+}
+
+void test_wrap_around()
+{
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(0, SegmentLog::format(&bd, segment_size));
+    std::vector<uint8_t> data = pattern(20000, 5);     // 2 segments each
+    for (uint32_t stream = 1; stream <= 20; stream++) {
+        SegmentLog log(1);
+        TEST_ASSERT_EQUAL(0, log.mount(&bd));
+        TEST_ASSERT_EQUAL(stream - 1, log.get_stream());
+        TEST_ASSERT_EQUAL((stream - 1) * 2, log.get_sequence());
+        TEST_ASSERT_EQUAL(0, log.open("w"));
+        write_chunks(log, data, 7);
+        TEST_ASSERT_EQUAL(0, log.unmount());
+    }
+
+    // the 15 data segments hold the last 7 streams and the second segment of the one before
+    TEST_ASSERT_TRUE(read_stream(bd, 12).empty());
+    std::vector<uint8_t> tail = read_stream(bd, 13);
+    TEST_ASSERT_TRUE(!tail.empty() && tail.size() < data.size());
+    TEST_ASSERT_TRUE(std::equal(tail.begin(), tail.end(), data.end() - tail.size()));
+    for (uint32_t stream = 14; stream <= 20; stream++) {
+        TEST_ASSERT_TRUE(read_stream(bd, stream) == data);
+    }
+
+    // a format starts over, without the old segments counting
+    TEST_ASSERT_EQUAL(0, SegmentLog::format(&bd, segment_size));
+    SegmentLog log;
+    TEST_ASSERT_EQUAL(0, log.mount(&bd));
+    TEST_ASSERT_EQUAL(0, log.get_sequence());
+    TEST_ASSERT_EQUAL(0, log.unmount());
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+}
+
+void test_power_loss_wrapping()
+{
+    PowerLossBlockDevice dev(&heap);
+    TEST_ASSERT_EQUAL(0, dev.init());
+    TEST_ASSERT_EQUAL(0, SegmentLog::format(&dev, segment_size));
+    std::vector<uint8_t> data = pattern(20000, 6);     // 2 segments each
+    for (uint32_t stream = 1; stream <= 8; stream++) {
+        SegmentLog log;
+        TEST_ASSERT_EQUAL(0, log.mount(&dev));
+        TEST_ASSERT_EQUAL(0, log.open("w"));
+        if (stream == 8) {
+            // the first segment of the last stream is the last segment of the device, and the
+            // power goes right after the log wraps around and erases segment 1 for the next one
+            dev.lose_after_erase = segment_size;
+            TEST_ASSERT_TRUE(log.write(data.data(), data.size()) < 0);
+            log.unmount();
+        } else {
+            write_chunks(log, data, 7);
+            TEST_ASSERT_EQUAL(0, log.unmount());
+        }
+    }
+    dev.lost = false;
+    dev.lose_after_erase = -1;
+
+    // the newest segment is found without segment 1, and the log carries on after it
+    SegmentLog log;
+    TEST_ASSERT_EQUAL(0, log.mount(&dev));
+    TEST_ASSERT_EQUAL(15, log.get_sequence());
+    TEST_ASSERT_EQUAL(8, log.get_stream());
+    TEST_ASSERT_EQUAL(0, log.open("after"));
+    TEST_ASSERT_EQUAL(100, log.write(data.data(), 100));
+    TEST_ASSERT_EQUAL(0, log.unmount());
+    TEST_ASSERT_EQUAL(0, log.mount(&dev));
+    TEST_ASSERT_EQUAL(16, log.get_sequence());
+    TEST_ASSERT_EQUAL(9, log.get_stream());
+    TEST_ASSERT_EQUAL(0, log.unmount());
+
+    std::vector<uint8_t> tail = read_stream(dev, 8);
+    TEST_ASSERT_TRUE(!tail.empty() && std::equal(tail.begin(), tail.end(), data.begin()));
+    for (uint32_t stream = 2; stream <= 7; stream++) {
+        TEST_ASSERT_TRUE(read_stream(dev, stream) == data);
+    }
+    TEST_ASSERT_TRUE(read_stream(dev, 9) == std::vector<uint8_t>(data.begin(), data.begin() + 100));
+    TEST_ASSERT_EQUAL(0, dev.deinit());
+}
+
+
+// test setup
+utest::v1::status_t test_setup(const size_t number_of_cases)
+{
+    GREENTEA_SETUP(120, "default_auto");
+    return verbose_test_setup_handler(number_of_cases);
+}
+
+Case cases[] = {
+    Case("Format and mount", test_format_mount),
+    Case("Streams", test_streams),
+    Case("Power loss", test_power_loss),
+    Case("Wrap around", test_wrap_around),
+    Case("Power loss while wrapping around", test_power_loss_wrapping),
+};
+
+Specification specification(test_setup, cases);
+
+int main()
+{
+    return !Harness::run(specification);
+}
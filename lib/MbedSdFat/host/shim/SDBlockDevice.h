@@ -0,0 +1,35 @@
+// Host stand-in for SDBlockDevice, so tests written for an SD card (eg TESTS/filesystem/fopen)
+// run on a HeapBlockDevice with the same block size
+
+#ifndef MBED_SD_BLOCK_DEVICE_H
+#define MBED_SD_BLOCK_DEVICE_H
+
+#include "HeapBlockDevice.h"
+
+#ifndef MBED_CONF_SD_SPI_MOSI
+#define MBED_CONF_SD_SPI_MOSI NC
+#define MBED_CONF_SD_SPI_MISO NC
+#define MBED_CONF_SD_SPI_CLK NC
+#define MBED_CONF_SD_SPI_CS NC
+#endif
+
+/** Size of the simulated card */
+#ifndef HOST_SD_SIZE
+#define HOST_SD_SIZE (64 * 1024 * 1024)
+#endif
+
+class SDBlockDevice : public mbed::HeapBlockDevice {
+public:
+    SDBlockDevice(PinName /*mosi*/, PinName /*miso*/, PinName /*sclk*/, PinName /*cs*/, uint64_t /*hz*/ = 1000000,
+                  bool /*crc_on*/ = 0)
+        : HeapBlockDevice(HOST_SD_SIZE, 512)
+    {
+    }
+
+    virtual const char *get_type() const
+    {
+        return "SD";
+    }
+};
+
+#endif
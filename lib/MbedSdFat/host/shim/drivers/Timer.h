@@ -0,0 +1,77 @@
+#ifndef MBED_TIMER_H
+#define MBED_TIMER_H
+
+#include <chrono>
+#include <stdint.h>
+
+#include "platform/NonCopyable.h"
+#include "platform/platform.h"
+
+namespace mbed {
+
+/** A general purpose timer, on the host monotonic clock
+ */
+class Timer : private NonCopyable<Timer> {
+public:
+    Timer() : _running(false), _time(0), _start(0) {}
+
+    void start()
+    {
+        if (!_running) {
+            _start = now_us();
+            _running = true;
+        }
+    }
+
+    void stop()
+    {
+        _time += slicetime();
+        _running = false;
+    }
+
+    void reset()
+    {
+        _start = now_us();
+        _time = 0;
+    }
+
+    float read()
+    {
+        return read_high_resolution_us() / 1000000.0f;
+    }
+
+    int read_ms()
+    {
+        return read_high_resolution_us() / 1000;
+    }
+
+    int read_us()
+    {
+        return read_high_resolution_us();
+    }
+
+    uint64_t read_high_resolution_us()
+    {
+        return _time + slicetime();
+    }
+
+protected:
+    static uint64_t now_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t slicetime()
+    {
+        return _running ? now_us() - _start : 0;
+    }
+
+    bool _running;
+    uint64_t _time;
+    uint64_t _start;
+};
+
+} // namespace mbed
+
+#endif
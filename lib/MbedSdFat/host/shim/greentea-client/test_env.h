@@ -0,0 +1,11 @@
+// Host stand-in for greentea-client, there is no host test script to talk to
+
+#ifndef GREENTEA_CLIENT_TEST_ENV_H_
+#define GREENTEA_CLIENT_TEST_ENV_H_
+
+#include <stdio.h>
+
+#define GREENTEA_SETUP(timeout, host_test) \
+    printf("{{__timeout;%d}}\n{{__host_test_name;%s}}\n", (int)(timeout), (host_test))
+
+#endif
@@ -0,0 +1,25 @@
+// Host stand-in for mbed.h, see host/README.md
+
+#ifndef MBED_H
+#define MBED_H
+
+#include "platform/platform.h"
+
+#include "drivers/Timer.h"
+#include "platform/Callback.h"
+#include "platform/DirHandle.h"
+#include "platform/FileHandle.h"
+#include "platform/FileSystemLike.h"
+#include "platform/mbed_assert.h"
+#include "platform/mbed_critical.h"
+#include "platform/mbed_debug.h"
+#include "platform/mbed_error.h"
+
+#include "features/storage/filesystem/mbed_filesystem.h"
+
+#ifndef MBED_NO_GLOBAL_USING_DIRECTIVE
+using namespace mbed;
+using namespace std;
+#endif
+
+#endif
@@ -0,0 +1 @@
+// Host builds take their configuration from -D flags in host/Makefile, as the target builds do from platformio.ini
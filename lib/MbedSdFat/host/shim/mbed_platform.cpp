@@ -0,0 +1,162 @@
+// Host implementations of the mbed platform functions declared in this directory
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+#include "platform/FileBase.h"
+#include "platform/FileHandle.h"
+#include "platform/FileSystemHandle.h"
+#include "platform/mbed_assert.h"
+#include "platform/mbed_critical.h"
+#include "platform/mbed_error.h"
+
+static std::recursive_mutex critical_section;
+
+extern "C" void core_util_critical_section_enter(void)
+{
+    critical_section.lock();
+}
+
+extern "C" void core_util_critical_section_exit(void)
+{
+    critical_section.unlock();
+}
+
+extern "C" void mbed_assert_internal(const char *expr, const char *file, int line)
+{
+    fprintf(stderr, "mbed assertation failed: %s, file: %s, line %d\n", expr, file, line);
+    abort();
+}
+
+extern "C" void error(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    abort();
+}
+
+namespace mbed {
+
+FileBase *FileBase::_head = NULL;
+SingletonPtr<PlatformMutex> FileBase::_mutex;
+
+FileBase::FileBase(const char *name, PathType t)
+    : _next(NULL), _name(name), _path_type(t)
+{
+    _mutex->lock();
+    if (name != NULL) {
+        // put this object at head of the list
+        _next = _head;
+        _head = this;
+    }
+    _mutex->unlock();
+}
+
+FileBase::~FileBase()
+{
+    _mutex->lock();
+    if (_name != NULL) {
+        // remove this object from the list
+        if (_head == this) {
+            _head = _next;
+        } else {
+            FileBase *p = _head;
+            while (p->_next != this) {
+                p = p->_next;
+            }
+            p->_next = _next;
+        }
+    }
+    _mutex->unlock();
+}
+
+FileBase *FileBase::lookup(const char *name, unsigned int len)
+{
+    _mutex->lock();
+    FileBase *p = _head;
+    while (p != NULL) {
+        if (p->_name != NULL && strncmp(p->_name, name, len) == 0 && strlen(p->_name) == len) {
+            break;
+        }
+        p = p->_next;
+    }
+    _mutex->unlock();
+    return p;
+}
+
+FileBase *FileBase::get(int n)
+{
+    _mutex->lock();
+    FileBase *p = _head;
+    int m = 0;
+    while (p != NULL) {
+        if (m == n) {
+            break;
+        }
+        m++;
+        p = p->_next;
+    }
+    _mutex->unlock();
+    return p;
+}
+
+const char *FileBase::getName(void)
+{
+    return _name;
+}
+
+PathType FileBase::getPathType(void)
+{
+    return _path_type;
+}
+
+off_t FileHandle::size()
+{
+    // remember our current position
+    off_t off = seek(0, SEEK_CUR);
+    if (off < 0) {
+        return off;
+    }
+    // seek to the end to get the file length
+    off_t size = seek(0, SEEK_END);
+    // return to our old position
+    seek(off, SEEK_SET);
+    return size;
+}
+
+int FileSystemHandle::open(DirHandle **, const char *)
+{
+    return -ENOSYS;
+}
+
+int FileSystemHandle::remove(const char *)
+{
+    return -ENOSYS;
+}
+
+int FileSystemHandle::rename(const char *, const char *)
+{
+    return -ENOSYS;
+}
+
+int FileSystemHandle::stat(const char *, struct stat *)
+{
+    return -ENOSYS;
+}
+
+int FileSystemHandle::mkdir(const char *, mode_t)
+{
+    return -ENOSYS;
+}
+
+int FileSystemHandle::statvfs(const char *, struct statvfs *)
+{
+    return -ENOSYS;
+}
+
+} // namespace mbed
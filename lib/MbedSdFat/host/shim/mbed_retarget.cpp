@@ -0,0 +1,310 @@
+// Host version of the mbed retarget layer: the POSIX file functions for paths under a mounted
+// FileSystemLike (eg "/sd/...") are routed to it, like on the target, and all other paths go to
+// the host C library.
+//
+// This works by defining the C library functions themselves, which take precedence over the
+// shared C library, and finding the originals with dlsym(RTLD_NEXT). Streams are real FILEs
+// made with fopencookie(), so the stdio buffering and error flags are the host's.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <set>
+
+#include "platform/DirHandle.h"
+#include "platform/FileHandle.h"
+#include "platform/FileSystemLike.h"
+
+using namespace mbed;
+
+// A directory stream on a FileSystemLike, handed out as an (opaque) DIR
+struct MbedDir {
+    DirHandle *handle;
+    struct dirent ent;
+};
+
+static std::set<DIR *> mbed_dirs;
+
+template <typename F>
+static F next_function(F, const char *name)
+{
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+/** Find the file system for a path
+ *
+ *  Relative paths are never on the host, as on the target they have no file system,
+ *  so a test can't leave files in the working directory.
+ *
+ *  @param path     Path, eg "/sd/dir/file.txt"
+ *  @param fs       Set to the file system, or NULL if the path has none (eg "file.txt")
+ *  @param fs_path  Set to the path within the file system, eg "dir/file.txt"
+ *  @return         false if the path is for the host C library
+ */
+static bool lookup_fs(const char *path, FileSystemHandle **fs, const char **fs_path)
+{
+    *fs = NULL;
+    if (path == NULL) {
+        return false;
+    }
+    if (path[0] != '/') {
+        return true;
+    }
+    const char *name = path + 1;
+    const char *end = strchr(name, '/');
+    size_t len = end ? end - name : strlen(name);
+    FileBase *base = FileBase::lookup(name, len);
+    if (base == NULL || base->getPathType() != FileSystemPathType) {
+        return false;
+    }
+    *fs = static_cast<FileSystemLike *>(base);
+    *fs_path = end ? end + 1 : "";
+    return true;
+}
+
+// returns -1 and sets errno, from an mbed negative error code
+static int set_errno(int err)
+{
+    if (err < 0) {
+        errno = -err;
+        return -1;
+    }
+    return err;
+}
+
+static ssize_t cookie_read(void *cookie, char *buf, size_t size)
+{
+    ssize_t res = static_cast<FileHandle *>(cookie)->read(buf, size);
+    return res < 0 ? set_errno(res) : res;
+}
+
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size)
+{
+    ssize_t res = static_cast<FileHandle *>(cookie)->write(buf, size);
+    return res < 0 ? set_errno(res) : res;
+}
+
+static int cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+    off_t res = static_cast<FileHandle *>(cookie)->seek(*offset, whence);
+    if (res < 0) {
+        return set_errno(res);
+    }
+    *offset = res;
+    return 0;
+}
+
+static int cookie_close(void *cookie)
+{
+    // deletes the handle, see FileSystem::open
+    return set_errno(static_cast<FileHandle *>(cookie)->close());
+}
+
+static int mode_to_flags(const char *mode)
+{
+    int flags;
+    switch (mode[0]) {
+        case 'r':
+            flags = O_RDONLY;
+            break;
+        case 'w':
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case 'a':
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        default:
+            return -1;
+    }
+    if (strchr(mode, '+') != NULL) {
+        flags = (flags & ~O_ACCMODE) | O_RDWR;
+    }
+    return flags;
+}
+
+extern "C" FILE *fopen(const char *path, const char *mode)
+{
+    FileSystemHandle *fs;
+    const char *fs_path;
+    if (!lookup_fs(path, &fs, &fs_path)) {
+        static auto host_fopen = next_function(&fopen, "fopen");
+        return host_fopen(path, mode);
+    }
+    if (fs == NULL) {
+        errno = ENODEV;
+        return NULL;
+    }
+
+    int flags = mode_to_flags(mode);
+    if (flags < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    FileHandle *file;
+    int err = fs->open(&file, fs_path, flags);
+    if (err) {
+        set_errno(err);
+        return NULL;
+    }
+    cookie_io_functions_t functions = {cookie_read, cookie_write, cookie_seek, cookie_close};
+    FILE *stream = fopencookie(file, mode, functions);
+    if (stream == NULL) {
+        file->close();
+    }
+    return stream;
+}
+
+extern "C" int remove(const char *path) __THROW
+{
+    FileSystemHandle *fs;
+    const char *fs_path;
+    if (!lookup_fs(path, &fs, &fs_path)) {
+        static auto host_remove = next_function(&remove, "remove");
+        return host_remove(path);
+    }
+    if (fs == NULL) {
+        errno = ENODEV;
+        return -1;
+    }
+    return set_errno(fs->remove(fs_path));
+}
+
+extern "C" int rename(const char *oldpath, const char *newpath) __THROW
+{
+    FileSystemHandle *fs, *new_fs;
+    const char *fs_oldpath, *fs_newpath;
+    if (!lookup_fs(oldpath, &fs, &fs_oldpath)) {
+        static auto host_rename = next_function(&rename, "rename");
+        return host_rename(oldpath, newpath);
+    }
+    if (fs == NULL) {
+        errno = ENODEV;
+        return -1;
+    }
+    if (!lookup_fs(newpath, &new_fs, &fs_newpath) || new_fs != fs) {
+        errno = EXDEV;
+        return -1;
+    }
+    return set_errno(fs->rename(fs_oldpath, fs_newpath));
+}
+
+extern "C" int mkdir(const char *path, mode_t mode) __THROW
+{
+    FileSystemHandle *fs;
+    const char *fs_path;
+    if (!lookup_fs(path, &fs, &fs_path)) {
+        static auto host_mkdir = next_function(&mkdir, "mkdir");
+        return host_mkdir(path, mode);
+    }
+    if (fs == NULL) {
+        errno = ENODEV;
+        return -1;
+    }
+    return set_errno(fs->mkdir(fs_path, mode));
+}
+
+extern "C" int stat(const char *path, struct stat *st) __THROW
+{
+    FileSystemHandle *fs;
+    const char *fs_path;
+    if (!lookup_fs(path, &fs, &fs_path)) {
+        static auto host_stat = next_function(&stat, "stat");
+        return host_stat(path, st);
+    }
+    if (fs == NULL) {
+        errno = ENODEV;
+        return -1;
+    }
+    memset(st, 0, sizeof(*st));
+    return set_errno(fs->stat(fs_path, st));
+}
+
+extern "C" DIR *opendir(const char *path)
+{
+    FileSystemHandle *fs;
+    const char *fs_path;
+    if (!lookup_fs(path, &fs, &fs_path)) {
+        static auto host_opendir = next_function(&opendir, "opendir");
+        return host_opendir(path);
+    }
+    if (fs == NULL) {
+        errno = ENODEV;
+        return NULL;
+    }
+
+    DirHandle *handle;
+    int err = fs->open(&handle, fs_path);
+    if (err) {
+        set_errno(err);
+        return NULL;
+    }
+    MbedDir *dir = new MbedDir;
+    dir->handle = handle;
+    DIR *result = reinterpret_cast<DIR *>(dir);
+    mbed_dirs.insert(result);
+    return result;
+}
+
+extern "C" struct dirent *readdir(DIR *dirp)
+{
+    if (mbed_dirs.count(dirp) == 0) {
+        static auto host_readdir = next_function(&readdir, "readdir");
+        return host_readdir(dirp);
+    }
+    MbedDir *dir = reinterpret_cast<MbedDir *>(dirp);
+    ssize_t res = dir->handle->read(&dir->ent);
+    if (res <= 0) {
+        if (res < 0) {
+            set_errno(res);
+        }
+        return NULL;
+    }
+    return &dir->ent;
+}
+
+extern "C" int closedir(DIR *dirp)
+{
+    if (mbed_dirs.count(dirp) == 0) {
+        static auto host_closedir = next_function(&closedir, "closedir");
+        return host_closedir(dirp);
+    }
+    mbed_dirs.erase(dirp);
+    MbedDir *dir = reinterpret_cast<MbedDir *>(dirp);
+    int err = dir->handle->close();
+    delete dir;
+    return set_errno(err);
+}
+
+extern "C" void seekdir(DIR *dirp, long loc) __THROW
+{
+    if (mbed_dirs.count(dirp) == 0) {
+        static auto host_seekdir = next_function(&seekdir, "seekdir");
+        return host_seekdir(dirp, loc);
+    }
+    reinterpret_cast<MbedDir *>(dirp)->handle->seek(loc);
+}
+
+extern "C" long telldir(DIR *dirp) __THROW
+{
+    if (mbed_dirs.count(dirp) == 0) {
+        static auto host_telldir = next_function(&telldir, "telldir");
+        return host_telldir(dirp);
+    }
+    return reinterpret_cast<MbedDir *>(dirp)->handle->tell();
+}
+
+extern "C" void rewinddir(DIR *dirp) __THROW
+{
+    if (mbed_dirs.count(dirp) == 0) {
+        static auto host_rewinddir = next_function(&rewinddir, "rewinddir");
+        return host_rewinddir(dirp);
+    }
+    reinterpret_cast<MbedDir *>(dirp)->handle->rewind();
+}
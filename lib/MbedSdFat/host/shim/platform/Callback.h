@@ -0,0 +1,88 @@
+#ifndef MBED_CALLBACK_H
+#define MBED_CALLBACK_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+namespace mbed {
+
+template <typename F>
+class Callback;
+
+/** Host version of mbed::Callback, backed by std::function
+ *
+ *  Like the target version, it can be built from a function pointer (including NULL),
+ *  an object and member function, or a function object.
+ */
+template <typename R, typename... ArgTs>
+class Callback<R(ArgTs...)> {
+public:
+    Callback()
+    {
+    }
+
+    Callback(R(*func)(ArgTs...))
+    {
+        if (func) {
+            _func = func;
+        }
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R(T::*method)(ArgTs...))
+        : _func([obj, method](ArgTs... args) -> R {
+        return (obj->*method)(std::forward<ArgTs>(args)...);
+    })
+    {
+    }
+
+    template <typename T, typename U>
+    Callback(const U *obj, R(T::*method)(ArgTs...) const)
+        : _func([obj, method](ArgTs... args) -> R {
+        return (obj->*method)(std::forward<ArgTs>(args)...);
+    })
+    {
+    }
+
+    template <typename F, typename = decltype(std::declval<F &>()(std::declval<ArgTs>()...)),
+              typename = typename std::enable_if<!std::is_pointer<F>::value>::type>
+    Callback(F f)
+        : _func(std::move(f))
+    {
+    }
+
+    R call(ArgTs... args) const
+    {
+        return _func(std::forward<ArgTs>(args)...);
+    }
+
+    R operator()(ArgTs... args) const
+    {
+        return _func(std::forward<ArgTs>(args)...);
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(_func);
+    }
+
+private:
+    std::function<R(ArgTs...)> _func;
+};
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R(*func)(ArgTs...) = nullptr)
+{
+    return Callback<R(ArgTs...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(U *obj, R(T::*method)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+} // namespace mbed
+
+#endif
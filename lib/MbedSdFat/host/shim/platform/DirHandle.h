@@ -0,0 +1,47 @@
+#ifndef MBED_DIRHANDLE_H
+#define MBED_DIRHANDLE_H
+
+#include <stdint.h>
+
+#include "platform/NonCopyable.h"
+#include "platform/mbed_assert.h"
+#include "platform/mbed_retarget.h"
+
+namespace mbed {
+
+/** Represents a directory stream
+ */
+class DirHandle : private NonCopyable<DirHandle> {
+public:
+    virtual ~DirHandle() {}
+
+    virtual ssize_t read(struct dirent *ent) = 0;
+
+    virtual int close() = 0;
+
+    virtual void seek(off_t offset) = 0;
+
+    virtual off_t tell() = 0;
+
+    virtual void rewind() = 0;
+
+    virtual size_t size()
+    {
+        off_t off = tell();
+        size_t size = 0;
+        struct dirent *ent = new struct dirent;
+
+        rewind();
+        while (read(ent) > 0) {
+            size += 1;
+        }
+        seek(off);
+
+        delete ent;
+        return size;
+    }
+};
+
+} // namespace mbed
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MBED_FILEBASE_H
+#define MBED_FILEBASE_H
+
+typedef int FILEHANDLE;
+
+#include "platform/NonCopyable.h"
+#include "platform/PlatformMutex.h"
+#include "platform/SingletonPtr.h"
+#include "platform/platform.h"
+
+namespace mbed {
+
+typedef enum {
+    FilePathType,
+    FileSystemPathType
+} PathType;
+
+/** Class FileBase
+ *
+ *  Names an object so that it can be found by path, eg "/sd/..." finds the file system named "sd".
+ */
+class FileBase : private NonCopyable<FileBase> {
+public:
+    FileBase(const char *name, PathType t);
+    virtual ~FileBase();
+
+    const char *getName(void);
+    PathType getPathType(void);
+
+    /** Find a named object
+     *
+     *  @param name     Name, not null-terminated
+     *  @param len      Length of the name
+     *  @return         The object, or NULL if there is none with that name
+     */
+    static FileBase *lookup(const char *name, unsigned int len);
+
+    static FileBase *get(int n);
+
+private:
+    static FileBase *_head;
+    static SingletonPtr<PlatformMutex> _mutex;
+
+    FileBase *_next;
+    const char *const _name;
+    const PathType _path_type;
+};
+
+} // namespace mbed
+
+#endif
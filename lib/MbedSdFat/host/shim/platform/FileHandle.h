@@ -0,0 +1,60 @@
+#ifndef MBED_FILEHANDLE_H
+#define MBED_FILEHANDLE_H
+
+#include <stdio.h>
+
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+#include "platform/mbed_assert.h"
+#include "platform/mbed_retarget.h"
+
+namespace mbed {
+
+/** Class FileHandle
+ *
+ *  An abstract interface that represents a stream of bytes, like a file on a file system.
+ *  Host builds keep only the file operations, the device (blocking, poll, sigio) parts are left out.
+ */
+class FileHandle : private NonCopyable<FileHandle> {
+public:
+    virtual ~FileHandle() = default;
+
+    virtual ssize_t read(void *buffer, size_t size) = 0;
+
+    virtual ssize_t write(const void *buffer, size_t size) = 0;
+
+    virtual off_t seek(off_t offset, int whence = SEEK_SET) = 0;
+
+    virtual int close() = 0;
+
+    virtual int sync()
+    {
+        return 0;
+    }
+
+    virtual int isatty()
+    {
+        return false;
+    }
+
+    virtual off_t tell()
+    {
+        return seek(0, SEEK_CUR);
+    }
+
+    virtual void rewind()
+    {
+        seek(0, SEEK_SET);
+    }
+
+    virtual off_t size();
+
+    virtual int truncate(off_t)
+    {
+        return -EINVAL;
+    }
+};
+
+} // namespace mbed
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MBED_FILESYSTEMHANDLE_H
+#define MBED_FILESYSTEMHANDLE_H
+
+#include "platform/platform.h"
+
+#include "platform/FileBase.h"
+#include "platform/FileHandle.h"
+#include "platform/DirHandle.h"
+#include "platform/NonCopyable.h"
+
+namespace mbed {
+
+/** A filesystem-like object is one that can be used to open file-like
+ *  objects though it by fopen("/name/filename", mode)
+ */
+class FileSystemHandle : private NonCopyable<FileSystemHandle> {
+public:
+    virtual ~FileSystemHandle() {}
+
+    virtual int open(FileHandle **file, const char *filename, int flags) = 0;
+
+    virtual int open(DirHandle **dir, const char *path);
+
+    virtual int remove(const char *path);
+
+    virtual int rename(const char *path, const char *newpath);
+
+    virtual int stat(const char *path, struct stat *st);
+
+    virtual int mkdir(const char *path, mode_t mode);
+
+    virtual int statvfs(const char *path, struct statvfs *buf);
+};
+
+} // namespace mbed
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef PLATFORM_MUTEX_H
+#define PLATFORM_MUTEX_H
+
+#include <mutex>
+
+#include "platform/NonCopyable.h"
+
+class PlatformMutex : private mbed::NonCopyable<PlatformMutex> {
+public:
+    void lock()
+    {
+        _mutex.lock();
+    }
+
+    void unlock()
+    {
+        _mutex.unlock();
+    }
+
+private:
+    std::recursive_mutex _mutex;
+};
+
+#endif
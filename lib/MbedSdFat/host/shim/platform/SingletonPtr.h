@@ -0,0 +1,41 @@
+#ifndef SINGLETONPTR_H
+#define SINGLETONPTR_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+// Lazily constructed on first use, one instance per SingletonPtr object, like mbed's.
+// Zero-initialized as a static, so usable before static constructors have run.
+template <class T>
+struct SingletonPtr {
+    T *get() const
+    {
+        T *p = _ptr.load(std::memory_order_acquire);
+        if (!p) {
+            static std::mutex construct;
+            std::lock_guard<std::mutex> guard(construct);
+            p = _ptr.load(std::memory_order_relaxed);
+            if (!p) {
+                p = new (_data) T();
+                _ptr.store(p, std::memory_order_release);
+            }
+        }
+        return p;
+    }
+
+    T *operator->() const
+    {
+        return get();
+    }
+
+    T &operator*() const
+    {
+        return *get();
+    }
+
+    mutable std::atomic<T *> _ptr;
+    alignas(T) mutable unsigned char _data[sizeof(T)];
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef MBED_ASSERT_H
+#define MBED_ASSERT_H
+
+#include "platform/mbed_toolchain.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MBED_NORETURN void mbed_assert_internal(const char *expr, const char *file, int line);
+
+#ifdef __cplusplus
+}
+#endif
+
+// always on in host builds, the tests are where asserts should fire
+#define MBED_ASSERT(expr)                                   \
+do {                                                        \
+    if (!(expr)) {                                          \
+        mbed_assert_internal(#expr, __FILE__, __LINE__);    \
+    }                                                       \
+} while (0)
+
+#endif
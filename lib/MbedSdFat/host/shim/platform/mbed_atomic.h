@@ -0,0 +1,16 @@
+#ifndef MBED_ATOMIC_H
+#define MBED_ATOMIC_H
+
+#include <stdint.h>
+
+inline uint32_t core_util_atomic_incr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t core_util_atomic_decr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_sub_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef MBED_CRITICAL_H
+#define MBED_CRITICAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a process-wide recursive lock stands in for disabling interrupts
+void core_util_critical_section_enter(void);
+void core_util_critical_section_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef MBED_DEBUG_H
+#define MBED_DEBUG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static inline void debug(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static inline void debug_if(int condition, const char *format, ...)
+{
+    if (condition) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef MBED_ERROR_H
+#define MBED_ERROR_H
+
+#include "platform/mbed_toolchain.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MBED_NORETURN void error(const char *format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define MBED_MODULE_BLOCK_DEVICE 0
+#define MBED_ERROR_CODE_WRITE_PROTECTED 1
+#define MBED_ERROR_WRITE_PROTECTED MBED_MAKE_ERROR(MBED_MODULE_BLOCK_DEVICE, MBED_ERROR_CODE_WRITE_PROTECTED)
+#define MBED_MAKE_ERROR(module, error_code) (((module) << 16) | (error_code))
+#define MBED_ERROR1(error_status, error_msg, error_value) error("%s (0x%x)\n", error_msg, (unsigned)(error_status))
+#define MBED_ERROR(error_status, error_msg) error("%s (0x%x)\n", error_msg, (unsigned)(error_status))
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef RETARGET_H
+#define RETARGET_H
+
+// the host C library already has the POSIX types and flags that mbed defines here
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef MBED_TOOLCHAIN_H
+#define MBED_TOOLCHAIN_H
+
+#define MBED_PACKED(struct) struct __attribute__((packed))
+#define MBED_ALIGN(N) __attribute__((aligned(N)))
+#define MBED_UNUSED __attribute__((__unused__))
+#define MBED_USED __attribute__((used))
+#define MBED_WEAK __attribute__((weak))
+#define MBED_NOINLINE __attribute__((noinline))
+#define MBED_FORCEINLINE inline __attribute__((always_inline))
+#define MBED_NORETURN __attribute__((noreturn))
+#define MBED_UNREACHABLE __builtin_unreachable()
+#define MBED_DEPRECATED(M) __attribute__((deprecated(M)))
+#define MBED_DEPRECATED_SINCE(D, M) MBED_DEPRECATED(M " [since " D "]")
+#define MBED_STATIC_ASSERT(expr, msg) static_assert(expr, msg)
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef MBED_WAIT_API_H
+#define MBED_WAIT_API_H
+
+#include <chrono>
+#include <thread>
+
+// Sleeps rather than spinning like the target, so on the host other threads run meanwhile,
+// as they would while a peripheral works on the target
+inline void wait_us(int us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+#endif
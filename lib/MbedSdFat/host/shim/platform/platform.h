@@ -0,0 +1,19 @@
+// Host build of the mbed platform headers used by the storage stack, see host/README.md.
+// Only the parts that BlockDevice, FileSystem and FATFileSystem use are provided.
+
+#ifndef MBED_PLATFORM_H
+#define MBED_PLATFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "platform/mbed_retarget.h"
+#include "platform/mbed_toolchain.h"
+
+typedef int PinName;
+#define NC ((PinName)-1)
+
+#endif
@@ -0,0 +1 @@
+#include "unity/unity.h"
@@ -0,0 +1,57 @@
+// Host stand-in for the Unity assertions used by the greentea tests, see host/README.md.
+// A failed assertion reports and jumps back to the utest harness, which fails the case.
+
+#ifndef UNITY_FRAMEWORK_H
+#define UNITY_FRAMEWORK_H
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern jmp_buf utest_unity_abort;
+
+void utest_unity_fail(const char *file, int line, const char *message);
+void utest_unity_skip(const char *file, int line, const char *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define UNITY_TEST_ASSERT(condition, message)                   \
+do {                                                            \
+    if (!(condition)) {                                         \
+        utest_unity_fail(__FILE__, __LINE__, (message));        \
+        longjmp(utest_unity_abort, 1);                          \
+    }                                                           \
+} while (0)
+
+#define TEST_ASSERT(condition) UNITY_TEST_ASSERT(condition, "Expression Evaluated To FALSE: " #condition)
+#define TEST_ASSERT_TRUE(condition) TEST_ASSERT(condition)
+#define TEST_ASSERT_FALSE(condition) UNITY_TEST_ASSERT(!(condition), "Expected FALSE: " #condition)
+#define TEST_ASSERT_MESSAGE(condition, message) UNITY_TEST_ASSERT(condition, message)
+#define TEST_ASSERT_EQUAL(expected, actual) \
+    UNITY_TEST_ASSERT((intmax_t)(expected) == (intmax_t)(actual), "Expected " #expected " == " #actual)
+#define TEST_ASSERT_EQUAL_INT(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_MESSAGE(expected, actual, message) \
+    UNITY_TEST_ASSERT((intmax_t)(expected) == (intmax_t)(actual), message)
+#define TEST_ASSERT_NOT_EQUAL(expected, actual) \
+    UNITY_TEST_ASSERT((intmax_t)(expected) != (intmax_t)(actual), "Expected " #expected " != " #actual)
+#define TEST_ASSERT_EQUAL_STRING(expected, actual) \
+    UNITY_TEST_ASSERT(strcmp((expected), (actual)) == 0, "Expected string " #expected " == " #actual)
+#define TEST_ASSERT_EQUAL_MEMORY(expected, actual, len) \
+    UNITY_TEST_ASSERT(memcmp((expected), (actual), (len)) == 0, "Expected memory " #expected " == " #actual)
+#define TEST_FAIL_MESSAGE(message) UNITY_TEST_ASSERT(0, message)
+
+#define TEST_SKIP_UNLESS_MESSAGE(condition, message)            \
+do {                                                            \
+    if (!(condition)) {                                         \
+        utest_unity_skip(__FILE__, __LINE__, (message));        \
+        longjmp(utest_unity_abort, 2);                          \
+    }                                                           \
+} while (0)
+
+#endif
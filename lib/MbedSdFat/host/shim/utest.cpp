@@ -0,0 +1,93 @@
+// Host implementation of the utest harness and Unity failure reporting declared in this directory
+
+#include <stdio.h>
+
+#include "unity/unity.h"
+#include "utest/utest.h"
+
+jmp_buf utest_unity_abort;
+
+extern "C" void utest_unity_fail(const char *file, int line, const char *message)
+{
+    printf("%s:%d: assertion failed: %s\n", file, line, message);
+}
+
+extern "C" void utest_unity_skip(const char *file, int line, const char *message)
+{
+    printf("%s:%d: skipped: %s\n", file, line, message);
+}
+
+namespace utest {
+namespace v1 {
+
+Case::Case(const char *description, const case_handler_t handler)
+    : _description(description), _handler(handler), _control_handler(NULL), _repeat_count_handler(NULL)
+{
+}
+
+Case::Case(const char *description, const case_control_handler_t handler)
+    : _description(description), _handler(NULL), _control_handler(handler), _repeat_count_handler(NULL)
+{
+}
+
+Case::Case(const char *description, const case_call_count_handler_t handler)
+    : _description(description), _handler(NULL), _control_handler(NULL), _repeat_count_handler(handler)
+{
+}
+
+bool Case::run() const
+{
+    // like Unity, a failed assertion abandons the case without unwinding
+    int abort = setjmp(utest_unity_abort);
+    if (abort == 1) {
+        return false;
+    } else if (abort == 2) {
+        return true;
+    }
+    if (_handler) {
+        _handler();
+    } else if (_control_handler) {
+        _control_handler();
+    } else if (_repeat_count_handler) {
+        _repeat_count_handler(1);
+    }
+    return true;
+}
+
+status_t verbose_test_setup_handler(const size_t number_of_cases)
+{
+    printf(">>> Running %u test cases...\n", (unsigned)number_of_cases);
+    return STATUS_CONTINUE;
+}
+
+status_t greentea_test_setup_handler(const size_t number_of_cases)
+{
+    return verbose_test_setup_handler(number_of_cases);
+}
+
+bool Harness::run(const Specification &specification)
+{
+    if (specification._setup_handler != NULL
+            && specification._setup_handler(specification._length) != STATUS_CONTINUE) {
+        return false;
+    }
+
+    size_t passed = 0;
+    for (size_t i = 0; i < specification._length; i++) {
+        const Case &test_case = specification._cases[i];
+        printf("\n>>> Running case #%u: '%s'...\n", (unsigned)(i + 1), test_case.get_description());
+        bool ok = test_case.run();
+        printf("{{__testcase_finish;%s;%d;%d}}\n", test_case.get_description(), ok ? 1 : 0, ok ? 0 : 1);
+        if (ok) {
+            passed++;
+        }
+    }
+
+    printf("\n>>> Test cases: %u passed, %u failed\n",
+           (unsigned)passed, (unsigned)(specification._length - passed));
+    printf("{{end;%s}}\n", passed == specification._length ? "success" : "failure");
+    return passed == specification._length;
+}
+
+} // namespace v1
+} // namespace utest
@@ -0,0 +1 @@
+#include "utest/utest.h"
@@ -0,0 +1,82 @@
+// Host stand-in for the utest harness used by the greentea tests, see host/README.md.
+// Cases run in order, once each, and each result is printed in the greentea key-value format.
+
+#ifndef UTEST_H
+#define UTEST_H
+
+#include <stddef.h>
+
+namespace utest {
+namespace v1 {
+
+enum status_t {
+    STATUS_CONTINUE = 0,
+    STATUS_IGNORE = 1,
+    STATUS_ABORT = -1
+};
+
+/** What to do after a case handler returns, only moving on to the next case is supported
+ */
+struct control_t {
+};
+
+const control_t CaseNext = control_t();
+
+typedef status_t (*test_setup_handler_t)(const size_t number_of_cases);
+typedef void (*case_handler_t)(void);
+typedef control_t (*case_control_handler_t)(void);
+typedef control_t (*case_call_count_handler_t)(const size_t call_count);
+
+class Case {
+public:
+    Case(const char *description, const case_handler_t handler);
+    Case(const char *description, const case_control_handler_t handler);
+    Case(const char *description, const case_call_count_handler_t handler);
+
+    const char *get_description() const
+    {
+        return _description;
+    }
+
+    /** Run the case handler
+     *
+     *  @return         true if no assertion failed
+     */
+    bool run() const;
+
+private:
+    const char *_description;
+    case_handler_t _handler;
+    case_control_handler_t _control_handler;
+    case_call_count_handler_t _repeat_count_handler;
+};
+
+class Specification {
+public:
+    template <size_t N>
+    Specification(const test_setup_handler_t setup_handler, const Case (&cases)[N])
+        : _setup_handler(setup_handler), _cases(cases), _length(N)
+    {
+    }
+
+    test_setup_handler_t _setup_handler;
+    const Case *_cases;
+    size_t _length;
+};
+
+status_t verbose_test_setup_handler(const size_t number_of_cases);
+status_t greentea_test_setup_handler(const size_t number_of_cases);
+
+class Harness {
+public:
+    /** Run all cases of a specification
+     *
+     *  @return         true if every case passed
+     */
+    static bool run(const Specification &specification);
+};
+
+} // namespace v1
+} // namespace utest
+
+#endif
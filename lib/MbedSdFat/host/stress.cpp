@@ -0,0 +1,272 @@
+// Multi-threaded FATFileSystem stress and contention benchmark on the host, see README.md.
+//
+// Threads hammer the file system with a mix of appends, reads, stats and mkdirs, on SD cards
+// simulated in real time, so a thread waiting for a card leaves the CPU to the others, as on
+// the target. Each run prints one line of JSON, with the throughput and how long the
+// FATFileSystem lock was waited for and held.
+//
+// Built twice: with FF_FS_REENTRANT=0 one lock serializes all volumes ("lock": "global"),
+// with FF_FS_REENTRANT=1 each volume has its own ("lock": "volume").
+
+#include "mbed.h"
+#include "FATFileSystem.h"
+#include "HeapBlockDevice.h"
+#include "LatencySimBlockDevice.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const bd_size_t device_size = 16 * 1024 * 1024;
+static const size_t record_size = 512;
+static const size_t shared_size = 64 * 1024;
+static const int stat_files = 16;
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// FATFileSystem recording how long its lock is waited for and held
+class TimedFATFileSystem : public FATFileSystem {
+public:
+    TimedFATFileSystem(const char *name) : FATFileSystem(name), _depth(0), _acquired_ns(0), _wait_ns(0) {}
+
+    void reset_stats()
+    {
+        _wait_ns = 0;
+        _holds.clear();
+    }
+
+    uint64_t wait_ns() const
+    {
+        return _wait_ns;
+    }
+
+    std::vector<uint32_t> &holds()
+    {
+        return _holds;
+    }
+
+protected:
+    // lock is recursive, only the outermost lock and unlock count
+    virtual void lock()
+    {
+        uint64_t start_ns = now_ns();
+        FATFileSystem::lock();
+        if (_depth++ == 0) {
+            _acquired_ns = now_ns();
+            _wait_ns += _acquired_ns - start_ns;
+        }
+    }
+
+    virtual void unlock()
+    {
+        if (--_depth == 0) {
+            _holds.push_back((now_ns() - _acquired_ns) / 1000);
+        }
+        FATFileSystem::unlock();
+    }
+
+private:
+    // only changed while holding the lock
+    int _depth;
+    uint64_t _acquired_ns;
+    uint64_t _wait_ns;
+    std::vector<uint32_t> _holds;
+};
+
+// One simulated card with a file system on it
+struct Volume {
+    Volume(const char *name, const latency_sim_bd_config_t &config)
+        : heap(device_size, 512), sim(&heap, &config, true), fs(name) {}
+
+    HeapBlockDevice heap;
+    LatencySimBlockDevice sim;
+    TimedFATFileSystem fs;
+};
+
+struct ThreadResult {
+    uint32_t ops;
+    uint32_t errors;
+    size_t appended;
+};
+
+// The per-thread mix: half appends to its own log, then reads, stats and mkdirs
+static void worker(FATFileSystem *fs, int index, int ops, ThreadResult *result)
+{
+    char path[32];
+    uint8_t record[record_size];
+    memset(record, 'a' + index, sizeof(record));
+    uint32_t seed = index + 1;
+    int dirs = 0;
+
+    File log;
+    File shared;
+    snprintf(path, sizeof(path), "log%d.bin", index);
+    if (log.open(fs, path, O_WRONLY | O_CREAT | O_TRUNC) || shared.open(fs, "shared.bin", O_RDONLY)) {
+        result->errors++;
+        return;
+    }
+
+    for (int i = 0; i < ops; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t choice = (seed >> 16) % 20;
+        int err;
+        if (choice < 10) {
+            err = log.write(record, sizeof(record));
+            if (err == (int)sizeof(record)) {
+                result->appended += sizeof(record);
+            }
+        } else if (choice < 16) {
+            uint8_t buffer[record_size];
+            off_t offset = ((seed >> 8) % (shared_size / sizeof(buffer))) * sizeof(buffer);
+            err = shared.seek(offset, SEEK_SET);
+            if (err >= 0) {
+                err = shared.read(buffer, sizeof(buffer));
+            }
+        } else if (choice < 19) {
+            struct stat st;
+            snprintf(path, sizeof(path), "stat/f%02u", (unsigned)((seed >> 8) % stat_files));
+            err = fs->stat(path, &st);
+        } else {
+            snprintf(path, sizeof(path), "dir%d_%d", index, dirs++);
+            err = fs->mkdir(path, 0777);
+        }
+        result->ops++;
+        if (err < 0) {
+            result->errors++;
+        }
+    }
+
+    if (shared.close() || log.close()) {
+        result->errors++;
+    }
+}
+
+static int populate(FATFileSystem &fs)
+{
+    int err = fs.mkdir("stat", 0777);
+    char path[32];
+    for (int i = 0; i < stat_files && !err; i++) {
+        File file;
+        snprintf(path, sizeof(path), "stat/f%02d", i);
+        err = file.open(&fs, path, O_WRONLY | O_CREAT);
+        if (!err) {
+            err = file.close();
+        }
+    }
+
+    File file;
+    if (!err) {
+        err = file.open(&fs, "shared.bin", O_WRONLY | O_CREAT);
+    }
+    std::vector<uint8_t> buffer(shared_size, 's');
+    if (!err && file.write(buffer.data(), buffer.size()) != (ssize_t)buffer.size()) {
+        err = -EIO;
+    }
+    if (!err) {
+        err = file.close();
+    }
+    return err;
+}
+
+static bool any_failed = false;
+
+// Runs threads over volumes, thread i using volume i % volumes
+static void run(const char *bench, int volumes, int threads, int ops, const latency_sim_bd_config_t &config)
+{
+    std::vector<std::unique_ptr<Volume>> vols;
+    int err = 0;
+    for (int v = 0; v < volumes && !err; v++) {
+        std::string name = "stress" + std::to_string(v);
+        vols.emplace_back(new Volume(name.c_str(), config));
+        Volume &vol = *vols.back();
+        err = FATFileSystem::format(&vol.sim);
+        if (!err) {
+            err = vol.fs.mount(&vol.sim);
+        }
+        if (!err) {
+            err = populate(vol.fs);
+        }
+        vol.fs.reset_stats();
+    }
+
+    std::vector<ThreadResult> results(threads, ThreadResult());
+    uint64_t start_ns = now_ns();
+    if (!err) {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back(worker, &vols[t % volumes]->fs, t, ops, &results[t]);
+        }
+        for (std::thread &w : workers) {
+            w.join();
+        }
+    }
+    uint64_t us = (now_ns() - start_ns) / 1000;
+
+    uint32_t total_ops = 0;
+    uint32_t errors = err ? 1 : 0;
+    uint64_t wait_ns = 0;
+    std::vector<uint32_t> holds;
+    for (ThreadResult &r : results) {
+        total_ops += r.ops;
+        errors += r.errors;
+    }
+    for (std::unique_ptr<Volume> &vol : vols) {
+        wait_ns += vol->fs.wait_ns();
+        holds.insert(holds.end(), vol->fs.holds().begin(), vol->fs.holds().end());
+    }
+
+    // every append has to have landed in its log
+    for (int t = 0; t < threads && !err; t++) {
+        char path[32];
+        struct stat st;
+        snprintf(path, sizeof(path), "log%d.bin", t);
+        if (vols[t % volumes]->fs.stat(path, &st) || (size_t)st.st_size != results[t].appended) {
+            errors++;
+        }
+    }
+    for (std::unique_ptr<Volume> &vol : vols) {
+        vol->fs.unmount();
+    }
+
+    uint64_t hold_us = 0;
+    for (uint32_t hold : holds) {
+        hold_us += hold;
+    }
+    std::sort(holds.begin(), holds.end());
+
+    printf("{\"bench\": \"%s\", \"lock\": \"%s\", \"volumes\": %d, \"threads\": %d, \"ops\": %lu, \"us\": %llu, "
+           "\"ops_per_s\": %llu, \"lock_wait_us\": %llu, \"lock_hold_us\": %llu, \"locks\": %lu, "
+           "\"p99_hold_us\": %lu, \"max_hold_us\": %lu, \"ok\": %d}\n",
+           bench, FF_FS_REENTRANT ? "volume" : "global", volumes, threads, (unsigned long)total_ops,
+           (unsigned long long)us, (unsigned long long)(us ? total_ops * 1000000ull / us : 0),
+           (unsigned long long)(wait_ns / 1000), (unsigned long long)hold_us, (unsigned long)holds.size(),
+           (unsigned long)(holds.empty() ? 0 : holds[holds.size() * 99 / 100]),
+           (unsigned long)(holds.empty() ? 0 : holds.back()), errors ? 0 : 1);
+    fflush(stdout);
+    any_failed |= errors != 0;
+}
+
+int main()
+{
+    // the typical card, without the stalls, which would only make the runs longer
+    latency_sim_bd_config_t config = LatencySimBlockDevice::get_sd_card_config();
+    config.gc_interval = 0;
+    config.au_size = 0;
+
+    static const int thread_counts[] = {1, 2, 4};
+    for (int threads : thread_counts) {
+        run("one_volume", 1, threads, 200, config);
+    }
+    for (int threads : thread_counts) {
+        run("volume_per_thread", threads, threads, 200, config);
+    }
+    return any_failed ? 1 : 0;
+}
@@ -22,15 +22,18 @@
 
 namespace mbed {
 
-static inline uint32_t align_down(bd_size_t val, bd_size_t size)
+static inline bd_size_t align_down(bd_size_t val, bd_size_t size)
 {
     return val / size * size;
 }
 
-BufferedBlockDevice::BufferedBlockDevice(BlockDevice *bd)
-    : _bd(bd), _bd_program_size(0), _bd_read_size(0), _bd_size(0), _write_cache_addr(0), _write_cache_valid(false),
-      _write_cache(0), _read_buf(0), _init_ref_count(0), _is_initialized(false)
+BufferedBlockDevice::BufferedBlockDevice(BlockDevice *bd, uint32_t cache_entries, uint32_t read_ahead_units)
+    : _bd(bd), _bd_program_size(0), _bd_read_size(0), _bd_size(0), _cache_entries(cache_entries),
+      _read_ahead_units(read_ahead_units), _last_read_end(0), _sequential(false), _entries(0), _cache(0), _swap_buf(0), _read_buf(0), _use_counter(0), _init_ref_count(0), _is_initialized(false)
 {
+    MBED_ASSERT(cache_entries >= 1);
+    MBED_ASSERT(read_ahead_units <= cache_entries / 2);  // so prefetching can't evict its own units
+    reset_stats();
 }
 
 BufferedBlockDevice::~BufferedBlockDevice()
@@ -48,6 +51,8 @@ int BufferedBlockDevice::init()
 
     int err = _bd->init();
     if (err) {
+        // allow a later init to retry, instead of reporting success on an uninitialized device
+        core_util_atomic_decr_u32(&_init_ref_count, 1);
         return err;
     }
 
@@ -55,8 +60,19 @@ int BufferedBlockDevice::init()
     _bd_program_size = _bd->get_program_size();
     _bd_size = _bd->size();
 
-    if (!_write_cache) {
-        _write_cache = new uint8_t[_bd_program_size];
+    if (!_entries) {
+        _entries = new cache_entry_t[_cache_entries];
+        for (uint32_t i = 0; i < _cache_entries; i++) {
+            _entries[i].slot = i;
+        }
+    }
+
+    if (!_cache) {
+        _cache = new uint8_t[_cache_entries * _bd_program_size];
+    }
+
+    if (!_swap_buf && _cache_entries > 1) {
+        _swap_buf = new uint8_t[_bd_program_size];
     }
 
     if (!_read_buf) {
@@ -81,35 +97,209 @@ int BufferedBlockDevice::deinit()
         return BD_ERROR_OK;
     }
 
-    delete[] _write_cache;
-    _write_cache = 0;
+    int err = flush();
+
+    delete[] _entries;
+    _entries = 0;
+    delete[] _cache;
+    _cache = 0;
+    delete[] _swap_buf;
+    _swap_buf = 0;
     delete[] _read_buf;
     _read_buf = 0;
     _is_initialized = false;
-    return _bd->deinit();
+
+    int deinit_err = _bd->deinit();
+    return err ? err : deinit_err;
 }
 
 int BufferedBlockDevice::flush()
 {
-    MBED_ASSERT(_write_cache);
+    MBED_ASSERT(_entries);
     if (!_is_initialized) {
         return BD_ERROR_DEVICE_ERROR;
     }
 
-    if (_write_cache_valid) {
-        int ret = _bd->program(_write_cache, _write_cache_addr, _bd_program_size);
+    // Write back in address order, so the sequence of programs is deterministic
+    while (true) {
+        cache_entry_t *lowest = 0;
+        for (uint32_t i = 0; i < _cache_entries; i++) {
+            if (_entries[i].dirty && (!lowest || _entries[i].addr < lowest->addr)) {
+                lowest = &_entries[i];
+            }
+        }
+        if (!lowest) {
+            return 0;
+        }
+        int ret = flush_run(lowest);
+        if (ret) {
+            return ret;
+        }
+    }
+}
+
+int BufferedBlockDevice::flush_run(cache_entry_t *entry)
+{
+    // Find the start of the run of adjacent dirty units
+    cache_entry_t *first = entry;
+    while (first->addr >= _bd_program_size) {
+        cache_entry_t *prev = find_entry(first->addr - _bd_program_size);
+        if (!prev || !prev->dirty) {
+            break;
+        }
+        first = prev;
+    }
+
+    // Gather the run into consecutive slots, so it can be programmed in one go
+    bd_addr_t run_addr = first->addr;
+    uint32_t count = 0;
+    cache_entry_t *next;
+    while ((next = find_entry(run_addr + count * _bd_program_size)) && next->dirty) {
+        move_to_slot(next, count);
+        count++;
+    }
+
+    int ret = _bd->program(_cache, run_addr, count * _bd_program_size);
+    if (ret) {
+        return ret;
+    }
+    _stats.programs++;
+    _stats.programmed_units += count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        find_entry(run_addr + i * _bd_program_size)->dirty = false;
+    }
+    return 0;
+}
+
+BufferedBlockDevice::cache_entry_t *BufferedBlockDevice::find_entry(bd_addr_t addr)
+{
+    for (uint32_t i = 0; i < _cache_entries; i++) {
+        if (_entries[i].valid && _entries[i].addr == addr) {
+            return &_entries[i];
+        }
+    }
+    return 0;
+}
+
+BufferedBlockDevice::cache_entry_t *BufferedBlockDevice::first_entry_in(bd_addr_t addr, bd_addr_t end)
+{
+    cache_entry_t *first = 0;
+    for (uint32_t i = 0; i < _cache_entries; i++) {
+        if (_entries[i].valid && _entries[i].addr >= addr && _entries[i].addr < end
+                && (!first || _entries[i].addr < first->addr)) {
+            first = &_entries[i];
+        }
+    }
+    return first;
+}
+
+int BufferedBlockDevice::allocate_entry(bd_addr_t addr, cache_entry_t **entry)
+{
+    cache_entry_t *lru = &_entries[0];
+    for (uint32_t i = 0; i < _cache_entries; i++) {
+        if (!_entries[i].valid) {
+            lru = &_entries[i];
+            break;
+        }
+        if (_entries[i].last_use < lru->last_use) {
+            lru = &_entries[i];
+        }
+    }
+
+    if (lru->valid && lru->dirty) {
+        _stats.evictions++;
+        int ret = flush_run(lru);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    lru->addr = addr;
+    lru->valid = false;
+    lru->dirty = false;
+    lru->prefetched = false;
+    *entry = lru;
+    return 0;
+}
+
+int BufferedBlockDevice::read_ahead(bd_addr_t addr)
+{
+    // Claim entries for the run, up to the next cached unit or the end of the device.
+    // Claimed entries are the most recently used, so claiming more can't evict them.
+    uint32_t count = 0;
+    while (count < _read_ahead_units && addr + count * _bd_program_size < _bd_size
+            && !find_entry(addr + count * _bd_program_size)) {
+        cache_entry_t *entry;
+        int ret = allocate_entry(addr + count * _bd_program_size, &entry);
         if (ret) {
+            invalidate_range(addr, count * _bd_program_size);
             return ret;
         }
-        invalidate_write_cache();
+        entry->valid = true;
+        entry->last_use = ++_use_counter;
+        count++;
     }
+
+    for (uint32_t i = 0; i < count; i++) {
+        move_to_slot(find_entry(addr + i * _bd_program_size), i);
+    }
+    int ret = _bd->read(_cache, addr, count * _bd_program_size);
+    if (ret) {
+        invalidate_range(addr, count * _bd_program_size);
+        return ret;
+    }
+
+    // The unit that was actually requested isn't counted as prefetched
+    for (uint32_t i = 1; i < count; i++) {
+        find_entry(addr + i * _bd_program_size)->prefetched = true;
+    }
+    _stats.read_ahead_units += count - 1;
+    _stats.read_misses++;
     return 0;
 }
 
+void BufferedBlockDevice::move_to_slot(cache_entry_t *entry, uint32_t slot)
+{
+    if (entry->slot == slot) {
+        return;
+    }
+    cache_entry_t *other = 0;
+    for (uint32_t i = 0; i < _cache_entries; i++) {
+        if (_entries[i].slot == slot) {
+            other = &_entries[i];
+            break;
+        }
+    }
+    MBED_ASSERT(other && _swap_buf);
+
+    uint8_t *entry_data = _cache + entry->slot * _bd_program_size;
+    uint8_t *other_data = _cache + slot * _bd_program_size;
+    memcpy(_swap_buf, other_data, _bd_program_size);
+    memcpy(other_data, entry_data, _bd_program_size);
+    memcpy(entry_data, _swap_buf, _bd_program_size);
+    other->slot = entry->slot;
+    entry->slot = slot;
+}
+
+void BufferedBlockDevice::invalidate_range(bd_addr_t addr, bd_size_t size)
+{
+    for (uint32_t i = 0; i < _cache_entries; i++) {
+        if (_entries[i].valid && _entries[i].addr < addr + size && addr < _entries[i].addr + _bd_program_size) {
+            _entries[i].valid = false;
+            _entries[i].dirty = false;
+        }
+    }
+}
+
 void BufferedBlockDevice::invalidate_write_cache()
 {
-    _write_cache_addr = _bd_size;
-    _write_cache_valid = false;
+    for (uint32_t i = 0; i < _cache_entries; i++) {
+        _entries[i].valid = false;
+        _entries[i].dirty = false;
+        _entries[i].prefetched = false;
+        _entries[i].last_use = 0;
+    }
 }
 
 int BufferedBlockDevice::sync()
@@ -118,7 +308,7 @@ int BufferedBlockDevice::sync()
         return BD_ERROR_DEVICE_ERROR;
     }
 
-    MBED_ASSERT(_write_cache);
+    MBED_ASSERT(_entries);
     int ret = flush();
     if (ret) {
         return ret;
@@ -132,33 +322,43 @@ int BufferedBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
         return BD_ERROR_DEVICE_ERROR;
     }
 
-    MBED_ASSERT(_write_cache && _read_buf);
-    // Common case - no need to involve write cache or read buffer
-    if (_bd->is_valid_read(addr, size) &&
-            ((addr + size <= _write_cache_addr) || (addr > _write_cache_addr + _bd_program_size))) {
-        return _bd->read(b, addr, size);
-    }
+    MBED_ASSERT(_entries && _read_buf);
 
     uint8_t *buf = static_cast<uint8_t *>(b);
 
-    // Read logic: Split read to chunks, according to whether we cross the write cache
+    bool sequential = _sequential;
+    _sequential = (addr == _last_read_end);
+    sequential = sequential && _sequential;  // two sequential reads in a row
+    _last_read_end = addr + size;
+
+    // Read logic: Split read to chunks, according to whether each program unit is cached
     while (size) {
+        bd_addr_t unit_addr = align_down(addr, _bd_program_size);
+        cache_entry_t *entry = find_entry(unit_addr);
         bd_size_t chunk;
-        bool read_from_bd = true;
-        if (addr < _write_cache_addr) {
-            chunk = std::min(size, _write_cache_addr - addr);
-        } else if ((addr >= _write_cache_addr) && (addr < _write_cache_addr + _bd_program_size)) {
-            // One case we need to take our data from cache
-            chunk = std::min(size, _bd_program_size - addr % _bd_program_size);
-            memcpy(buf, _write_cache + addr % _bd_program_size, chunk);
-            read_from_bd = false;
+        if (entry) {
+            bd_size_t offs_in_unit = addr - unit_addr;
+            chunk = std::min(size, _bd_program_size - offs_in_unit);
+            memcpy(buf, _cache + entry->slot * _bd_program_size + offs_in_unit, chunk);
+            entry->last_use = ++_use_counter;
+            _stats.read_hits++;
+            if (entry->prefetched) {
+                entry->prefetched = false;
+                _stats.read_ahead_hits++;
+            }
+        } else if (sequential && _read_ahead_units && size < _read_ahead_units * _bd_program_size) {
+            // The rest of this read is small, prefetch the following units along with it
+            int ret = read_ahead(unit_addr);
+            if (ret) {
+                return ret;
+            }
+            continue;  // now served from the cache
         } else {
-            chunk = size;
-        }
+            // Read everything up to the next cached unit from the BD, making sure we are aligned
+            // with its read size. If not, use read buffer as a helper.
+            cache_entry_t *next = first_entry_in(unit_addr + _bd_program_size, addr + size);
+            chunk = (next ? next->addr : addr + size) - addr;
 
-        // Now, in case we read from the BD, make sure we are aligned with its read size.
-        // If not, use read buffer as a helper.
-        if (read_from_bd) {
             bd_size_t offs_in_read_buf = addr % _bd_read_size;
             int ret;
             if (offs_in_read_buf || (chunk < _bd_read_size)) {
@@ -172,6 +372,7 @@ int BufferedBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
             if (ret) {
                 return ret;
             }
+            _stats.read_misses += (addr + chunk - 1) / _bd_program_size - addr / _bd_program_size + 1;
         }
 
         buf += chunk;
@@ -188,68 +389,59 @@ int BufferedBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
         return BD_ERROR_DEVICE_ERROR;
     }
 
-    MBED_ASSERT(_write_cache);
+    MBED_ASSERT(_entries);
 
     int ret;
 
-    bd_addr_t aligned_addr = align_down(addr, _bd_program_size);
-
     const uint8_t *buf = static_cast <const uint8_t *>(b);
 
-    // Need to flush if moved to another program unit
-    if (aligned_addr != _write_cache_addr) {
-        ret = flush();
-        if (ret) {
-            return ret;
-        }
-        _write_cache_addr = aligned_addr;
-    }
-
-    // Write logic: Keep data in cache as long as we don't reach the end of the program unit.
-    // Otherwise, program to the underlying BD.
+    // Write logic: Keep data in cache until it's evicted or synced, except for writes too large
+    // to be worth caching, which are programmed to the underlying BD directly.
     while (size) {
-        _write_cache_addr = align_down(addr, _bd_program_size);
-        bd_addr_t offs_in_buf = addr - _write_cache_addr;
-        bd_size_t chunk;
-        if (offs_in_buf) {
-            chunk = std::min(_bd_program_size - offs_in_buf, size);
-        } else if (size >= _bd_program_size) {
-            chunk = align_down(size, _bd_program_size);
-        } else {
-            chunk = size;
-        }
-
-        const uint8_t *prog_buf;
-        if (chunk < _bd_program_size) {
-            // If cache not valid, and program doesn't cover an entire unit, it means we need to
-            // read it from the underlying BD
-            if (!_write_cache_valid) {
-                ret = _bd->read(_write_cache, _write_cache_addr, _bd_program_size);
+        bd_addr_t unit_addr = align_down(addr, _bd_program_size);
+        bd_addr_t offs_in_unit = addr - unit_addr;
+        bd_size_t chunk = std::min(_bd_program_size - offs_in_unit, size);
+
+        cache_entry_t *entry = find_entry(unit_addr);
+        if (!entry) {
+            if (!offs_in_unit && size >= _cache_entries * _bd_program_size) {
+                chunk = align_down(size, _bd_program_size);
+                invalidate_range(addr, chunk);  // stale, since completely overwritten
+                ret = _bd->program(buf, addr, chunk);
                 if (ret) {
                     return ret;
                 }
+                _stats.bypass_units += chunk / _bd_program_size;
+
+                buf += chunk;
+                addr += chunk;
+                size -= chunk;
+                continue;
             }
-            memcpy(_write_cache + offs_in_buf, buf, chunk);
-            prog_buf = _write_cache;
-        } else {
-            prog_buf = buf;
-        }
 
-        // Only program if we reached the end of a program unit
-        if (!((offs_in_buf + chunk) % _bd_program_size)) {
-            ret = _bd->program(prog_buf, _write_cache_addr, std::max(chunk, _bd_program_size));
+            ret = allocate_entry(unit_addr, &entry);
             if (ret) {
                 return ret;
             }
-            ret = _bd->sync();
-            if (ret) {
-                return ret;
+            // If program doesn't cover an entire unit, it means we need to
+            // read it from the underlying BD
+            if (chunk < _bd_program_size) {
+                ret = _bd->read(_cache + entry->slot * _bd_program_size, unit_addr, _bd_program_size);
+                if (ret) {
+                    return ret;
+                }
             }
-            invalidate_write_cache();
+            entry->valid = true;
+            _stats.program_misses++;
         } else {
-            _write_cache_valid = true;
+            _stats.program_hits++;
         }
 
+        memcpy(_cache + entry->slot * _bd_program_size + offs_in_unit, buf, chunk);
+        entry->dirty = true;
+        entry->prefetched = false;
+        entry->last_use = ++_use_counter;
+
         buf += chunk;
         addr += chunk;
         size -= chunk;
@@ -265,9 +457,7 @@ int BufferedBlockDevice::erase(bd_addr_t addr, bd_size_t size)
         return BD_ERROR_DEVICE_ERROR;
     }
 
-    if ((_write_cache_addr >= addr) && (_write_cache_addr <= addr + size)) {
-        invalidate_write_cache();
-    }
+    invalidate_range(addr, size);
     return _bd->erase(addr, size);
 }
 
@@ -278,9 +468,7 @@ int BufferedBlockDevice::trim(bd_addr_t addr, bd_size_t size)
         return BD_ERROR_DEVICE_ERROR;
     }
 
-    if ((_write_cache_addr >= addr) && (_write_cache_addr <= addr + size)) {
-        invalidate_write_cache();
-    }
+    invalidate_range(addr, size);
     return _bd->trim(addr, size);
 }
 
@@ -339,4 +527,14 @@ const char *BufferedBlockDevice::get_type() const
     return NULL;
 }
 
+void BufferedBlockDevice::get_stats(buffered_bd_stats_t *stats) const
+{
+    *stats = _stats;
+}
+
+void BufferedBlockDevice::reset_stats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
 } // namespace mbed
@@ -30,16 +30,43 @@
 
 namespace mbed {
 
+/** Cache statistics for a BufferedBlockDevice
+ */
+struct buffered_bd_stats_t {
+    uint32_t read_hits;         /**< Program units read from the cache */
+    uint32_t read_misses;       /**< Program units read from the underlying BD */
+    uint32_t program_hits;      /**< Program units written into an already cached entry */
+    uint32_t program_misses;    /**< Program units that needed a new cache entry */
+    uint32_t bypass_units;      /**< Program units in writes too large to cache, programmed directly */
+    uint32_t evictions;         /**< Dirty entries written back to make room */
+    uint32_t programs;          /**< Program calls to the underlying BD from write-back */
+    uint32_t programmed_units;  /**< Program units written back */
+    uint32_t read_ahead_units;  /**< Program units prefetched by sequential read-ahead */
+    uint32_t read_ahead_hits;   /**< Prefetched units that were then read */
+};
+
 /** Block device for allowing minimal read and program sizes (of 1) for the underlying BD,
- *  using a buffer on the heap.
+ *  using a write-back cache of program units on the heap.
+ *
+ *  Dirty units stay cached until they are evicted (least recently used first) or sync is called,
+ *  so repeated writes to the same units (eg, filesystem metadata) are absorbed. Adjacent dirty
+ *  units are written back together in a single multi-unit program. Writes covering at least as
+ *  many whole units as the cache holds bypass it.
+ *
+ *  Optionally, once reads are detected to be sequential, a read that misses the cache also
+ *  prefetches the following units into the cache with the same read of the underlying BD,
+ *  so sequential small reads (eg, file reads and directory scans) become multi-block reads.
  */
 class BufferedBlockDevice : public BlockDevice {
 public:
     /** Lifetime of a memory-buffered block device wrapping an underlying block device
      *
-     *  @param bd        Block device to back the BufferedBlockDevice
+     *  @param bd               Block device to back the BufferedBlockDevice
+     *  @param cache_entries    Number of program units to cache
+     *  @param read_ahead_units Number of program units to prefetch on sequential reads, 0 to disable,
+     *                          at most half of cache_entries
      */
-    BufferedBlockDevice(BlockDevice *bd);
+    BufferedBlockDevice(BlockDevice *bd, uint32_t cache_entries = 1, uint32_t read_ahead_units = 0);
 
     /** Lifetime of the memory-buffered block device
      */
@@ -159,25 +186,102 @@ public:
      */
     virtual const char *get_type() const;
 
+    /** Get the cache statistics
+     *
+     *  @param stats    Destination for the statistics
+     */
+    void get_stats(buffered_bd_stats_t *stats) const;
+
+    /** Reset the cache statistics to zero
+     */
+    void reset_stats();
+
 protected:
+    struct cache_entry_t {
+        bd_addr_t addr;         // address of the cached program unit
+        uint32_t slot;          // index of the unit's data in _cache
+        uint32_t last_use;      // _use_counter value at the last access, for LRU
+        bool valid;
+        bool dirty;
+        bool prefetched;        // filled by read-ahead and not yet read
+    };
+
     BlockDevice *_bd;
     bd_size_t _bd_program_size;
     bd_size_t _bd_read_size;
     bd_size_t _bd_size;
-    bd_size_t _write_cache_addr;
-    bool _write_cache_valid;
-    uint8_t *_write_cache;
+    uint32_t _cache_entries;
+    uint32_t _read_ahead_units;
+    bd_addr_t _last_read_end;   // end address of the previous read, for sequential detection
+    bool _sequential;           // previous read continued the one before it
+    cache_entry_t *_entries;
+    uint8_t *_cache;            // _cache_entries program units, indexed by slot
+    uint8_t *_swap_buf;         // one program unit, for rearranging slots
     uint8_t *_read_buf;
+    uint32_t _use_counter;
+    buffered_bd_stats_t _stats;
     uint32_t _init_ref_count;
     bool _is_initialized;
 
 #if !(DOXYGEN_ONLY)
-    /** Flush data in cache
+    /** Write back all dirty cache entries
      *
      *  @return         0 on success or a negative error code on failure
      */
     int flush();
 
+    /** Write back a dirty entry, together with the dirty entries adjacent to it,
+     *  as one program of the underlying BD
+     *
+     *  @param entry    Dirty cache entry
+     *  @return         0 on success or a negative error code on failure
+     */
+    int flush_run(cache_entry_t *entry);
+
+    /** Find the cache entry for a program unit
+     *
+     *  @param addr     Program unit aligned address
+     *  @return         Cache entry, or NULL if not cached
+     */
+    cache_entry_t *find_entry(bd_addr_t addr);
+
+    /** Find the lowest addressed cache entry in a range
+     *
+     *  @param addr     Start of the range
+     *  @param end      End of the range, exclusive
+     *  @return         Cache entry, or NULL if none in the range
+     */
+    cache_entry_t *first_entry_in(bd_addr_t addr, bd_addr_t end);
+
+    /** Get a cache entry for a program unit, evicting the least recently used if needed
+     *
+     *  @param addr     Program unit aligned address, which must not already be cached
+     *  @param entry    Set to the (invalid) entry to use
+     *  @return         0 on success or a negative error code on failure
+     */
+    int allocate_entry(bd_addr_t addr, cache_entry_t **entry);
+
+    /** Read a run of uncached program units into the cache with one read of the underlying BD
+     *
+     *  @param addr     Program unit aligned address of the first unit, which must not be cached
+     *  @return         0 on success or a negative error code on failure
+     */
+    int read_ahead(bd_addr_t addr);
+
+    /** Move an entry's data to a cache slot, swapping with the entry already in it
+     *
+     *  @param entry    Cache entry to move
+     *  @param slot     Destination slot
+     */
+    void move_to_slot(cache_entry_t *entry, uint32_t slot);
+
+    /** Drop cache entries overlapping a range, without writing them back
+     *
+     *  @param addr     Start of the range
+     *  @param size     Size of the range
+     */
+    void invalidate_range(bd_addr_t addr, bd_size_t size);
+
     /** Invalidate write cache
      *
      *  @return         none
@@ -15,6 +15,7 @@
  */
 
 #include "ExhaustibleBlockDevice.h"
+#include "stddef.h"
 #include "platform/mbed_atomic.h"
 #include "platform/mbed_assert.h"
 
@@ -0,0 +1,212 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencySimBlockDevice.h"
+#include "platform/mbed_wait_api.h"
+
+namespace mbed {
+
+static const latency_sim_bd_config_t sd_card_config = {
+    200,                // read_us: command, access time and start token
+    320,                // read_ns_per_byte: 8 bits at 25 MHz
+    800,                // program_us: command and programming busy
+    320,                // program_ns_per_byte
+    0,                  // erase_us: SDBlockDevice doesn't need erases, they do nothing
+    0,                  // erase_ns_per_byte
+    2000,               // trim_us: CMD38, a table update on SD cards
+    0,                  // sync_us: programming busy is counted in program_us
+    20,                 // jitter_percent
+    4 * 1024 * 1024,    // gc_interval
+    250000,             // gc_stall_us
+    4 * 1024 * 1024,    // au_size
+    10000,              // au_penalty_us
+    1,                  // seed
+};
+
+LatencySimBlockDevice::LatencySimBlockDevice(BlockDevice *bd, const latency_sim_bd_config_t *config, bool realtime)
+    : _bd(bd)
+    , _config(config ? *config : sd_card_config)
+    , _realtime(realtime)
+    , _time_us(0)
+    , _gc_debt(0)
+    , _last_au((bd_addr_t) -1)
+    , _gc_stalls(0)
+    , _au_penalties(0)
+    , _max_latency_us(0)
+{
+    _random = _config.seed ? _config.seed : 1;
+}
+
+int LatencySimBlockDevice::init()
+{
+    return _bd->init();
+}
+
+int LatencySimBlockDevice::deinit()
+{
+    return _bd->deinit();
+}
+
+int LatencySimBlockDevice::sync()
+{
+    delay(jitter(_config.sync_us));
+    return _bd->sync();
+}
+
+int LatencySimBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
+{
+    delay(jitter(_config.read_us + size * _config.read_ns_per_byte / 1000));
+    return _bd->read(b, addr, size);
+}
+
+int LatencySimBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
+{
+    uint64_t us = jitter(_config.program_us + size * _config.program_ns_per_byte / 1000);
+
+    if (_config.au_size && size) {
+        // each allocation unit the program moves into, other than the one the last program was in
+        bd_addr_t first_au = addr / _config.au_size;
+        bd_addr_t last_au = (addr + size - 1) / _config.au_size;
+        uint32_t changes = last_au - first_au + (first_au != _last_au ? 1 : 0);
+        _last_au = last_au;
+        _au_penalties += changes;
+        us += (uint64_t)changes * _config.au_penalty_us;
+    }
+
+    if (_config.gc_interval) {
+        _gc_debt += size;
+        while (_gc_debt >= _config.gc_interval) {
+            _gc_debt -= _config.gc_interval;
+            _gc_stalls++;
+            us += jitter(_config.gc_stall_us);
+        }
+    }
+
+    delay(us);
+    return _bd->program(b, addr, size);
+}
+
+int LatencySimBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    delay(jitter(_config.erase_us + size * _config.erase_ns_per_byte / 1000));
+    return _bd->erase(addr, size);
+}
+
+int LatencySimBlockDevice::trim(bd_addr_t addr, bd_size_t size)
+{
+    delay(jitter(_config.trim_us));
+    return _bd->trim(addr, size);
+}
+
+bd_size_t LatencySimBlockDevice::get_read_size() const
+{
+    return _bd->get_read_size();
+}
+
+bd_size_t LatencySimBlockDevice::get_program_size() const
+{
+    return _bd->get_program_size();
+}
+
+bd_size_t LatencySimBlockDevice::get_erase_size() const
+{
+    return _bd->get_erase_size();
+}
+
+bd_size_t LatencySimBlockDevice::get_erase_size(bd_addr_t addr) const
+{
+    return _bd->get_erase_size(addr);
+}
+
+int LatencySimBlockDevice::get_erase_value() const
+{
+    return _bd->get_erase_value();
+}
+
+bd_size_t LatencySimBlockDevice::size() const
+{
+    return _bd->size();
+}
+
+uint64_t LatencySimBlockDevice::get_time_us() const
+{
+    return _time_us;
+}
+
+void LatencySimBlockDevice::advance_time_us(uint64_t us)
+{
+    _time_us += us;
+}
+
+uint32_t LatencySimBlockDevice::get_gc_stalls() const
+{
+    return _gc_stalls;
+}
+
+uint32_t LatencySimBlockDevice::get_au_penalties() const
+{
+    return _au_penalties;
+}
+
+uint64_t LatencySimBlockDevice::get_max_latency_us() const
+{
+    return _max_latency_us;
+}
+
+const latency_sim_bd_config_t &LatencySimBlockDevice::get_sd_card_config()
+{
+    return sd_card_config;
+}
+
+uint64_t LatencySimBlockDevice::jitter(uint64_t us)
+{
+    if (_config.jitter_percent == 0 || us == 0) {
+        return us;
+    }
+    // xorshift32, deterministic for a given seed
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    // uniform in [-jitter_percent, +jitter_percent] percent
+    int64_t spread = (int64_t)(_random % (2 * _config.jitter_percent + 1)) - _config.jitter_percent;
+    return us + (int64_t)us * spread / 100;
+}
+
+void LatencySimBlockDevice::delay(uint64_t us)
+{
+    _time_us += us;
+    if (us > _max_latency_us) {
+        _max_latency_us = us;
+    }
+    if (_realtime) {
+        while (us > INT32_MAX) {
+            wait_us(INT32_MAX);
+            us -= INT32_MAX;
+        }
+        wait_us((int)us);
+    }
+}
+
+const char *LatencySimBlockDevice::get_type() const
+{
+    if (_bd != NULL) {
+        return _bd->get_type();
+    }
+
+    return NULL;
+}
+
+} // namespace mbed
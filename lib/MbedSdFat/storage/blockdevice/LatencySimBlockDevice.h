@@ -0,0 +1,251 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \addtogroup storage */
+/** @{*/
+
+#ifndef MBED_LATENCY_SIM_BLOCK_DEVICE_H
+#define MBED_LATENCY_SIM_BLOCK_DEVICE_H
+
+#include "BlockDevice.h"
+#include "stddef.h"
+
+namespace mbed {
+
+/** Latency model for LatencySimBlockDevice
+ *
+ *  Each operation costs its base latency plus a per-byte transfer cost, scaled by a random
+ *  jitter. Programs can additionally stall for garbage collection and at allocation unit changes.
+ */
+struct latency_sim_bd_config_t {
+    uint32_t read_us;               /**< Base latency of a read, eg command and access time */
+    uint32_t read_ns_per_byte;      /**< Transfer cost of reads */
+    uint32_t program_us;            /**< Base latency of a program, eg command and programming busy */
+    uint32_t program_ns_per_byte;   /**< Transfer cost of programs */
+    uint32_t erase_us;              /**< Base latency of an erase */
+    uint32_t erase_ns_per_byte;     /**< Cost of erases per byte erased */
+    uint32_t trim_us;               /**< Latency of a trim */
+    uint32_t sync_us;               /**< Latency of a sync */
+    uint8_t jitter_percent;         /**< Each latency is scaled by a uniform random factor of 100% +/- this */
+    bd_size_t gc_interval;          /**< Bytes programmed between garbage collection stalls, 0 for none */
+    uint32_t gc_stall_us;           /**< Length of a garbage collection stall, also subject to jitter */
+    bd_size_t au_size;              /**< Allocation unit size, 0 for no allocation unit penalties */
+    uint32_t au_penalty_us;         /**< Extra latency when programming moves to a different allocation unit */
+    uint32_t seed;                  /**< Random seed, runs with the same seed and operations are identical */
+};
+
+/** Block device that adds modelled latency, including stalls, to another block device
+ *
+ *  Time is kept on a virtual clock that each operation advances by its modelled latency,
+ *  so a host simulation of hours of logging finishes in seconds, and the result is repeatable.
+ *  With realtime set, operations also wait for their latency with wait_us, to exercise
+ *  firmware against slow storage on the target, or threads contending for it on the host.
+ *
+ *  @code
+ *  #include "mbed.h"
+ *  #include "HeapBlockDevice.h"
+ *  #include "LatencySimBlockDevice.h"
+ *
+ *  HeapBlockDevice heap(64 * 1024 * 1024, 512);
+ *  LatencySimBlockDevice sim(&heap);   // typical SD card figures
+ *
+ *  int main() {
+ *      sim.init();
+ *      // ... use sim as a block device ...
+ *      printf("took %llu us, %lu stalls\n", sim.get_time_us(), sim.get_gc_stalls());
+ *  }
+ *  @endcode
+ */
+class LatencySimBlockDevice : public BlockDevice {
+public:
+    /** Lifetime of the latency simulating block device
+     *
+     *  @param bd           Block device to back the LatencySimBlockDevice
+     *  @param config       Latency model, copied, or NULL for get_sd_card_config()
+     *  @param realtime     Wait out modelled latencies, rather than only advancing the virtual clock
+     */
+    LatencySimBlockDevice(BlockDevice *bd, const latency_sim_bd_config_t *config = NULL, bool realtime = false);
+
+    /** Lifetime of a block device
+     */
+    virtual ~LatencySimBlockDevice() {};
+
+    /** Initialize a block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     *  @note The init and deinit functions take no modelled time
+     */
+    virtual int init();
+
+    /** Deinitialize a block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int deinit();
+
+    /** Ensure data on storage is in sync with the driver
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Read blocks from a block device
+     *
+     *  @param buffer   Buffer to read blocks into
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Program blocks to a block device
+     *
+     *  The blocks must have been erased prior to being programmed
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Erase blocks on a block device
+     *
+     *  @param addr     Address of block to begin erasing
+     *  @param size     Size to erase in bytes, must be a multiple of erase block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int erase(bd_addr_t addr, bd_size_t size);
+
+    /** Mark blocks as no longer in use
+     *
+     *  @param addr     Address of block to begin trimming
+     *  @param size     Size to trim in bytes, must be a multiple of erase block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int trim(bd_addr_t addr, bd_size_t size);
+
+    /** Get the size of a readable block
+     *
+     *  @return         Size of a readable block in bytes
+     */
+    virtual bd_size_t get_read_size() const;
+
+    /** Get the size of a programmable block
+     *
+     *  @return         Size of a programmable block in bytes
+     */
+    virtual bd_size_t get_program_size() const;
+
+    /** Get the size of an erasable block
+     *
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual bd_size_t get_erase_size() const;
+
+    /** Get the size of an erasable block given address
+     *
+     *  @param addr     Address within the erasable block
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual bd_size_t get_erase_size(bd_addr_t addr) const;
+
+    /** Get the value of storage when erased
+     *
+     *  @return         The value of storage when erased, or -1 if you can't
+     *                  rely on the value of erased storage
+     */
+    virtual int get_erase_value() const;
+
+    /** Get the total size of the underlying device
+     *
+     *  @return         Size of the underlying device in bytes
+     */
+    virtual bd_size_t size() const;
+
+    /** Get the virtual clock
+     *
+     *  @return         Modelled time spent in operations, plus any advance_time_us(), in microseconds
+     */
+    uint64_t get_time_us() const;
+
+    /** Advance the virtual clock, for time the application spends between operations
+     *
+     *  @param us       Microseconds to add
+     */
+    void advance_time_us(uint64_t us);
+
+    /** Get the number of garbage collection stalls so far
+     *
+     *  @return         Number of stalls
+     */
+    uint32_t get_gc_stalls() const;
+
+    /** Get the number of allocation unit penalties so far
+     *
+     *  @return         Number of penalties
+     */
+    uint32_t get_au_penalties() const;
+
+    /** Get the latency of the slowest operation so far
+     *
+     *  @return         Latency in microseconds
+     */
+    uint64_t get_max_latency_us() const;
+
+    /** Get a latency model for a typical SD card on a 25 MHz SPI bus
+     *
+     *  Rough figures for a class 10 card: 4 MiB allocation units, and a quarter second
+     *  garbage collection stall every 4 MiB programmed. Real cards vary widely, measure yours
+     *  with TimingBlockDevice.
+     *
+     *  @return         The model
+     */
+    static const latency_sim_bd_config_t &get_sd_card_config();
+
+    /** Get the BlockDevice class type.
+     *
+     *  @return         A string represent the BlockDevice class type.
+     */
+    virtual const char *get_type() const;
+
+private:
+    uint64_t jitter(uint64_t us);
+    void delay(uint64_t us);
+
+    BlockDevice *_bd;
+    latency_sim_bd_config_t _config;
+    bool _realtime;
+
+    uint64_t _time_us;
+    uint32_t _random;
+    bd_size_t _gc_debt;             // bytes programmed since the last garbage collection stall
+    bd_addr_t _last_au;             // allocation unit of the last program, or -1 before the first
+    uint32_t _gc_stalls;
+    uint32_t _au_penalties;
+    uint64_t _max_latency_us;
+};
+
+} // namespace mbed
+
+// Added "using" for backwards compatibility
+#ifndef MBED_NO_GLOBAL_USING_DIRECTIVE
+using mbed::LatencySimBlockDevice;
+#endif
+
+#endif
+
+/** @}*/
@@ -227,6 +227,40 @@ int MBRBlockDevice::partition(BlockDevice *bd, int part, uint8_t type,
     return 0;
 }
 
+int MBRBlockDevice::partition_aligned(BlockDevice *bd, int part, uint8_t type, bd_size_t align)
+{
+    int err = bd->init();
+    if (err) {
+        return err;
+    }
+
+    // Calculate dimensions, block 0 holds the MBR so the partition starts one boundary in
+    bd_size_t sector = std::max<uint32_t>(bd->get_erase_size(), 512);
+    if (align < sector || align % sector != 0) {
+        bd->deinit();
+        return BD_ERROR_INVALID_PARTITION;
+    }
+    bd_size_t offset = align;
+    bd_size_t stop = bd->size() - bd->size() % align;
+    if (stop <= offset) {
+        bd->deinit();
+        return BD_ERROR_INVALID_PARTITION;
+    }
+
+    err = partition_absolute(bd, part, type, offset, stop - offset);
+    if (err) {
+        bd->deinit();
+        return err;
+    }
+
+    err = bd->deinit();
+    if (err) {
+        return err;
+    }
+
+    return 0;
+}
+
 MBRBlockDevice::MBRBlockDevice(BlockDevice *bd, int part)
     : _bd(bd), _offset(0), _size(0), _type(0), _part(part), _init_ref_count(0), _is_initialized(false)
 {
@@ -258,14 +292,14 @@ int MBRBlockDevice::init()
 
     err = _bd->read(buffer, 512 - buffer_size, buffer_size);
     if (err) {
-        goto fail;
+        goto fail_deinit;
     }
 
     // Check for valid table
     table = reinterpret_cast<struct mbr_table *>(&buffer[buffer_size - sizeof(struct mbr_table)]);
     if (table->signature[0] != 0x55 || table->signature[1] != 0xaa) {
         err = BD_ERROR_INVALID_MBR;
-        goto fail;
+        goto fail_deinit;
     }
 
     // Check for valid partition status
@@ -273,7 +307,7 @@ int MBRBlockDevice::init()
     if (table->entries[_part - 1].status != 0x00 &&
             table->entries[_part - 1].status != 0x80) {
         err = BD_ERROR_INVALID_PARTITION;
-        goto fail;
+        goto fail_deinit;
     }
 
     // Check for valid entry
@@ -283,7 +317,7 @@ int MBRBlockDevice::init()
             table->entries[_part - 1].type == 0x05 ||
             table->entries[_part - 1].type == 0x0f)) {
         err = BD_ERROR_INVALID_PARTITION;
-        goto fail;
+        goto fail_deinit;
     }
 
     // Get partition attributes
@@ -295,13 +329,16 @@ int MBRBlockDevice::init()
     // Check that block addresses are valid
     if (!_bd->is_valid_erase(_offset, _size)) {
         err = BD_ERROR_INVALID_PARTITION;
-        goto fail;
+        goto fail_deinit;
     }
 
     _is_initialized = true;
     delete[] buffer;
     return BD_ERROR_OK;
 
+fail_deinit:
+    // the underlying device was initialized, and its init counts until deinit
+    _bd->deinit();
 fail:
     delete[] buffer;
     _is_initialized = false;
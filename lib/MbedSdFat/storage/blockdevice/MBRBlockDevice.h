@@ -78,6 +78,20 @@ public:
      */
     static int partition(BlockDevice *bd, int part, uint8_t type, bd_addr_t start, bd_addr_t stop);
 
+    /** Format the MBR to contain a partition aligned to the given boundary
+     *
+     *  The partition starts at the first boundary after the MBR and ends at the last one,
+     *  so a file system formatted with the same alignment (see FATFileSystem::format) keeps
+     *  its FAT and data area aligned on the underlying device, eg, to SD card allocation units.
+     *
+     *  @param bd       Block device to partition
+     *  @param part     Partition to use, 1-4
+     *  @param type     8-bit partition type to identify partition contents
+     *  @param align    Alignment of the partition start and end in bytes, a multiple of the erase size
+     *  @return         0 on success or a negative error code on failure.
+     */
+    static int partition_aligned(BlockDevice *bd, int part, uint8_t type, bd_size_t align);
+
     /** Lifetime of the block device
      *
      *  @param bd       Block device to back the MBRBlockDevice
@@ -0,0 +1,426 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StripingBlockDevice.h"
+#include "platform/mbed_atomic.h"
+#include "platform/mbed_assert.h"
+#include <string.h>
+
+namespace mbed {
+
+StripingBlockDevice::StripingBlockDevice(BlockDevice **bds, size_t bd_count, bd_size_t stripe_size,
+                                         void *bounce, bd_size_t bounce_size)
+    : _bds(bds), _bd_count(bd_count), _stripe_size(stripe_size)
+    , _bounce(static_cast<uint8_t *>(bounce)), _bounce_size(bounce ? bounce_size : 0)
+    , _read_size(0), _program_size(0), _erase_size(0), _size(0)
+    , _erase_value(-1), _init_ref_count(0), _is_initialized(false)
+{
+}
+
+static bool is_aligned(uint64_t x, uint64_t alignment)
+{
+    return (x / alignment) * alignment == x;
+}
+
+int StripingBlockDevice::init()
+{
+    int err;
+    uint32_t val = core_util_atomic_incr_u32(&_init_ref_count, 1);
+
+    if (val != 1) {
+        return BD_ERROR_OK;
+    }
+
+    _read_size = 0;
+    _program_size = 0;
+    _erase_size = 0;
+    _erase_value = -1;
+    bd_size_t stripes = 0;
+
+    // Initialize children block devices, find all sizes and
+    // assert that block sizes are similar, as in ChainingBlockDevice
+    for (size_t i = 0; i < _bd_count; i++) {
+        err = _bds[i]->init();
+        if (err) {
+            goto fail;
+        }
+
+        bd_size_t read = _bds[i]->get_read_size();
+        if (i == 0 || (read >= _read_size && is_aligned(read, _read_size))) {
+            _read_size = read;
+        } else {
+            MBED_ASSERT(_read_size > read && is_aligned(_read_size, read));
+        }
+
+        bd_size_t program = _bds[i]->get_program_size();
+        if (i == 0 || (program >= _program_size && is_aligned(program, _program_size))) {
+            _program_size = program;
+        } else {
+            MBED_ASSERT(_program_size > program && is_aligned(_program_size, program));
+        }
+
+        bd_size_t erase = _bds[i]->get_erase_size();
+        if (i == 0 || (erase >= _erase_size && is_aligned(erase, _erase_size))) {
+            _erase_size = erase;
+        } else {
+            MBED_ASSERT(_erase_size > erase && is_aligned(_erase_size, erase));
+        }
+
+        int value = _bds[i]->get_erase_value();
+        if (i == 0 || value == _erase_value) {
+            _erase_value = value;
+        } else {
+            _erase_value = -1;
+        }
+
+        // every block device holds the same number of stripes
+        bd_size_t bd_stripes = _bds[i]->size() / _stripe_size;
+        if (i == 0 || bd_stripes < stripes) {
+            stripes = bd_stripes;
+        }
+    }
+
+    // a block never straddles two stripes
+    MBED_ASSERT(_stripe_size > 0 && is_aligned(_stripe_size, _erase_size));
+    if (_stripe_size == 0 || !is_aligned(_stripe_size, _erase_size)) {
+        err = BD_ERROR_DEVICE_ERROR;
+        goto fail;
+    }
+
+    _size = stripes * _stripe_size * _bd_count;
+
+    _is_initialized = true;
+    return BD_ERROR_OK;
+
+fail:
+    _is_initialized = false;
+    _init_ref_count = 0;
+    return err;
+}
+
+int StripingBlockDevice::deinit()
+{
+    if (!_is_initialized) {
+        return BD_ERROR_OK;
+    }
+
+    uint32_t val = core_util_atomic_decr_u32(&_init_ref_count, 1);
+
+    if (val) {
+        return BD_ERROR_OK;
+    }
+
+    for (size_t i = 0; i < _bd_count; i++) {
+        int err = _bds[i]->deinit();
+        if (err) {
+            return err;
+        }
+    }
+
+    _is_initialized = false;
+    return BD_ERROR_OK;
+}
+
+int StripingBlockDevice::sync()
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    for (size_t i = 0; i < _bd_count; i++) {
+        int err = _bds[i]->sync();
+        if (err) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+BlockDevice *StripingBlockDevice::locate(bd_addr_t &addr) const
+{
+    bd_addr_t stripe = addr / _stripe_size;
+    addr = (stripe / _bd_count) * _stripe_size + addr % _stripe_size;
+    return _bds[stripe % _bd_count];
+}
+
+// The part of the request from addr to end in stripe, starting at *start
+static bd_size_t stripe_part(bd_addr_t stripe, bd_size_t stripe_size, bd_addr_t addr, bd_addr_t end, bd_addr_t *start)
+{
+    bd_addr_t stripe_start = stripe * stripe_size;
+    bd_addr_t stripe_end = stripe_start + stripe_size;
+    *start = (addr > stripe_start) ? addr : stripe_start;
+    return ((end < stripe_end) ? end : stripe_end) - *start;
+}
+
+bool StripingBlockDevice::gathers(bd_addr_t addr, bd_size_t size) const
+{
+    // with room for less than two stripes, a request to a block device is one stripe anyway
+    return _bounce_size >= 2 * _stripe_size && size > 0 && (addr + size - 1) / _stripe_size - addr / _stripe_size >= _bd_count;
+}
+
+bd_addr_t StripingBlockDevice::gather_end(bd_addr_t first, bd_addr_t addr, bd_size_t size, bd_size_t *gathered) const
+{
+    bd_addr_t stripe = first;
+    *gathered = 0;
+    while (stripe * _stripe_size < addr + size) {
+        bd_addr_t start;
+        bd_size_t part = stripe_part(stripe, _stripe_size, addr, addr + size, &start);
+        if (*gathered + part > _bounce_size) {
+            break;
+        }
+        *gathered += part;
+        stripe += _bd_count;
+    }
+    return stripe;
+}
+
+int StripingBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
+{
+    MBED_ASSERT(is_valid_read(addr, size));
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    uint8_t *buffer = static_cast<uint8_t *>(b);
+
+    // The stripes on each block device are contiguous on it, so read them together into the
+    // bounce buffer, then scatter them to their places in the buffer
+    if (gathers(addr, size)) {
+        for (size_t i = 0; i < _bd_count; i++) {
+            bd_addr_t stripe = addr / _stripe_size;
+            stripe += (i + _bd_count - stripe % _bd_count) % _bd_count;
+            while (stripe * _stripe_size < addr + size) {
+                bd_size_t gathered;
+                bd_addr_t end = gather_end(stripe, addr, size, &gathered);
+
+                bd_addr_t bd_addr;
+                stripe_part(stripe, _stripe_size, addr, addr + size, &bd_addr);
+                BlockDevice *bd = locate(bd_addr);
+                int err = bd->read(_bounce, bd_addr, gathered);
+                if (err) {
+                    return err;
+                }
+
+                bd_size_t offset = 0;
+                for (; stripe != end; stripe += _bd_count) {
+                    bd_addr_t start;
+                    bd_size_t part = stripe_part(stripe, _stripe_size, addr, addr + size, &start);
+                    memcpy(buffer + (start - addr), _bounce + offset, part);
+                    offset += part;
+                }
+            }
+        }
+        return 0;
+    }
+
+    // One request per stripe, each to the next block device in turn
+    while (size > 0) {
+        bd_size_t read = _stripe_size - addr % _stripe_size;
+        if (read > size) {
+            read = size;
+        }
+
+        bd_addr_t bd_addr = addr;
+        BlockDevice *bd = locate(bd_addr);
+        int err = bd->read(buffer, bd_addr, read);
+        if (err) {
+            return err;
+        }
+
+        buffer += read;
+        addr += read;
+        size -= read;
+    }
+
+    return 0;
+}
+
+int StripingBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
+{
+    MBED_ASSERT(is_valid_program(addr, size));
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    const uint8_t *buffer = static_cast<const uint8_t *>(b);
+
+    // The stripes on each block device are contiguous on it, so gather them into the bounce
+    // buffer and program them together, each block device in turn
+    if (gathers(addr, size)) {
+        for (size_t i = 0; i < _bd_count; i++) {
+            bd_addr_t stripe = addr / _stripe_size;
+            stripe += (i + _bd_count - stripe % _bd_count) % _bd_count;
+            while (stripe * _stripe_size < addr + size) {
+                bd_size_t gathered;
+                bd_addr_t end = gather_end(stripe, addr, size, &gathered);
+
+                bd_addr_t bd_addr;
+                stripe_part(stripe, _stripe_size, addr, addr + size, &bd_addr);
+                BlockDevice *bd = locate(bd_addr);
+
+                bd_size_t offset = 0;
+                for (; stripe != end; stripe += _bd_count) {
+                    bd_addr_t start;
+                    bd_size_t part = stripe_part(stripe, _stripe_size, addr, addr + size, &start);
+                    memcpy(_bounce + offset, buffer + (start - addr), part);
+                    offset += part;
+                }
+
+                int err = bd->program(_bounce, bd_addr, gathered);
+                if (err) {
+                    return err;
+                }
+            }
+        }
+        return 0;
+    }
+
+    // One request per stripe, each to the next block device in turn, so a block device
+    // that programs in the background works on its stripe while the next one is sent
+    while (size > 0) {
+        bd_size_t program = _stripe_size - addr % _stripe_size;
+        if (program > size) {
+            program = size;
+        }
+
+        bd_addr_t bd_addr = addr;
+        BlockDevice *bd = locate(bd_addr);
+        int err = bd->program(buffer, bd_addr, program);
+        if (err) {
+            return err;
+        }
+
+        buffer += program;
+        addr += program;
+        size -= program;
+    }
+
+    return 0;
+}
+
+int StripingBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    MBED_ASSERT(is_valid_erase(addr, size));
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    while (size > 0) {
+        bd_size_t erase = _stripe_size - addr % _stripe_size;
+        if (erase > size) {
+            erase = size;
+        }
+
+        bd_addr_t bd_addr = addr;
+        BlockDevice *bd = locate(bd_addr);
+        int err = bd->erase(bd_addr, erase);
+        if (err) {
+            return err;
+        }
+
+        addr += erase;
+        size -= erase;
+    }
+
+    return 0;
+}
+
+int StripingBlockDevice::trim(bd_addr_t addr, bd_size_t size)
+{
+    MBED_ASSERT(is_valid_erase(addr, size));
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    // Whole rounds of stripes trim a contiguous range on each block device,
+    // so a large trim (eg, when formatting) is one request per block device
+    if (addr % (_stripe_size * _bd_count) == 0 && size % (_stripe_size * _bd_count) == 0) {
+        for (size_t i = 0; i < _bd_count; i++) {
+            int err = _bds[i]->trim(addr / _bd_count, size / _bd_count);
+            if (err) {
+                return err;
+            }
+        }
+        return 0;
+    }
+
+    while (size > 0) {
+        bd_size_t trim = _stripe_size - addr % _stripe_size;
+        if (trim > size) {
+            trim = size;
+        }
+
+        bd_addr_t bd_addr = addr;
+        BlockDevice *bd = locate(bd_addr);
+        int err = bd->trim(bd_addr, trim);
+        if (err) {
+            return err;
+        }
+
+        addr += trim;
+        size -= trim;
+    }
+
+    return 0;
+}
+
+bd_size_t StripingBlockDevice::get_read_size() const
+{
+    return _read_size;
+}
+
+bd_size_t StripingBlockDevice::get_program_size() const
+{
+    return _program_size;
+}
+
+bd_size_t StripingBlockDevice::get_erase_size() const
+{
+    return _erase_size;
+}
+
+bd_size_t StripingBlockDevice::get_erase_size(bd_addr_t addr) const
+{
+    if (!_is_initialized) {
+        return 0;
+    }
+
+    BlockDevice *bd = locate(addr);
+    return bd->get_erase_size(addr);
+}
+
+int StripingBlockDevice::get_erase_value() const
+{
+    return _erase_value;
+}
+
+bd_size_t StripingBlockDevice::size() const
+{
+    return _size;
+}
+
+bd_size_t StripingBlockDevice::get_stripe_size() const
+{
+    return _stripe_size;
+}
+
+const char *StripingBlockDevice::get_type() const
+{
+    return "STRIPING";
+}
+
+} // namespace mbed
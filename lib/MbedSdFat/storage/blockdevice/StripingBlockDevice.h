@@ -0,0 +1,254 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** \addtogroup storage */
+/** @{*/
+
+#ifndef MBED_STRIPING_BLOCK_DEVICE_H
+#define MBED_STRIPING_BLOCK_DEVICE_H
+
+#include "BlockDevice.h"
+#include "platform/mbed_assert.h"
+#include <stdlib.h>
+
+namespace mbed {
+
+/** Block device for interleaving fixed size stripes across multiple block devices
+ *
+ *  Stripe i is on block device i % bd_count, so a request spanning several stripes is split
+ *  across the block devices, issued to them in turn. Block devices that return from program
+ *  before the medium is done (eg, SDBlockDevice with the sd.DEFER_PROGRAM_BUSY option) then
+ *  program in parallel, each finishing its part while the others are sent theirs. Reads are
+ *  not overlapped.
+ *
+ *  The stripes of a request that land on one block device are contiguous on it. With a bounce
+ *  buffer of at least two stripes, they are gathered into one request to that block device, or
+ *  one per bounce buffer full, saving the per-request cost of the block device (eg, an SD
+ *  card's command and access time). Without one, each stripe is its own request.
+ *
+ *  The size is bd_count times the size of the smallest block device, rounded down to
+ *  a whole number of stripes on each.
+ *
+ *  @code
+ *  #include "mbed.h"
+ *  #include "SDBlockDevice.h"
+ *  #include "StripingBlockDevice.h"
+ *
+ *  // Two cards on separate SPI buses
+ *  SDBlockDevice sd1(MOSI1, MISO1, SCK1, CS1);
+ *  SDBlockDevice sd2(MOSI2, MISO2, SCK2, CS2);
+ *
+ *  // Create a block device alternating 32KiB stripes between the cards, sending each card up to
+ *  // 4 of its stripes at a time
+ *  BlockDevice *bds[] = {&sd1, &sd2};
+ *  uint8_t bounce[4 * 32 * 1024];
+ *  StripingBlockDevice striped(bds, 32 * 1024, bounce, sizeof(bounce));
+ *  @endcode
+ */
+class StripingBlockDevice : public BlockDevice {
+public:
+    /** Lifetime of the striping block device
+     *
+     *  @param bds          Array of block devices to stripe across
+     *  @param bd_count     Number of block devices to stripe across
+     *  @param stripe_size  Size of each stripe in bytes
+     *  @param bounce       Bounce buffer that gathers the stripes of a request for one block device,
+     *                      or NULL for none
+     *  @param bounce_size  Size of the bounce buffer in bytes, less than two stripes is the same as none
+     *  @note The stripe size must be a multiple of the erase size of every block device
+     */
+    StripingBlockDevice(BlockDevice **bds, size_t bd_count, bd_size_t stripe_size,
+                        void *bounce = NULL, bd_size_t bounce_size = 0);
+
+    /** Lifetime of the striping block device
+     *
+     *  @param bds          Array of block devices to stripe across
+     *  @param stripe_size  Size of each stripe in bytes
+     *  @param bounce       Bounce buffer that gathers the stripes of a request for one block device,
+     *                      or NULL for none
+     *  @param bounce_size  Size of the bounce buffer in bytes, less than two stripes is the same as none
+     *  @note The stripe size must be a multiple of the erase size of every block device
+     */
+    template <size_t Size>
+    StripingBlockDevice(BlockDevice * (&bds)[Size], bd_size_t stripe_size, void *bounce = NULL, bd_size_t bounce_size = 0)
+        : _bds(bds), _bd_count(sizeof(bds) / sizeof(bds[0])), _stripe_size(stripe_size)
+        , _bounce(static_cast<uint8_t *>(bounce)), _bounce_size(bounce ? bounce_size : 0)
+        , _read_size(0), _program_size(0), _erase_size(0), _size(0)
+        , _erase_value(-1), _init_ref_count(0), _is_initialized(false)
+    {
+    }
+
+    /** Lifetime of the striping block device
+     *
+     */
+    virtual ~StripingBlockDevice() {}
+
+    /** Initialize a block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int init();
+
+    /** Deinitialize a block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int deinit();
+
+    /** Ensure data on storage is in sync with the driver
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Read blocks from a block device
+     *
+     *  @param buffer   Buffer to write blocks to
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Program blocks to a block device
+     *
+     *  The blocks must have been erased prior to being programmed
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Erase blocks on a block device
+     *
+     *  The state of an erased block is undefined until it has been programmed,
+     *  unless get_erase_value returns a non-negative byte value
+     *
+     *  @param addr     Address of block to begin erasing
+     *  @param size     Size to erase in bytes, must be a multiple of erase block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int erase(bd_addr_t addr, bd_size_t size);
+
+    /** Mark blocks as no longer in use
+     *
+     *  @param addr     Address of block to begin trimming
+     *  @param size     Size to trim in bytes, must be a multiple of erase block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int trim(bd_addr_t addr, bd_size_t size);
+
+    /** Get the size of a readable block
+     *
+     *  @return         Size of a readable block in bytes
+     */
+    virtual bd_size_t get_read_size() const;
+
+    /** Get the size of a programmable block
+     *
+     *  @return         Size of a programmable block in bytes
+     *  @note Must be a multiple of the read size
+     */
+    virtual bd_size_t get_program_size() const;
+
+    /** Get the size of an eraseable block
+     *
+     *  @return         Size of an erasable block in bytes
+     *  @note Must be a multiple of the program size
+     */
+    virtual bd_size_t get_erase_size() const;
+
+    /** Get the size of an erasable block given address
+     *
+     *  @param addr     Address within the erasable block
+     *  @return         Size of an erasable block in bytes
+     *  @note Must be a multiple of the program size
+     */
+    virtual bd_size_t get_erase_size(bd_addr_t addr) const;
+
+    /** Get the value of storage when erased
+     *
+     *  If get_erase_value returns a non-negative byte value, the underlying
+     *  storage is set to that value when erased, and storage containing
+     *  that value can be programmed without another erase.
+     *
+     *  @return         The value of storage when erased, or -1 if you can't
+     *                  rely on the value of erased storage
+     */
+    virtual int get_erase_value() const;
+
+    /** Get the total size of the underlying device
+     *
+     *  @return         Size of the underlying device in bytes
+     */
+    virtual bd_size_t size() const;
+
+    /** Get the stripe size
+     *
+     *  @return         Size of each stripe in bytes
+     */
+    bd_size_t get_stripe_size() const;
+
+    /** Get the BlockDevice class type.
+     *
+     *  @return         A string represent the BlockDevice class type.
+     */
+    virtual const char *get_type() const;
+
+protected:
+    // Block device holding addr, with addr translated to its address
+    BlockDevice *locate(bd_addr_t &addr) const;
+
+    // Whether a request spans more stripes than there are block devices, so that gathering
+    // the stripes for each block device saves requests
+    bool gathers(bd_addr_t addr, bd_size_t size) const;
+
+    // The stripes from first, first + bd_count, ... of the request at addr of size that fit in the
+    // bounce buffer: the stripe after the last one, and the size of their parts of the request
+    bd_addr_t gather_end(bd_addr_t first, bd_addr_t addr, bd_size_t size, bd_size_t *gathered) const;
+
+    BlockDevice **_bds;
+    size_t _bd_count;
+    bd_size_t _stripe_size;
+    uint8_t *_bounce;
+    bd_size_t _bounce_size;
+    bd_size_t _read_size;
+    bd_size_t _program_size;
+    bd_size_t _erase_size;
+    bd_size_t _size;
+    int _erase_value;
+    uint32_t _init_ref_count;
+    bool _is_initialized;
+};
+
+} // namespace mbed
+
+// Added "using" for backwards compatibility
+#ifndef MBED_NO_GLOBAL_USING_DIRECTIVE
+using mbed::StripingBlockDevice;
+#endif
+
+#endif
+
+/** @}*/
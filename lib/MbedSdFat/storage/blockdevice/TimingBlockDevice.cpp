@@ -0,0 +1,235 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TimingBlockDevice.h"
+#include "stddef.h"
+#include <string.h>
+
+namespace mbed {
+
+// Roughly 3x steps from a fast single-block transfer up to a multi-hundred-millisecond card stall
+static const uint32_t latency_bucket_limits_us[TIMING_BD_LATENCY_BUCKETS - 1] = {
+    100, 300, 1000, 3000, 10000, 30000, 100000, 300000
+};
+
+static const bd_size_t smallest_size_bucket = 512;
+
+TimingBlockDevice::TimingBlockDevice(BlockDevice *bd, uint32_t window_ms)
+    : _bd(bd)
+    , _window_us(window_ms * 1000)
+    , _window_start_us(0)
+    , _window_index(0)
+{
+    reset();
+    memset(_window_read_bytes, 0, sizeof(_window_read_bytes));
+    memset(_window_program_bytes, 0, sizeof(_window_program_bytes));
+    _timer.start();
+}
+
+int TimingBlockDevice::init()
+{
+    return _bd->init();
+}
+
+int TimingBlockDevice::deinit()
+{
+    return _bd->deinit();
+}
+
+int TimingBlockDevice::sync()
+{
+    uint32_t start_us = _timer.read_us();
+    int err = _bd->sync();
+    record(_sync, start_us, 0, 0, err);
+    return err;
+}
+
+int TimingBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
+{
+    uint32_t start_us = _timer.read_us();
+    int err = _bd->read(b, addr, size);
+    record(_read, start_us, addr, size, err);
+    if (!err) {
+        _window_read_bytes[_window_index] += size;
+    }
+    return err;
+}
+
+int TimingBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
+{
+    uint32_t start_us = _timer.read_us();
+    int err = _bd->program(b, addr, size);
+    record(_program, start_us, addr, size, err);
+    if (!err) {
+        _window_program_bytes[_window_index] += size;
+    }
+    return err;
+}
+
+int TimingBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    uint32_t start_us = _timer.read_us();
+    int err = _bd->erase(addr, size);
+    record(_erase, start_us, addr, size, err);
+    return err;
+}
+
+int TimingBlockDevice::trim(bd_addr_t addr, bd_size_t size)
+{
+    // trims erase on most devices (eg, CMD38 on SD cards), so they share the erase statistics
+    uint32_t start_us = _timer.read_us();
+    int err = _bd->trim(addr, size);
+    record(_erase, start_us, addr, size, err);
+    return err;
+}
+
+bd_size_t TimingBlockDevice::get_read_size() const
+{
+    return _bd->get_read_size();
+}
+
+bd_size_t TimingBlockDevice::get_program_size() const
+{
+    return _bd->get_program_size();
+}
+
+bd_size_t TimingBlockDevice::get_erase_size() const
+{
+    return _bd->get_erase_size();
+}
+
+bd_size_t TimingBlockDevice::get_erase_size(bd_addr_t addr) const
+{
+    return _bd->get_erase_size(addr);
+}
+
+int TimingBlockDevice::get_erase_value() const
+{
+    return _bd->get_erase_value();
+}
+
+bd_size_t TimingBlockDevice::size() const
+{
+    return _bd->size();
+}
+
+void TimingBlockDevice::record(timing_bd_op_stats_t &stats, uint32_t start_us,
+                               bd_addr_t addr, bd_size_t size, int err)
+{
+    uint32_t now_us = _timer.read_us();
+    uint32_t latency_us = now_us - start_us;
+    advance_windows(now_us);
+
+    stats.count++;
+    if (err) {
+        stats.errors++;
+    } else {
+        stats.bytes += size;
+    }
+    stats.total_latency_us += latency_us;
+    if (stats.count == 1 || latency_us < stats.min_latency_us) {
+        stats.min_latency_us = latency_us;
+    }
+    if (latency_us > stats.max_latency_us) {
+        stats.max_latency_us = latency_us;
+        stats.max_latency_addr = addr;
+        stats.max_latency_size = size;
+    }
+
+    size_t bucket = 0;
+    while (bucket < TIMING_BD_LATENCY_BUCKETS - 1 && latency_us >= latency_bucket_limits_us[bucket]) {
+        bucket++;
+    }
+    stats.latency_counts[bucket]++;
+
+    bucket = 0;
+    bd_size_t bucket_limit = smallest_size_bucket;
+    while (bucket < TIMING_BD_SIZE_BUCKETS - 1 && size > bucket_limit) {
+        bucket++;
+        bucket_limit *= 2;
+    }
+    stats.size_counts[bucket]++;
+}
+
+void TimingBlockDevice::advance_windows(uint32_t now_us)
+{
+    uint32_t elapsed_windows = (now_us - _window_start_us) / _window_us;
+    if (elapsed_windows >= TIMING_BD_WINDOWS) {
+        // idle for longer than the whole span, restart the windows from now
+        memset(_window_read_bytes, 0, sizeof(_window_read_bytes));
+        memset(_window_program_bytes, 0, sizeof(_window_program_bytes));
+        _window_start_us = now_us;
+        return;
+    }
+    for (uint32_t i = 0; i < elapsed_windows; i++) {
+        _window_index = (_window_index + 1) % TIMING_BD_WINDOWS;
+        _window_read_bytes[_window_index] = 0;
+        _window_program_bytes[_window_index] = 0;
+    }
+    _window_start_us += elapsed_windows * _window_us;
+}
+
+void TimingBlockDevice::get_snapshot(timing_bd_snapshot_t *snapshot)
+{
+    advance_windows(_timer.read_us());
+
+    snapshot->read = _read;
+    snapshot->program = _program;
+    snapshot->erase = _erase;
+    snapshot->sync = _sync;
+
+    // only completed windows, the current one is still filling
+    uint64_t read_bytes = 0, program_bytes = 0;
+    uint32_t peak_program_bytes = 0;
+    for (uint8_t i = 0; i < TIMING_BD_WINDOWS; i++) {
+        if (i == _window_index) {
+            continue;
+        }
+        read_bytes += _window_read_bytes[i];
+        program_bytes += _window_program_bytes[i];
+        if (_window_program_bytes[i] > peak_program_bytes) {
+            peak_program_bytes = _window_program_bytes[i];
+        }
+    }
+    uint64_t span_us = (uint64_t)_window_us * (TIMING_BD_WINDOWS - 1);
+    snapshot->read_bytes_per_s = read_bytes * 1000000 / span_us;
+    snapshot->program_bytes_per_s = program_bytes * 1000000 / span_us;
+    snapshot->peak_program_bytes_per_s = (uint64_t)peak_program_bytes * 1000000 / _window_us;
+}
+
+void TimingBlockDevice::reset()
+{
+    memset(&_read, 0, sizeof(_read));
+    memset(&_program, 0, sizeof(_program));
+    memset(&_erase, 0, sizeof(_erase));
+    memset(&_sync, 0, sizeof(_sync));
+}
+
+const uint32_t *TimingBlockDevice::get_latency_bucket_limits()
+{
+    return latency_bucket_limits_us;
+}
+
+const char *TimingBlockDevice::get_type() const
+{
+    if (_bd != NULL) {
+        return _bd->get_type();
+    }
+
+    return NULL;
+}
+
+} // namespace mbed
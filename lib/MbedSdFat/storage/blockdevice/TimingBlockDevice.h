@@ -0,0 +1,248 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \addtogroup storage */
+/** @{*/
+
+#ifndef MBED_TIMING_BLOCK_DEVICE_H
+#define MBED_TIMING_BLOCK_DEVICE_H
+
+#include "BlockDevice.h"
+#include "drivers/Timer.h"
+
+namespace mbed {
+
+/** Number of latency histogram buckets, see TimingBlockDevice::get_latency_bucket_limits */
+#define TIMING_BD_LATENCY_BUCKETS   9
+/** Number of request size buckets: up to 512B, 1KiB, ... 32KiB, and larger */
+#define TIMING_BD_SIZE_BUCKETS      8
+/** Number of sliding throughput windows */
+#define TIMING_BD_WINDOWS           8
+
+/** Timing statistics for one kind of block device operation
+ */
+struct timing_bd_op_stats_t {
+    uint32_t count;                 /**< Operations, including failed ones */
+    uint32_t errors;                /**< Failed operations */
+    bd_size_t bytes;                /**< Bytes in successful operations */
+    uint64_t total_latency_us;      /**< Sum of latencies, for averaging */
+    uint32_t min_latency_us;        /**< Lowest latency, 0 if no operations */
+    uint32_t max_latency_us;        /**< Highest latency */
+    bd_addr_t max_latency_addr;     /**< Address of the operation with the highest latency */
+    bd_size_t max_latency_size;     /**< Size of the operation with the highest latency */
+    uint32_t latency_counts[TIMING_BD_LATENCY_BUCKETS];  /**< Latency histogram */
+    uint32_t size_counts[TIMING_BD_SIZE_BUCKETS];        /**< Request size histogram */
+};
+
+/** Point-in-time copy of all TimingBlockDevice statistics
+ */
+struct timing_bd_snapshot_t {
+    timing_bd_op_stats_t read;
+    timing_bd_op_stats_t program;
+    timing_bd_op_stats_t erase;             /**< Erase and trim */
+    timing_bd_op_stats_t sync;
+    uint32_t read_bytes_per_s;          /**< Read throughput over the completed sliding windows */
+    uint32_t program_bytes_per_s;       /**< Program throughput over the completed sliding windows */
+    uint32_t peak_program_bytes_per_s;  /**< Program throughput of the busiest completed window */
+};
+
+/** Block device for measuring per-operation latency and throughput of another block device
+ *
+ *  Unlike ProfilingBlockDevice, which only counts bytes, this records latency and request size
+ *  histograms, the slowest operation and its address, and throughput over sliding windows,
+ *  to find stalls (eg, SD card internal garbage collection during program).
+ *
+ *  @code
+ *  #include "mbed.h"
+ *  #include "SDBlockDevice.h"
+ *  #include "TimingBlockDevice.h"
+ *
+ *  SDBlockDevice sd(MOSI, MISO, SCK, CS);
+ *  TimingBlockDevice timing(&sd);
+ *
+ *  int main() {
+ *      timing.init();
+ *      // ... use timing as a block device ...
+ *
+ *      timing_bd_snapshot_t snapshot;
+ *      timing.get_snapshot(&snapshot);
+ *      printf("max program %lu us at 0x%llx\n",
+ *             snapshot.program.max_latency_us, snapshot.program.max_latency_addr);
+ *  }
+ *  @endcode
+ */
+class TimingBlockDevice : public BlockDevice {
+public:
+    /** Lifetime of the timing block device
+     *
+     *  @param bd           Block device to back the TimingBlockDevice
+     *  @param window_ms    Length of each sliding throughput window in milliseconds
+     */
+    TimingBlockDevice(BlockDevice *bd, uint32_t window_ms = 125);
+
+    /** Lifetime of a block device
+     */
+    virtual ~TimingBlockDevice() {};
+
+    /** Initialize a block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     *  @note The init and deinit functions are not timed
+     */
+    virtual int init();
+
+    /** Deinitialize a block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int deinit();
+
+    /** Ensure data on storage is in sync with the driver
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Read blocks from a block device
+     *
+     *  @param buffer   Buffer to read blocks into
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Program blocks to a block device
+     *
+     *  The blocks must have been erased prior to being programmed
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Erase blocks on a block device
+     *
+     *  @param addr     Address of block to begin erasing
+     *  @param size     Size to erase in bytes, must be a multiple of erase block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int erase(bd_addr_t addr, bd_size_t size);
+
+    /** Mark blocks as no longer in use
+     *
+     *  @param addr     Address of block to begin trimming
+     *  @param size     Size to trim in bytes, must be a multiple of erase block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int trim(bd_addr_t addr, bd_size_t size);
+
+    /** Get the size of a readable block
+     *
+     *  @return         Size of a readable block in bytes
+     */
+    virtual bd_size_t get_read_size() const;
+
+    /** Get the size of a programmable block
+     *
+     *  @return         Size of a programmable block in bytes
+     */
+    virtual bd_size_t get_program_size() const;
+
+    /** Get the size of an erasable block
+     *
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual bd_size_t get_erase_size() const;
+
+    /** Get the size of an erasable block given address
+     *
+     *  @param addr     Address within the erasable block
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual bd_size_t get_erase_size(bd_addr_t addr) const;
+
+    /** Get the value of storage when erased
+     *
+     *  @return         The value of storage when erased, or -1 if you can't
+     *                  rely on the value of erased storage
+     */
+    virtual int get_erase_value() const;
+
+    /** Get the total size of the underlying device
+     *
+     *  @return         Size of the underlying device in bytes
+     */
+    virtual bd_size_t size() const;
+
+    /** Copy the current statistics
+     *
+     *  @param snapshot Destination for the statistics
+     */
+    void get_snapshot(timing_bd_snapshot_t *snapshot);
+
+    /** Reset the per-operation statistics
+     *
+     *  The throughput windows are not cleared, since they age out on their own.
+     */
+    void reset();
+
+    /** Get the upper latency limits of the histogram buckets
+     *
+     *  Bucket i counts latencies below limit i (and at or above limit i-1),
+     *  with the last bucket counting everything above the last limit.
+     *
+     *  @return         Array of TIMING_BD_LATENCY_BUCKETS - 1 limits in microseconds
+     */
+    static const uint32_t *get_latency_bucket_limits();
+
+    /** Get the BlockDevice class type.
+     *
+     *  @return         A string represent the BlockDevice class type.
+     */
+    virtual const char *get_type() const;
+
+private:
+    void record(timing_bd_op_stats_t &stats, uint32_t start_us, bd_addr_t addr, bd_size_t size, int err);
+    void advance_windows(uint32_t now_us);
+
+    BlockDevice *_bd;
+    Timer _timer;
+    uint32_t _window_us;
+
+    timing_bd_op_stats_t _read;
+    timing_bd_op_stats_t _program;
+    timing_bd_op_stats_t _erase;
+    timing_bd_op_stats_t _sync;
+
+    uint32_t _window_start_us;          // start time of the current (incomplete) window
+    uint8_t _window_index;              // index of the current window
+    uint32_t _window_read_bytes[TIMING_BD_WINDOWS];
+    uint32_t _window_program_bytes[TIMING_BD_WINDOWS];
+};
+
+} // namespace mbed
+
+// Added "using" for backwards compatibility
+#ifndef MBED_NO_GLOBAL_USING_DIRECTIVE
+using mbed::TimingBlockDevice;
+#endif
+
+#endif
+
+/** @}*/
@@ -116,4 +116,22 @@ int File::truncate(off_t length)
     return _fs->file_truncate(_file, length);
 }
 
+ssize_t File::write_direct(const void *buffer, size_t size)
+{
+    MBED_ASSERT(_fs);
+    return _fs->file_write_direct(_file, buffer, size);
+}
+
+int File::set_extent_size(off_t size)
+{
+    MBED_ASSERT(_fs);
+    return _fs->file_set_extent_size(_file, size);
+}
+
+int File::checkpoint()
+{
+    MBED_ASSERT(_fs);
+    return _fs->file_checkpoint(_file);
+}
+
 } // namespace mbed
@@ -138,6 +138,41 @@ public:
      */
     virtual int truncate(off_t length);
 
+    /** Write whole blocks to the file, straight from the buffer to the block device
+     *
+     *  For appenders that batch their data into blocks: the data is not copied into a buffer of
+     *  the file system, and contiguous blocks go to the device in one program. A write that
+     *  doesn't start and end on block boundaries is refused, so the caller knows which path each
+     *  write took and can fall back to write().
+     *
+     *  @param buffer   The buffer to write from
+     *  @param size     The number of bytes to write, a multiple of the block size (statvfs f_bsize)
+     *  @return         The number of bytes written, -EINVAL if the file position or size isn't a
+     *                  multiple of the block size, -ENOSYS if the file system doesn't support it,
+     *                  or a negative error code on failure
+     */
+    ssize_t write_direct(const void *buffer, size_t size);
+
+    /** Set how much space the file claims at once when it grows
+     *
+     *  For files written side by side, so that each stays in contiguous extents of this size
+     *  instead of interleaving with the others.
+     *
+     *  @param size     Size of the extents in bytes, rounded to the allocation unit, 0 for the default
+     *  @return         0 on success, -ENOSYS if the file system doesn't support it,
+     *                  or a negative error code on failure
+     */
+    int set_extent_size(off_t size);
+
+    /** Make the data written so far durable, more cheaply than sync
+     *
+     *  After a power loss the file has at least the size it had at the last checkpoint,
+     *  the rest of its metadata is updated by sync or close
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    int checkpoint();
+
 private:
     FileSystem *_fs;
     fs_file_t _file;
@@ -89,6 +89,26 @@ int FileSystem::file_truncate(fs_file_t file, off_t length)
     return -ENOSYS;
 }
 
+ssize_t FileSystem::file_write_direct(fs_file_t file, const void *buffer, size_t len)
+{
+    (void)file;
+    (void)buffer;
+    (void)len;
+    return -ENOSYS;
+}
+
+int FileSystem::file_set_extent_size(fs_file_t file, off_t size)
+{
+    (void)file;
+    (void)size;
+    return -ENOSYS;
+}
+
+int FileSystem::file_checkpoint(fs_file_t file)
+{
+    return file_sync(file);
+}
+
 int FileSystem::dir_open(fs_dir_t *dir, const char *path)
 {
     return -ENOSYS;
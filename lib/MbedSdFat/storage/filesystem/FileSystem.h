@@ -233,6 +233,41 @@ protected:
      */
     virtual int file_truncate(fs_file_t file, off_t length);
 
+    /** Write whole blocks to a file, straight from the buffer to the block device.
+     *
+     *  Unlike file_write, the data never goes through a buffer of the file system, and the
+     *  write is refused rather than buffered if it isn't made of whole blocks.
+     *
+     *  @param file     File handle.
+     *  @param buffer   The buffer to write from.
+     *  @param len      The number of bytes to write, a multiple of the block size (statvfs f_bsize).
+     *  @return         The number of bytes written, -EINVAL if the file position or len isn't a
+     *                  multiple of the block size, -ENOSYS if not supported, or a negative error code on failure.
+     */
+    virtual ssize_t file_write_direct(fs_file_t file, const void *buffer, size_t len);
+
+    /** Set how much space a file claims at once when it grows.
+     *
+     *  Files growing side by side then each get contiguous extents of this size, instead of
+     *  taking turns over the free space.
+     *
+     *  @param file     File handle.
+     *  @param size     Size of the extents in bytes, rounded to the allocation unit, 0 for the default.
+     *  @return         0 on success, -ENOSYS if not supported, or a negative error code on failure.
+     */
+    virtual int file_set_extent_size(fs_file_t file, off_t size);
+
+    /** Make the data written so far durable, more cheaply than file_sync.
+     *
+     *  After a power loss the file has at least the size it had at the last checkpoint.
+     *  Metadata that doesn't affect that, such as the modified time, can wait for file_sync
+     *  or file_close. Defaults to file_sync.
+     *
+     *  @param file     File handle.
+     *  @return         0 on success, negative error code on failure.
+     */
+    virtual int file_checkpoint(fs_file_t file);
+
     /** Open a directory on the file system.
      *
      *  @param dir      Destination for the handle to the directory.
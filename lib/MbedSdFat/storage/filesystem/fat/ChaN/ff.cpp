@@ -1406,6 +1406,234 @@ FRESULT fill_last_frag (
 
 
 
+#if !FF_FS_READONLY && (FF_APPEND_RUN || FF_FREE_MAP)
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Get the FAT sector holding a cluster's entry           */
+/*-----------------------------------------------------------------------*/
+static
+DWORD fat_sect (	/* FAT sector# (first sector for FAT12 entries on a sector boundary) */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster# */
+)
+{
+	switch (fs->fs_type) {
+	case FS_FAT12 :
+		return fs->fatbase + (clst + clst / 2) / SS(fs);
+	case FS_FAT16 :
+		return fs->fatbase + clst / (SS(fs) / 2);
+	default :
+		return fs->fatbase + clst / (SS(fs) / 4);
+	}
+}
+#endif
+
+
+
+#if !FF_FS_READONLY && FF_FREE_MAP
+/*-----------------------------------------------------------------------*/
+/* Free map - Remove an extent from the map                              */
+/*-----------------------------------------------------------------------*/
+static
+void fmap_drop (
+	FATFS* fs,		/* Filesystem object */
+	UINT i			/* Index of the extent */
+)
+{
+	fs->fmap_n--;
+	mem_cpy(&fs->fmap[i], &fs->fmap[i + 1], (fs->fmap_n - i) * sizeof (FEXTENT));
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Free map - Insert an extent into the map                              */
+/*-----------------------------------------------------------------------*/
+static
+void fmap_insert (
+	FATFS* fs,		/* Filesystem object */
+	UINT i,			/* Index to insert at, keeping the map sorted */
+	DWORD clst,		/* First cluster of the extent */
+	DWORD ncl		/* Number of clusters */
+)
+{
+	UINT j, k;
+
+
+	if (fs->fmap_n == FF_FREE_MAP) {	/* Map is full, drop the smallest extent to make room */
+		fs->fmap_lost = 1;
+		for (j = 0, k = 1; k < fs->fmap_n; k++) {
+			if (fs->fmap[k].len < fs->fmap[j].len) j = k;
+		}
+		if (fs->fmap[j].len >= ncl) return;	/* The new one is the smallest */
+		fmap_drop(fs, j);
+		if (j < i) i--;
+	}
+	for (k = fs->fmap_n; k > i; k--) fs->fmap[k] = fs->fmap[k - 1];
+	fs->fmap[i].start = clst;
+	fs->fmap[i].len = ncl;
+	fs->fmap_n++;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Free map - Add freed clusters                                         */
+/*-----------------------------------------------------------------------*/
+static
+void fmap_put (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* First cluster freed */
+	DWORD ncl		/* Number of clusters freed */
+)
+{
+	UINT i;
+
+
+	if (clst >= fs->fmap_scan) return;	/* The scan will find them */
+	if (clst + ncl > fs->fmap_scan) ncl = fs->fmap_scan - clst;
+	fs->fmap_free += ncl;
+
+	for (i = 0; i < fs->fmap_n && fs->fmap[i].start < clst; i++) ;	/* Find the extent after it */
+	if (i > 0 && fs->fmap[i - 1].start + fs->fmap[i - 1].len == clst) {	/* Join the previous extent */
+		fs->fmap[i - 1].len += ncl;
+		if (i < fs->fmap_n && clst + ncl == fs->fmap[i].start) {	/* and the next one */
+			fs->fmap[i - 1].len += fs->fmap[i].len;
+			fmap_drop(fs, i);
+		}
+	} else if (i < fs->fmap_n && clst + ncl == fs->fmap[i].start) {	/* Join the next extent */
+		fs->fmap[i].start = clst;
+		fs->fmap[i].len += ncl;
+	} else {
+		fmap_insert(fs, i, clst, ncl);
+	}
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Free map - Remove allocated clusters                                  */
+/*-----------------------------------------------------------------------*/
+static
+void fmap_take (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* First cluster allocated */
+	DWORD ncl		/* Number of clusters allocated */
+)
+{
+	UINT i;
+	DWORD ecl, end;
+
+
+	if (clst >= fs->fmap_scan) return;	/* Not scanned yet */
+	if (clst + ncl > fs->fmap_scan) ncl = fs->fmap_scan - clst;
+	fs->fmap_free -= ncl;
+
+	ecl = clst + ncl;
+	for (i = 0; i < fs->fmap_n && fs->fmap[i].start < ecl; ) {
+		end = fs->fmap[i].start + fs->fmap[i].len;
+		if (end <= clst) {				/* Entirely before the range */
+			i++;
+		} else if (fs->fmap[i].start >= clst && end <= ecl) {	/* Entirely in the range */
+			fmap_drop(fs, i);
+		} else if (fs->fmap[i].start >= clst) {	/* Head of the extent in the range */
+			fs->fmap[i].start = ecl;
+			fs->fmap[i].len = end - ecl;
+			i++;
+		} else {						/* Tail of the extent in the range, or the range inside it */
+			fs->fmap[i].len = clst - fs->fmap[i].start;
+			if (end > ecl) fmap_insert(fs, i + 1, ecl, end - ecl);	/* Split it */
+			i++;
+		}
+	}
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Free map - Find a free cluster                                        */
+/*-----------------------------------------------------------------------*/
+static
+DWORD fmap_find (	/* 0:Map can not tell, >=2:Free cluster# */
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl		/* Find a free cluster after this one */
+)
+{
+	UINT i;
+
+
+	if (fs->fmap_scan < fs->n_fatent) return 0;	/* Map is not complete */
+	if (fs->fmap_n == 0) {
+		if (fs->fmap_lost) {	/* Extents were dropped, rescan in the background to find them */
+			fs->fmap_scan = 2;
+			fs->fmap_free = 0;
+			fs->fmap_lost = 0;
+		}
+		return 0;
+	}
+	for (i = 0; i < fs->fmap_n; i++) {
+		if (fs->fmap[i].start > scl) return fs->fmap[i].start;
+		if (fs->fmap[i].start + fs->fmap[i].len - 1 > scl) return scl + 1;
+	}
+	return fs->fmap[0].start;	/* Wrap around */
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Free map - Scan the FAT into the map                                  */
+/*-----------------------------------------------------------------------*/
+static
+FRESULT fmap_scan (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	UINT nsect		/* Number of FAT sectors to scan */
+)
+{
+	DWORD clst, sect, stat, scl;
+	FFOBJID obj;
+
+
+	if (fs->fmap_scan >= fs->n_fatent || nsect == 0) return FR_OK;
+
+	obj.fs = fs;
+	clst = fs->fmap_scan;
+	sect = fat_sect(fs, clst);
+	scl = 0;
+	while (clst < fs->n_fatent) {
+		if (fat_sect(fs, clst) != sect) {	/* Next FAT sector */
+			if (--nsect == 0) break;
+			sect = fat_sect(fs, clst);
+		}
+		stat = get_fat(&obj, clst);
+		if (stat == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (stat == 1) return FR_INT_ERR;
+		if (stat == 0) {		/* Free cluster */
+			if (scl == 0) scl = clst;
+		} else if (scl != 0) {	/* End of a free extent */
+			fs->fmap_scan = clst;
+			fmap_put(fs, scl, clst - scl);
+			scl = 0;
+		}
+		clst++;
+	}
+	fs->fmap_scan = clst;
+	if (scl != 0) fmap_put(fs, scl, clst - scl);	/* Extent continuing into the next step */
+
+	if (fs->fmap_scan >= fs->n_fatent) {	/* Map complete, the free cluster count is exact */
+		fs->free_clst = fs->fmap_free;
+		fs->fsi_flag |= 1;
+	}
+	return FR_OK;
+}
+#endif
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Remove a cluster chain                                 */
@@ -1444,6 +1672,9 @@ FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 		if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
 			res = put_fat(fs, clst, 0);		/* Mark the cluster 'free' on the FAT */
 			if (res != FR_OK) return res;
+#if FF_FREE_MAP
+			fmap_put(fs, clst, 1);
+#endif
 		}
 		if (fs->free_clst < fs->n_fatent - 2) {	/* Update FSINFO */
 			fs->free_clst++;
@@ -1570,6 +1801,10 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
 			ncl = scl;	/* Start cluster */
+#if FF_FREE_MAP
+			cs = fmap_find(fs, scl);			/* Start right before a free cluster if the free map knows one */
+			if (cs != 0) ncl = cs - 1;
+#endif
 			for (;;) {
 				ncl++;							/* Next cluster */
 				if (ncl >= fs->n_fatent) {		/* Check wrap-around */
@@ -1586,6 +1821,9 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 		if (res == FR_OK && clst != 0) {
 			res = put_fat(fs, clst, ncl);		/* Link it from the previous one if needed */
 		}
+#if FF_FREE_MAP
+		if (res == FR_OK) fmap_take(fs, ncl, 1);
+#endif
 	}
 
 	if (res == FR_OK) {			/* Update FSINFO if function succeeded. */
@@ -1599,6 +1837,147 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 	return ncl;		/* Return new cluster number or error status */
 }
 
+
+
+#if FF_APPEND_RUN
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Stretch a file by a run of clusters                    */
+/*-----------------------------------------------------------------------*/
+static
+DWORD create_run (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Next cluster# */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD clst		/* Current cluster of the file, 0:Create a new chain */
+)
+{
+	DWORD cs, ncl, scl, n, nmax, lim, bcl, bn;
+	FRESULT res;
+	FATFS *fs = fp->obj.fs;
+
+
+	if (fp->run_end && fp->run_next <= fp->run_end) {	/* Is there a claimed run left? */
+		if (clst == (fp->run_next == fp->run_start ? fp->run_prev : fp->run_next - 1)) {
+#if FF_USE_TRIM
+			if (fp->run_next >= fs->trim_next && fp->run_next <= fs->trim_end) {
+				fs->trim_next = fp->run_next + 1;	/* Never trim a cluster once it is handed to the writer */
+			}
+#endif
+			return fp->run_next++;			/* Next cluster of the run, the FAT already links it */
+		}
+	}
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) return create_chain(&fp->obj, clst);
+#endif
+
+	if (clst == 0) {	/* Create a new chain */
+		scl = fs->last_clst;				/* Suggested cluster to start to find */
+		if (scl == 0 || scl >= fs->n_fatent) scl = 1;
+	} else {			/* Stretch the chain */
+		cs = get_fat(&fp->obj, clst);		/* Check the cluster status */
+		if (cs < 2) return 1;				/* Test for insanity */
+		if (cs == 0xFFFFFFFF) return cs;	/* Test for disk error */
+		if (cs < fs->n_fatent) return cs;	/* It is already followed by next cluster */
+		scl = clst;							/* Prefer the cluster next to the current one */
+	}
+	if (fs->free_clst == 0) return 0;		/* No free cluster */
+
+	nmax = fp->run_size ? fp->run_size : FF_APPEND_RUN;	/* Size of the run to claim */
+	lim = fp->run_size * 16;	/* Clusters to look through for a whole extent before taking the longest one found */
+	bcl = bn = 0;
+	ncl = scl;	/* Find the first free cluster of the run */
+#if FF_FREE_MAP
+	cs = fmap_find(fs, scl);			/* Start right before a free cluster if the free map knows one */
+	if (cs != 0) ncl = cs - 1;
+#endif
+	for (;;) {
+		ncl++;							/* Next cluster */
+		if (ncl >= fs->n_fatent) {		/* Check wrap-around */
+			ncl = 2;
+			if (ncl > scl) break;		/* Searched the whole FAT */
+		}
+		cs = get_fat(&fp->obj, ncl);	/* Get the cluster status */
+		if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+		if (cs == 0) {					/* Found a free cluster? */
+			for (n = 1; n < nmax && ncl + n < fs->n_fatent && (fp->run_size || fat_sect(fs, ncl + n) == fat_sect(fs, ncl)); n++) {
+				cs = get_fat(&fp->obj, ncl + n);	/* Extend the run while the following clusters are free (in the same FAT sector by default) */
+				if (cs == 1 || cs == 0xFFFFFFFF) return cs;
+				if (cs != 0) break;
+			}
+			if (n > bn) {
+				bcl = ncl; bn = n;
+			}
+			if (n == nmax || ncl == clst + 1 || lim <= n) break;	/* Whole run, continues the chain, or looked far enough */
+			lim -= n;
+			ncl += n - 1;				/* A file with an extent size skips holes too small for it */
+		} else if (lim > 0) {
+			lim--;
+		} else if (bn != 0) {
+			break;
+		}
+		if (ncl == scl) break;			/* Searched the whole FAT */
+	}
+	if (bn == 0) return 0;				/* No free cluster found? */
+	ncl = bcl; n = bn;
+
+	res = FR_OK;
+	for (cs = ncl; res == FR_OK && cs < ncl + n - 1; cs++) {
+		res = put_fat(fs, cs, cs + 1);			/* Link the run in the FAT sector on the window */
+	}
+	if (res == FR_OK) res = put_fat(fs, ncl + n - 1, 0xFFFFFFFF);	/* Mark the last cluster 'EOC' */
+	if (res == FR_OK && clst != 0) {
+		res = put_fat(fs, clst, ncl);			/* Link it from the current one if needed */
+	}
+	if (res != FR_OK) return (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;
+#if FF_FREE_MAP
+	fmap_take(fs, ncl, n);
+#endif
+
+	fs->last_clst = ncl + n - 1;				/* Next free cluster hint, saved in the FSINFO */
+	if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst -= n;
+	fs->fsi_flag |= 1;
+	fp->run_prev = clst;
+	fp->run_start = ncl;
+	fp->run_end = ncl + n - 1;
+	fp->run_next = ncl + 1;
+#if FF_USE_TRIM
+	fs->trim_next = ncl + 1;		/* The rest of the run can be trimmed ahead by f_trimahead() */
+	fs->trim_end = (n > 1) ? ncl + n - 1 : 0;
+#endif
+	return ncl;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Release unused clusters of the claimed run             */
+/*-----------------------------------------------------------------------*/
+static
+FRESULT remove_run (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp				/* Pointer to the file object */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD lcl;
+	FATFS *fs = fp->obj.fs;
+
+
+#if FF_USE_TRIM
+	if (fp->run_end && fs->trim_end == fp->run_end) fs->trim_end = 0;	/* remove_chain() trims the unused clusters */
+#endif
+	if (fp->run_end && fp->run_next <= fp->run_end) {	/* Any cluster of the run left unused? */
+		lcl = (fp->run_next == fp->run_start) ? fp->run_prev : fp->run_next - 1;	/* Last cluster in use */
+		res = remove_chain(&fp->obj, fp->run_next, lcl);
+		if (res == FR_OK) {
+			if (lcl == 0) fp->obj.sclust = 0;	/* The whole chain was removed */
+			if (fs->last_clst == fp->run_end) fs->last_clst = lcl;	/* Rewind the hint so that the file stays contiguous */
+			fp->flag |= FA_MODIFIED;
+		}
+	}
+	fp->run_end = 0;
+	return res;
+}
+#endif
+
 #endif /* !FF_FS_READONLY */
 
 
@@ -2420,6 +2799,94 @@ FRESULT dir_read (
 
 
 
+#if FF_DIR_CACHE
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Cache of recently found entries                  */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD dcache_hash (	/* Hash value of the name to find (never 0) */
+	FATFS_DIR* dp	/* Pointer to the directory object with the file name */
+)
+{
+	DWORD hash = 2166136261;
+#if FF_USE_LFN
+	const WCHAR* name = dp->obj.fs->lfnbuf;
+	WCHAR chr;
+
+	while ((chr = *name++) != 0) {
+		hash = (hash ^ (WCHAR)ff_wtoupper(chr)) * 16777619;	/* File name needs to be upper-case converted */
+	}
+#else
+	UINT i;
+
+	for (i = 0; i < 11; i++) hash = (hash ^ dp->fn[i]) * 16777619;
+#endif
+	return hash ? hash : 1;
+}
+
+
+static
+DCENT* dcache_get (	/* Pointer to the cache entry, 0:not cached */
+	FATFS_DIR* dp,	/* Pointer to the directory object */
+	DWORD hash		/* Hash value of the name */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT i;
+
+
+	for (i = 0; i < FF_DIR_CACHE; i++) {
+		if (fs->dcache[i].hash == hash && fs->dcache[i].dclst == dp->obj.sclust) return &fs->dcache[i];
+	}
+	return 0;
+}
+
+
+static
+void dcache_put (
+	FATFS_DIR* dp,	/* Pointer to the directory object pointing the SFN entry of the found object */
+	DWORD hash		/* Hash value of its name */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DCENT *dc = dcache_get(dp, hash);
+
+
+	if (!dc) {				/* Replace the entries in turn */
+		dc = &fs->dcache[fs->dcache_next];
+		fs->dcache_next = (fs->dcache_next + 1) % FF_DIR_CACHE;
+		dc->dclst = dp->obj.sclust;
+		dc->hash = hash;
+	}
+	dc->ofs = dp->dptr;
+#if FF_USE_LFN
+	dc->blk_ofs = (dp->blk_ofs == 0xFFFFFFFF) ? dp->dptr : dp->blk_ofs;
+#else
+	dc->blk_ofs = dp->dptr;
+#endif
+}
+
+
+static
+void dcache_purge (
+	FATFS* fs,		/* Filesystem object */
+	DWORD dclst,	/* Start cluster of the directory (0:root) */
+	DWORD ofs		/* Offset of the removed SFN entry (0xFFFFFFFF:whole directory) */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_DIR_CACHE; i++) {
+		if (fs->dcache[i].dclst == dclst && (ofs == 0xFFFFFFFF || fs->dcache[i].ofs == ofs)) fs->dcache[i].hash = 0;
+	}
+}
+
+#endif	/* FF_DIR_CACHE */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
@@ -2435,6 +2902,10 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 #if FF_USE_LFN
 	BYTE a, ord, sum;
 #endif
+#if FF_DIR_CACHE
+	DWORD hash = 0, lim = 0xFFFFFFFF;
+	DCENT *dc;
+#endif
 
 	res = dir_sdi(dp, 0);			/* Rewind directory object */
 	if (res != FR_OK) return res;
@@ -2459,10 +2930,24 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	}
 #endif
 	/* On the FAT/FAT32 volume */
+#if FF_DIR_CACHE
+#if FF_USE_LFN
+	if (!(dp->fn[NSFLAG] & NS_NOLFN))	/* Not an SFN collision check */
+#endif
+	{
+		hash = dcache_hash(dp);
+		dc = dcache_get(dp, hash);
+		if (dc) {			/* Look in the entry block where the name was found last time first */
+			lim = dc->ofs;
+			res = dir_sdi(dp, dc->blk_ofs);
+		}
+	}
+rescan:
+#endif
 #if FF_USE_LFN
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
-	do {
+	while (res == FR_OK) {
 		res = move_window(fs, dp->sect);
 		if (res != FR_OK) break;
 		c = dp->dir[DIR_Name];
@@ -2491,9 +2976,20 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 #else		/* Non LFN configuration */
 		dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
 		if (!(dp->dir[DIR_Attr] & AM_VOL) && !mem_cmp(dp->dir, dp->fn, 11)) break;	/* Is it a valid entry? */
+#endif
+#if FF_DIR_CACHE
+		if (dp->dptr >= lim) { res = FR_NO_FILE; break; }	/* Not in the cached entry block */
 #endif
 		res = dir_next(dp, 0);	/* Next entry */
-	} while (res == FR_OK);
+	}
+#if FF_DIR_CACHE
+	if (lim != 0xFFFFFFFF && res != FR_OK) {	/* The cached entry has gone, scan the table from the top */
+		lim = 0xFFFFFFFF;
+		res = dir_sdi(dp, 0);
+		goto rescan;
+	}
+	if (res == FR_OK && hash) dcache_put(dp, hash);
+#endif
 
 	return res;
 }
@@ -2569,6 +3065,9 @@ FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many S
 	/* Create an SFN with/without LFNs. */
 	nent = (sn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 + 1 : 1;	/* Number of entries to allocate */
 	res = dir_alloc(dp, nent);		/* Allocate entries */
+#if FF_DIR_CACHE
+	dp->blk_ofs = (nent > 1) ? dp->dptr - SZDIRE * (nent - 1) : 0xFFFFFFFF;	/* Set the allocated entry block offset */
+#endif
 	if (res == FR_OK && --nent) {	/* Set LFN entry if needed */
 		res = dir_sdi(dp, dp->dptr - nent * SZDIRE);
 		if (res == FR_OK) {
@@ -2598,6 +3097,9 @@ FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many S
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put NT flag */
 #endif
 			fs->wflag = 1;
+#if FF_DIR_CACHE
+			dcache_put(dp, dcache_hash(dp));	/* A new object is likely to be looked up again */
+#endif
 		}
 	}
 
@@ -2623,6 +3125,9 @@ FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
 
+#if FF_DIR_CACHE
+	dcache_purge(fs, dp->obj.sclust, dp->dptr);	/* Forget the entry */
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -2641,6 +3146,9 @@ FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 	}
 #else			/* Non LFN configuration */
 
+#if FF_DIR_CACHE
+	dcache_purge(fs, dp->obj.sclust, dp->dptr);	/* Forget the entry */
+#endif
 	res = move_window(fs, dp->sect);
 	if (res == FR_OK) {
 		dp->dir[DIR_Name] = DDEM;	/* Mark the entry 'deleted'.*/
@@ -3286,8 +3794,15 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 #endif
 
 	/* Find an FAT partition on the drive. Supports only generic partitioning rules, FDISK and SFD. */
-	bsect = 0;
-	fmt = check_fs(fs, bsect);			/* Load sector 0 and check if it is an FAT-VBR as SFD */
+	fmt = 3;
+	if (fs->volhint != 0 && LD2PT(vol) == 0) {	/* Volume base of the last mount of this medium is given */
+		bsect = fs->volhint;
+		fmt = check_fs(fs, bsect);		/* Check it first, skipping the partition table if it is still there */
+	}
+	if (fmt >= 2) {
+		bsect = 0;
+		fmt = check_fs(fs, bsect);		/* Load sector 0 and check if it is an FAT-VBR as SFD */
+	}
 	if (fmt == 2 || (fmt < 2 && LD2PT(vol) != 0)) {	/* Not an FAT-VBR or forced partition number */
 		for (i = 0; i < 4; i++) {		/* Get partition offset */
 			pt = fs->win + (MBR_Table + i * SZ_PTE);
@@ -3408,6 +3923,15 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 		/* Get FSInfo if available */
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
 		fs->fsi_flag = 0x80;
+#if FF_FREE_MAP
+		fs->fmap_scan = 2;		/* Free map is built by f_mapfree() or f_getfree() */
+		fs->fmap_free = 0;
+		fs->fmap_n = 0;
+		fs->fmap_lost = 0;
+#endif
+#if FF_APPEND_RUN && FF_USE_TRIM
+		fs->trim_end = 0;		/* No claimed run to trim ahead */
+#endif
 #if (FF_FS_NOFSINFO & 3) != 3
 		if (fmt == FS_FAT32				/* Allow to update FSInfo only if BPB_FSInfo32 == 1 */
 			&& ld_word(fs->win + BPB_FSInfo32) == 1
@@ -3432,6 +3956,10 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 
 	fs->fs_type = fmt;		/* FAT sub-type */
 	fs->id = ++Fsid;		/* Volume mount ID */
+#if FF_DIR_CACHE
+	mem_set(fs->dcache, 0, sizeof fs->dcache);	/* Forget the entries of the previous volume */
+	fs->dcache_next = 0;
+#endif
 #if FF_USE_LFN == 1
 	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
 #if FF_FS_EXFAT
@@ -3700,6 +4228,10 @@ FRESULT f_open (
 			fp->err = 0;			/* Clear error flag */
 			fp->sect = 0;			/* Invalidate current data sector */
 			fp->fptr = 0;			/* Set file pointer top of the file */
+#if !FF_FS_READONLY && FF_APPEND_RUN
+			fp->run_end = 0;		/* No claimed run */
+			fp->run_size = 0;		/* Default runs */
+#endif
 #if !FF_FS_READONLY
 #if !FF_FS_TINY
 #if FF_FS_HEAPBUF
@@ -3759,7 +4291,7 @@ FRESULT f_read (
 	FATFS *fs;
 	DWORD clst, sect;
 	FSIZE_t remain;
-	UINT rcnt, cc, csect;
+	UINT rcnt, cc, nc, csect;
 	BYTE *rbuff = (BYTE*)buff;
 
 
@@ -3797,7 +4329,16 @@ FRESULT f_read (
 			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
 			if (cc > 0) {						/* Read maximum contiguous sectors directly */
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
+					nc = cc;
 					cc = fs->csize - csect;
+					while (cc < nc) {			/* and stretch over the following clusters while they are contiguous */
+						clst = get_fat(&fp->obj, fp->clust);
+						if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+						if (clst != fp->clust + 1) break;	/* Not contiguous (or an error, caught at the next cluster) */
+						fp->clust = clst;
+						cc += fs->csize;
+					}
+					if (cc > nc) cc = nc;
 				}
 				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
@@ -3811,39 +4352,161 @@ FRESULT f_read (
 				}
 #endif
 #endif
-				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
-				continue;
+				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
+				continue;
+			}
+#if !FF_FS_TINY
+			if (fp->sect != sect) {			/* Load data sector if not in cache */
+#if !FF_FS_READONLY
+				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
+					if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+					fp->flag &= (BYTE)~FA_DIRTY;
+				}
+#endif
+				if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+			}
+#endif
+			fp->sect = sect;
+		}
+		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
+		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
+#if FF_FS_TINY
+		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+		mem_cpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+#else
+		mem_cpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+#endif
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Synchronize the File - Update the directory entry and flush           */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT sync_file (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the validated file object */
+	FATFS* fs		/* Filesystem object of the file */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD tm;
+	BYTE *dir;
+
+
+	if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
+#if !FF_FS_TINY
+		if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
+			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+#endif
+		/* Update the directory entry */
+		tm = GET_FATTIME();				/* Modified time */
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {
+			res = fill_first_frag(&fp->obj);	/* Fill first fragment on the FAT if needed */
+			if (res == FR_OK) {
+				res = fill_last_frag(&fp->obj, fp->clust, 0xFFFFFFFF);	/* Fill last fragment on the FAT if needed */
 			}
-#if !FF_FS_TINY
-			if (fp->sect != sect) {			/* Load data sector if not in cache */
-#if !FF_FS_READONLY
-				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-					if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-					fp->flag &= (BYTE)~FA_DIRTY;
+			if (res == FR_OK) {
+				FATFS_DIR dj;
+				DEF_NAMBUF
+
+				INIT_NAMBUF(fs);
+				res = load_obj_xdir(&dj, &fp->obj);	/* Load directory entry block */
+				if (res == FR_OK) {
+					fs->dirbuf[XDIR_Attr] |= AM_ARC;				/* Set archive attribute to indicate that the file has been changed */
+					fs->dirbuf[XDIR_GenFlags] = fp->obj.stat | 1;	/* Update file allocation information */
+					st_dword(fs->dirbuf + XDIR_FstClus, fp->obj.sclust);
+					st_qword(fs->dirbuf + XDIR_FileSize, fp->obj.objsize);
+					st_qword(fs->dirbuf + XDIR_ValidFileSize, fp->obj.objsize);
+					st_dword(fs->dirbuf + XDIR_ModTime, tm);		/* Update modified time */
+					fs->dirbuf[XDIR_ModTime10] = 0;
+					st_dword(fs->dirbuf + XDIR_AccTime, 0);
+					res = store_xdir(&dj);	/* Restore it to the directory */
+					if (res == FR_OK) {
+						res = sync_fs(fs);
+						fp->flag &= (BYTE)~FA_MODIFIED;
+					}
 				}
-#endif
-				if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+				FREE_NAMBUF();
 			}
+		} else
 #endif
-			fp->sect = sect;
+		{
+			res = move_window(fs, fp->dir_sect);
+			if (res == FR_OK) {
+				dir = fp->dir_ptr;
+				dir[DIR_Attr] |= AM_ARC;						/* Set archive attribute to indicate that the file has been changed */
+				st_clust(fp->obj.fs, dir, fp->obj.sclust);		/* Update file allocation information  */
+				st_dword(dir + DIR_FileSize, (DWORD)fp->obj.objsize);	/* Update file size */
+				st_dword(dir + DIR_ModTime, tm);				/* Update modified time */
+				st_word(dir + DIR_LstAccDate, 0);
+				fs->wflag = 1;
+				res = sync_fs(fs);					/* Restore it to the directory */
+				fp->flag &= (BYTE)~FA_MODIFIED;
+			}
 		}
-		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
-		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
-#if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		mem_cpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
-#else
-		mem_cpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
-#endif
 	}
 
-	LEAVE_FF(fs, FR_OK);
+	return res;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Checkpoint the file size into the directory entry                     */
+/*-----------------------------------------------------------------------*/
+/* Only the dirty sector on the window (the FAT sector of the last claimed
+/  run, or cached file data), the cached file data and the directory entry
+/  are written. The modified time and the FSInfo are left to sync_file(), so
+/  the file stays modified. */
+
+static
+FRESULT checkpoint_file (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the validated file object */
+	FATFS* fs		/* Filesystem object of the file */
+)
+{
+	FRESULT res;
+	BYTE *dir;
+
+
+	if (!(fp->flag & FA_MODIFIED)) return FR_OK;	/* No change since the last sync */
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) return sync_file(fp, fs);	/* The size lives in the checksummed entry set */
+#endif
+#if !FF_FS_TINY
+	if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
+		if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+		fp->flag &= (BYTE)~FA_DIRTY;
+	}
+#endif
+	res = move_window(fs, fp->dir_sect);	/* Write back the window, so the FAT links the clusters before the size counts them */
+	if (res == FR_OK) {
+		dir = fp->dir_ptr;
+		if (ld_clust(fs, dir) != fp->obj.sclust || ld_dword(dir + DIR_FileSize) != (DWORD)fp->obj.objsize) {
+			st_clust(fs, dir, fp->obj.sclust);		/* Update file allocation information  */
+			st_dword(dir + DIR_FileSize, (DWORD)fp->obj.objsize);	/* Update file size */
+			fs->wflag = 1;
+			res = sync_window(fs);
+		}
+		if (res == FR_OK && disk_ioctl(fs->pdrv, CTRL_SYNC, 0) != RES_OK) res = FR_DISK_ERR;
+	}
+	return res;
 }
 
 
 
 
-#if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Write File                                                            */
 /*-----------------------------------------------------------------------*/
@@ -3880,7 +4543,11 @@ FRESULT f_write (
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->obj.sclust;	/* Follow from the origin */
 					if (clst == 0) {		/* If no cluster is allocated, */
+#if FF_APPEND_RUN
+						clst = create_run(fp, 0);			/* create a new cluster chain with a run */
+#else
 						clst = create_chain(&fp->obj, 0);	/* create a new cluster chain */
+#endif
 					}
 				} else {					/* On the middle or end of the file */
 #if FF_USE_FASTSEEK
@@ -3889,7 +4556,11 @@ FRESULT f_write (
 					} else
 #endif
 					{
+#if FF_APPEND_RUN
+						clst = create_run(fp, fp->clust);	/* Follow the claimed run or stretch cluster chain by a run */
+#else
 						clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+#endif
 					}
 				}
 				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
@@ -3969,7 +4640,7 @@ FRESULT f_write (
 	fp->flag |= FA_MODIFIED;				/* Set file change flag */
 
     if (need_sync) {
-        f_sync (fp);
+        checkpoint_file (fp, fs);	/* Keep the claimed run, it is still being filled */
     }
 
 	LEAVE_FF(fs, FR_OK);
@@ -3979,78 +4650,178 @@ FRESULT f_write (
 
 
 /*-----------------------------------------------------------------------*/
-/* Synchronize the File                                                  */
+/* Write Whole Sectors to the File Directly                              */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_sync (
-	FIL* fp		/* Pointer to the file object */
+FRESULT f_write_direct (
+	FIL* fp,			/* Pointer to the file object */
+	const void* buff,	/* Pointer to the data to be written */
+	UINT btw,			/* Number of bytes to write (multiple of the sector size) */
+	UINT* bw			/* Pointer to number of bytes written */
 )
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD tm;
-	BYTE *dir;
+	DWORD clst, nclst = 0, sect;
+	UINT cc, csect;
+	const BYTE *wbuff = (const BYTE*)buff;
 
 
-	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
-	if (res == FR_OK) {
-		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
-#if !FF_FS_TINY
-			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
+	*bw = 0;	/* Clear write byte counter */
+	res = validate(&fp->obj, &fs);			/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+	if (fp->fptr % SS(fs) || btw % SS(fs)) LEAVE_FF(fs, FR_INVALID_PARAMETER);	/* Whole sectors on the sector boundary only */
+
+	/* Check fptr wrap-around (file size cannot reach 4 GiB at FAT volume) */
+	if ((!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
+		btw = (UINT)(0xFFFFFFFF - (DWORD)fp->fptr) / SS(fs) * SS(fs);
+	}
+	if (btw == 0) LEAVE_FF(fs, FR_OK);
+
+#if FF_FS_TINY
+	if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the last partial sector */
+#else
+	if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
+		if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+		fp->flag &= (BYTE)~FA_DIRTY;
+	}
+#endif
+	while (btw) {
+		csect = (UINT)(fp->fptr / SS(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
+		if (csect == 0) {				/* On the cluster boundary? */
+			if (nclst) {				/* Next cluster found by the previous write? */
+				clst = nclst; nclst = 0;
+			} else if (fp->fptr == 0) {	/* On the top of the file? */
+				clst = fp->obj.sclust;	/* Follow from the origin */
+				if (clst == 0) {		/* If no cluster is allocated, create a new cluster chain */
+#if FF_APPEND_RUN
+					clst = create_run(fp, 0);
+#else
+					clst = create_chain(&fp->obj, 0);
 #endif
-			/* Update the directory entry */
-			tm = GET_FATTIME();				/* Modified time */
-#if FF_FS_EXFAT
-			if (fs->fs_type == FS_EXFAT) {
-				res = fill_first_frag(&fp->obj);	/* Fill first fragment on the FAT if needed */
-				if (res == FR_OK) {
-					res = fill_last_frag(&fp->obj, fp->clust, 0xFFFFFFFF);	/* Fill last fragment on the FAT if needed */
 				}
-				if (res == FR_OK) {
-					FATFS_DIR dj;
-					DEF_NAMBUF
-
-					INIT_NAMBUF(fs);
-					res = load_obj_xdir(&dj, &fp->obj);	/* Load directory entry block */
-					if (res == FR_OK) {
-						fs->dirbuf[XDIR_Attr] |= AM_ARC;				/* Set archive attribute to indicate that the file has been changed */
-						fs->dirbuf[XDIR_GenFlags] = fp->obj.stat | 1;	/* Update file allocation information */
-						st_dword(fs->dirbuf + XDIR_FstClus, fp->obj.sclust);
-						st_qword(fs->dirbuf + XDIR_FileSize, fp->obj.objsize);
-						st_qword(fs->dirbuf + XDIR_ValidFileSize, fp->obj.objsize);
-						st_dword(fs->dirbuf + XDIR_ModTime, tm);		/* Update modified time */
-						fs->dirbuf[XDIR_ModTime10] = 0;
-						st_dword(fs->dirbuf + XDIR_AccTime, 0);
-						res = store_xdir(&dj);	/* Restore it to the directory */
-						if (res == FR_OK) {
-							res = sync_fs(fs);
-							fp->flag &= (BYTE)~FA_MODIFIED;
-						}
-					}
-					FREE_NAMBUF();
+			} else {					/* Follow or stretch cluster chain on the FAT */
+#if FF_USE_FASTSEEK
+				if (fp->cltbl) {
+					clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+				} else
+#endif
+				{
+#if FF_APPEND_RUN
+					clst = create_run(fp, fp->clust);
+#else
+					clst = create_chain(&fp->obj, fp->clust);
+#endif
 				}
+			}
+			if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
+			if (clst == 1) ABORT(fs, FR_INT_ERR);
+			if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+			fp->clust = clst;			/* Update current cluster */
+			if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
+		}
+		sect = clst2sect(fs, fp->clust);	/* Get current sector */
+		if (sect == 0) ABORT(fs, FR_INT_ERR);
+		sect += csect;
+		cc = fs->csize - csect;			/* Sectors left in the cluster */
+		if (cc > btw / SS(fs)) cc = btw / SS(fs);
+		while ((csect + cc) % fs->csize == 0 && cc < btw / SS(fs)) {	/* Extend the write over contiguous clusters */
+#if FF_USE_FASTSEEK
+			if (fp->cltbl) {
+				clst = clmt_clust(fp, fp->fptr + (FSIZE_t)cc * SS(fs));
 			} else
 #endif
 			{
-				res = move_window(fs, fp->dir_sect);
-				if (res == FR_OK) {
-					dir = fp->dir_ptr;
-					dir[DIR_Attr] |= AM_ARC;						/* Set archive attribute to indicate that the file has been changed */
-					st_clust(fp->obj.fs, dir, fp->obj.sclust);		/* Update file allocation information  */
-					st_dword(dir + DIR_FileSize, (DWORD)fp->obj.objsize);	/* Update file size */
-					st_dword(dir + DIR_ModTime, tm);				/* Update modified time */
-					st_word(dir + DIR_LstAccDate, 0);
-					fs->wflag = 1;
-					res = sync_fs(fs);					/* Restore it to the directory */
-					fp->flag &= (BYTE)~FA_MODIFIED;
-				}
+#if FF_APPEND_RUN
+				clst = create_run(fp, fp->clust);
+#else
+				clst = create_chain(&fp->obj, fp->clust);
+#endif
+			}
+			if (clst == 1) ABORT(fs, FR_INT_ERR);
+			if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+			if (clst != fp->clust + 1) {	/* Not contiguous (or disk full), write up to here */
+				nclst = clst;
+				break;
 			}
+			fp->clust = clst;
+			cc += fs->csize;
+			if (cc > btw / SS(fs)) cc = btw / SS(fs);
+		}
+		if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#if FF_FS_TINY
+		if (fs->winsect - sect < cc) {	/* Invalidate the sector cache if the write has overtaken it */
+			fs->wflag = 0; fs->winsect = 0xFFFFFFFF;
+		}
+#else
+		if (fp->sect - sect < cc) {		/* Invalidate the sector cache if the write has overtaken it */
+			fp->flag &= (BYTE)~FA_DIRTY; fp->sect = 0;
 		}
+#endif
+		btw -= SS(fs) * cc; *bw += SS(fs) * cc; wbuff += SS(fs) * cc; fp->fptr += SS(fs) * cc;
+		if (fp->fptr > fp->obj.objsize) fp->obj.objsize = fp->fptr;
 	}
 
+	fp->flag |= FA_MODIFIED;				/* Set file change flag, FLUSH_ON_NEW_* do not apply: the caller syncs */
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Synchronize the File                                                  */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT flush_file (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the file object */
+	int release		/* 1:Release the claimed run even if it is an extent (close) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+#if FF_APPEND_RUN
+	if (res == FR_OK && (release || !fp->run_size)) res = remove_run(fp);	/* Release unused clusters of the claimed run, but keep an extent until close */
+#else
+	(void)release;
+#endif
+	if (res == FR_OK) res = sync_file(fp, fs);
+
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_sync (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	return flush_file(fp, 0);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Checkpoint the File                                                   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_checkpoint (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) res = checkpoint_file(fp, fs);	/* Keep the claimed run, it is still being filled */
+
 	LEAVE_FF(fs, res);
 }
 
@@ -4071,7 +4842,7 @@ FRESULT f_close (
 	FATFS *fs;
 
 #if !FF_FS_READONLY
-	res = f_sync(fp);					/* Flush cached data */
+	res = flush_file(fp, 1);			/* Flush cached data and release the claimed run */
 	if (res == FR_OK)
 #endif
 	{
@@ -4274,6 +5045,12 @@ FRESULT f_lseek (
 	}
 #endif
 	if (res != FR_OK) LEAVE_FF(fs, res);
+#if !FF_FS_READONLY && FF_APPEND_RUN
+	if (ofs != fp->fptr) {	/* Release the claimed run, f_write only fills it sequentially */
+		res = remove_run(fp);
+		if (res != FR_OK) ABORT(fs, res);
+	}
+#endif
 
 #if FF_USE_FASTSEEK
 	if (fp->cltbl) {	/* Fast seek */
@@ -4653,7 +5430,14 @@ FRESULT f_getfree (
 		/* If free_clst is valid, return it without full FAT scan */
 		if (fs->free_clst <= fs->n_fatent - 2) {
 			*nclst = fs->free_clst;
-		} else {
+		} else
+#if FF_FREE_MAP
+		if (fs->fs_type != FS_EXFAT) {	/* Finish building the free map, which counts free clusters */
+			res = fmap_scan(fs, (UINT)-1);
+			if (res == FR_OK) *nclst = fs->free_clst;
+		} else
+#endif
+		{
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
@@ -4718,6 +5502,108 @@ FRESULT f_getfree (
 
 
 
+#if FF_FREE_MAP
+/*-----------------------------------------------------------------------*/
+/* Build the Free Cluster Map                                            */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_mapfree (
+	const TCHAR* path,	/* Logical drive number */
+	UINT nsect,			/* Number of FAT sectors to scan in this call */
+	DWORD* nleft		/* Pointer to return number of FAT sectors left to scan (0:map complete) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = find_volume(&path, &fs, 0);	/* Get logical drive */
+	if (res == FR_OK) {
+		*nleft = 0;
+		if (fs->fs_type != FS_EXFAT) {	/* exFAT has its own allocation bitmap */
+			res = fmap_scan(fs, nsect);
+			if (res == FR_OK && fs->fmap_scan < fs->n_fatent) {
+				*nleft = fat_sect(fs, fs->n_fatent - 1) - fat_sect(fs, fs->fmap_scan) + 1;
+			}
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
+
+#if !FF_FS_READONLY && FF_APPEND_RUN
+/*-----------------------------------------------------------------------*/
+/* Set the Extent Size of a Growing File                                 */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_setextent (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ncl		/* Number of clusters to claim at once when the file grows (0:FF_APPEND_RUN) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) res = (FRESULT)fp->err;
+	if (res == FR_OK && !(fp->flag & FA_WRITE)) res = FR_DENIED;	/* Check access mode */
+	if (res == FR_OK) fp->run_size = ncl;	/* Takes effect at the next run, the claimed one is kept */
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
+
+#if FF_APPEND_RUN && FF_USE_TRIM
+/*-----------------------------------------------------------------------*/
+/* Trim Claimed Clusters Ahead of the Writer                             */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_trimahead (
+	const TCHAR* path,	/* Logical drive number */
+	DWORD align,		/* Stop at a multiple of this many sectors, eg the erase unit of the media (0:no limit) */
+	DWORD* nleft		/* Pointer to return number of sectors left to trim (0:done) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD ncl, n, rt[2];
+
+
+	res = find_volume(&path, &fs, 0);	/* Get logical drive */
+	if (res == FR_OK) {
+		*nleft = 0;
+		if (fs->trim_end != 0 && fs->trim_next <= fs->trim_end) {
+			ncl = fs->trim_end - fs->trim_next + 1;	/* Claimed clusters not handed to the writer yet */
+			rt[0] = clst2sect(fs, fs->trim_next);
+			if (align > 1) {	/* Stop at the next boundary, but trim at least a cluster */
+				n = (align - rt[0] % align) / fs->csize;
+				if (n == 0) n = 1;
+				if (ncl > n) ncl = n;
+			}
+			rt[1] = rt[0] + ncl * fs->csize - 1;
+			fs->trim_next += ncl;			/* Skip the piece even on error, not to retry it forever */
+			if (disk_ioctl(fs->pdrv, CTRL_TRIM, rt) != RES_OK) res = FR_DISK_ERR;
+			if (fs->trim_next <= fs->trim_end) {
+				*nleft = (fs->trim_end - fs->trim_next + 1) * fs->csize;
+			}
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Truncate File                                                         */
 /*-----------------------------------------------------------------------*/
@@ -4750,6 +5636,12 @@ FRESULT f_truncate (
 		}
 		fp->obj.objsize = fp->fptr;	/* Set file size to current read/write point */
 		fp->flag |= FA_MODIFIED;
+#if FF_APPEND_RUN
+#if FF_USE_TRIM
+		if (fp->run_end && fs->trim_end == fp->run_end) fs->trim_end = 0;	/* Its clusters may be reused */
+#endif
+		fp->run_end = 0;			/* Any claimed run has been removed with the chain */
+#endif
 #if !FF_FS_TINY
 		if (res == FR_OK && (fp->flag & FA_DIRTY)) {
 			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) {
@@ -4844,6 +5736,9 @@ FRESULT f_unlink (
 			if (res == FR_OK) {
 				res = dir_remove(&dj);			/* Remove the directory entry */
 				if (res == FR_OK && dclst != 0) {	/* Remove the cluster chain if exist */
+#if FF_DIR_CACHE
+					dcache_purge(fs, dclst, 0xFFFFFFFF);	/* Forget the entries of a removed sub-directory */
+#endif
 #if FF_FS_EXFAT
 					res = remove_chain(&obj, dclst, 0);
 #else
@@ -5449,6 +6344,9 @@ FRESULT f_expand (
 				fs->free_clst -= tcl;
 				fs->fsi_flag |= 1;
 			}
+#if FF_FREE_MAP
+			if (fs->fs_type != FS_EXFAT) fmap_take(fs, scl, tcl);
+#endif
 		}
 	}
 
@@ -5801,6 +6699,7 @@ FRESULT f_mkfs (
 				if (pau == 0) {	/* au auto-selection */
 					n = sz_vol / 0x20000;	/* Volume size in unit of 128KS */
 					for (i = 0, pau = 1; cst32[i] && cst32[i] <= n; i++, pau <<= 1) ;	/* Get from table */
+					if (sz_blk > 1 && pau > sz_blk) pau = sz_blk;	/* Cluster within the erase block */
 				}
 				n_clst = sz_vol / pau;	/* Number of clusters */
 				sz_fat = (n_clst * 4 + 8 + ss - 1) / ss;	/* FAT size [sector] */
@@ -5811,6 +6710,7 @@ FRESULT f_mkfs (
 				if (pau == 0) {	/* au auto-selection */
 					n = sz_vol / 0x1000;	/* Volume size in unit of 4KS */
 					for (i = 0, pau = 1; cst[i] && cst[i] <= n; i++, pau <<= 1) ;	/* Get from table */
+					if (sz_blk > 1 && pau > sz_blk) pau = sz_blk;	/* Cluster within the erase block */
 				}
 				n_clst = sz_vol / pau;
 				if (n_clst > MAX_FAT12) {
@@ -5823,16 +6723,15 @@ FRESULT f_mkfs (
 				sz_rsv = 1;						/* Number of reserved sectors */
 				sz_dir = (DWORD)n_rootdir * SZDIRE / ss;	/* Rootdir size [sector] */
 			}
+			if (sz_blk > 1) {	/* Align FAT base to erase block boundary too (for SD cards, the allocation unit) */
+				sz_rsv = ((b_vol + sz_rsv + sz_blk - 1) & ~(sz_blk - 1)) - b_vol;
+			}
 			b_fat = b_vol + sz_rsv;						/* FAT base */
 			b_data = b_fat + sz_fat * n_fats + sz_dir;	/* Data base */
 
 			/* Align data base to erase block boundary (for flash memory media) */
 			n = ((b_data + sz_blk - 1) & ~(sz_blk - 1)) - b_data;	/* Next nearest erase block from current data base */
-			if (fmt == FS_FAT32) {		/* FAT32: Move FAT base */
-				sz_rsv += n; b_fat += n;
-			} else {					/* FAT: Expand FAT size */
-				sz_fat += n / n_fats;
-			}
+			sz_fat += n / n_fats;	/* Expand FAT size, the FAT base is already aligned */
 
 			/* Determine number of clusters and final check of validity of the FAT sub-type */
 			if (sz_vol < b_data + pau * 16 - b_vol) LEAVE_MKFS(FR_MKFS_ABORTED);	/* Too small volume */
@@ -5845,7 +6744,7 @@ FRESULT f_mkfs (
 			}
 			if (fmt == FS_FAT16) {
 				if (n_clst > MAX_FAT16) {	/* Too many clusters for FAT16 */
-					if (au == 0 && (pau * 2) <= 64) {
+					if (au == 0 && (pau * 2) <= 64 && (sz_blk == 1 || (pau * 2) <= sz_blk)) {
 						au = pau * 2; continue;		/* Adjust cluster size and retry */
 					}
 					if ((opt & FM_FAT32)) {
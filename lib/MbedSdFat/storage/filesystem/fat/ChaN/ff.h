@@ -82,6 +82,30 @@ typedef DWORD FSIZE_t;
 
 
 
+#if !FF_FS_READONLY && FF_FREE_MAP
+/* Free cluster extent (FEXTENT) */
+
+typedef struct {
+	DWORD	start;			/* First free cluster */
+	DWORD	len;			/* Number of free clusters */
+} FEXTENT;
+#endif
+
+
+
+#if FF_DIR_CACHE
+/* Directory entry cache entry (DCENT) */
+
+typedef struct {
+	DWORD	dclst;			/* Start cluster of the directory (0:root) */
+	DWORD	hash;			/* Hash of the name (0:unused) */
+	DWORD	ofs;			/* Offset of the SFN entry in the directory */
+	DWORD	blk_ofs;		/* Offset of the entry block (LFN entries, or the SFN entry) */
+} DCENT;
+#endif
+
+
+
 /* Filesystem object structure (FATFS) */
 
 typedef struct {
@@ -108,6 +132,21 @@ typedef struct {
 #if !FF_FS_READONLY
 	DWORD	last_clst;		/* Last allocated cluster */
 	DWORD	free_clst;		/* Number of free clusters */
+#if FF_FREE_MAP
+	DWORD	fmap_scan;		/* Next cluster to be scanned into the free map (>=n_fatent:complete) */
+	DWORD	fmap_free;		/* Number of free clusters below fmap_scan */
+	UINT	fmap_n;			/* Number of extents in fmap[] */
+	BYTE	fmap_lost;		/* Some free extents did not fit in fmap[] */
+	FEXTENT	fmap[FF_FREE_MAP];	/* Free extents below fmap_scan, sorted by cluster# */
+#endif
+#if FF_APPEND_RUN && FF_USE_TRIM
+	DWORD	trim_next;		/* Next claimed but unwritten cluster to trim ahead of the writer */
+	DWORD	trim_end;		/* Last cluster to trim ahead of the writer (0:nothing to trim) */
+#endif
+#endif
+#if FF_DIR_CACHE
+	UINT	dcache_next;	/* Next dcache[] entry to be replaced */
+	DCENT	dcache[FF_DIR_CACHE];	/* Recently found directory entries */
 #endif
 #if FF_FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
@@ -120,6 +159,7 @@ typedef struct {
 	DWORD	n_fatent;		/* Number of FAT entries (number of clusters + 2) */
 	DWORD	fsize;			/* Size of an FAT [sectors] */
 	DWORD	volbase;		/* Volume base sector */
+	DWORD	volhint;		/* Volume base sector to check before the partition table at mount (0:none) */
 	DWORD	fatbase;		/* FAT base sector */
 	DWORD	dirbase;		/* Root directory base sector/cluster */
 	DWORD	database;		/* Data base sector */
@@ -172,6 +212,13 @@ typedef struct {
 #if FF_USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
 #endif
+#if !FF_FS_READONLY && FF_APPEND_RUN
+	DWORD	run_prev;		/* Cluster linked to the top of the claimed run (0:run starts the chain) */
+	DWORD	run_start;		/* First cluster of the claimed run */
+	DWORD	run_end;		/* Last cluster of the claimed run (0:no run) */
+	DWORD	run_next;		/* Next cluster of the run to be used by f_write */
+	DWORD	run_size;		/* Clusters claimed at once, set by f_setextent (0:FF_APPEND_RUN within one FAT sector) */
+#endif
 #if !FF_FS_TINY
 #if FF_FS_HEAPBUF
 	BYTE	*buf;			/* File private data read/write window */
@@ -253,9 +300,12 @@ FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode);				/* Open or create a f
 FRESULT f_close (FIL* fp);											/* Close an open file object */
 FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);			/* Read data from the file */
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data to the file */
+FRESULT f_write_direct (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write whole sectors to the file bypassing the sector buffer */
+FRESULT f_setextent (FIL* fp, DWORD ncl);							/* Set the number of clusters the file claims at once */
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
+FRESULT f_checkpoint (FIL* fp);										/* Write the file size to the directory entry, without a full sync */
 FRESULT f_opendir (FATFS_DIR* dp, const TCHAR* path);				/* Open a directory */
 FRESULT f_closedir (FATFS_DIR* dp);									/* Close an open directory */
 FRESULT f_readdir (FATFS_DIR* dp, FILINFO* fno);					/* Read a directory item */
@@ -271,6 +321,8 @@ FRESULT f_chdir (const TCHAR* path);								/* Change current directory */
 FRESULT f_chdrive (const TCHAR* path);								/* Change current drive */
 FRESULT f_getcwd (TCHAR* buff, UINT len);							/* Get current directory */
 FRESULT f_getfree (const TCHAR* path, DWORD* nclst, FATFS** fatfs);	/* Get number of free clusters on the drive */
+FRESULT f_mapfree (const TCHAR* path, UINT nsect, DWORD* nleft);	/* Build the free cluster map incrementally */
+FRESULT f_trimahead (const TCHAR* path, DWORD align, DWORD* nleft);	/* Trim claimed clusters ahead of the writer */
 FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume label */
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
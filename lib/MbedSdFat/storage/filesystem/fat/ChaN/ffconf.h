@@ -214,6 +214,43 @@
 */
 
 
+#define FF_APPEND_RUN	MBED_CONF_FAT_CHAN_FF_APPEND_RUN
+/* This option sets the number of clusters f_write() claims at once when a file
+/  grows at its end (0:Disable). The run is taken from free clusters within one
+/  FAT sector and its links are written in a single FAT sector update, so that
+/  crossing the following cluster boundaries does not touch the FAT at all.
+/  Unused clusters of the run are released by f_sync(), f_close() and f_lseek().
+/  Until then the cluster chain may be longer than the file on the media, which
+/  costs lost clusters at worst if power is removed. With FF_USE_TRIM, f_trimahead()
+/  passes the claimed clusters not written yet to the device as trim requests, so
+/  that the media can erase them in idle time instead of when they are written.
+/  f_setextent() makes a file claim runs of a given size instead, which may span
+/  several FAT sectors, so that files growing side by side each stay in large
+/  contiguous extents rather than taking turns over the free clusters. f_sync()
+/  and f_checkpoint() keep such an extent claimed, so that another file does not
+/  take the rest of it, and only f_close() and f_lseek() release it. If power is
+/  removed before the close, the chain on the media is longer than the file by
+/  at most the unused part of one extent: those clusters are lost (allocated, but
+/  past the end of the file) until a disk check reclaims them, and the file data
+/  itself is not affected. */
+
+
+#define FF_FREE_MAP		MBED_CONF_FAT_CHAN_FF_FREE_MAP
+/* This option sets the number of free cluster extents kept in RAM, 8 bytes each
+/  in the FATFS (0:Disable). The map is built a few FAT sectors at a time by
+/  f_mapfree() after mount, or at once by f_getfree(), and then serves cluster
+/  allocation and the free cluster count without scanning the FAT. When there are
+/  more extents than fit, the smallest are left out and found again by a rescan. */
+
+
+#define FF_DIR_CACHE	MBED_CONF_FAT_CHAN_FF_DIR_CACHE
+/* This option sets the number of recently found directory entries remembered,
+/  16 bytes each in the FATFS (0:Disable). A lookup of a remembered name in the
+/  same directory reads the entry block where it was found last time, and scans
+/  the directory from the top only if the name is not there any more. Names not
+/  in the directory, eg a file to be created, still scan the whole directory. */
+
+
 
 /*---------------------------------------------------------------------------/
 / System Configurations
@@ -268,7 +305,7 @@
 
 #define FF_FS_REENTRANT	MBED_CONF_FAT_CHAN_FF_FS_REENTRANT
 #define FF_FS_TIMEOUT	MBED_CONF_FAT_CHAN_FF_FS_TIMEOUT
-#define FF_SYNC_t		MBED_CONF_FAT_CHAN_FF_SYNC_t
+#define FF_SYNC_t		MBED_CONF_FAT_CHAN_FF_SYNC_T
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
@@ -291,7 +328,8 @@
 #define FLUSH_ON_NEW_CLUSTER    MBED_CONF_FAT_CHAN_FLUSH_ON_NEW_CLUSTER   /* Sync the file on every new cluster */
 #define FLUSH_ON_NEW_SECTOR     MBED_CONF_FAT_CHAN_FLUSH_ON_NEW_SECTOR   /* Sync the file on every new sector */
 /* Only one of these two defines needs to be set to 1. If both are set to 0
-   the file is only sync when closed.
+   the file is only sync when closed. These syncs are checkpoints, see
+   f_checkpoint(): the modified time and FSInfo are written at f_sync()/f_close().
    Clusters are group of sectors (eg: 8 sectors). Flushing on new cluster means
    it would be less often than flushing on new sector. Sectors are generally
    512 Bytes long. */
@@ -142,8 +142,38 @@ static Deferred<const char *> fat_path_prefix(int id, const char *path)
 
 // Global access to block device from FAT driver
 static mbed::BlockDevice *_ffs[FF_VOLUMES] = {0};
+static DWORD _ffs_format_align[FF_VOLUMES] = {0};  // in sectors, for f_mkfs while formatting
 static SingletonPtr<PlatformMutex> _ffs_mutex;
 
+#if FF_FS_REENTRANT
+// FatFs volume grants (see ChaN/ffconf.h), a mutex per volume.
+// Grants wait until the volume is free, FF_FS_TIMEOUT isn't used.
+static SingletonPtr<PlatformMutex> _ffs_volume_mutex[FF_VOLUMES];
+
+extern "C" int ff_cre_syncobj(BYTE vol, FF_SYNC_t *sobj)
+{
+    *sobj = _ffs_volume_mutex[vol].get();
+    return 1;
+}
+
+extern "C" int ff_req_grant(FF_SYNC_t sobj)
+{
+    static_cast<PlatformMutex *>(sobj)->lock();
+    return 1;
+}
+
+extern "C" void ff_rel_grant(FF_SYNC_t sobj)
+{
+    static_cast<PlatformMutex *>(sobj)->unlock();
+}
+
+extern "C" int ff_del_syncobj(FF_SYNC_t sobj)
+{
+    (void)sobj;
+    return 1;
+}
+#endif
+
 // FAT driver functions
 extern "C" DWORD get_fattime(void)
 {
@@ -239,10 +269,11 @@ extern "C" DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
     debug_if(FFS_DBG, "disk_ioctl(%d)\n", cmd);
     switch (cmd) {
         case CTRL_SYNC:
+            // also writes back a caching block device below, eg a BufferedBlockDevice
             if (_ffs[pdrv] == NULL) {
                 return RES_NOTRDY;
             } else {
-                return RES_OK;
+                return _ffs[pdrv]->sync() ? RES_ERROR : RES_OK;
             }
         case GET_SECTOR_COUNT:
             if (_ffs[pdrv] == NULL) {
@@ -259,7 +290,8 @@ extern "C" DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
                 return RES_OK;
             }
         case GET_BLOCK_SIZE:
-            *((DWORD *)buff) = 1; // default when not known
+            // f_mkfs aligns to this, 1 (not known) unless format was given an alignment
+            *((DWORD *)buff) = _ffs_format_align[pdrv] ? _ffs_format_align[pdrv] : 1;
             return RES_OK;
         case CTRL_TRIM:
             if (_ffs[pdrv] == NULL) {
@@ -308,22 +340,40 @@ int FATFileSystem::mount(BlockDevice *bd, bool mount)
         return -EINVAL;
     }
 
+    // the drive table is shared by all volumes, lock() may only cover this one
+    _ffs_mutex->lock();
     for (int i = 0; i < FF_VOLUMES; i++) {
         if (!_ffs[i]) {
             _id = i;
             _ffs[_id] = bd;
-            _fsid[0] = '0' + _id;
-            _fsid[1] = ':';
-            _fsid[2] = '\0';
-            debug_if(FFS_DBG, "Mounting [%s] on ffs drive [%s]\n", getName(), _fsid);
-            FRESULT res = f_mount(&_fs, _fsid, mount);
-            unlock();
-            return fat_error_remap(res);
+            break;
         }
     }
+    _ffs_mutex->unlock();
+
+    if (_id == -1) {
+        unlock();
+        return -ENOMEM;
+    }
+
+    _fsid[0] = '0' + _id;
+    _fsid[1] = ':';
+    _fsid[2] = '\0';
+    debug_if(FFS_DBG, "Mounting [%s] on ffs drive [%s]\n", getName(), _fsid);
+    FRESULT res = f_mount(&_fs, _fsid, mount);
+    unlock();
+    return fat_error_remap(res);
+}
 
+int FATFileSystem::warm_mount(BlockDevice *bd)
+{
+    lock();
+    // the FATFS keeps the volume base of the last mount across unmount
+    _fs.volhint = _fs.volbase;
+    int err = mount(bd, true);
+    _fs.volhint = 0;
     unlock();
-    return -ENOMEM;
+    return err;
 }
 
 int FATFileSystem::unmount()
@@ -335,7 +385,9 @@ int FATFileSystem::unmount()
     }
 
     FRESULT res = f_mount(NULL, _fsid, 0);
+    _ffs_mutex->lock();
     _ffs[_id] = NULL;
+    _ffs_mutex->unlock();
     _id = -1;
     unlock();
     return fat_error_remap(res);
@@ -343,7 +395,7 @@ int FATFileSystem::unmount()
 
 /* See http://elm-chan.org/fsw/ff/en/mkfs.html for details of f_mkfs() and
  * associated arguments. */
-int FATFileSystem::format(BlockDevice *bd, bd_size_t cluster_size)
+int FATFileSystem::format(BlockDevice *bd, bd_size_t cluster_size, bd_size_t align)
 {
     FATFileSystem fs;
     fs.lock();
@@ -408,8 +460,14 @@ int FATFileSystem::format(BlockDevice *bd, bd_size_t cluster_size)
         return err;
     }
 
+    // f_mkfs aligns to a power of two number of sectors, up to 32768
+    DWORD align_sectors = align / disk_get_sector_size(fs._id);
+    align_sectors &= -align_sectors;
+    _ffs_format_align[fs._id] = (align_sectors > 32768) ? 32768 : align_sectors;
+
     // Logical drive number, Partitioning rule, Allocation unit size (bytes per cluster)
     FRESULT res = f_mkfs(fs._fsid, FM_ANY | FM_SFD, cluster_size, NULL, 0);
+    _ffs_format_align[fs._id] = 0;
     if (res != FR_OK) {
         fs.unmount();
         fs.unlock();
@@ -427,6 +485,11 @@ int FATFileSystem::format(BlockDevice *bd, bd_size_t cluster_size)
 }
 
 int FATFileSystem::reformat(BlockDevice *bd, int allocation_unit)
+{
+    return reformat(bd, allocation_unit, 0);
+}
+
+int FATFileSystem::reformat(BlockDevice *bd, int allocation_unit, bd_size_t align)
 {
     lock();
     if (_id != -1) {
@@ -446,7 +509,7 @@ int FATFileSystem::reformat(BlockDevice *bd, int allocation_unit)
         return -ENODEV;
     }
 
-    int err = FATFileSystem::format(bd, allocation_unit);
+    int err = FATFileSystem::format(bd, allocation_unit, align);
     if (err) {
         unlock();
         return err;
@@ -557,14 +620,61 @@ int FATFileSystem::statvfs(const char *path, struct statvfs *buf)
     return 0;
 }
 
+int FATFileSystem::build_free_map(uint32_t sectors)
+{
+#if FF_FREE_MAP
+    DWORD left;
+
+    lock();
+    FRESULT res = f_mapfree(_fsid, sectors, &left);
+    unlock();
+
+    if (res != FR_OK) {
+        debug_if(FFS_DBG, "f_mapfree() failed: %d\n", res);
+        return fat_error_remap(res);
+    }
+    return left;
+#else
+    return 0;
+#endif
+}
+
+int FATFileSystem::trim_ahead(bd_size_t align)
+{
+#if FF_APPEND_RUN && FF_USE_TRIM
+    DWORD left;
+
+    lock();
+    DWORD align_sectors = _fs.ssize ? align / _fs.ssize : 0;
+    FRESULT res = f_trimahead(_fsid, align_sectors, &left);
+    unlock();
+
+    if (res != FR_OK) {
+        debug_if(FFS_DBG, "f_trimahead() failed: %d\n", res);
+        return fat_error_remap(res);
+    }
+    return left;
+#else
+    return 0;
+#endif
+}
+
 void FATFileSystem::lock()
 {
+#if FF_FS_REENTRANT
+    _mutex.lock();
+#else
     _ffs_mutex->lock();
+#endif
 }
 
 void FATFileSystem::unlock()
 {
+#if FF_FS_REENTRANT
+    _mutex.unlock();
+#else
     _ffs_mutex->unlock();
+#endif
 }
 
 
@@ -660,6 +770,46 @@ ssize_t FATFileSystem::file_write(fs_file_t file, const void *buffer, size_t len
     }
 }
 
+ssize_t FATFileSystem::file_write_direct(fs_file_t file, const void *buffer, size_t len)
+{
+    FIL *fh = static_cast<FIL *>(file);
+
+    lock();
+    UINT n;
+    FRESULT res = f_write_direct(fh, buffer, len, &n);
+    unlock();
+
+    if (res != FR_OK) {
+        debug_if(FFS_DBG, "f_write_direct() failed: %d", res);
+        return fat_error_remap(res);
+    } else {
+        return n;
+    }
+}
+
+int FATFileSystem::file_set_extent_size(fs_file_t file, off_t size)
+{
+#if FF_APPEND_RUN
+    FIL *fh = static_cast<FIL *>(file);
+    if (size < 0) {
+        return -EINVAL;
+    }
+
+    lock();
+    DWORD cluster_size = (DWORD)_fs.csize * _fs.ssize;
+    FRESULT res = f_setextent(fh, (size + cluster_size - 1) / cluster_size);
+    unlock();
+
+    if (res != FR_OK) {
+        debug_if(FFS_DBG, "f_setextent() failed: %d", res);
+        return fat_error_remap(res);
+    }
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
 int FATFileSystem::file_sync(fs_file_t file)
 {
     FIL *fh = static_cast<FIL *>(file);
@@ -674,6 +824,20 @@ int FATFileSystem::file_sync(fs_file_t file)
     return fat_error_remap(res);
 }
 
+int FATFileSystem::file_checkpoint(fs_file_t file)
+{
+    FIL *fh = static_cast<FIL *>(file);
+
+    lock();
+    FRESULT res = f_checkpoint(fh);
+    unlock();
+
+    if (res != FR_OK) {
+        debug_if(FFS_DBG, "f_checkpoint() failed: %d\n", res);
+    }
+    return fat_error_remap(res);
+}
+
 off_t FATFileSystem::file_seek(fs_file_t file, off_t offset, int whence)
 {
     FIL *fh = static_cast<FIL *>(file);
@@ -747,6 +911,7 @@ int FATFileSystem::file_truncate(fs_file_t file, off_t length)
         return fat_error_remap(res);
     }
 
+    unlock();
     return 0;
 }
 
@@ -803,10 +968,12 @@ ssize_t FATFileSystem::dir_read(fs_dir_t dir, struct dirent *ent)
 #if FF_USE_LFN
     if (ent->d_name[0] == 0) {
         // No long filename so use short filename.
-        strncpy(ent->d_name, finfo.fname, FF_LFN_BUF);
+        strncpy(ent->d_name, finfo.fname, sizeof(ent->d_name) - 1);
+        ent->d_name[sizeof(ent->d_name) - 1] = '\0';
     }
 #else
-    strncpy(ent->d_name, finfo.fname, FF_SFN_BUF);
+    strncpy(ent->d_name, finfo.fname, sizeof(ent->d_name) - 1);
+    ent->d_name[sizeof(ent->d_name) - 1] = '\0';
 #endif
 
     return 1;
@@ -38,7 +38,13 @@ namespace mbed {
 /**
  * FAT file system based on ChaN's FAT file system library v0.8
  *
- * Synchronization level: Thread safe
+ * Files growing at their end can claim clusters in runs, with one FAT sector
+ * update per run rather than per cluster, see the fat_chan.ff_append_run option.
+ *
+ * Synchronization level: Thread safe. One lock serializes all mounted volumes,
+ * unless the fat_chan.ff_fs_reentrant option is set, which locks each volume
+ * separately. Operations on one volume are always serialized, since FatFs
+ * shares the FAT and sector buffer between all files on a volume.
  */
 class FATFileSystem : public FileSystem {
 public:
@@ -64,9 +70,16 @@ public:
      *    and is currently limited to a max of 32,768 bytes. If the cluster size is set to zero, a cluster size
      *    is determined from the device's allocation unit. Defaults to zero.
      *
+     *  @param align
+     *    Boundary in bytes to align the FAT and the data area to, relative to the start of
+     *    the block device, eg, SDBlockDevice::get_allocation_unit_size() so cluster writes
+     *    don't straddle the card's allocation units. An automatically determined cluster
+     *    size is limited to it. Zero (the default) packs the volume without alignment.
+     *    Alignments which are not a power of two use their largest power of two factor.
+     *
      *  @return         0 on success, negative error code on failure.
      */
-    static int format(BlockDevice *bd, bd_size_t cluster_size = 0);
+    static int format(BlockDevice *bd, bd_size_t cluster_size = 0, bd_size_t align = 0);
 
     /** Mount a file system to a block device.
      *
@@ -75,6 +88,18 @@ public:
      */
     virtual int mount(BlockDevice *bd);
 
+    /** Mount a file system to a block device holding the same medium as the last mount.
+     *
+     *  Checks the volume location found by the last mount before reading the partition
+     *  table, saving a read when it's still there. Falls back to a normal mount otherwise,
+     *  so a wrong guess only costs time. A volume left behind at that location by
+     *  repartitioning the medium elsewhere is still mounted, as the partition table isn't read.
+     *
+     *  @param bd       Block device to mount to.
+     *  @return         0 on success, negative error code on failure.
+     */
+    int warm_mount(BlockDevice *bd);
+
     /** Unmount a file system from the underlying block device.
      *
      *  @return         0 on success, negative error code on failure.
@@ -100,6 +125,16 @@ public:
      */
     virtual int reformat(BlockDevice *bd, int allocation_unit);
 
+    /** Reformat a file system with its FAT and data area aligned, results in an empty and mounted file system.
+     *
+     *  @param bd               Block device to reformat and mount. If NULL, the mounted
+     *                          Block device is used.
+     *  @param allocation_unit  Number of bytes per cluster, zero to select it automatically.
+     *  @param align            Boundary in bytes to align the FAT and data area to, see format().
+     *  @return                 0 on success, negative error code on failure.
+     */
+    int reformat(BlockDevice *bd, int allocation_unit, bd_size_t align);
+
     /** Reformat a file system, results in an empty and mounted file system.
      *
      *  @param bd       Block device to reformat and mount. If NULL, the mounted
@@ -153,6 +188,31 @@ public:
      */
     virtual int statvfs(const char *path, struct statvfs *buf);
 
+    /** Build the in-RAM free cluster map a few FAT sectors at a time.
+     *
+     *  Meant to be called from idle time after mounting, until it returns 0. Once the map is
+     *  complete, statvfs and cluster allocation are served from it without scanning the FAT.
+     *  Does nothing without the fat_chan.ff_free_map option.
+     *
+     *  @param sectors  Maximum number of FAT sectors to read in this call.
+     *  @return         Number of FAT sectors left to scan, 0 once the map is complete,
+     *                  or a negative error code on failure.
+     */
+    int build_free_map(uint32_t sectors);
+
+    /** Trim clusters a growing file has claimed but not written yet, one piece per call.
+     *
+     *  Meant to be called from idle time while logging, so that the card erases the region
+     *  ahead of the write pointer before it is programmed. A piece ends at a multiple of
+     *  align, so that each trim covers at most one allocation unit of the card.
+     *  Does nothing without the fat_chan.ff_append_run and fat_chan.ff_use_trim options.
+     *
+     *  @param align    Alignment of the pieces in bytes, eg the card allocation unit (0 for no limit).
+     *  @return         Number of sectors left to trim, 0 once the claimed clusters are trimmed,
+     *                  or a negative error code on failure.
+     */
+    int trim_ahead(bd_size_t align);
+
 protected:
 #if !(DOXYGEN_ONLY)
     /** Open a file on the file system.
@@ -190,6 +250,29 @@ protected:
      */
     virtual ssize_t file_write(fs_file_t file, const void *buffer, size_t len);
 
+    /** Write whole sectors to a file, straight from the buffer to the block device.
+     *
+     *  @param file     File handle.
+     *  @param buffer   The buffer to write from.
+     *  @param len      The number of bytes to write, a multiple of the sector size.
+     *  @return         The number of bytes written, -EINVAL if the file position or len isn't a
+     *                  multiple of the sector size, negative error on failure.
+     */
+    virtual ssize_t file_write_direct(fs_file_t file, const void *buffer, size_t len);
+
+    /** Set how much space a file claims at once when it grows.
+     *
+     *  The extents are linked in the FAT when they are claimed, and the unused part is released
+     *  on close and seek. Sync keeps it, so the chain on the card may be up to an extent longer
+     *  than the file, which costs lost clusters if power is removed. Needs the
+     *  fat_chan.ff_append_run option.
+     *
+     *  @param file     File handle.
+     *  @param size     Size of the extents in bytes, rounded up to whole clusters, 0 for ff_append_run clusters.
+     *  @return         0 on success, -ENOSYS without ff_append_run, or a negative error code on failure.
+     */
+    virtual int file_set_extent_size(fs_file_t file, off_t size);
+
     /** Flush any buffers associated with the file.
      *
      *  @param file     File handle.
@@ -197,6 +280,18 @@ protected:
      */
     virtual int file_sync(fs_file_t file);
 
+    /** Write the file size to the directory entry, without a full sync.
+     *
+     *  Writes back the cached file data and the FAT sector of the last claimed clusters if they
+     *  are dirty, then the directory entry if the size changed: at most a couple of sectors, so
+     *  it can run every few seconds. The claimed run is kept, and the modified time and FSInfo
+     *  wait for file_sync or file_close.
+     *
+     *  @param file     File handle.
+     *  @return         0 on success, negative error code on failure.
+     */
+    virtual int file_checkpoint(fs_file_t file);
+
     /** Move the file position to a given offset from a given location
      *
      *  @param file     File handle.
@@ -285,6 +380,9 @@ private:
     FATFS _fs; // Work area (file system object) for logical drive.
     char _fsid[sizeof("0:")];
     int _id;
+#if FF_FS_REENTRANT
+    PlatformMutex _mutex;
+#endif
 
 protected:
     virtual void lock();
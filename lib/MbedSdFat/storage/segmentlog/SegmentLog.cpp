@@ -0,0 +1,451 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SegmentLog.h"
+#include "platform/mbed_assert.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+namespace mbed {
+
+// Superblock, the first block of the device:
+//   0  magic "SEGLOGSB"
+//   8  u32 version
+//  12  u32 block size
+//  16  u32 segment size
+//  20  u32 segment count, including segment 0
+//  24  u32 format id, one more than the previous format of the device, if it had a valid superblock
+//  28  u32 CRC-32 of bytes 0-27
+//
+// Segment header, the first block of each segment from segment 1:
+//   0  magic "SEGLOGHD"
+//   8  u32 format id
+//  12  u32 sequence number, 1 for the first segment written after a format
+//  16  u32 stream number, 1 for the first stream
+//  20  u32 part, the index of the segment within its stream
+//  24  char[32] stream name, NUL padded
+//  56  u32 CRC-32 of bytes 0-55
+//
+// Data block trailer, after the SEGMENT_LOG_BLOCK_PAYLOAD bytes of data:
+// 500  u32 sequence number of the segment
+// 504  u16 bytes of data used, the rest is zero
+// 506  u16 index of the block within the segment
+// 508  u32 CRC-32 of the format id (4 bytes) then bytes 0-507
+//
+// The rest of the superblock and headers is zero.
+static const uint8_t superblock_magic[8] = {'S', 'E', 'G', 'L', 'O', 'G', 'S', 'B'};
+static const uint8_t header_magic[8] = {'S', 'E', 'G', 'L', 'O', 'G', 'H', 'D'};
+static const uint32_t version = 1;
+static const size_t superblock_crc_offset = 28;
+static const size_t header_name_offset = 24;
+static const size_t header_crc_offset = 56;
+
+static void put_le32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// CRC-32 as zlib crc32(), with a 16 entry table, small enough to keep in flash
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ data[i]) & 0xf];
+        crc = (crc >> 4) ^ table[(crc ^ (data[i] >> 4)) & 0xf];
+    }
+    return ~crc;
+}
+
+// Reads and checks the superblock, returning its format id, or 0 if there is no valid superblock
+static uint32_t read_superblock(BlockDevice *bd, uint8_t *block, bd_size_t *segment_size, uint32_t *segment_count)
+{
+    if (bd->read(block, 0, SEGMENT_LOG_BLOCK_SIZE)
+            || memcmp(block, superblock_magic, sizeof(superblock_magic)) != 0
+            || get_le32(block + 8) != version
+            || get_le32(block + 12) != SEGMENT_LOG_BLOCK_SIZE
+            || get_le32(block + superblock_crc_offset) != crc32(0, block, superblock_crc_offset)) {
+        return 0;
+    }
+    *segment_size = get_le32(block + 16);
+    *segment_count = get_le32(block + 20);
+    return get_le32(block + 24);
+}
+
+// Reads a segment header, returning 1 if it is valid for the format, 0 if not, or a negative error code
+static int read_header(BlockDevice *bd, uint8_t *block, bd_addr_t addr, uint32_t format_id)
+{
+    int err = bd->read(block, addr, SEGMENT_LOG_BLOCK_SIZE);
+    if (err) {
+        return err;
+    }
+    return memcmp(block, header_magic, sizeof(header_magic)) == 0
+           && get_le32(block + 8) == format_id
+           && get_le32(block + header_crc_offset) == crc32(0, block, header_crc_offset);
+}
+
+SegmentLog::SegmentLog(uint32_t buffer_blocks)
+    : _bd(NULL)
+    , _buffer_blocks(buffer_blocks)
+    , _buffer(NULL)
+    , _segment_size(0)
+    , _segment_count(0)
+    , _format_id(0)
+    , _segment(0)
+    , _sequence(0)
+    , _stream(0)
+    , _part(0)
+    , _open(false)
+    , _stream_size(0)
+    , _block(0)
+    , _buffer_start(0)
+    , _used(0)
+{
+    MBED_ASSERT(buffer_blocks >= 1);
+    _name[0] = '\0';
+}
+
+SegmentLog::~SegmentLog()
+{
+    unmount();
+}
+
+int SegmentLog::format(BlockDevice *bd, bd_size_t segment_size)
+{
+    if (segment_size % SEGMENT_LOG_BLOCK_SIZE || segment_size % bd->get_erase_size()
+            || SEGMENT_LOG_BLOCK_SIZE % bd->get_read_size() || SEGMENT_LOG_BLOCK_SIZE % bd->get_program_size()
+            || segment_size / SEGMENT_LOG_BLOCK_SIZE > 0x10000) {
+        return -EINVAL;
+    }
+    uint32_t segment_count = std::min<bd_size_t>(bd->size() / segment_size, UINT32_MAX);
+    if (segment_count < 3) {
+        return -ENOSPC;
+    }
+
+    uint8_t *block = new uint8_t[SEGMENT_LOG_BLOCK_SIZE];
+    bd_size_t old_segment_size;
+    uint32_t old_segment_count;
+    uint32_t format_id = read_superblock(bd, block, &old_segment_size, &old_segment_count) + 1;
+
+    // only the superblock is written, stale headers and blocks don't match the new format id
+    memset(block, 0, SEGMENT_LOG_BLOCK_SIZE);
+    memcpy(block, superblock_magic, sizeof(superblock_magic));
+    put_le32(block + 8, version);
+    put_le32(block + 12, SEGMENT_LOG_BLOCK_SIZE);
+    put_le32(block + 16, segment_size);
+    put_le32(block + 20, segment_count);
+    put_le32(block + 24, format_id);
+    put_le32(block + superblock_crc_offset, crc32(0, block, superblock_crc_offset));
+
+    int err = bd->erase(0, segment_size);
+    if (!err) {
+        err = bd->program(block, 0, SEGMENT_LOG_BLOCK_SIZE);
+    }
+    if (!err) {
+        err = bd->sync();
+    }
+    delete[] block;
+    return err;
+}
+
+int SegmentLog::mount(BlockDevice *bd)
+{
+    if (_bd) {
+        return -EBUSY;
+    }
+    uint8_t *buffer = new uint8_t[_buffer_blocks * SEGMENT_LOG_BLOCK_SIZE];
+
+    bd_size_t segment_size;
+    uint32_t segment_count;
+    uint32_t format_id = read_superblock(bd, buffer, &segment_size, &segment_count);
+    if (!format_id || segment_count < 3 || segment_size % SEGMENT_LOG_BLOCK_SIZE
+            || (bd_size_t)segment_count * segment_size > bd->size()) {
+        delete[] buffer;
+        return -EINVAL;
+    }
+
+    // Segment headers from the first one up to the newest have consecutive sequence numbers, so
+    // the newest is the last one with the sequence number of the first plus its distance from it.
+    // Past it are older segments, from before the log wrapped around, or unwritten ones.
+    // Without a valid first header, either nothing was written yet, or power was lost while the
+    // log was wrapping around into the first segment, and only a scan of all headers can tell.
+    uint32_t newest = 0;
+    uint32_t sequence = 0, stream = 0, part = 0;
+    int valid = read_header(bd, buffer, segment_size, format_id);
+    if (valid == 0) {
+        for (uint32_t i = 2; i < segment_count && valid >= 0; i++) {
+            valid = read_header(bd, buffer, i * segment_size, format_id);
+            if (valid > 0 && (!newest || get_le32(buffer + 12) - sequence < 0x80000000)) {
+                newest = i;
+                sequence = get_le32(buffer + 12);
+                stream = get_le32(buffer + 16);
+                part = get_le32(buffer + 20);
+            }
+        }
+    } else if (valid > 0) {
+        uint32_t first_sequence = get_le32(buffer + 12);
+        uint32_t hi = segment_count - 1;
+        newest = 1;
+        sequence = first_sequence;
+        stream = get_le32(buffer + 16);
+        part = get_le32(buffer + 20);
+        while (newest < hi && valid >= 0) {
+            uint32_t mid = (newest + hi + 1) / 2;
+            valid = read_header(bd, buffer, mid * segment_size, format_id);
+            if (valid > 0 && get_le32(buffer + 12) == first_sequence + (mid - 1)) {
+                newest = mid;
+                sequence = get_le32(buffer + 12);
+                stream = get_le32(buffer + 16);
+                part = get_le32(buffer + 20);
+            } else {
+                hi = mid - 1;
+            }
+        }
+    }
+    if (valid < 0) {
+        delete[] buffer;
+        return valid;
+    }
+
+    _bd = bd;
+    _buffer = buffer;
+    _segment_size = segment_size;
+    _segment_count = segment_count;
+    _format_id = format_id;
+    _segment = newest;
+    _sequence = sequence;
+    _stream = stream;
+    _part = part;
+    _open = false;
+    return 0;
+}
+
+int SegmentLog::unmount()
+{
+    if (!_bd) {
+        return 0;
+    }
+    int err = close();
+    delete[] _buffer;
+    _buffer = NULL;
+    _bd = NULL;
+    return err;
+}
+
+int SegmentLog::open(const char *name)
+{
+    if (!_bd) {
+        return -EBADF;
+    }
+    int err = close();
+    if (err) {
+        return err;
+    }
+
+    strncpy(_name, name, sizeof(_name) - 1);
+    _name[sizeof(_name) - 1] = '\0';
+    _stream++;
+    _part = 0;
+    _stream_size = 0;
+    err = start_segment();
+    _open = !err;
+    return err;
+}
+
+ssize_t SegmentLog::read(void *buffer, size_t size)
+{
+    (void)buffer;
+    (void)size;
+    return -EBADF;
+}
+
+ssize_t SegmentLog::write(const void *buffer, size_t size)
+{
+    if (!_open) {
+        return -EBADF;
+    }
+
+    const uint8_t *data = static_cast<const uint8_t *>(buffer);
+    uint32_t segment_blocks = _segment_size / SEGMENT_LOG_BLOCK_SIZE;
+    size_t written = 0;
+    while (written < size) {
+        int err = 0;
+        if (_block == segment_blocks) {
+            err = flush();
+            if (!err) {
+                _part++;
+                err = start_segment();
+            }
+        }
+        if (!err && _block - _buffer_start == _buffer_blocks) {
+            err = flush();
+        }
+        if (err) {
+            return err;
+        }
+
+        uint8_t *block = _buffer + (_block - _buffer_start) * SEGMENT_LOG_BLOCK_SIZE;
+        size_t chunk = std::min<size_t>(size - written, SEGMENT_LOG_BLOCK_PAYLOAD - _used);
+        memcpy(block + _used, data + written, chunk);
+        _used += chunk;
+        written += chunk;
+        _stream_size += chunk;
+        if (_used == SEGMENT_LOG_BLOCK_PAYLOAD) {
+            finish_block();
+        }
+    }
+    return size;
+}
+
+off_t SegmentLog::seek(off_t offset, int whence)
+{
+    if (offset != 0 || (whence != SEEK_CUR && whence != SEEK_END)) {
+        return -ESPIPE;
+    }
+    return _stream_size;
+}
+
+int SegmentLog::sync()
+{
+    if (!_open) {
+        return -EBADF;
+    }
+    // the partial block is programmed as it is, and later data starts the next block
+    if (_used) {
+        finish_block();
+    }
+    int err = flush();
+    if (!err) {
+        err = _bd->sync();
+    }
+    return err;
+}
+
+int SegmentLog::close()
+{
+    if (!_open) {
+        return 0;
+    }
+    int err = sync();
+    _open = false;
+    return err;
+}
+
+off_t SegmentLog::size()
+{
+    return _stream_size;
+}
+
+bd_size_t SegmentLog::get_segment_size() const
+{
+    return _segment_size;
+}
+
+uint32_t SegmentLog::get_segment_count() const
+{
+    return _segment_count;
+}
+
+uint32_t SegmentLog::get_sequence() const
+{
+    return _sequence;
+}
+
+uint32_t SegmentLog::get_stream() const
+{
+    return _stream;
+}
+
+// Moves to the next segment, erasing it and programming its header, so that a segment is only
+// without a valid header for as long as the erase and that program take. The buffer must be empty.
+int SegmentLog::start_segment()
+{
+    _segment = _segment % (_segment_count - 1) + 1;
+    _sequence++;
+    int err = _bd->erase(_segment * _segment_size, _segment_size);
+    if (err) {
+        return err;
+    }
+
+    memset(_buffer, 0, SEGMENT_LOG_BLOCK_SIZE);
+    memcpy(_buffer, header_magic, sizeof(header_magic));
+    put_le32(_buffer + 8, _format_id);
+    put_le32(_buffer + 12, _sequence);
+    put_le32(_buffer + 16, _stream);
+    put_le32(_buffer + 20, _part);
+    strncpy((char *)_buffer + header_name_offset, _name, SEGMENT_LOG_NAME_SIZE);
+    put_le32(_buffer + header_crc_offset, crc32(0, _buffer, header_crc_offset));
+    err = _bd->program(_buffer, _segment * _segment_size, SEGMENT_LOG_BLOCK_SIZE);
+    if (err) {
+        return err;
+    }
+
+    _buffer_start = 1;
+    _block = 1;
+    _used = 0;
+    return 0;
+}
+
+// Pads the block being filled and adds its trailer
+void SegmentLog::finish_block()
+{
+    uint8_t *block = _buffer + (_block - _buffer_start) * SEGMENT_LOG_BLOCK_SIZE;
+    memset(block + _used, 0, SEGMENT_LOG_BLOCK_PAYLOAD - _used);
+    uint8_t *trailer = block + SEGMENT_LOG_BLOCK_PAYLOAD;
+    put_le32(trailer, _sequence);
+    trailer[4] = _used;
+    trailer[5] = _used >> 8;
+    trailer[6] = _block;
+    trailer[7] = _block >> 8;
+    uint8_t id[4];
+    put_le32(id, _format_id);
+    put_le32(trailer + 8, crc32(crc32(0, id, sizeof(id)), block, SEGMENT_LOG_BLOCK_SIZE - 4));
+
+    _block++;
+    _used = 0;
+}
+
+// Programs the finished blocks in the buffer, with one program
+int SegmentLog::flush()
+{
+    uint32_t blocks = _block - _buffer_start;
+    if (!blocks) {
+        return 0;
+    }
+    int err = _bd->program(_buffer, _segment * _segment_size + _buffer_start * SEGMENT_LOG_BLOCK_SIZE,
+                           blocks * SEGMENT_LOG_BLOCK_SIZE);
+    if (err) {
+        return err;
+    }
+    _buffer_start = _block;
+    return 0;
+}
+
+} // namespace mbed
@@ -0,0 +1,230 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \addtogroup storage */
+/** @{*/
+
+#ifndef MBED_SEGMENT_LOG_H
+#define MBED_SEGMENT_LOG_H
+
+#include "BlockDevice.h"
+#include "platform/FileHandle.h"
+#include "stddef.h"
+
+namespace mbed {
+
+/** Append-only log written straight to a block device (eg, a raw partition), without a file system
+ *
+ *  Appends to a file cost the file system extra writes: the FAT chain, the directory entry and
+ *  FSInfo are rewritten on each sync. The log only ever programs each block once, sequentially,
+ *  so a sync costs one block and the card sees one long sequential write.
+ *
+ *  The device is divided into segments of a fixed size (ideally the SD card allocation unit):
+ *  - Segment 0 holds the superblock in its first block, and is otherwise unused.
+ *  - Each other segment starts with a header block, with the sequence number of the segment,
+ *    and the stream (log file) it belongs to, then data blocks.
+ *  - Each data block holds SEGMENT_LOG_BLOCK_PAYLOAD bytes of stream data, followed by a trailer
+ *    with the segment sequence number, the count of bytes used and a CRC-32.
+ *  All fields are little-endian, see SegmentLog.cpp for the layouts.
+ *
+ *  Segments are written in order, wrapping around to overwrite the oldest when the device is full,
+ *  and each segment has the next sequence number. Each stream starts a new segment. A sync writes
+ *  out the partially filled block, and later data continues in the next block, so blocks are never
+ *  rewritten and a sync can't lose data synced before it.
+ *
+ *  Mounting finds the newest segment with a binary search over the segment headers, since the
+ *  sequence numbers only increase from segment 1 up to the newest segment, so recovering after
+ *  a power loss reads a handful of blocks, however large the device. A segment's header is
+ *  programmed right after its erase. If power is lost in between while the log wraps around into
+ *  segment 1, that header is invalid, and mounting reads every header instead.
+ *
+ *  Streams are read back on a PC, from an image of the device, by DataloggerTools/extract.
+ *
+ *  @code
+ *  #include "mbed.h"
+ *  #include "MBRBlockDevice.h"
+ *  #include "SegmentLog.h"
+ *
+ *  MBRBlockDevice part(&sd, 2);
+ *  SegmentLog log;
+ *
+ *  int main() {
+ *      part.init();
+ *      if (log.mount(&part) == -EINVAL) {
+ *          SegmentLog::format(&part);
+ *          log.mount(&part);
+ *      }
+ *      log.open("20240501/1200");
+ *      log.write("hello", 5);
+ *      log.close();
+ *      log.unmount();
+ *  }
+ *  @endcode
+ */
+
+/** Size of the blocks the log is read and programmed in */
+#define SEGMENT_LOG_BLOCK_SIZE 512
+
+/** Stream data in each data block, the rest of the block is its trailer */
+#define SEGMENT_LOG_BLOCK_PAYLOAD (SEGMENT_LOG_BLOCK_SIZE - 12)
+
+/** Longest stream name, including the terminating NUL */
+#define SEGMENT_LOG_NAME_SIZE 32
+
+class SegmentLog : public FileHandle {
+public:
+    /** Lifetime of a segment log
+     *
+     *  @param buffer_blocks    Blocks buffered in RAM, programmed together with one program,
+     *                          at least 1. Syncs and full buffers program the device.
+     */
+    SegmentLog(uint32_t buffer_blocks = 8);
+
+    /** Lifetime of a segment log
+     */
+    virtual ~SegmentLog();
+
+    /** Formats a block device as an empty log, discarding any streams
+     *
+     *  @param bd           Block device to format, it must be initialized
+     *  @param segment_size Size of each segment in bytes, a multiple of the erase size and of
+     *                      SEGMENT_LOG_BLOCK_SIZE, of at most 65536 blocks. The device has to
+     *                      hold at least 3 segments.
+     *  @return             0 on success or a negative error code on failure
+     */
+    static int format(BlockDevice *bd, bd_size_t segment_size = 4 * 1024 * 1024);
+
+    /** Mounts a formatted log, finding where the next segment goes
+     *
+     *  @param bd       Block device with the log, it must be initialized
+     *  @return         0 on success, -EINVAL if the device isn't formatted, or a negative error code
+     */
+    int mount(BlockDevice *bd);
+
+    /** Unmounts the log, closing the open stream if any
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    int unmount();
+
+    /** Starts a new stream, in a new segment, closing the open stream if any
+     *
+     *  @param name     Name of the stream, eg the path the log file would have had,
+     *                  truncated to SEGMENT_LOG_NAME_SIZE - 1 characters
+     *  @return         0 on success or a negative error code on failure
+     */
+    int open(const char *name);
+
+    /** Not supported, streams are only read back on a PC
+     *
+     *  @return         -EBADF
+     */
+    virtual ssize_t read(void *buffer, size_t size);
+
+    /** Appends to the open stream
+     *
+     *  @param buffer   Data to append
+     *  @param size     Number of bytes to append
+     *  @return         size on success or a negative error code on failure
+     */
+    virtual ssize_t write(const void *buffer, size_t size);
+
+    /** Only reports the position, streams are append-only
+     *
+     *  @param offset   0
+     *  @param whence   SEEK_CUR or SEEK_END
+     *  @return         Bytes written to the open stream, or -ESPIPE for any other seek
+     */
+    virtual off_t seek(off_t offset, int whence = SEEK_SET);
+
+    /** Programs all appended data to the device, and syncs the device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Syncs and closes the open stream, the log stays mounted for the next open
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int close();
+
+    /** Get the size of the open stream
+     *
+     *  @return         Bytes written to the open stream
+     */
+    virtual off_t size();
+
+    /** Get the size of the segments
+     *
+     *  @return         Size of a segment in bytes
+     */
+    bd_size_t get_segment_size() const;
+
+    /** Get the number of segments, including segment 0 with the superblock
+     *
+     *  @return         Number of segments
+     */
+    uint32_t get_segment_count() const;
+
+    /** Get the sequence number of the newest segment
+     *
+     *  @return         Sequence number, or 0 if no segment has been written yet
+     */
+    uint32_t get_sequence() const;
+
+    /** Get the number of the newest stream
+     *
+     *  @return         Stream number, or 0 if no stream has been written yet
+     */
+    uint32_t get_stream() const;
+
+private:
+    int start_segment();
+    void finish_block();
+    int flush();
+
+    BlockDevice *_bd;
+    uint32_t _buffer_blocks;
+    uint8_t *_buffer;
+
+    bd_size_t _segment_size;
+    uint32_t _segment_count;
+    uint32_t _format_id;            // from the superblock, so headers from before a format don't count
+
+    uint32_t _segment;              // newest segment, 0 if none
+    uint32_t _sequence;             // its sequence number
+    uint32_t _stream;               // its stream
+    uint32_t _part;                 // its index within the stream
+
+    bool _open;
+    char _name[SEGMENT_LOG_NAME_SIZE];
+    off_t _stream_size;
+    uint32_t _block;                // block within the segment being filled
+    uint32_t _buffer_start;         // block within the segment of the first buffered block
+    uint32_t _used;                 // payload bytes in the block being filled
+};
+
+} // namespace mbed
+
+// Added "using" for backwards compatibility
+#ifndef MBED_NO_GLOBAL_USING_DIRECTIVE
+using mbed::SegmentLog;
+#endif
+
+#endif
+
+/** @}*/
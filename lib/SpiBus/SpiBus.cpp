@@ -0,0 +1,114 @@
+#include "SpiBus.h"
+
+#include <algorithm>
+
+void SpiBus::configure(const SpiSettings& settings) {
+  waitInFlight();
+  if (settingsValid_ && settings == settings_) {
+    skippedReconfigureCount_++;
+    return;
+  }
+  if (!settingsValid_ || settings.bits != settings_.bits || settings.mode != settings_.mode) {
+    spi_.format(settings.bits, settings.mode);
+  }
+  if (!settingsValid_ || settings.frequencyHz != settings_.frequencyHz) {
+    spi_.frequency(settings.frequencyHz);
+  }
+  settings_ = settings;
+  settingsValid_ = true;
+  reconfigureCount_++;
+}
+
+bool SpiBus::submit(SpiTransaction& transaction) {
+  if (transaction.state_ == SpiTransaction::kQueued) {
+    return false;
+  }
+  transaction.offset_ = 0;
+  transaction.state_ = SpiTransaction::kQueued;
+
+  // insert after all transactions of the same or higher priority
+  SpiTransaction** insertPtr = &queue_;
+  while (*insertPtr != NULL && (*insertPtr)->priority_ <= transaction.priority_) {
+    insertPtr = &(*insertPtr)->next_;
+  }
+  transaction.next_ = *insertPtr;
+  *insertPtr = &transaction;
+  return true;
+}
+
+void SpiBus::poll() {
+#if DEVICE_SPI_ASYNCH
+  if (inFlight_ != NULL) {
+    if (!asyncDone_) {
+      return;
+    }
+    SpiTransaction* transaction = inFlight_;
+    inFlight_ = NULL;
+    finishSlice(*transaction, inFlightBytes_);
+    return;
+  }
+#endif
+
+  SpiTransaction* transaction = queue_;
+  if (transaction == NULL) {
+    return;
+  }
+
+  size_t sliceBytes = transaction->length_ - transaction->offset_;
+  if (transaction->sliceBytes_ > 0) {
+    sliceBytes = std::min(sliceBytes, transaction->sliceBytes_);
+  }
+  const char* txSlice = transaction->txBuffer_ != NULL ?
+      (const char*)transaction->txBuffer_ + transaction->offset_ : NULL;
+  char* rxSlice = transaction->rxBuffer_ != NULL ?
+      (char*)transaction->rxBuffer_ + transaction->offset_ : NULL;
+
+  configure(*transaction->settings_);
+  if (transaction->dc_ != NULL) {
+    *transaction->dc_ = transaction->dcValue_;
+  }
+  *transaction->cs_ = 0;
+
+#if DEVICE_SPI_ASYNCH
+  if (sliceBytes >= kMinAsyncBytes) {
+    asyncDone_ = false;
+    inFlight_ = transaction;
+    inFlightBytes_ = sliceBytes;
+    spi_.transfer(txSlice, txSlice != NULL ? sliceBytes : 0, rxSlice, rxSlice != NULL ? sliceBytes : 0,
+        callback(this, &SpiBus::onAsyncDone), SPI_EVENT_COMPLETE);
+    return;
+  }
+#endif
+
+  spi_.write(txSlice, txSlice != NULL ? sliceBytes : 0, rxSlice, rxSlice != NULL ? sliceBytes : 0);
+  finishSlice(*transaction, sliceBytes);
+}
+
+void SpiBus::waitInFlight() {
+#if DEVICE_SPI_ASYNCH
+  while (inFlight_ != NULL) {
+    poll();
+  }
+#endif
+}
+
+void SpiBus::finishSlice(SpiTransaction& transaction, size_t sliceBytes) {
+  *transaction.cs_ = 1;
+  transaction.offset_ += sliceBytes;
+  if (transaction.offset_ >= transaction.length_) {
+    unlink(transaction);
+    transaction.state_ = SpiTransaction::kDone;
+  }
+}
+
+void SpiBus::unlink(SpiTransaction& transaction) {
+  SpiTransaction** ptr = &queue_;
+  while (*ptr != NULL) {
+    if (*ptr == &transaction) {
+      *ptr = transaction.next_;
+      transaction.next_ = NULL;
+      return;
+    }
+    ptr = &(*ptr)->next_;
+  }
+}
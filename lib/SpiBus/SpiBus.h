@@ -0,0 +1,210 @@
+#ifndef _SPI_BUS_H_
+#define _SPI_BUS_H_
+
+#include "mbed.h"
+
+/**
+ * Per-device settings for a shared SPI bus.
+ */
+struct SpiSettings {
+  uint32_t frequencyHz;
+  uint8_t bits;
+  uint8_t mode;
+
+  bool operator==(const SpiSettings& other) const {
+    return frequencyHz == other.frequencyHz && bits == other.bits && mode == other.mode;
+  }
+  bool operator!=(const SpiSettings& other) const {
+    return !(*this == other);
+  }
+};
+
+/**
+ * A queued transfer to one device on a SpiBus.
+ *
+ * Long transfers (eg, display frames) can be split into slices, with chip select released between
+ * slices, so higher-priority transactions submitted in the meantime run in between.
+ * The transaction (and its buffers) is owned by the submitter and must stay valid until done().
+ */
+class SpiTransaction {
+public:
+  enum Priority {
+    kHigh = 0,  // latency-critical, eg ADC and DAC updates
+    kNormal,
+    kBulk  // long transfers, eg display frames
+  };
+
+  SpiTransaction() :
+      settings_(NULL), cs_(NULL), dc_(NULL), dcValue_(true),
+      txBuffer_(NULL), rxBuffer_(NULL), length_(0), sliceBytes_(0), priority_(kNormal),
+      offset_(0), state_(kIdle), next_(NULL) {
+  }
+
+  /**
+   * Sets up the transfer. Either buffer may be NULL (writes fill bytes / discards reads).
+   * A sliceBytes of 0 runs the whole transfer at once. If dc is provided, it is driven to dcValue
+   * for each slice, for display controllers with a data/command line.
+   * Must not be called while the transaction is queued.
+   */
+  void set(const SpiSettings& settings, DigitalOut& cs,
+      const uint8_t* txBuffer, uint8_t* rxBuffer, size_t length,
+      Priority priority = kNormal, size_t sliceBytes = 0,
+      DigitalOut* dc = NULL, bool dcValue = true) {
+    settings_ = &settings;
+    cs_ = &cs;
+    dc_ = dc;
+    dcValue_ = dcValue;
+    txBuffer_ = txBuffer;
+    rxBuffer_ = rxBuffer;
+    length_ = length;
+    sliceBytes_ = sliceBytes;
+    priority_ = priority;
+    offset_ = 0;
+    state_ = kIdle;
+  }
+
+  /**
+   * Returns true if the transaction is queued or in progress.
+   */
+  bool pending() const {
+    return state_ == kQueued;
+  }
+
+  /**
+   * Returns true once all bytes have been transferred.
+   */
+  bool done() const {
+    return state_ == kDone;
+  }
+
+protected:
+  friend class SpiBus;
+
+  enum State {
+    kIdle,
+    kQueued,
+    kDone
+  };
+
+  const SpiSettings* settings_;
+  DigitalOut* cs_;
+  DigitalOut* dc_;
+  bool dcValue_;
+  const uint8_t* txBuffer_;
+  uint8_t* rxBuffer_;
+  size_t length_;
+  size_t sliceBytes_;
+  Priority priority_;
+
+  size_t offset_;  // bytes transferred so far
+  State state_;
+  SpiTransaction* next_;  // next in the bus queue
+};
+
+/**
+ * Manager for a SPI bus shared by several devices.
+ *
+ * Tracks the active settings so switching between devices only reconfigures the peripheral when
+ * the settings differ, and runs queued transactions highest-priority first, one slice per poll().
+ * Synchronous drivers can call configure() then use spi() directly between polls; drivers that
+ * reconfigure the peripheral themselves must be followed by invalidate().
+ *
+ * On targets with DEVICE_SPI_ASYNCH, slices of at least kMinAsyncBytes are run by the asynchronous
+ * (DMA) transfer API, and poll() returns while the slice is in flight.
+ */
+class SpiBus {
+public:
+  SpiBus(SPI& spi) :
+      spi_(spi), settingsValid_(false), queue_(NULL), inFlight_(NULL), inFlightBytes_(0),
+#if DEVICE_SPI_ASYNCH
+      asyncDone_(false),
+#endif
+      reconfigureCount_(0), skippedReconfigureCount_(0) {
+  }
+
+  /**
+   * Returns the underlying SPI, for synchronous drivers.
+   */
+  SPI& spi() {
+    return spi_;
+  }
+
+  /**
+   * Applies device settings to the bus, skipping reconfiguration if they are already active.
+   * Waits for any in-flight asynchronous slice to complete first.
+   */
+  void configure(const SpiSettings& settings);
+
+  /**
+   * Forgets the active settings, so the next configure() always reconfigures.
+   */
+  void invalidate() {
+    settingsValid_ = false;
+  }
+
+  /**
+   * Queues a transaction, behind any queued transactions of the same or higher priority.
+   * Returns false if the transaction is already queued.
+   */
+  bool submit(SpiTransaction& transaction);
+
+  /**
+   * Runs at most one slice of the highest-priority queued transaction.
+   * Call once per main loop iteration.
+   */
+  void poll();
+
+  /**
+   * Runs queued transactions until the queue is empty.
+   */
+  void flush() {
+    while (queue_ != NULL || inFlight_ != NULL) {
+      poll();
+    }
+  }
+
+  /**
+   * Returns true if no transactions are queued or in flight.
+   */
+  bool idle() const {
+    return queue_ == NULL && inFlight_ == NULL;
+  }
+
+  uint32_t getReconfigureCount() const {
+    return reconfigureCount_;
+  }
+
+  uint32_t getSkippedReconfigureCount() const {
+    return skippedReconfigureCount_;
+  }
+
+protected:
+  void waitInFlight();
+  void finishSlice(SpiTransaction& transaction, size_t sliceBytes);
+  void unlink(SpiTransaction& transaction);
+
+#if DEVICE_SPI_ASYNCH
+  static const size_t kMinAsyncBytes = 32;  // below this, the DMA setup costs more than it saves
+
+  void onAsyncDone(int) {  // only SPI_EVENT_COMPLETE is requested
+    asyncDone_ = true;
+  }
+#endif
+
+  SPI& spi_;
+
+  SpiSettings settings_;  // currently active settings, if settingsValid_
+  bool settingsValid_;
+
+  SpiTransaction* queue_;  // sorted by priority, FIFO within a priority
+  SpiTransaction* inFlight_;  // transaction with an asynchronous slice in progress, or NULL
+  size_t inFlightBytes_;
+#if DEVICE_SPI_ASYNCH
+  volatile bool asyncDone_;
+#endif
+
+  uint32_t reconfigureCount_;
+  uint32_t skippedReconfigureCount_;
+};
+
+#endif